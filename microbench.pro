@@ -0,0 +1,34 @@
+#
+# VCS microbenchmarks
+# 2023 Tarpeeksi Hyvae Soft
+#
+# Builds vcs-microbench, a command-line program that benchmarks each of VCS's
+# image filters and scalers in isolation on standard resolutions, and can verify
+# the filters' optimized kernels against their reference kernels. See
+# src/benchmark/microbench/microbench.cpp for its usage.
+#
+# The build parameters (capture backend, OpenCV paths, etc.) are taken from
+# vcs.pro, so configure them there. Build with e.g.:
+#
+#   qmake microbench.pro && make
+#
+
+include(vcs.pro)
+
+SOURCES -= src/main.cpp
+SOURCES += \
+    src/benchmark/microbench/microbench.cpp \
+    src/benchmark/microbench/equivalence.cpp
+
+HEADERS += \
+    src/benchmark/microbench/microbench.h \
+    src/benchmark/microbench/equivalence.h
+
+TARGET = vcs-microbench
+
+# Keep the objects separate from the main program's, so the two builds don't
+# trample each other.
+OBJECTS_DIR = generated_files/microbench
+RCC_DIR = generated_files/microbench
+MOC_DIR = generated_files/microbench
+UI_DIR = generated_files/microbench
@@ -0,0 +1,541 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <functional>
+#include <algorithm>
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <atomic>
+#include <new>
+#include <sys/resource.h>
+#include "benchmark/benchmark.h"
+#include "capture/capture.h"
+#include "scaler/scaler.h"
+#include "filter/filter.h"
+#include "filter/abstract_filter.h"
+#include "common/command_line/command_line.h"
+#include "common/disk/disk.h"
+#include "common/timer/timer.h"
+#include "common/trace/trace.h"
+#include "common/globals.h"
+#include "common/assert.h"
+#include "main.h"
+
+// If the capture backend produces no frames for this long, we assume it never
+// will (e.g. there's no signal) and give up.
+static const auto FRAME_TIMEOUT = std::chrono::seconds(10);
+
+// Allocations are counted only while this is set, i.e. while the benchmark's
+// frames are being processed, so that VCS's initialization isn't included.
+static std::atomic<bool> COUNT_ALLOCATIONS = false;
+static std::atomic<uint64_t> NUM_ALLOCATIONS = 0;
+static std::atomic<uint64_t> NUM_BYTES_ALLOCATED = 0;
+
+// How many frames the scaler has output during the benchmark.
+static unsigned NUM_OUTPUT_FRAMES = 0;
+
+// In builds with VCS_BENCHMARK_COUNTS_ALLOCATIONS defined, we replace the global
+// allocation functions to count the allocations made by the frame pipeline. Note
+// that this covers only C++ allocations; memory allocated directly with malloc()
+// (e.g. by OpenCV) isn't counted.
+#ifdef VCS_BENCHMARK_COUNTS_ALLOCATIONS
+void* operator new(std::size_t numBytes)
+{
+    if (COUNT_ALLOCATIONS.load(std::memory_order_relaxed))
+    {
+        NUM_ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+        NUM_BYTES_ALLOCATED.fetch_add(numBytes, std::memory_order_relaxed);
+    }
+
+    void *const ptr = std::malloc(numBytes? numBytes : 1);
+
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+void* operator new[](std::size_t numBytes)
+{
+    return operator new(numBytes);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+
+    return;
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+
+    return;
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+
+    return;
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+
+    return;
+}
+#endif
+
+static bool parse_resolution(const std::string &string, resolution_s *const dst)
+{
+    unsigned w = 0, h = 0;
+    char trailing = '\0';
+
+    if (std::sscanf(string.c_str(), "%ux%u%c", &w, &h, &trailing) != 2)
+    {
+        return false;
+    }
+
+    *dst = {w, h};
+
+    return true;
+}
+
+bool kbench_parse_options(const std::string &spec, benchmark_options_s *const options)
+{
+    std::stringstream specStream(spec);
+    std::string option;
+
+    while (std::getline(specStream, option, ','))
+    {
+        const std::size_t separatorPos = option.find('=');
+        const std::string key = option.substr(0, separatorPos);
+        const std::string value = ((separatorPos == std::string::npos)? "" : option.substr(separatorPos + 1));
+
+        if (key == "frames")
+        {
+            char *valueEnd = nullptr;
+            options->numFrames = unsigned(std::strtoul(value.c_str(), &valueEnd, 10));
+
+            if (value.empty() || *valueEnd)
+            {
+                options->numFrames = 0;
+            }
+        }
+        else if (key == "res")
+        {
+            if (!parse_resolution(value, &options->resolution))
+            {
+                NBENE(("Malformed benchmark capture resolution \"%s\". Expected e.g. \"640x480\".", value.c_str()));
+                return false;
+            }
+        }
+        else if (key == "out")
+        {
+            if (!parse_resolution(value, &options->outputResolution))
+            {
+                NBENE(("Malformed benchmark output resolution \"%s\". Expected e.g. \"640x480\".", value.c_str()));
+                return false;
+            }
+        }
+        else if (key == "json")
+        {
+            options->jsonFilename = value;
+        }
+        else if (key == "replay")
+        {
+            options->replayFilename = value;
+        }
+        else
+        {
+            NBENE(("Unknown benchmark option \"%s\".", option.c_str()));
+            return false;
+        }
+    }
+
+    if (!options->numFrames)
+    {
+        NBENE(("The benchmark needs a positive frame count, e.g. \"frames=1000\"."));
+        return false;
+    }
+
+    if (
+        (options->resolution.w < MIN_CAPTURE_WIDTH) ||
+        (options->resolution.h < MIN_CAPTURE_HEIGHT) ||
+        (options->resolution.w > MAX_CAPTURE_WIDTH) ||
+        (options->resolution.h > MAX_CAPTURE_HEIGHT)
+    ){
+        NBENE((
+            "The benchmark needs a capture resolution between %u x %u and %u x %u, e.g. \"res=640x480\".",
+            MIN_CAPTURE_WIDTH, MIN_CAPTURE_HEIGHT, MAX_CAPTURE_WIDTH, MAX_CAPTURE_HEIGHT
+        ));
+        return false;
+    }
+
+    if (
+        (options->outputResolution.w || options->outputResolution.h) &&
+        ((options->outputResolution.w < MIN_OUTPUT_WIDTH) ||
+         (options->outputResolution.h < MIN_OUTPUT_HEIGHT) ||
+         (options->outputResolution.w > MAX_OUTPUT_WIDTH) ||
+         (options->outputResolution.h > MAX_OUTPUT_HEIGHT))
+    ){
+        NBENE((
+            "The benchmark's output resolution must be between %u x %u and %u x %u.",
+            MIN_OUTPUT_WIDTH, MIN_OUTPUT_HEIGHT, MAX_OUTPUT_WIDTH, MAX_OUTPUT_HEIGHT
+        ));
+        return false;
+    }
+
+    return true;
+}
+
+// Creates and registers the filter chains of the given filter graph file, as the
+// display subsystem's filter graph would but without needing a GUI.
+static bool load_filter_graph(const std::string &filename)
+{
+    const std::vector<abstract_filter_graph_node_s> nodes = kdisk_load_filter_graph(filename);
+
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    std::vector<abstract_filter_c*> filters;
+
+    for (const auto &node: nodes)
+    {
+        abstract_filter_c *const filter = kf_create_filter_instance(node.typeUuid, node.initialParameters);
+        k_assert(filter, "Failed to create a filter instance.");
+
+        filters.push_back(filter);
+    }
+
+    bool isGraphValid = true;
+
+    // Note: The nodes' connections are given as indices into the list of nodes.
+    // We track the visited nodes separately from the accumulated chain so that
+    // loops through disabled nodes are also caught.
+    const std::function<void(const unsigned, std::vector<abstract_filter_c*>, std::vector<unsigned>)> traverse_node =
+          [&](const unsigned nodeIdx, std::vector<abstract_filter_c*> accumulatedFilterChain, std::vector<unsigned> visitedNodeIdxs)
+    {
+        abstract_filter_c *const filter = filters.at(nodeIdx);
+
+        if (std::find(visitedNodeIdxs.begin(), visitedNodeIdxs.end(), nodeIdx) != visitedNodeIdxs.end())
+        {
+            NBENE(("The filter graph contains a loop."));
+            isGraphValid = false;
+            return;
+        }
+
+        visitedNodeIdxs.push_back(nodeIdx);
+
+        if (nodes.at(nodeIdx).isEnabled)
+        {
+            accumulatedFilterChain.push_back(filter);
+        }
+
+        if (
+            (filter->category() == filter_category_e::output_condition) ||
+            (filter->category() == filter_category_e::output_scaler)
+        ){
+            kf_register_filter_chain(accumulatedFilterChain);
+            return;
+        }
+
+        for (const int dstNodeIdx: nodes.at(nodeIdx).connectedTo)
+        {
+            if ((dstNodeIdx < 0) || (unsigned(dstNodeIdx) >= nodes.size()))
+            {
+                NBENE(("The filter graph contains an invalid node connection."));
+                isGraphValid = false;
+                return;
+            }
+
+            traverse_node(unsigned(dstNodeIdx), accumulatedFilterChain, visitedNodeIdxs);
+        }
+
+        return;
+    };
+
+    for (unsigned i = 0; i < nodes.size(); i++)
+    {
+        if (filters.at(i)->category() == filter_category_e::input_condition)
+        {
+            traverse_node(i, {}, {});
+        }
+    }
+
+    kf_set_filtering_enabled(true);
+
+    return isGraphValid;
+}
+
+static std::string json_escaped(const std::string &string)
+{
+    std::string escaped;
+
+    for (const char c: string)
+    {
+        if ((c == '"') || (c == '\\'))
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (uint8_t(c) < 0x20)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", unsigned(c));
+            escaped += buffer;
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+int kbench_run(const benchmark_options_s &options)
+{
+    INFO(("Running the benchmark for %u frames.", options.numFrames));
+
+    if (
+        !kcom_filter_graph_file_name().empty() &&
+        !load_filter_graph(kcom_filter_graph_file_name())
+    ){
+        NBENE(("Failed to load the filter graph for the benchmark."));
+        return EXIT_FAILURE;
+    }
+
+    {
+        LOCK_CAPTURE_MUTEX_IN_SCOPE;
+
+        if (
+            !options.replayFilename.empty() &&
+            !kc_set_device_property("replay file", intptr_t(options.replayFilename.c_str()))
+        ){
+            NBENE(("Failed to open \"%s\" for replay.", options.replayFilename.c_str()));
+            return EXIT_FAILURE;
+        }
+
+        kc_set_device_property("unthrottled", true);
+        resolution_s::to_capture_device_properties(options.resolution);
+
+        if (options.outputResolution.w && options.outputResolution.h)
+        {
+            ks_set_base_resolution(options.outputResolution);
+            ks_set_base_resolution_enabled(true);
+        }
+    }
+
+    ev_new_output_image.listen([]
+    {
+        NUM_OUTPUT_FRAMES++;
+    }, "Benchmark frame counter");
+
+    // The time taken by the capture subsystem to process each new frame, which
+    // includes filtering and scaling it.
+    latency_histogram_c frameLatencies;
+
+    // Runs the capture subsystem until it has produced the given number of frames.
+    // Returns false if the capture device fails or stops producing frames.
+    const auto process_frames = [&frameLatencies](const unsigned numFrames)->bool
+    {
+        auto latestFrameTime = std::chrono::steady_clock::now();
+        unsigned numFramesProcessed = 0;
+
+        while (numFramesProcessed < numFrames)
+        {
+            // E.g. a capture backend's reopening of its device in response to the
+            // new video mode is deferred until the capture mutex is unlocked.
+            k_run_deferred_callbacks();
+
+            LOCK_CAPTURE_MUTEX_IN_SCOPE;
+
+            const auto startTime = std::chrono::steady_clock::now();
+            const capture_event_e event = kc_process_next_capture_event();
+
+            switch (event)
+            {
+                case capture_event_e::new_frame:
+                {
+                    latestFrameTime = std::chrono::steady_clock::now();
+                    frameLatencies.add(unsigned(std::chrono::duration_cast<std::chrono::microseconds>(latestFrameTime - startTime).count()));
+                    numFramesProcessed++;
+                    break;
+                }
+                case capture_event_e::unrecoverable_error:
+                case capture_event_e::invalid_device:
+                {
+                    NBENE(("The capture device failed during the benchmark."));
+                    return false;
+                }
+                default:
+                {
+                    if ((std::chrono::steady_clock::now() - latestFrameTime) > FRAME_TIMEOUT)
+                    {
+                        NBENE(("The capture device stopped producing frames during the benchmark."));
+                        return false;
+                    }
+
+                    break;
+                }
+            }
+
+            kt_update_timers();
+        }
+
+        return true;
+    };
+
+    // Let the capture device settle into the new video mode before we start
+    // measuring.
+    if (!process_frames(1))
+    {
+        return EXIT_FAILURE;
+    }
+
+    frameLatencies.clear();
+    ktrace_reset();
+    kevent_reset_listener_stats();
+    NUM_OUTPUT_FRAMES = 0;
+
+    const auto startTime = std::chrono::steady_clock::now();
+    COUNT_ALLOCATIONS = true;
+
+    const bool isCompleted = process_frames(options.numFrames);
+
+    COUNT_ALLOCATIONS = false;
+    const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    if (!isCompleted)
+    {
+        return EXIT_FAILURE;
+    }
+
+    rusage resourceUsage = {};
+    getrusage(RUSAGE_SELF, &resourceUsage);
+
+    const resolution_s inputResolution = kc_frame_buffer().resolution;
+    const resolution_s outputResolution = ks_output_resolution();
+
+    // Assemble the results.
+    std::string json;
+    {
+        char buffer[512];
+
+        const auto append = [&json, &buffer](const char *const format, auto... args)
+        {
+            std::snprintf(buffer, sizeof(buffer), format, args...);
+            json += buffer;
+        };
+
+        const auto append_stage = [&append](const char *const name, const latency_percentiles_s &stats, const bool isLast)
+        {
+            append(
+                "    {\"name\": \"%s\", \"count\": %llu, \"p50_us\": %u, \"p95_us\": %u, \"p99_us\": %u, \"max_us\": %u}%s\n",
+                name,
+                (unsigned long long)stats.count,
+                stats.p50,
+                stats.p95,
+                stats.p99,
+                stats.max,
+                (isLast? "" : ",")
+            );
+        };
+
+        append("{\n");
+        append("  \"frames\": %u,\n", options.numFrames);
+        append("  \"output_frames\": %u,\n", NUM_OUTPUT_FRAMES);
+        append("  \"elapsed_s\": %.6f,\n", elapsedSeconds);
+        append("  \"fps\": %.3f,\n", (options.numFrames / elapsedSeconds));
+        append("  \"input_resolution\": \"%ux%u\",\n", inputResolution.w, inputResolution.h);
+        append("  \"output_resolution\": \"%ux%u\",\n", outputResolution.w, outputResolution.h);
+        append("  \"filter_graph\": \"%s\",\n", json_escaped(kcom_filter_graph_file_name()).c_str());
+        append("  \"stages\": [\n");
+        {
+            std::vector<trace_stage_e> tracedStages;
+
+            for (int i = 0; i < int(trace_stage_e::num_enumerators); i++)
+            {
+                if (ktrace_stage_percentiles(trace_stage_e(i)).count)
+                {
+                    tracedStages.push_back(trace_stage_e(i));
+                }
+            }
+
+            append_stage("Frame", frameLatencies.percentiles(), tracedStages.empty());
+
+            for (const trace_stage_e stage: tracedStages)
+            {
+                append_stage(ktrace_stage_name(stage), ktrace_stage_percentiles(stage), (stage == tracedStages.back()));
+            }
+        }
+        append("  ],\n");
+        append("  \"event_listeners\": [\n");
+        {
+            std::vector<vcs_event_listener_stats_s> listenerStats = kevent_listener_stats();
+
+            std::erase_if(listenerStats, [](const vcs_event_listener_stats_s &stats){return !stats.profile.numCalls;});
+            std::sort(listenerStats.begin(), listenerStats.end(), [](const vcs_event_listener_stats_s &a, const vcs_event_listener_stats_s &b)
+            {
+                return (a.profile.totalNs > b.profile.totalNs);
+            });
+
+            for (const vcs_event_listener_stats_s &stats: listenerStats)
+            {
+                append(
+                    "    {\"event\": \"%s\", \"listener\": \"%s\", \"calls\": %llu, \"total_us\": %llu, \"max_us\": %llu}%s\n",
+                    json_escaped(stats.eventName).c_str(),
+                    json_escaped(stats.listenerName).c_str(),
+                    (unsigned long long)stats.profile.numCalls,
+                    (unsigned long long)(stats.profile.totalNs / 1000),
+                    (unsigned long long)(stats.profile.maxNs / 1000),
+                    ((&stats == &listenerStats.back())? "" : ",")
+                );
+            }
+        }
+        append("  ],\n");
+        #ifdef VCS_BENCHMARK_COUNTS_ALLOCATIONS
+            append("  \"allocations\": {\"count\": %llu, \"bytes\": %llu},\n", (unsigned long long)NUM_ALLOCATIONS, (unsigned long long)NUM_BYTES_ALLOCATED);
+        #else
+            append("  \"allocations\": null,\n");
+        #endif
+        append("  \"peak_rss_kib\": %ld\n", resourceUsage.ru_maxrss);
+        append("}\n");
+    }
+
+    if (options.jsonFilename.empty())
+    {
+        std::fputs(json.c_str(), stdout);
+    }
+    else
+    {
+        FILE *const file = std::fopen(options.jsonFilename.c_str(), "w");
+        const bool isWritten = (file && (std::fputs(json.c_str(), file) >= 0));
+
+        if (
+            !file ||
+            (std::fclose(file) != 0) ||
+            !isWritten
+        ){
+            NBENE(("Failed to write the benchmark results into \"%s\".", options.jsonFilename.c_str()));
+            return EXIT_FAILURE;
+        }
+
+        INFO(("Saved the benchmark results into \"%s\".", options.jsonFilename.c_str()));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The headless benchmark interface.
+ *
+ * Runs captured frames through VCS's frame pipeline -- capture, the filter graph
+ * and the scaler -- as fast as the capture backend will produce them, without
+ * an output window, and reports the pipeline's throughput, per-stage latency
+ * percentiles, the time spent by each event listener, memory allocations and
+ * peak memory use as JSON. Memory allocations are counted only in builds with
+ * VCS_BENCHMARK_COUNTS_ALLOCATIONS defined (see vcs.pro); otherwise, they're
+ * reported as null.
+ *
+ * The benchmark is requested via the command line, e.g.
+ *
+ *   vcs --benchmark frames=1000,res=640x480,out=1920x1440 -f graph.vcs-filter-graph
+ *
+ * The options are given as comma-separated key=value pairs:
+ *
+ *   frames=N     The number of frames to run through the pipeline (required).
+ *   res=WxH      The capture resolution (required). Ignored by capture backends
+ *                whose resolution is fixed, like the replay backend's.
+ *   out=WxH      The output resolution; by default, the capture resolution.
+ *   json=FILE    Write the results into this file rather than to stdout.
+ *   replay=FILE  For the replay backend, the file to be replayed.
+ *
+ * The benchmark is intended for the virtual and replay capture backends, which
+ * can produce frames unthrottled. Other backends are benchmarked at whatever
+ * rate their capture device produces frames.
+ *
+ * ## Usage
+ *
+ *   1. Parse the options given on the command line:
+ *      @code
+ *      benchmark_options_s options;
+ *
+ *      if (!kbench_parse_options(kcom_benchmark_spec(), &options))
+ *      {
+ *          // Malformed options.
+ *      }
+ *      @endcode
+ *
+ *   2. Initialize the capture, filter and scaler subsystems (but not the display
+ *      subsystem), then run the benchmark, which returns the program's exit code:
+ *      @code
+ *      const int exitCode = kbench_run(options);
+ *      @endcode
+ *
+ */
+
+#ifndef VCS_BENCHMARK_BENCHMARK_H
+#define VCS_BENCHMARK_BENCHMARK_H
+
+#include <string>
+#include "display/display.h"
+
+struct benchmark_options_s
+{
+    unsigned numFrames = 0;
+
+    resolution_s resolution = {0, 0};
+
+    // If zero, the capture resolution is used.
+    resolution_s outputResolution = {0, 0};
+
+    // If empty, the results are printed to stdout.
+    std::string jsonFilename = "";
+
+    std::string replayFilename = "";
+};
+
+// Parses the given benchmark specification string (e.g. "frames=1000,res=640x480")
+// into the given options struct. Returns true on success; false otherwise, in
+// which case the reason will have been printed into the console.
+bool kbench_parse_options(const std::string &spec, benchmark_options_s *const options);
+
+// Runs the benchmark as specified by the given options, and reports its results.
+// Expects the capture, filter and scaler subsystems to have been initialized.
+// Returns EXIT_SUCCESS if the benchmark completed; EXIT_FAILURE otherwise.
+int kbench_run(const benchmark_options_s &options);
+
+#endif
@@ -0,0 +1,407 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <algorithm>
+#include <random>
+#include <cstdlib>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include "benchmark/microbench/equivalence.h"
+#include "benchmark/microbench/microbench.h"
+#include "filter/filter.h"
+#include "filter/abstract_filter.h"
+#include "common/pixel_conversion/pixel_conversion.h"
+#include "common/globals.h"
+#include "common/assert.h"
+
+// How many bytes of guard to surround each test image with, and their value.
+static const unsigned NUM_GUARD_BYTES = 256;
+static const uint8_t GUARD_BYTE = 0xa5;
+
+// How many consecutive frames to run each filter on per test image, so that
+// filters which carry state from frame to frame get to exercise it.
+static const unsigned NUM_FRAMES_PER_SEQUENCE = 3;
+
+// Resolutions that are likely to trip up optimized kernels, e.g. ones that
+// process pixels in blocks or split the image into slices for threads.
+static const std::vector<resolution_s> EDGE_CASE_RESOLUTIONS = {
+    {1, 1},
+    {1, 480},
+    {640, 1},
+    {3, 3},
+    {17, 5},
+    {641, 479},
+    {1279, 719},
+    {MAX_CAPTURE_WIDTH, MAX_CAPTURE_HEIGHT},
+};
+
+enum class test_pixels_e
+{
+    noise,
+    black,
+    white,
+};
+
+struct test_image_s
+{
+    resolution_s resolution;
+    test_pixels_e pixels;
+    uint32_t seed;
+};
+
+// An image whose pixels are surrounded by guard bytes, to catch writes out of
+// the image's bounds.
+class guarded_image_c
+{
+public:
+    guarded_image_c(const resolution_s &resolution) :
+        buffer(((NUM_GUARD_BYTES * 2) + (resolution.w * resolution.h * 4)), GUARD_BYTE),
+        image((this->buffer.data() + NUM_GUARD_BYTES), resolution)
+    {
+    }
+
+    bool are_guards_intact(void) const
+    {
+        const auto is_guard = [](const uint8_t byte){return (byte == GUARD_BYTE);};
+
+        return (
+            std::all_of(this->buffer.begin(), (this->buffer.begin() + NUM_GUARD_BYTES), is_guard) &&
+            std::all_of((this->buffer.end() - NUM_GUARD_BYTES), this->buffer.end(), is_guard)
+        );
+    }
+
+private:
+    // Note: Must be declared before the image, which points into it.
+    std::vector<uint8_t> buffer;
+
+public:
+    image_s image;
+};
+
+static void fill_test_image(image_s *const image, const test_image_s &testImage, const unsigned frameIdx)
+{
+    switch (testImage.pixels)
+    {
+        case test_pixels_e::noise: fill_with_noise(image, (testImage.seed + frameIdx)); break;
+        case test_pixels_e::black: std::memset(image->pixels, 0x00, image->byte_size()); break;
+        case test_pixels_e::white: std::memset(image->pixels, 0xff, image->byte_size()); break;
+        default: k_assert(0, "Unknown type of test image."); break;
+    }
+
+    return;
+}
+
+// Returns the index of the first byte by which the two images differ by more
+// than the given tolerance, or -1 if there's no such byte.
+static long first_mismatch(const image_s &a, const image_s &b, const unsigned tolerance)
+{
+    k_assert((a.resolution == b.resolution), "Expected images of equal size.");
+
+    for (std::size_t i = 0; i < a.byte_size(); i++)
+    {
+        if (unsigned(std::abs(int(a.pixels[i]) - int(b.pixels[i]))) > tolerance)
+        {
+            return long(i);
+        }
+    }
+
+    return -1;
+}
+
+enum class check_result_e
+{
+    pass,
+    fail,
+
+    // The filter's output isn't reproducible (e.g. because it depends on the
+    // time of day), so differences in it wouldn't tell us anything.
+    skip,
+};
+
+// Runs fresh instances of the given type of filter on a sequence of frames of
+// each test image: one instance using the optimized kernel, and two using the
+// reference kernel (to tell whether the reference is reproducible).
+static check_result_e check_filter(const abstract_filter_c *const filterType, const std::vector<test_image_s> &testImages)
+{
+    for (const test_image_s &testImage: testImages)
+    {
+        abstract_filter_c *const optimizedFilter = kf_create_filter_instance(filterType->uuid());
+        abstract_filter_c *const referenceFilter = kf_create_filter_instance(filterType->uuid());
+        abstract_filter_c *const referenceFilter2 = kf_create_filter_instance(filterType->uuid());
+
+        check_result_e result = check_result_e::pass;
+
+        for (unsigned i = 0; ((i < NUM_FRAMES_PER_SEQUENCE) && (result == check_result_e::pass)); i++)
+        {
+            guarded_image_c optimized(testImage.resolution);
+            guarded_image_c reference(testImage.resolution);
+            guarded_image_c reference2(testImage.resolution);
+
+            fill_test_image(&optimized.image, testImage, i);
+            fill_test_image(&reference.image, testImage, i);
+            fill_test_image(&reference2.image, testImage, i);
+
+            optimizedFilter->apply(&optimized.image);
+            referenceFilter->apply_reference(&reference.image);
+            referenceFilter2->apply_reference(&reference2.image);
+
+            const std::string frameName = ("frame #" + std::to_string(i + 1) + " of " + resolution_string(testImage.resolution));
+
+            if (!reference.are_guards_intact() || !reference2.are_guards_intact())
+            {
+                NBENE(("%s: the reference kernel wrote out of bounds on %s.", filterType->name().c_str(), frameName.c_str()));
+                result = check_result_e::fail;
+            }
+            else if (!optimized.are_guards_intact())
+            {
+                NBENE(("%s: the optimized kernel wrote out of bounds on %s.", filterType->name().c_str(), frameName.c_str()));
+                result = check_result_e::fail;
+            }
+            else if (first_mismatch(reference.image, reference2.image, 0) >= 0)
+            {
+                result = check_result_e::skip;
+            }
+            else if (const long mismatchIdx = first_mismatch(reference.image, optimized.image, filterType->reference_tolerance()); mismatchIdx >= 0)
+            {
+                const unsigned pixelIdx = unsigned(mismatchIdx / 4);
+
+                NBENE((
+                    "%s: the output differs from the reference on %s at (%u, %u), channel %u: %u vs. %u (tolerance %u).",
+                    filterType->name().c_str(),
+                    frameName.c_str(),
+                    (pixelIdx % testImage.resolution.w),
+                    (pixelIdx / testImage.resolution.w),
+                    unsigned(mismatchIdx % 4),
+                    reference.image.pixels[mismatchIdx],
+                    optimized.image.pixels[mismatchIdx],
+                    filterType->reference_tolerance()
+                ));
+
+                result = check_result_e::fail;
+            }
+        }
+
+        kf_delete_filter_instance(optimizedFilter);
+        kf_delete_filter_instance(referenceFilter);
+        kf_delete_filter_instance(referenceFilter2);
+
+        if (result != check_result_e::pass)
+        {
+            return result;
+        }
+    }
+
+    return check_result_e::pass;
+}
+
+// Returns the edge cases and the given number of randomly sized noise images.
+static std::vector<test_image_s> make_test_images(const unsigned numRandomImages)
+{
+    std::vector<test_image_s> testImages;
+
+    // A fixed seed, so that failures are reproducible.
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<unsigned> randomDimension(1, 1024);
+
+    for (const resolution_s &resolution: EDGE_CASE_RESOLUTIONS)
+    {
+        testImages.push_back({resolution, test_pixels_e::noise, uint32_t(rng())});
+    }
+
+    testImages.push_back({{640, 480}, test_pixels_e::black, 0});
+    testImages.push_back({{640, 480}, test_pixels_e::white, 0});
+
+    for (unsigned i = 0; i < numRandomImages; i++)
+    {
+        const resolution_s resolution = {randomDimension(rng), randomDimension(rng)};
+        testImages.push_back({resolution, test_pixels_e::noise, uint32_t(rng())});
+    }
+
+    return testImages;
+}
+
+// A pixel conversion, as functions that convert the whole of a source image of
+// the given resolution into the given BGRA image using the vectorized and the
+// reference kernel, respectively.
+struct pixel_conversion_s
+{
+    const char *name;
+    void (*convert)(const uint8_t *src, image_s *dst);
+    void (*convert_reference)(const uint8_t *src, image_s *dst);
+};
+
+static const std::vector<pixel_conversion_s> PIXEL_CONVERSIONS = {
+    {
+        "RGB565 to BGRA",
+        [](const uint8_t *src, image_s *dst)
+        {
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_rgb565_to_bgra((const uint16_t*)(src + (y * dst->resolution.w * 2)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+        [](const uint8_t *src, image_s *dst)
+        {
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_rgb565_to_bgra_reference((const uint16_t*)(src + (y * dst->resolution.w * 2)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+    },
+    {
+        "RGB555 to BGRA",
+        [](const uint8_t *src, image_s *dst)
+        {
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_rgb555_to_bgra((const uint16_t*)(src + (y * dst->resolution.w * 2)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+        [](const uint8_t *src, image_s *dst)
+        {
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_rgb555_to_bgra_reference((const uint16_t*)(src + (y * dst->resolution.w * 2)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+    },
+    {
+        "YUYV to BGRA",
+        [](const uint8_t *src, image_s *dst)
+        {
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_yuyv_to_bgra((src + (y * dst->resolution.w * 2)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+        [](const uint8_t *src, image_s *dst)
+        {
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_yuyv_to_bgra_reference((src + (y * dst->resolution.w * 2)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+    },
+    {
+        // The luma plane followed by the chroma plane, each row of which covers
+        // two rows of luma.
+        "NV12 to BGRA",
+        [](const uint8_t *src, image_s *dst)
+        {
+            const uint8_t *const chromaPlane = (src + (dst->resolution.w * dst->resolution.h));
+
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_nv12_row_to_bgra((src + (y * dst->resolution.w)), (chromaPlane + ((y / 2) * dst->resolution.w)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+        [](const uint8_t *src, image_s *dst)
+        {
+            const uint8_t *const chromaPlane = (src + (dst->resolution.w * dst->resolution.h));
+
+            for (unsigned y = 0; y < dst->resolution.h; y++)
+            {
+                kpixel_convert_nv12_row_to_bgra_reference((src + (y * dst->resolution.w)), (chromaPlane + ((y / 2) * dst->resolution.w)), (dst->pixels + (y * dst->resolution.w * 4)), dst->resolution.w);
+            }
+        },
+    },
+};
+
+// Converts each test image with both kernels of the given pixel conversion. The
+// source pixels are taken from a BGRA test image of the same resolution, which
+// holds more than enough bytes for any of the source formats.
+static bool check_pixel_conversion(const pixel_conversion_s &conversion, const std::vector<test_image_s> &testImages)
+{
+    for (const test_image_s &testImage: testImages)
+    {
+        guarded_image_c source(testImage.resolution);
+        guarded_image_c optimized(testImage.resolution);
+        guarded_image_c reference(testImage.resolution);
+
+        fill_test_image(&source.image, testImage, 0);
+
+        conversion.convert(source.image.pixels, &optimized.image);
+        conversion.convert_reference(source.image.pixels, &reference.image);
+
+        const std::string imageName = resolution_string(testImage.resolution);
+
+        if (!reference.are_guards_intact())
+        {
+            NBENE(("%s: the reference kernel wrote out of bounds on %s.", conversion.name, imageName.c_str()));
+            return false;
+        }
+        else if (!optimized.are_guards_intact())
+        {
+            NBENE(("%s: the optimized kernel wrote out of bounds on %s.", conversion.name, imageName.c_str()));
+            return false;
+        }
+        else if (const long mismatchIdx = first_mismatch(reference.image, optimized.image, 0); mismatchIdx >= 0)
+        {
+            const unsigned pixelIdx = unsigned(mismatchIdx / 4);
+
+            NBENE((
+                "%s: the output differs from the reference on %s at (%u, %u), channel %u: %u vs. %u.",
+                conversion.name,
+                imageName.c_str(),
+                (pixelIdx % testImage.resolution.w),
+                (pixelIdx / testImage.resolution.w),
+                unsigned(mismatchIdx % 4),
+                reference.image.pixels[mismatchIdx],
+                optimized.image.pixels[mismatchIdx]
+            ));
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool check_pixel_conversion_equivalence(const unsigned numRandomImages)
+{
+    const std::vector<test_image_s> testImages = make_test_images(numRandomImages);
+    bool isAllPassed = true;
+
+    for (const pixel_conversion_s &conversion: PIXEL_CONVERSIONS)
+    {
+        const bool isPassed = check_pixel_conversion(conversion, testImages);
+
+        std::printf("%-24s %s\n", conversion.name, (isPassed? "PASS" : "FAIL"));
+
+        isAllPassed &= isPassed;
+    }
+
+    return isAllPassed;
+}
+
+bool check_filter_equivalence(const unsigned numRandomImages)
+{
+    const std::vector<test_image_s> testImages = make_test_images(numRandomImages);
+
+    bool isAllPassed = true;
+
+    for (const abstract_filter_c *const filterType: kf_available_filter_types())
+    {
+        if (!is_standalone_filter(filterType))
+        {
+            continue;
+        }
+
+        const check_result_e result = check_filter(filterType, testImages);
+
+        std::printf(
+            "%-24s %s\n",
+            filterType->name().c_str(),
+            ((result == check_result_e::pass)? "PASS" : (result == check_result_e::fail)? "FAIL" : "SKIP (not reproducible)")
+        );
+
+        isAllPassed &= (result != check_result_e::fail);
+    }
+
+    return isAllPassed;
+}
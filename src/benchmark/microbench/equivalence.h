@@ -0,0 +1,36 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * Verifies that the filters' optimized kernels, and the vectorized pixel format
+ * conversions, produce the same output as their reference kernels.
+ *
+ * A filter that gets an optimized (e.g. vectorized or multithreaded) apply()
+ * keeps its earlier, plain implementation as apply_reference(), optionally with
+ * a tolerance for differences (see abstract_filter_c). The check runs both on
+ * the same sequences of frames -- randomized images of random sizes and edge
+ * cases like odd widths, 1-pixel rows and columns, and the maximum resolution --
+ * using separate instances of the filter, so that filters that carry state from
+ * frame to frame (e.g. temporal denoising, anti-tearing) are compared fairly.
+ * The images are surrounded by guard bytes to catch writes out of bounds.
+ *
+ */
+
+#ifndef VCS_BENCHMARK_MICROBENCH_EQUIVALENCE_H
+#define VCS_BENCHMARK_MICROBENCH_EQUIVALENCE_H
+
+// Runs the check on each filter type known to the filter subsystem, printing
+// any mismatches into the console. Returns true if all filters passed; false
+// otherwise.
+bool check_filter_equivalence(const unsigned numRandomImages = 20);
+
+// Runs the same check on the vectorized pixel conversions of pixel_conversion.h
+// against their scalar reference versions, converting the test images row by
+// row. Returns true if all conversions passed; false otherwise.
+bool check_pixel_conversion_equivalence(const unsigned numRandomImages = 20);
+
+#endif
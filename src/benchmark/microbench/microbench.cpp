@@ -0,0 +1,437 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * A microbenchmark of VCS's image filters and scalers. Built as its own program
+ * by microbench.pro.
+ *
+ * Each filter type known to the filter subsystem is instantiated with its
+ * default parameters and applied to images of standard resolutions, and each of
+ * the scaler subsystem's scalers is run on the same images. The results are given
+ * as nanoseconds per pixel, frames per second and nominal memory traffic (the
+ * bytes of the source and destination images, i.e. disregarding caching and
+ * any intermediate buffers).
+ *
+ * Usage:
+ *
+ *   vcs-microbench [-n iterations] [-o results.csv] [-c baseline.csv] [-e]
+ *
+ *   -n  How many times to apply each filter and scaler per resolution (default
+ *       20). The first application is a warm-up and isn't timed.
+ *   -o  Save the results into this file, e.g. to serve as a baseline for later
+ *       runs.
+ *   -c  Compare the results against those saved from a previous run.
+ *   -e  Instead of benchmarking, verify that the filters' optimized kernels and
+ *       the vectorized pixel format conversions produce the same output as their
+ *       reference kernels (see equivalence.h). Exits with EXIT_FAILURE if any
+ *       don't.
+ *
+ */
+
+#include <unistd.h>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <map>
+#include "common/globals.h"
+#include "common/disk/csv.h"
+#include "filter/filter.h"
+#include "filter/abstract_filter.h"
+#include "scaler/scaler.h"
+#include "benchmark/microbench/microbench.h"
+#include "benchmark/microbench/equivalence.h"
+#include "main.h"
+
+// The resolutions of the images that the filters and scalers are benchmarked on.
+static const std::vector<resolution_s> RESOLUTIONS = {
+    {640, 480},
+    {1280, 720},
+    {1920, 1080},
+    {3840, 2160},
+};
+
+// The resolution to which the scalers scale the images, as when displaying a
+// captured frame on a 4K screen. An image already at this resolution is instead
+// scaled down to 1080p.
+static const resolution_s SCALER_OUTPUT_RESOLUTION = {3840, 2160};
+static const resolution_s SCALER_ALTERNATE_OUTPUT_RESOLUTION = {1920, 1080};
+
+struct benchmark_result_s
+{
+    // Identifies the benchmark, e.g. "filter,Blur,640x480".
+    std::string key;
+
+    unsigned numIterations = 0;
+    double nsPerPixel = 0;
+    double fps = 0;
+    double gigabytesPerSecond = 0;
+};
+
+// The main VCS program's main.cpp isn't part of this build, so we provide the
+// symbols that the rest of VCS expects from it.
+bool PROGRAM_EXIT_REQUESTED = false;
+
+void k_set_eco_mode_enabled(const bool)
+{
+    return;
+}
+
+bool k_is_eco_mode_enabled(void)
+{
+    return false;
+}
+
+void k_defer_until_capture_mutex_unlocked(std::function<void(void)> callback)
+{
+    callback();
+
+    return;
+}
+
+bool is_standalone_filter(const abstract_filter_c *const filterType)
+{
+    // The gates don't process images, and the output scaler filter writes into
+    // the scaler subsystem's frame buffer rather than the image it's given.
+    return !(
+        (filterType->category() == filter_category_e::input_condition) ||
+        (filterType->category() == filter_category_e::output_condition) ||
+        (filterType->category() == filter_category_e::output_scaler) ||
+        (filterType->uuid() == KF_PLACEHOLDER_FILTER->uuid())
+    );
+}
+
+std::string resolution_string(const resolution_s &resolution)
+{
+    return (std::to_string(resolution.w) + "x" + std::to_string(resolution.h));
+}
+
+void fill_with_noise(image_s *const image, const uint32_t seed)
+{
+    uint32_t state = (seed? seed : 1);
+
+    for (std::size_t i = 0; i < image->byte_size(); i++)
+    {
+        state ^= (state << 13);
+        state ^= (state >> 17);
+        state ^= (state << 5);
+        image->pixels[i] = uint8_t(state);
+    }
+
+    return;
+}
+
+// Runs the given function the given number of times (plus one untimed warm-up
+// run), calling the preparation function before each run without timing it.
+// Returns the total time taken by the timed runs, in seconds.
+static double time_runs(
+    const unsigned numIterations,
+    const std::function<void(void)> &prepare,
+    const std::function<void(void)> &run
+){
+    prepare();
+    run();
+
+    std::chrono::steady_clock::duration totalTime(0);
+
+    for (unsigned i = 0; i < numIterations; i++)
+    {
+        prepare();
+
+        const auto startTime = std::chrono::steady_clock::now();
+        run();
+        totalTime += (std::chrono::steady_clock::now() - startTime);
+    }
+
+    return std::chrono::duration<double>(totalTime).count();
+}
+
+static benchmark_result_s make_result(
+    const std::string &key,
+    const unsigned numIterations,
+    const double elapsedSeconds,
+    const uint64_t numPixelsPerRun,
+    const uint64_t numBytesPerRun
+){
+    benchmark_result_s result;
+
+    result.key = key;
+    result.numIterations = numIterations;
+    result.nsPerPixel = ((elapsedSeconds * 1e9) / (double(numPixelsPerRun) * numIterations));
+    result.fps = (numIterations / elapsedSeconds);
+    result.gigabytesPerSecond = ((double(numBytesPerRun) * numIterations) / elapsedSeconds / 1e9);
+
+    return result;
+}
+
+static std::vector<benchmark_result_s> benchmark_filters(const unsigned numIterations)
+{
+    std::vector<benchmark_result_s> results;
+    std::vector<uint8_t> srcPixels(MAX_NUM_BYTES_IN_OUTPUT_FRAME);
+    std::vector<uint8_t> dstPixels(MAX_NUM_BYTES_IN_OUTPUT_FRAME);
+
+    for (const abstract_filter_c *const filterType: kf_available_filter_types())
+    {
+        // The output scaler filter's scaling is covered by the scaler benchmarks.
+        if (!is_standalone_filter(filterType))
+        {
+            continue;
+        }
+
+        abstract_filter_c *const filter = kf_create_filter_instance(filterType->uuid());
+
+        for (const resolution_s &resolution: RESOLUTIONS)
+        {
+            image_s srcImage(srcPixels.data(), resolution);
+            image_s dstImage(dstPixels.data(), resolution);
+            fill_with_noise(&srcImage);
+
+            // Filters modify the image in place, so we restore it for each run.
+            const double elapsedSeconds = time_runs(
+                numIterations,
+                [&]{dstImage = srcImage;},
+                [&]{filter->apply(&dstImage);}
+            );
+
+            results.push_back(make_result(
+                ("filter," + filter->name() + "," + resolution_string(resolution)),
+                numIterations,
+                elapsedSeconds,
+                (uint64_t(resolution.w) * resolution.h),
+                (2 * dstImage.byte_size())
+            ));
+        }
+
+        kf_delete_filter_instance(filter);
+    }
+
+    return results;
+}
+
+static std::vector<benchmark_result_s> benchmark_scalers(const unsigned numIterations)
+{
+    std::vector<benchmark_result_s> results;
+    std::vector<uint8_t> srcPixels(MAX_NUM_BYTES_IN_OUTPUT_FRAME);
+    std::vector<uint8_t> dstPixels(MAX_NUM_BYTES_IN_OUTPUT_FRAME);
+
+    for (const image_scaler_s &scaler: ks_known_scalers())
+    {
+        for (const resolution_s &resolution: RESOLUTIONS)
+        {
+            const resolution_s outputResolution = (
+                (resolution == SCALER_OUTPUT_RESOLUTION)
+                    ? SCALER_ALTERNATE_OUTPUT_RESOLUTION
+                    : SCALER_OUTPUT_RESOLUTION
+            );
+
+            image_s srcImage(srcPixels.data(), resolution);
+            image_s dstImage(dstPixels.data(), outputResolution);
+            fill_with_noise(&srcImage);
+
+            const double elapsedSeconds = time_runs(
+                numIterations,
+                []{},
+                [&]{scaler.apply(srcImage, &dstImage, {0, 0, 0, 0});}
+            );
+
+            // Scalers' cost is proportional to the number of pixels they
+            // output, so we give the per-pixel time in output pixels.
+            results.push_back(make_result(
+                ("scaler," + scaler.name + "," + resolution_string(resolution) + "->" + resolution_string(outputResolution)),
+                numIterations,
+                elapsedSeconds,
+                (uint64_t(outputResolution.w) * outputResolution.h),
+                (srcImage.byte_size() + dstImage.byte_size())
+            ));
+        }
+    }
+
+    return results;
+}
+
+static bool save_results(const std::vector<benchmark_result_s> &results, const std::string &filename)
+{
+    FILE *const file = std::fopen(filename.c_str(), "w");
+
+    if (!file)
+    {
+        NBENE(("Failed to open \"%s\" for writing the benchmark results.", filename.c_str()));
+        return false;
+    }
+
+    for (const benchmark_result_s &result: results)
+    {
+        std::fprintf(
+            file,
+            "{%s},%u,%.4f,%.2f,%.3f\n",
+            result.key.c_str(),
+            result.numIterations,
+            result.nsPerPixel,
+            result.fps,
+            result.gigabytesPerSecond
+        );
+    }
+
+    if (std::fclose(file) != 0)
+    {
+        NBENE(("Failed to write the benchmark results into \"%s\".", filename.c_str()));
+        return false;
+    }
+
+    INFO(("Saved the benchmark results into \"%s\".", filename.c_str()));
+
+    return true;
+}
+
+// Returns the results saved by save_results() into the given file, keyed by
+// the benchmarks' keys.
+static std::map<std::string, benchmark_result_s> load_results(const std::string &filename)
+{
+    std::map<std::string, benchmark_result_s> results;
+
+    for (const QStringList &row: csv_parse_c(QString::fromStdString(filename)).contents())
+    {
+        if (row.size() != 5)
+        {
+            NBENE(("Skipping a malformed row in \"%s\".", filename.c_str()));
+            continue;
+        }
+
+        benchmark_result_s result;
+        result.key = row.at(0).toStdString();
+        result.numIterations = row.at(1).toUInt();
+        result.nsPerPixel = row.at(2).toDouble();
+        result.fps = row.at(3).toDouble();
+        result.gigabytesPerSecond = row.at(4).toDouble();
+
+        results[result.key] = result;
+    }
+
+    return results;
+}
+
+static void print_results(
+    const std::vector<benchmark_result_s> &results,
+    const std::map<std::string, benchmark_result_s> &baseline
+){
+    std::printf("%-56s %12s %12s %10s", "Benchmark", "ns/pixel", "FPS", "GB/s");
+    std::printf("%s\n", (baseline.empty()? "" : "   vs. baseline"));
+
+    for (const benchmark_result_s &result: results)
+    {
+        std::printf("%-56s %12.4f %12.2f %10.3f", result.key.c_str(), result.nsPerPixel, result.fps, result.gigabytesPerSecond);
+
+        if (!baseline.empty())
+        {
+            const auto baselineResult = baseline.find(result.key);
+
+            if (baselineResult == baseline.end())
+            {
+                std::printf("   (new)");
+            }
+            else
+            {
+                // Positive if the benchmark has become slower.
+                const double change = (((result.nsPerPixel / baselineResult->second.nsPerPixel) - 1) * 100);
+                std::printf("   %+.1f%%", change);
+            }
+        }
+
+        std::printf("\n");
+    }
+
+    return;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned numIterations = 20;
+    std::string resultsFilename = "";
+    std::string baselineFilename = "";
+    bool isEquivalenceCheck = false;
+
+    int c = 0;
+    while ((c = getopt(argc, argv, "n:o:c:e")) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+            {
+                numIterations = std::max(1, atoi(optarg));
+                break;
+            }
+            case 'o':
+            {
+                resultsFilename = optarg;
+                break;
+            }
+            case 'c':
+            {
+                baselineFilename = optarg;
+                break;
+            }
+            case 'e':
+            {
+                isEquivalenceCheck = true;
+                break;
+            }
+            default:
+            {
+                std::fprintf(stderr, "Usage: %s [-n iterations] [-o results.csv] [-c baseline.csv] [-e]\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    try
+    {
+        const subsystem_releaser_t releaseFilters = kf_initialize_filters();
+
+        if (isEquivalenceCheck)
+        {
+            const bool areFiltersEquivalent = check_filter_equivalence();
+            const bool areConversionsEquivalent = check_pixel_conversion_equivalence();
+            releaseFilters();
+
+            return ((areFiltersEquivalent && areConversionsEquivalent)? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        std::map<std::string, benchmark_result_s> baseline;
+
+        if (!baselineFilename.empty())
+        {
+            baseline = load_results(baselineFilename);
+        }
+
+        std::vector<benchmark_result_s> results = benchmark_filters(numIterations);
+        const std::vector<benchmark_result_s> scalerResults = benchmark_scalers(numIterations);
+        results.insert(results.end(), scalerResults.begin(), scalerResults.end());
+
+        print_results(results, baseline);
+
+        releaseFilters();
+
+        if (
+            !resultsFilename.empty() &&
+            !save_results(results, resultsFilename)
+        ){
+            return EXIT_FAILURE;
+        }
+    }
+    // Generally assumed to be from k_assert(), which will already have printed
+    // a more detailed error report.
+    catch (...)
+    {
+        NBENE(("The benchmark encountered an error and was terminated."));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * Helpers shared by the parts of the microbenchmark program (microbench.pro).
+ *
+ */
+
+#ifndef VCS_BENCHMARK_MICROBENCH_MICROBENCH_H
+#define VCS_BENCHMARK_MICROBENCH_MICROBENCH_H
+
+#include <cstdint>
+#include <string>
+#include "display/display.h"
+
+class abstract_filter_c;
+
+// Returns true if the given type of filter processes the image it's given and
+// can thus be run on its own, outside of a filter chain; false otherwise.
+bool is_standalone_filter(const abstract_filter_c *const filterType);
+
+// Fills the given image with pseudo-random pixels, so that filters don't get to
+// take shortcuts on e.g. uniform areas. The same seed produces the same pixels.
+void fill_with_noise(image_s *const image, const uint32_t seed = 0x12345678);
+
+// Returns the given resolution as a string, e.g. "640x480".
+std::string resolution_string(const resolution_s &resolution);
+
+#endif
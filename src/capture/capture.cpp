@@ -6,12 +6,24 @@
  */
 
 #include "capture/capture.h"
+#include "common/metrics/metrics.h"
 #include "common/timer/timer.h"
 
 static std::mutex CAPTURE_MUTEX;
 
 static unsigned LAST_KNOWN_MISSED_FRAMES_COUNT = 0;
 
+static struct
+{
+    metric_counter_c *framesCaptured;
+    metric_counter_c *framesDropped;
+    metric_counter_c *deviceFramesDropped;
+    metric_gauge_c *hasSignal;
+    metric_gauge_c *width;
+    metric_gauge_c *height;
+    metric_gauge_c *refreshRate;
+} METRICS;
+
 std::mutex& kc_mutex(void)
 {
     return CAPTURE_MUTEX;
@@ -23,6 +35,19 @@ subsystem_releaser_t kc_initialize_capture(void)
 
     kc_initialize_device();
 
+    METRICS.framesCaptured = kmetrics_counter("vcs_capture_frames_total", "Frames received from the capture device.");
+    METRICS.framesDropped = kmetrics_counter("vcs_capture_frames_dropped_total", "Captured frames that VCS was too busy to process.");
+    METRICS.deviceFramesDropped = kmetrics_counter("vcs_capture_device_frames_dropped_total", "Frames the capture device reported having failed to deliver.");
+    METRICS.hasSignal = kmetrics_gauge("vcs_capture_has_signal", "Whether the capture device is receiving a signal (1) or not (0).");
+    METRICS.width = kmetrics_gauge("vcs_capture_width_pixels", "Width of the captured video mode.");
+    METRICS.height = kmetrics_gauge("vcs_capture_height_pixels", "Height of the captured video mode.");
+    METRICS.refreshRate = kmetrics_gauge("vcs_capture_refresh_rate_hertz", "Refresh rate of the captured video mode.");
+
+    ev_new_captured_frame.listen([](const captured_frame_s&)
+    {
+        METRICS.framesCaptured->add();
+    }, "Capture metrics");
+
     kt_timer(1000, [](const unsigned)
     {
         const unsigned numMissedCurrent = kc_dropped_frames_count();
@@ -30,6 +55,13 @@ subsystem_releaser_t kc_initialize_capture(void)
 
         LAST_KNOWN_MISSED_FRAMES_COUNT = numMissedCurrent;
         ev_missed_frames_count.fire(numMissedFrames);
+
+        METRICS.framesDropped->set(numMissedCurrent);
+        METRICS.deviceFramesDropped->set(kc_device_dropped_frames_count());
+        METRICS.hasSignal->set(kc_has_signal());
+        METRICS.width->set(kc_device_property(device_property_e::width));
+        METRICS.height->set(kc_device_property(device_property_e::height));
+        METRICS.refreshRate->set(refresh_rate_s::from_capture_device_properties().value<double>());
     });
 
     return []{
@@ -38,9 +70,21 @@ subsystem_releaser_t kc_initialize_capture(void)
     };
 }
 
+unsigned kc_device_dropped_frames_count(void)
+{
+    return kc_frame_buffer().numDeviceDroppedFrames;
+}
+
+bool kc_set_device_property(const device_property_e property, intptr_t value)
+{
+    // Setting a property is rare enough that we can route it through the
+    // backend's string-keyed setter, which knows how to react to the change.
+    return kc_set_device_property(kc_device_property_name(property), value);
+}
+
 bool kc_has_signal(void)
 {
-    return kc_device_property("has signal");
+    return kc_device_property(device_property_e::has_signal);
 }
 
 const std::vector<const char*>& kc_supported_video_preset_properties(void)
@@ -52,10 +96,10 @@ const std::vector<const char*>& kc_supported_video_preset_properties(void)
 
 refresh_rate_s capture_rate_s::from_capture_device_properties(void)
 {
-    return refresh_rate_s::from_fixedpoint(kc_device_property("capture rate"));
+    return refresh_rate_s::from_fixedpoint(kc_device_property(device_property_e::capture_rate));
 }
 
 void capture_rate_s::to_capture_device_properties(const refresh_rate_s &rate)
 {
-    kc_set_device_property("capture rate", rate.fixedpoint);
+    kc_set_device_property(device_property_e::capture_rate, rate.fixedpoint);
 }
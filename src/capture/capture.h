@@ -90,6 +90,27 @@ enum class capture_event_e
     num_enumerators
 };
 
+// The capture device properties that VCS reads often enough (e.g. once per frame)
+// to warrant a key that can be looked up without hashing a string. The string
+// key of each is given by kc_device_property_name(). Properties not listed here
+// are accessible only by their string key.
+enum class device_property_e
+{
+    has_signal,
+    width,
+    height,
+    width_minimum,
+    width_maximum,
+    height_minimum,
+    height_maximum,
+    refresh_rate,
+    capture_rate,
+    channel,
+
+    // Total enumerator count. Should remain the last item in the list.
+    num_enumerators
+};
+
 struct video_mode_s
 {
     resolution_s resolution;
@@ -111,9 +132,22 @@ struct capture_rate_s
 
 struct captured_frame_s
 {
+    // When the frame was captured. If the capture device reports capture times,
+    // this is the device's timestamp for the frame; otherwise, it's the time at
+    // which the capture subsystem received the frame.
     std::chrono::time_point<std::chrono::steady_clock> timestamp = std::chrono::steady_clock::now();
+
     resolution_s resolution;
     uint8_t *pixels;
+
+    // The capture device's sequence number for the frame, if the device reports
+    // one; otherwise 0.
+    uint32_t sequence = 0;
+
+    // A running count of frames that the capture device itself failed to deliver
+    // (e.g. as indicated by gaps in its sequence numbers), as opposed to frames
+    // that VCS was too busy to process (see kc_dropped_frames_count()).
+    unsigned numDeviceDroppedFrames = 0;
 };
 
 // Returns a reference to a mutex which a caller should acquire before interacting
@@ -146,8 +180,16 @@ bool kc_release_device(void);
 //
 // If this value gets above 0, it indicates that VCS is failing to process and
 // display captured frames as fast as the capture device is producing them.
+//
+// Frames that the capture device failed to deliver in the first place aren't
+// included; see kc_device_dropped_frames_count().
 unsigned kc_dropped_frames_count(void);
 
+// Returns the count of frames that the capture device reported having failed
+// to capture or deliver, e.g. due to bus bandwidth. Capture backends whose
+// device doesn't report this information return 0.
+unsigned kc_device_dropped_frames_count(void);
+
 // Returns true if the capture device's active input channel is currently
 // receiving a signal; false otherwise.
 bool kc_has_signal(void);
@@ -161,8 +203,23 @@ const captured_frame_s& kc_frame_buffer(void);
 // event.
 capture_event_e kc_process_next_capture_event(void);
 
+// Returns the value of the given capture device property, or 0 if the device
+// doesn't have the property. Safe to call from any thread.
+intptr_t kc_device_property(const device_property_e property);
+
+// Same as kc_device_property(device_property_e), but for any property, by its
+// string key; e.g. "has signal" or "Brightness: maximum".
 intptr_t kc_device_property(const std::string &key);
 
+// Sets the given capture device property's value. The capture backend may react
+// to the change, e.g. by switching the device's input channel. Returns true on
+// success; false otherwise.
+bool kc_set_device_property(const device_property_e property, intptr_t value);
+
 bool kc_set_device_property(const std::string &key, intptr_t value);
 
+// Returns the string key of the given capture device property; e.g. "has signal"
+// for device_property_e::has_signal.
+const char* kc_device_property_name(const device_property_e property);
+
 #endif
@@ -0,0 +1,49 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include "capture/capture_event_flags.h"
+#include "common/assert.h"
+
+static_assert(
+    (int(capture_event_e::num_enumerators) <= 32),
+    "The capture events don't fit into the event bitmask."
+);
+
+uint32_t capture_event_flags_c::bit(const capture_event_e event)
+{
+    k_assert((event < capture_event_e::num_enumerators), "Unknown capture event.");
+
+    return (1u << unsigned(event));
+}
+
+bool capture_event_flags_c::push(const capture_event_e event)
+{
+    return (this->pendingEvents.fetch_or(bit(event), std::memory_order_release) & bit(event));
+}
+
+bool capture_event_flags_c::pop(const capture_event_e event)
+{
+    // Most polls find no event, which we can tell without a read-modify-write.
+    if (!this->is_pending(event))
+    {
+        return false;
+    }
+
+    return (this->pendingEvents.fetch_and(~bit(event), std::memory_order_acq_rel) & bit(event));
+}
+
+bool capture_event_flags_c::is_pending(const capture_event_e event) const
+{
+    return (this->pendingEvents.load(std::memory_order_acquire) & bit(event));
+}
+
+void capture_event_flags_c::clear(void)
+{
+    this->pendingEvents.store(0, std::memory_order_release);
+
+    return;
+}
@@ -0,0 +1,60 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * A set of pending capture events, for capture backends to pass capture events
+ * from their capture thread to VCS's main thread without locking.
+ *
+ * Each capture event type is a bit in an atomic bitmask, so raising or taking
+ * an event never blocks, and in particular the capture thread doesn't need to
+ * acquire the capture mutex (which VCS's main loop holds while processing a
+ * frame) just to report an event. Raising an event that's already pending
+ * coalesces the two, as with the bool flags this replaces.
+ *
+ * ## Usage
+ *
+ *   // In the capture thread.
+ *   EVENTS.push(capture_event_e::new_frame);
+ *
+ *   // In kc_process_next_capture_event(), on VCS's main thread.
+ *   if (EVENTS.pop(capture_event_e::new_frame))
+ *   {
+ *       ...
+ *   }
+ *
+ */
+
+#ifndef VCS_CAPTURE_CAPTURE_EVENT_FLAGS_H
+#define VCS_CAPTURE_CAPTURE_EVENT_FLAGS_H
+
+#include <cstdint>
+#include <atomic>
+#include "capture/capture.h"
+
+class capture_event_flags_c
+{
+public:
+    // Raises the given event. Returns true if the event was already pending
+    // (i.e. raised but not yet popped); false otherwise.
+    bool push(const capture_event_e event);
+
+    // Returns true if the given event was pending, and clears it.
+    bool pop(const capture_event_e event);
+
+    // Returns true if the given event is pending, without clearing it.
+    bool is_pending(const capture_event_e event) const;
+
+    // Clears all pending events.
+    void clear(void);
+
+private:
+    static uint32_t bit(const capture_event_e event);
+
+    std::atomic<uint32_t> pendingEvents = 0;
+};
+
+#endif
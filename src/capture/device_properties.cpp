@@ -0,0 +1,87 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include "capture/device_properties.h"
+#include "common/assert.h"
+
+// The string keys of the typed properties, indexed by device_property_e.
+static const std::array<const char*, unsigned(device_property_e::num_enumerators)> PROPERTY_NAMES = {
+    "has signal",
+    "width",
+    "height",
+    "width: minimum",
+    "width: maximum",
+    "height: minimum",
+    "height: maximum",
+    "refresh rate",
+    "capture rate",
+    "channel",
+};
+
+// Returns the typed key of the property with the given string key, or
+// device_property_e::num_enumerators if it has none.
+static device_property_e typed_key(const std::string &key)
+{
+    static const std::unordered_map<std::string, device_property_e> typedKeys = []
+    {
+        std::unordered_map<std::string, device_property_e> keys;
+
+        for (unsigned i = 0; i < PROPERTY_NAMES.size(); i++)
+        {
+            keys[PROPERTY_NAMES[i]] = device_property_e(i);
+        }
+
+        return keys;
+    }();
+
+    const auto typedKey = typedKeys.find(key);
+
+    return ((typedKey == typedKeys.end())? device_property_e::num_enumerators : typedKey->second);
+}
+
+const char* kc_device_property_name(const device_property_e property)
+{
+    k_assert((property < device_property_e::num_enumerators), "Unknown device property.");
+
+    return PROPERTY_NAMES[unsigned(property)];
+}
+
+device_properties_c::device_properties_c(std::initializer_list<std::pair<const std::string, intptr_t>> initialValues)
+{
+    for (const auto &[key, value]: initialValues)
+    {
+        this->set(key, value);
+    }
+
+    return;
+}
+
+intptr_t device_properties_c::value(const std::string &key) const
+{
+    if (const device_property_e property = typed_key(key); property != device_property_e::num_enumerators)
+    {
+        return this->value(property);
+    }
+
+    const auto untypedValue = this->untypedValues.find(key);
+
+    return ((untypedValue == this->untypedValues.end())? 0 : untypedValue->second);
+}
+
+void device_properties_c::set(const std::string &key, const intptr_t value)
+{
+    if (const device_property_e property = typed_key(key); property != device_property_e::num_enumerators)
+    {
+        this->set(property, value);
+    }
+    else
+    {
+        this->untypedValues[key] = value;
+    }
+
+    return;
+}
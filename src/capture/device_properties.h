@@ -0,0 +1,82 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * A capture backend's store of capture device properties, through which the
+ * backend implements kc_device_property() and kc_set_device_property().
+ *
+ * Properties are keyed by string (e.g. "has signal"), but those that VCS reads
+ * on its hot paths (e.g. the current resolution, which is read for each frame)
+ * also have a typed key (device_property_e). A property with a typed key is
+ * stored in an atomic slot indexed by the key, so reading it by the typed key
+ * is a plain load, with no hashing or locking; and reading or writing it by
+ * its string key resolves to the same slot. Other properties are stored in a
+ * hash map, which - as before this store existed - isn't thread-safe.
+ *
+ * ## Usage
+ *
+ *   static device_properties_c DEVICE_PROPERTIES = {
+ *       {"api name", intptr_t("Virtual")},
+ *       {"has signal", true},
+ *   };
+ *
+ *   intptr_t kc_device_property(const device_property_e property)
+ *   {
+ *       return DEVICE_PROPERTIES.value(property);
+ *   }
+ *
+ *   intptr_t kc_device_property(const std::string &key)
+ *   {
+ *       return DEVICE_PROPERTIES.value(key);
+ *   }
+ *
+ *   bool kc_set_device_property(const std::string &key, intptr_t value)
+ *   {
+ *       // React to the change, then:
+ *       DEVICE_PROPERTIES.set(key, value);
+ *       return true;
+ *   }
+ *
+ */
+
+#ifndef VCS_CAPTURE_DEVICE_PROPERTIES_H
+#define VCS_CAPTURE_DEVICE_PROPERTIES_H
+
+#include <initializer_list>
+#include <unordered_map>
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <array>
+#include "capture/capture.h"
+
+class device_properties_c
+{
+public:
+    device_properties_c(std::initializer_list<std::pair<const std::string, intptr_t>> initialValues);
+
+    // Returns the value of the given property, or 0 if it hasn't been set.
+    intptr_t value(const device_property_e property) const
+    {
+        return this->typedValues[unsigned(property)].load(std::memory_order_relaxed);
+    }
+
+    intptr_t value(const std::string &key) const;
+
+    void set(const device_property_e property, const intptr_t value)
+    {
+        this->typedValues[unsigned(property)].store(value, std::memory_order_relaxed);
+    }
+
+    void set(const std::string &key, const intptr_t value);
+
+private:
+    std::array<std::atomic<intptr_t>, unsigned(device_property_e::num_enumerators)> typedValues = {};
+    std::unordered_map<std::string, intptr_t> untypedValues;
+};
+
+#endif
@@ -9,20 +9,74 @@
  *
  * This implementation is intended for educational purposes only.
  *
+ * Frames are captured natively via Video4Linux2 (see v4l2_stream.h) if the
+ * device offers a pixel format that VCS can convert directly into its frame
+ * buffer; otherwise, via OpenCV's VideoCapture. MJPEG frames from the native
+ * stream are decoded on a pool of worker threads (see mjpeg_decoder.h).
+ *
  */
 
 #include <future>
+#include <atomic>
+#include <array>
 #include <chrono>
+#include <cstdio>
+#include <linux/videodev2.h>
 #include <opencv2/videoio/videoio.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "common/pixel_conversion/pixel_conversion.h"
+#include "capture/generic_v4l/mjpeg_decoder.h"
+#include "capture/generic_v4l/v4l2_stream.h"
 #include "common/timer/timer.h"
+#include "capture/capture_event_flags.h"
 #include "capture/capture.h"
+#include "capture/device_properties.h"
 
 static unsigned NUM_FRAMES_PER_SECOND = 0;
-static captured_frame_s LOCAL_FRAME_BUFFER = {.pixels = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]()};
-static std::vector<unsigned> CAPTURE_FLAGS(static_cast<unsigned>(capture_event_e::num_enumerators));
+// Frames from the native stream (other than MJPEG) and from OpenCV are captured
+// into one of three slots, which rotate between the capture thread and VCS's
+// main thread like the SCREEN slots of the MMAP capture backend: the capture
+// thread fills its back slot and then swaps it with the ready slot, and the main
+// thread, on receiving a new frame event, swaps its front slot with the ready
+// slot. The capture thread thus never writes into the frame that VCS is
+// processing, nor has to wait for the capture mutex to publish a frame.
+static std::array<captured_frame_s, 3> FRAME_SLOTS;
+
+// The size in bytes of each slot's pixel buffer. The buffers are allocated by the
+// capture thread as it first fills each slot, sized for the captured frames, and
+// reallocated if the frames grow.
+static std::array<unsigned, 3> FRAME_SLOT_NUM_BYTES;
+
+// Owned by the capture thread and the main thread, respectively.
+static unsigned BACK_SLOT = 1;
+static unsigned FRONT_SLOT = 0;
+
+// The index of the slot owned by neither thread, with READY_SLOT_IS_NEW set if
+// the slot holds a frame that the main thread hasn't yet received.
+static std::atomic<unsigned> READY_SLOT = 2;
+static const unsigned READY_SLOT_IS_NEW = (1u << 31);
+
+// For MJPEG, the frame buffer points to the latest frame delivered by the decoder;
+// otherwise, to the pixels of the front slot. Null until a frame is received.
+static captured_frame_s LOCAL_FRAME_BUFFER = {.pixels = nullptr};
+
+// The capture resolution set via the "width" and "height" device properties. The
+// frame buffer's resolution is that of its frame, which may differ from this.
+static resolution_s REQUESTED_RESOLUTION;
+static capture_event_flags_c CAPTURE_EVENTS;
 
 static std::future<void> CAPTURE_THREAD;
+static v4l2_stream_c NATIVE_STREAM;
+static mjpeg_decoder_c *MJPEG_DECODER = nullptr;
+static unsigned NUM_MJPEG_FRAMES_DROPPED = 0;
+
+// Count of captured frames that were replaced by a newer frame before VCS got
+// around to processing them.
+static std::atomic<unsigned> NUM_FRAMES_OVERWRITTEN = 0;
+
+// Count of frames the capture device has reported skipping. Copied into the
+// frame buffer along with each new frame.
+static std::atomic<unsigned> NUM_DEVICE_FRAMES_DROPPED = 0;
 static cv::VideoCapture CAPTURE_DEVICE;
 static cv::Mat DEVICE_FRAME_BUFFER;
 
@@ -36,7 +90,7 @@ static std::vector<const char*> SUPPORTED_VIDEO_PROPERTIES = {
     "Zoom",
 };
 
-static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
+static device_properties_c DEVICE_PROPERTIES = {
     {"api name", intptr_t("Video4Linux")},
     {"channel", 0},
     {"autofocus", 0},
@@ -54,61 +108,299 @@ static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
 
 static void push_event(capture_event_e flag)
 {
-    CAPTURE_FLAGS[int(flag)] = true;
+    CAPTURE_EVENTS.push(flag);
+}
+
+// Announces a new frame, either in the ready slot or (for MJPEG) in the frame
+// buffer.
+static void push_new_frame_event(void)
+{
+    if (CAPTURE_EVENTS.push(capture_event_e::new_frame))
+    {
+        NUM_FRAMES_OVERWRITTEN++;
+    }
+
+    return;
 }
 
 static bool pop_event(const capture_event_e flag)
 {
-    const bool flagValue = CAPTURE_FLAGS[int(flag)];
-    CAPTURE_FLAGS[int(flag)] = false;
-    return flagValue;
+    return CAPTURE_EVENTS.pop(flag);
+}
+
+// Called by the capture thread, having written a new frame into the back slot.
+// Makes the frame available to the main thread.
+static void publish_back_slot(void)
+{
+    FRAME_SLOTS[BACK_SLOT].numDeviceDroppedFrames = NUM_DEVICE_FRAMES_DROPPED;
+    BACK_SLOT = (READY_SLOT.exchange(BACK_SLOT | READY_SLOT_IS_NEW) & ~READY_SLOT_IS_NEW);
+    push_new_frame_event();
+
+    return;
+}
+
+// Called by the main thread on a new frame event. Moves into the frame buffer
+// the ready slot's frame, if there's a new one there. Returns false if there
+// wasn't, e.g. because the main thread already received the frame while the
+// capture thread was still announcing it; true otherwise.
+static bool receive_ready_slot(void)
+{
+    if (!(READY_SLOT.load() & READY_SLOT_IS_NEW))
+    {
+        return false;
+    }
+
+    FRONT_SLOT = (READY_SLOT.exchange(FRONT_SLOT) & ~READY_SLOT_IS_NEW);
+    LOCAL_FRAME_BUFFER = FRAME_SLOTS[FRONT_SLOT];
+
+    return true;
+}
+
+// Called by the capture thread. Makes sure that the back slot can hold a frame of
+// the given resolution, reallocating its pixel buffer if not.
+static void reserve_back_slot(const resolution_s &resolution)
+{
+    const unsigned numBytes = (resolution.w * resolution.h * 4);
+
+    if (FRAME_SLOT_NUM_BYTES[BACK_SLOT] < numBytes)
+    {
+        delete [] FRAME_SLOTS[BACK_SLOT].pixels;
+        FRAME_SLOTS[BACK_SLOT].pixels = new uint8_t[numBytes];
+        FRAME_SLOT_NUM_BYTES[BACK_SLOT] = numBytes;
+    }
+
+    return;
+}
+
+// Converts the given frame from the native V4L2 stream into BGRA in the given
+// pixel buffer. Returns false if the frame couldn't be converted; true otherwise.
+static bool convert_native_frame(const v4l2_stream_c::frame_s &frame, uint8_t *const dstPixels)
+{
+    const resolution_s &resolution = NATIVE_STREAM.resolution();
+    const unsigned bytesPerLine = NATIVE_STREAM.bytes_per_line();
+
+    // Guard against the driver reporting less data than the format requires.
+    const unsigned requiredBytes = (
+        (NATIVE_STREAM.pixel_format() == v4l2_stream_c::pixel_format_e::nv12)
+        ? ((bytesPerLine * resolution.h * 3) / 2)
+        : (bytesPerLine * resolution.h)
+    );
+
+    if (frame.numBytes < requiredBytes)
+    {
+        return false;
+    }
+
+    for (unsigned y = 0; y < resolution.h; y++)
+    {
+        const uint8_t *const src = (frame.data + (y * bytesPerLine));
+        uint8_t *const dst = (dstPixels + (y * resolution.w * 4));
+
+        switch (NATIVE_STREAM.pixel_format())
+        {
+            case v4l2_stream_c::pixel_format_e::bgr32:
+            {
+                std::memcpy(dst, src, (resolution.w * 4));
+                break;
+            }
+            case v4l2_stream_c::pixel_format_e::yuyv:
+            {
+                kpixel_convert_yuyv_to_bgra(src, dst, resolution.w);
+                break;
+            }
+            case v4l2_stream_c::pixel_format_e::nv12:
+            {
+                const uint8_t *const chromaPlane = (frame.data + (bytesPerLine * resolution.h));
+                kpixel_convert_nv12_row_to_bgra(src, (chromaPlane + ((y / 2) * bytesPerLine)), dst, resolution.w);
+                break;
+            }
+            case v4l2_stream_c::pixel_format_e::mjpeg:
+            {
+                // Decoded by the MJPEG decoder instead.
+                return false;
+            }
+        }
+    }
+
+    return true;
 }
 
 static void capture_loop(void)
 {
     while (RUN_CAPTURE_LOOP)
     {
-        if (
+        if (NATIVE_STREAM.is_open())
+        {
+            v4l2_stream_c::frame_s frame;
+
+            if (NATIVE_STREAM.dequeue(&frame, 100))
+            {
+                NUM_DEVICE_FRAMES_DROPPED += frame.numFramesSkipped;
+
+                // The decoder copies the frame's data, so the buffer can be given
+                // back to the device straight away.
+                if (MJPEG_DECODER)
+                {
+                    MJPEG_DECODER->submit(frame.data, frame.numBytes, frame.timestamp, frame.sequence);
+                }
+                else
+                {
+                    reserve_back_slot(NATIVE_STREAM.resolution());
+                    captured_frame_s &backSlot = FRAME_SLOTS[BACK_SLOT];
+
+                    if (convert_native_frame(frame, backSlot.pixels))
+                    {
+                        backSlot.timestamp = frame.timestamp;
+                        backSlot.sequence = frame.sequence;
+                        backSlot.resolution = NATIVE_STREAM.resolution();
+                        publish_back_slot();
+                    }
+                    // E.g. the driver delivered less data than the format requires.
+                    else
+                    {
+                        NUM_DEVICE_FRAMES_DROPPED++;
+                    }
+                }
+
+                NATIVE_STREAM.requeue(frame);
+            }
+        }
+        else if (
             CAPTURE_DEVICE.isOpened() &&
             CAPTURE_DEVICE.read(DEVICE_FRAME_BUFFER) &&
             !DEVICE_FRAME_BUFFER.empty()
         ){
-            cv::cvtColor(DEVICE_FRAME_BUFFER, DEVICE_FRAME_BUFFER, cv::COLOR_RGB2RGBA);
-
-            LOCK_CAPTURE_MUTEX_IN_SCOPE;
-            push_event(capture_event_e::new_frame);
-            LOCAL_FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
-            std::memcpy(
-                LOCAL_FRAME_BUFFER.pixels,
-                DEVICE_FRAME_BUFFER.data,
-                std::min(MAX_NUM_BYTES_IN_CAPTURED_FRAME, (DEVICE_FRAME_BUFFER.total() * DEVICE_FRAME_BUFFER.elemSize()))
-            );
+            // Convert directly into the back slot, without an intermediate copy.
+            if ((DEVICE_FRAME_BUFFER.total() * 4) <= MAX_NUM_BYTES_IN_CAPTURED_FRAME)
+            {
+                reserve_back_slot({.w = unsigned(DEVICE_FRAME_BUFFER.cols), .h = unsigned(DEVICE_FRAME_BUFFER.rows)});
+                captured_frame_s &backSlot = FRAME_SLOTS[BACK_SLOT];
+                cv::Mat frameBuffer(DEVICE_FRAME_BUFFER.rows, DEVICE_FRAME_BUFFER.cols, CV_8UC4, backSlot.pixels);
+                cv::cvtColor(DEVICE_FRAME_BUFFER, frameBuffer, cv::COLOR_BGR2BGRA);
+
+                backSlot.timestamp = std::chrono::steady_clock::now();
+                backSlot.sequence = 0;
+                backSlot.resolution = {.w = unsigned(DEVICE_FRAME_BUFFER.cols), .h = unsigned(DEVICE_FRAME_BUFFER.rows)};
+                publish_back_slot();
+            }
+            else
+            {
+                NUM_DEVICE_FRAMES_DROPPED++;
+            }
         }
     }
 }
 
+static void start_mjpeg_decoder(void)
+{
+    const unsigned numThreads = std::clamp((std::thread::hardware_concurrency() / 2), 2u, 4u);
+
+    MJPEG_DECODER = new mjpeg_decoder_c(numThreads, [](uint8_t *const pixels, const resolution_s &resolution, const std::chrono::steady_clock::time_point &timestamp, const uint32_t deviceSequence)
+    {
+        LOCK_CAPTURE_MUTEX_IN_SCOPE;
+        LOCAL_FRAME_BUFFER.pixels = pixels;
+        LOCAL_FRAME_BUFFER.resolution = resolution;
+        LOCAL_FRAME_BUFFER.timestamp = timestamp;
+        LOCAL_FRAME_BUFFER.sequence = deviceSequence;
+        LOCAL_FRAME_BUFFER.numDeviceDroppedFrames = NUM_DEVICE_FRAMES_DROPPED;
+        push_new_frame_event();
+    });
+
+    return;
+}
+
+static void stop_mjpeg_decoder(void)
+{
+    if (!MJPEG_DECODER)
+    {
+        return;
+    }
+
+    MJPEG_DECODER->stop();
+
+    {
+        // The decoder's pixel buffers are freed along with it, so any frame it
+        // has announced is discarded.
+        LOCK_CAPTURE_MUTEX_IN_SCOPE;
+        LOCAL_FRAME_BUFFER.pixels = nullptr;
+        pop_event(capture_event_e::new_frame);
+        NUM_MJPEG_FRAMES_DROPPED += MJPEG_DECODER->num_frames_dropped();
+    }
+
+    delete MJPEG_DECODER;
+    MJPEG_DECODER = nullptr;
+
+    return;
+}
+
 static void release_capture_device(void)
 {
     RUN_CAPTURE_LOOP = false;
     CAPTURE_THREAD.wait();
+    stop_mjpeg_decoder();
+    NATIVE_STREAM.close();
     CAPTURE_DEVICE.release();
 }
 
+static bool is_device_open(void)
+{
+    return (NATIVE_STREAM.is_open() || CAPTURE_DEVICE.isOpened());
+}
+
 static void acquire_capture_device(void)
 {
+    const bool isNativeStreamOpen = NATIVE_STREAM.open(
+        kc_device_property("channel"),
+        REQUESTED_RESOLUTION,
+        kc_device_property("fps"),
+        std::max(intptr_t(2), kc_device_property("buffer size"))
+    );
+
+    if (isNativeStreamOpen)
+    {
+        REQUESTED_RESOLUTION = NATIVE_STREAM.resolution();
+
+        if (NATIVE_STREAM.pixel_format() == v4l2_stream_c::pixel_format_e::mjpeg)
+        {
+            start_mjpeg_decoder();
+        }
+    }
+
     kc_set_device_property(
         "has signal",
-        CAPTURE_DEVICE.open(kc_device_property("channel"), cv::CAP_V4L2) &&
-        CAPTURE_DEVICE.isOpened()
+        isNativeStreamOpen || (
+            CAPTURE_DEVICE.open(kc_device_property("channel"), cv::CAP_V4L2) &&
+            CAPTURE_DEVICE.isOpened()
+        )
     );
 }
 
+// Sets the given device control on whichever capture path is in use.
+static void set_device_control(const uint32_t v4l2ControlId, const int cvPropertyId, const intptr_t value)
+{
+    if (NATIVE_STREAM.is_open())
+    {
+        NATIVE_STREAM.set_control(v4l2ControlId, value);
+    }
+    else
+    {
+        CAPTURE_DEVICE.set(cvPropertyId, value);
+    }
+
+    return;
+}
+
 static void start_capture(void)
 {
-    // Persist certain settings between capture sessions.
-    CAPTURE_DEVICE.set(cv::CAP_PROP_BUFFERSIZE, kc_device_property("buffer size"));
-    CAPTURE_DEVICE.set(cv::CAP_PROP_FPS, kc_device_property("fps"));
-    CAPTURE_DEVICE.set(cv::CAP_PROP_AUTOFOCUS, kc_device_property("autofocus"));
+    // Persist certain settings between capture sessions. The native stream will
+    // have been opened with the buffer size and frame rate already.
+    if (!NATIVE_STREAM.is_open())
+    {
+        CAPTURE_DEVICE.set(cv::CAP_PROP_BUFFERSIZE, kc_device_property("buffer size"));
+        CAPTURE_DEVICE.set(cv::CAP_PROP_FPS, kc_device_property("fps"));
+    }
+
+    set_device_control(V4L2_CID_FOCUS_AUTO, cv::CAP_PROP_AUTOFOCUS, kc_device_property("autofocus"));
 
     RUN_CAPTURE_LOOP = true;
     CAPTURE_THREAD = std::async(std::launch::async, capture_loop);
@@ -121,8 +413,8 @@ void kc_initialize_device(void)
     acquire_capture_device();
 
     kc_set_device_property("buffer size", 1);
-    kc_set_device_property("width", CAPTURE_DEVICE.get(cv::CAP_PROP_FRAME_WIDTH));
-    kc_set_device_property("height", CAPTURE_DEVICE.get(cv::CAP_PROP_FRAME_HEIGHT));
+    kc_set_device_property("width", (NATIVE_STREAM.is_open()? NATIVE_STREAM.resolution().w : CAPTURE_DEVICE.get(cv::CAP_PROP_FRAME_WIDTH)));
+    kc_set_device_property("height", (NATIVE_STREAM.is_open()? NATIVE_STREAM.resolution().h : CAPTURE_DEVICE.get(cv::CAP_PROP_FRAME_HEIGHT)));
     kc_set_device_property("Brightness: minimum", 0);
     kc_set_device_property("Brightness: maximum", 255);
     kc_set_device_property("Brightness: default", 63);
@@ -164,9 +456,37 @@ void kc_initialize_device(void)
         autoFocus->on_change = [](int idx){kc_set_device_property("autofocus", idx);};
         autoFocus->index = 0;
 
+        auto *mjpegStats = new abstract_gui_widget::label;
+        mjpegStats->text = "Not in use";
+
+        kt_timer(1000, [mjpegStats](const unsigned)
+        {
+            if (!MJPEG_DECODER)
+            {
+                mjpegStats->set_text("Not in use");
+                return;
+            }
+
+            const mjpeg_decoder_c::stats_s stats = MJPEG_DECODER->take_stats();
+
+            char text[128];
+            std::snprintf(
+                text,
+                sizeof(text),
+                "%u threads, avg. %.1f ms, max %.1f ms, %u dropped",
+                MJPEG_DECODER->num_threads(),
+                (stats.averageDecodeUs / 1000.0),
+                (stats.maxDecodeUs / 1000.0),
+                (stats.numDropped + stats.numFailed)
+            );
+
+            mjpegStats->set_text(text);
+        });
+
         static abstract_gui_s gui;
         gui.fields.push_back({"Autofocus", {autoFocus}});
         gui.fields.push_back({"FPS", {fps}});
+        gui.fields.push_back({"MJPEG decoding", {mjpegStats}});
         kd_add_control_panel_widget("Capture", "Video4Linux control properties", &gui);
     }
 
@@ -175,21 +495,26 @@ void kc_initialize_device(void)
     return;
 }
 
+intptr_t kc_device_property(const device_property_e property)
+{
+    return DEVICE_PROPERTIES.value(property);
+}
+
 intptr_t kc_device_property(const std::string &key)
 {
-    return (DEVICE_PROPERTIES.contains(key)? DEVICE_PROPERTIES.at(key) : 0);
+    return DEVICE_PROPERTIES.value(key);
 }
 
 bool kc_set_device_property(const std::string &key, intptr_t value)
 {
     if (key == "width")
     {
-        LOCAL_FRAME_BUFFER.resolution.w = value;
+        REQUESTED_RESOLUTION.w = value;
         RESET_RESOLUTION = true;
     }
     else if (key == "height")
     {
-        LOCAL_FRAME_BUFFER.resolution.h = value;
+        REQUESTED_RESOLUTION.h = value;
         RESET_RESOLUTION = true;
     }
     else if (key == "refresh rate")
@@ -201,6 +526,7 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
     }
     else if (key == "buffer size")
     {
+        // The native stream's buffers are allocated when the stream is opened.
         CAPTURE_DEVICE.set(cv::CAP_PROP_BUFFERSIZE, value);
     }
     else if (key == "channel")
@@ -218,23 +544,30 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
     }
     else if (key == "fps")
     {
-        CAPTURE_DEVICE.set(cv::CAP_PROP_FPS, value);
+        if (NATIVE_STREAM.is_open())
+        {
+            NATIVE_STREAM.set_frame_rate(value);
+        }
+        else
+        {
+            CAPTURE_DEVICE.set(cv::CAP_PROP_FPS, value);
+        }
     }
     else if (key == "autofocus")
     {
-        CAPTURE_DEVICE.set(cv::CAP_PROP_AUTOFOCUS, value);
+        set_device_control(V4L2_CID_FOCUS_AUTO, cv::CAP_PROP_AUTOFOCUS, value);
     }
     else if (key == "Focus")
     {
-        CAPTURE_DEVICE.set(cv::CAP_PROP_FOCUS, value);
+        set_device_control(V4L2_CID_FOCUS_ABSOLUTE, cv::CAP_PROP_FOCUS, value);
     }
     else if (key == "Zoom")
     {
-        CAPTURE_DEVICE.set(cv::CAP_PROP_ZOOM, value);
+        set_device_control(V4L2_CID_ZOOM_ABSOLUTE, cv::CAP_PROP_ZOOM, value);
     }
     else if (key == "Brightness")
     {
-        CAPTURE_DEVICE.set(cv::CAP_PROP_BRIGHTNESS, value);
+        set_device_control(V4L2_CID_BRIGHTNESS, cv::CAP_PROP_BRIGHTNESS, value);
     }
     else if (key == "has signal")
     {
@@ -250,18 +583,23 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
             // With a Datapath Vision capture card, changing the capture resolution
             // while capturing causes the capture to freeze, unless we first restart
             // the capture.
+            // The native stream is reopened at the new resolution.
             release_capture_device();
             acquire_capture_device();
 
-            CAPTURE_DEVICE.set(cv::CAP_PROP_FRAME_WIDTH, LOCAL_FRAME_BUFFER.resolution.w);
-            CAPTURE_DEVICE.set(cv::CAP_PROP_FRAME_HEIGHT, LOCAL_FRAME_BUFFER.resolution.h);
+            if (CAPTURE_DEVICE.isOpened())
+            {
+                CAPTURE_DEVICE.set(cv::CAP_PROP_FRAME_WIDTH, REQUESTED_RESOLUTION.w);
+                CAPTURE_DEVICE.set(cv::CAP_PROP_FRAME_HEIGHT, REQUESTED_RESOLUTION.h);
+            }
+
             push_event(capture_event_e::new_video_mode);
 
             start_capture();
         });
     }
 
-    DEVICE_PROPERTIES[key] = value;
+    DEVICE_PROPERTIES.set(key, value);
 
     return true;
 }
@@ -285,7 +623,7 @@ capture_event_e kc_process_next_capture_event(void)
         return capture_event_e::signal_lost;
     }
 
-    if (!CAPTURE_DEVICE.isOpened())
+    if (!is_device_open())
     {
         return capture_event_e::sleep;
     }
@@ -299,8 +637,11 @@ capture_event_e kc_process_next_capture_event(void)
         return capture_event_e::new_video_mode;
     }
 
-    if (pop_event(capture_event_e::new_frame))
-    {
+    // The MJPEG decoder delivers its frames directly into the frame buffer.
+    if (
+        pop_event(capture_event_e::new_frame) &&
+        (MJPEG_DECODER || receive_ready_slot())
+    ){
         ev_new_captured_frame.fire(LOCAL_FRAME_BUFFER);
         return capture_event_e::new_frame;
     }
@@ -315,7 +656,11 @@ const captured_frame_s& kc_frame_buffer(void)
 
 uint kc_dropped_frames_count(void)
 {
-    return 0;
+    return (
+        NUM_FRAMES_OVERWRITTEN +
+        NUM_MJPEG_FRAMES_DROPPED +
+        (MJPEG_DECODER? MJPEG_DECODER->num_frames_dropped() : 0)
+    );
 }
 
 bool kc_release_device(void)
@@ -0,0 +1,259 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cstring>
+#include "capture/generic_v4l/mjpeg_decoder.h"
+
+mjpeg_decoder_c::mjpeg_decoder_c(const unsigned numThreads, frame_callback_t onFrameDecoded) :
+    onFrameDecoded(onFrameDecoded)
+{
+    // Each worker can be decoding one frame while another waits to be delivered
+    // and a third is being shown by VCS.
+    // The slots' pixel buffers are allocated by the workers, sized for the frames
+    // they decode.
+    this->slots.resize(numThreads + 2);
+
+    for (unsigned i = 0; i < numThreads; i++)
+    {
+        this->workers.emplace_back(&mjpeg_decoder_c::worker_thread, this);
+    }
+
+    return;
+}
+
+mjpeg_decoder_c::~mjpeg_decoder_c()
+{
+    this->stop();
+
+    return;
+}
+
+void mjpeg_decoder_c::stop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->isStopping = true;
+    }
+
+    this->jobAvailable.notify_all();
+
+    for (std::thread &worker: this->workers)
+    {
+        worker.join();
+    }
+
+    this->workers.clear();
+
+    return;
+}
+
+bool mjpeg_decoder_c::submit(const uint8_t *const jpeg, const unsigned numBytes, const std::chrono::steady_clock::time_point &timestamp, const uint32_t deviceSequence)
+{
+    slot_s *slot = nullptr;
+    unsigned slotIdx = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        for (; slotIdx < this->slots.size(); slotIdx++)
+        {
+            if (this->slots[slotIdx].state == slot_state_e::free)
+            {
+                slot = &this->slots[slotIdx];
+                break;
+            }
+        }
+
+        if (!slot)
+        {
+            this->numDropped++;
+            this->totalNumDropped++;
+            return false;
+        }
+
+        slot->state = slot_state_e::queued;
+        slot->sequence = this->nextSubmittedSequence++;
+        slot->timestamp = timestamp;
+        slot->deviceSequence = deviceSequence;
+    }
+
+    // The slot now belongs to this thread until it's given to a worker, so the
+    // data can be copied without holding the lock.
+    slot->jpeg.assign(jpeg, (jpeg + numBytes));
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->jobs.push_back(slotIdx);
+    }
+
+    this->jobAvailable.notify_one();
+
+    return true;
+}
+
+void mjpeg_decoder_c::worker_thread(void)
+{
+    // Decoded pixels, before their conversion into BGRA. Reused across frames.
+    cv::Mat bgrImage;
+
+    while (true)
+    {
+        slot_s *slot = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->jobAvailable.wait(lock, [this]{return (this->isStopping || !this->jobs.empty());});
+
+            if (this->isStopping)
+            {
+                return;
+            }
+
+            slot = &this->slots[this->jobs.front()];
+            this->jobs.pop_front();
+        }
+
+        const auto startTime = std::chrono::steady_clock::now();
+        bool isDecoded = false;
+
+        try
+        {
+            cv::imdecode(cv::Mat(1, slot->jpeg.size(), CV_8UC1, slot->jpeg.data()), cv::IMREAD_COLOR, &bgrImage);
+
+            if (
+                !bgrImage.empty() &&
+                (unsigned(bgrImage.cols) <= MAX_CAPTURE_WIDTH) &&
+                (unsigned(bgrImage.rows) <= MAX_CAPTURE_HEIGHT)
+            ){
+                const unsigned numBytes = (bgrImage.total() * 4);
+
+                // The slot is free of VCS's use while queued, so its buffer can
+                // be reallocated.
+                if (slot->numPixelBytes < numBytes)
+                {
+                    slot->pixels.reset(new uint8_t[numBytes]);
+                    slot->numPixelBytes = numBytes;
+                }
+
+                cv::Mat dstImage(bgrImage.rows, bgrImage.cols, CV_8UC4, slot->pixels.get());
+                cv::cvtColor(bgrImage, dstImage, cv::COLOR_BGR2BGRA);
+                slot->resolution = {.w = unsigned(bgrImage.cols), .h = unsigned(bgrImage.rows)};
+                isDecoded = true;
+            }
+        }
+        catch (const cv::Exception&)
+        {
+            isDecoded = false;
+        }
+
+        const unsigned decodeUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+        this->sumDecodeUs += decodeUs;
+        (isDecoded? this->numDecoded : this->numFailed)++;
+
+        for (unsigned maxDecodeUs = this->maxDecodeUs.load(); decodeUs > maxDecodeUs;)
+        {
+            if (this->maxDecodeUs.compare_exchange_weak(maxDecodeUs, decodeUs))
+            {
+                break;
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            slot->state = (isDecoded? slot_state_e::decoded : slot_state_e::failed);
+            this->deliver_decoded_frames(lock);
+        }
+    }
+}
+
+void mjpeg_decoder_c::deliver_decoded_frames(std::unique_lock<std::mutex> &lock)
+{
+    // Another worker is delivering frames, and will deliver these too once it's
+    // done with its current one.
+    if (this->isDelivering)
+    {
+        return;
+    }
+
+    this->isDelivering = true;
+
+    while (true)
+    {
+        auto slot = std::find_if(this->slots.begin(), this->slots.end(), [this](const slot_s &s)
+        {
+            return (
+                (s.sequence == this->nextDeliveredSequence) &&
+                ((s.state == slot_state_e::decoded) || (s.state == slot_state_e::failed))
+            );
+        });
+
+        if (slot == this->slots.end())
+        {
+            break;
+        }
+
+        if (slot->state == slot_state_e::decoded)
+        {
+            slot->state = slot_state_e::delivering;
+
+            // The callback may wait on other locks (e.g. the capture mutex), so
+            // it's called without holding ours, which would hold up submit().
+            lock.unlock();
+            this->onFrameDecoded(slot->pixels.get(), slot->resolution, slot->timestamp, slot->deviceSequence);
+            lock.lock();
+
+            // The previously delivered frame is no longer in use.
+            for (slot_s &s: this->slots)
+            {
+                if (s.state == slot_state_e::published)
+                {
+                    s.state = slot_state_e::free;
+                }
+            }
+
+            slot->state = slot_state_e::published;
+        }
+        else
+        {
+            slot->state = slot_state_e::free;
+        }
+
+        this->nextDeliveredSequence++;
+    }
+
+    this->isDelivering = false;
+
+    return;
+}
+
+mjpeg_decoder_c::stats_s mjpeg_decoder_c::take_stats(void)
+{
+    const unsigned numDecoded = this->numDecoded.exchange(0);
+    const unsigned numFailed = this->numFailed.exchange(0);
+    const uint64_t sumDecodeUs = this->sumDecodeUs.exchange(0);
+
+    return {
+        .numDecoded = numDecoded,
+        .numFailed = numFailed,
+        .numDropped = this->numDropped.exchange(0),
+        .averageDecodeUs = unsigned((numDecoded + numFailed)? (sumDecodeUs / (numDecoded + numFailed)) : 0),
+        .maxDecodeUs = this->maxDecodeUs.exchange(0),
+    };
+}
+
+unsigned mjpeg_decoder_c::num_threads(void) const
+{
+    return (this->slots.size() - 2);
+}
+
+unsigned mjpeg_decoder_c::num_frames_dropped(void) const
+{
+    return this->totalNumDropped;
+}
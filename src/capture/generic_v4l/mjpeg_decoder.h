@@ -0,0 +1,117 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * Decodes a stream of MJPEG frames on a pool of worker threads, delivering the
+ * decoded frames in their original order. Used by the generic V4L capture
+ * backend for devices that reach their full frame rate only in MJPEG, whose
+ * decoding on the capture thread would cap the frame rate.
+ *
+ */
+
+#ifndef VCS_CAPTURE_GENERIC_V4L_MJPEG_DECODER_H
+#define VCS_CAPTURE_GENERIC_V4L_MJPEG_DECODER_H
+
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "capture/capture.h"
+
+class mjpeg_decoder_c
+{
+public:
+    // Called, from a worker thread, with each successfully decoded frame, in the
+    // order in which the frames were submitted. The pixels are BGRA and remain
+    // valid until the callback is next called, or the decoder is destroyed. The
+    // timestamp and device sequence number are those given to submit().
+    typedef std::function<void(uint8_t *const pixels, const resolution_s &resolution, const std::chrono::steady_clock::time_point &timestamp, const uint32_t deviceSequence)> frame_callback_t;
+
+    // Decoding statistics accumulated since the previous call to take_stats().
+    struct stats_s
+    {
+        unsigned numDecoded;
+        unsigned numFailed;
+        unsigned numDropped;
+        unsigned averageDecodeUs;
+        unsigned maxDecodeUs;
+    };
+
+    mjpeg_decoder_c(const unsigned numThreads, frame_callback_t onFrameDecoded);
+    ~mjpeg_decoder_c();
+
+    // Queues the given compressed frame for decoding. The data are copied, so the
+    // caller can reuse its buffer on return. Returns false if the frame had to be
+    // dropped because the workers were busy; true otherwise.
+    bool submit(const uint8_t *const jpeg, const unsigned numBytes, const std::chrono::steady_clock::time_point &timestamp, const uint32_t deviceSequence);
+
+    // Stops the worker threads, after which no more frames will be delivered.
+    void stop(void);
+
+    stats_s take_stats(void);
+
+    unsigned num_threads(void) const;
+
+    unsigned num_frames_dropped(void) const;
+
+private:
+    enum class slot_state_e
+    {
+        free,
+        queued,
+        decoded,
+        failed,
+        delivering,
+        published,
+    };
+
+    struct slot_s
+    {
+        slot_state_e state = slot_state_e::free;
+        uint64_t sequence = 0;
+        std::vector<uint8_t> jpeg;
+        std::unique_ptr<uint8_t[]> pixels;
+        unsigned numPixelBytes = 0;
+        resolution_s resolution;
+        std::chrono::steady_clock::time_point timestamp;
+        uint32_t deviceSequence = 0;
+    };
+
+    void worker_thread(void);
+
+    // Delivers, in order, the frames whose turn it is. Should be called with the
+    // given lock on the mutex held; the lock is released while the frame callback
+    // runs. Only one worker delivers frames at a time.
+    void deliver_decoded_frames(std::unique_lock<std::mutex> &lock);
+
+    const frame_callback_t onFrameDecoded;
+
+    std::vector<slot_s> slots;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<unsigned> jobs;
+    bool isStopping = false;
+
+    // Set while a worker is delivering frames.
+    bool isDelivering = false;
+
+    uint64_t nextSubmittedSequence = 0;
+    uint64_t nextDeliveredSequence = 0;
+
+    std::atomic<unsigned> numDecoded = 0;
+    std::atomic<unsigned> numFailed = 0;
+    std::atomic<unsigned> numDropped = 0;
+    std::atomic<unsigned> totalNumDropped = 0;
+    std::atomic<uint64_t> sumDecodeUs = 0;
+    std::atomic<unsigned> maxDecodeUs = 0;
+};
+
+#endif
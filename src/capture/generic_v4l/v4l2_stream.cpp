@@ -0,0 +1,406 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "capture/generic_v4l/v4l2_stream.h"
+#include "capture/v4l_timestamp.h"
+#include "common/globals.h"
+
+v4l2_stream_c::~v4l2_stream_c()
+{
+    this->close();
+
+    return;
+}
+
+bool v4l2_stream_c::device_ioctl(const unsigned long request, void *data)
+{
+    int retVal;
+
+    do
+    {
+        retVal = ioctl(this->fd, request, data);
+    } while ((retVal < 0) && (errno == EINTR));
+
+    return (retVal >= 0);
+}
+
+bool v4l2_stream_c::is_open(void) const
+{
+    return (this->fd >= 0);
+}
+
+// Asks the device to use the given pixel format at the given resolution (or, if
+// the resolution is 0 x 0, at its current one). Returns true and sets the format
+// the device agreed to if it accepted the pixel format; false otherwise.
+bool v4l2_stream_c::try_format(const uint32_t v4l2Format, const resolution_s &resolution, v4l2_format *const format)
+{
+    *format = {};
+    format->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    if (!this->device_ioctl(VIDIOC_G_FMT, format))
+    {
+        return false;
+    }
+
+    if (resolution.w && resolution.h)
+    {
+        format->fmt.pix.width = resolution.w;
+        format->fmt.pix.height = resolution.h;
+    }
+
+    format->fmt.pix.pixelformat = v4l2Format;
+    format->fmt.pix.field = V4L2_FIELD_NONE;
+
+    return (
+        this->device_ioctl(VIDIOC_S_FMT, format) &&
+        (format->fmt.pix.pixelformat == v4l2Format) &&
+        (format->fmt.pix.width <= MAX_CAPTURE_WIDTH) &&
+        (format->fmt.pix.height <= MAX_CAPTURE_HEIGHT)
+    );
+}
+
+// Returns the highest frame rate the device reports for the given pixel format
+// at the given resolution, or ~0 if the device doesn't report it.
+unsigned v4l2_stream_c::max_frame_rate(const uint32_t v4l2Format, const resolution_s &resolution)
+{
+    v4l2_frmivalenum interval = {};
+    interval.pixel_format = v4l2Format;
+    interval.width = resolution.w;
+    interval.height = resolution.h;
+
+    unsigned maxFps = 0;
+    bool anyEnumerated = false;
+
+    for (; this->device_ioctl(VIDIOC_ENUM_FRAMEINTERVALS, &interval); interval.index++)
+    {
+        anyEnumerated = true;
+
+        // For stepwise and continuous intervals, the first entry gives the range.
+        const v4l2_fract &shortest = (
+            (interval.type == V4L2_FRMIVAL_TYPE_DISCRETE)
+            ? interval.discrete
+            : interval.stepwise.min
+        );
+
+        if (shortest.numerator)
+        {
+            maxFps = std::max(maxFps, (shortest.denominator / shortest.numerator));
+        }
+
+        if (interval.type != V4L2_FRMIVAL_TYPE_DISCRETE)
+        {
+            break;
+        }
+    }
+
+    return (anyEnumerated? maxFps : ~0u);
+}
+
+bool v4l2_stream_c::negotiate_format(const resolution_s &resolution, const unsigned fps)
+{
+    // The supported uncompressed formats in order of preference, with their V4L2
+    // codes.
+    static const std::pair<pixel_format_e, uint32_t> uncompressedFormats[] = {
+        {pixel_format_e::bgr32, V4L2_PIX_FMT_XBGR32},
+        {pixel_format_e::bgr32, V4L2_PIX_FMT_BGR32},
+        {pixel_format_e::yuyv, V4L2_PIX_FMT_YUYV},
+        {pixel_format_e::nv12, V4L2_PIX_FMT_NV12},
+    };
+
+    std::vector<uint32_t> deviceFormats;
+    {
+        v4l2_fmtdesc formatDesc = {};
+        formatDesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+        while (this->device_ioctl(VIDIOC_ENUM_FMT, &formatDesc))
+        {
+            deviceFormats.push_back(formatDesc.pixelformat);
+            formatDesc.index++;
+        }
+    }
+
+    const auto is_offered = [&deviceFormats](const uint32_t v4l2Format)
+    {
+        return (std::find(deviceFormats.begin(), deviceFormats.end(), v4l2Format) != deviceFormats.end());
+    };
+
+    const auto use_format = [this](const pixel_format_e vcsFormat, const v4l2_format &format)
+    {
+        this->streamPixelFormat = vcsFormat;
+        this->streamResolution = {.w = format.fmt.pix.width, .h = format.fmt.pix.height};
+        this->streamBytesPerLine = format.fmt.pix.bytesperline;
+    };
+
+    v4l2_format format;
+    const bool isMjpegOffered = is_offered(V4L2_PIX_FMT_MJPEG);
+    std::pair<pixel_format_e, uint32_t> slowFormat = {pixel_format_e::mjpeg, 0};
+
+    for (const auto &[vcsFormat, v4l2Format]: uncompressedFormats)
+    {
+        if (!is_offered(v4l2Format) || !this->try_format(v4l2Format, resolution, &format))
+        {
+            continue;
+        }
+
+        const resolution_s formatResolution = {.w = format.fmt.pix.width, .h = format.fmt.pix.height};
+
+        if (!isMjpegOffered || (this->max_frame_rate(v4l2Format, formatResolution) >= fps))
+        {
+            use_format(vcsFormat, format);
+            return true;
+        }
+        else if (!slowFormat.second)
+        {
+            slowFormat = {vcsFormat, v4l2Format};
+        }
+    }
+
+    if (isMjpegOffered && this->try_format(V4L2_PIX_FMT_MJPEG, resolution, &format))
+    {
+        use_format(pixel_format_e::mjpeg, format);
+        return true;
+    }
+
+    // Fall back to an uncompressed format that's slower than requested.
+    if (slowFormat.second && this->try_format(slowFormat.second, resolution, &format))
+    {
+        use_format(slowFormat.first, format);
+        return true;
+    }
+
+    return false;
+}
+
+bool v4l2_stream_c::allocate_buffers(const unsigned numBuffers)
+{
+    v4l2_requestbuffers request = {};
+    request.count = std::max(2u, numBuffers);
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+
+    if (!this->device_ioctl(VIDIOC_REQBUFS, &request))
+    {
+        NBENE(("V4L2 MMAP streaming couldn't be initialized (error %d).", errno));
+        return false;
+    }
+
+    for (unsigned i = 0; i < request.count; i++)
+    {
+        v4l2_buffer buffer = {};
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+
+        if (!this->device_ioctl(VIDIOC_QUERYBUF, &buffer))
+        {
+            NBENE(("Failed to query V4L2 buffer #%u (error %d).", i, errno));
+            return false;
+        }
+
+        void *const ptr = mmap(nullptr, buffer.length, PROT_READ, MAP_SHARED, this->fd, buffer.m.offset);
+
+        if (ptr == MAP_FAILED)
+        {
+            NBENE(("Failed to map V4L2 buffer #%u.", i));
+            return false;
+        }
+
+        this->buffers.push_back({(uint8_t*)ptr, buffer.length});
+
+        if (!this->device_ioctl(VIDIOC_QBUF, &buffer))
+        {
+            NBENE(("Failed to enqueue V4L2 buffer #%u (error %d).", i, errno));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void v4l2_stream_c::release_buffers(void)
+{
+    for (const auto &buffer: this->buffers)
+    {
+        munmap(buffer.ptr, buffer.length);
+    }
+
+    this->buffers.clear();
+
+    v4l2_requestbuffers request = {};
+    request.count = 0; // 0 releases all buffers.
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    this->device_ioctl(VIDIOC_REQBUFS, &request);
+
+    return;
+}
+
+bool v4l2_stream_c::open(const unsigned deviceIndex, const resolution_s &resolution, const unsigned fps, const unsigned numBuffers)
+{
+    this->close();
+
+    const std::string deviceFilename = ("/dev/video" + std::to_string(deviceIndex));
+    this->fd = ::open(deviceFilename.c_str(), (O_RDWR | O_NONBLOCK));
+
+    if (this->fd < 0)
+    {
+        return false;
+    }
+
+    v4l2_capability caps = {};
+
+    if (!this->device_ioctl(VIDIOC_QUERYCAP, &caps) ||
+        !(caps.capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
+        !(caps.capabilities & V4L2_CAP_STREAMING))
+    {
+        DEBUG(("%s doesn't support V4L2 streaming capture.", deviceFilename.c_str()));
+        goto fail;
+    }
+
+    if (!this->negotiate_format(resolution, fps))
+    {
+        DEBUG(("%s doesn't offer a pixel format supported for native V4L2 capture.", deviceFilename.c_str()));
+        goto fail;
+    }
+
+    if (fps)
+    {
+        this->set_frame_rate(fps);
+    }
+
+    if (!this->allocate_buffers(numBuffers))
+    {
+        goto fail;
+    }
+
+    {
+        v4l2_buf_type bufferType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+        if (!this->device_ioctl(VIDIOC_STREAMON, &bufferType))
+        {
+            NBENE(("Couldn't start the V4L2 stream on %s (error %d).", deviceFilename.c_str(), errno));
+            goto fail;
+        }
+
+        this->isStreaming = true;
+        this->hasPrevSequence = false;
+    }
+
+    INFO((
+        "Capturing natively via V4L2 on %s at %u x %u.",
+        deviceFilename.c_str(),
+        this->streamResolution.w,
+        this->streamResolution.h
+    ));
+
+    return true;
+
+    fail:
+    this->close();
+    return false;
+}
+
+void v4l2_stream_c::close(void)
+{
+    if (!this->is_open())
+    {
+        return;
+    }
+
+    if (this->isStreaming)
+    {
+        v4l2_buf_type bufferType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        this->device_ioctl(VIDIOC_STREAMOFF, &bufferType);
+        this->isStreaming = false;
+    }
+
+    this->release_buffers();
+
+    ::close(this->fd);
+    this->fd = -1;
+
+    return;
+}
+
+bool v4l2_stream_c::dequeue(frame_s *const frame, const unsigned timeoutMs)
+{
+    pollfd pollFd = {};
+    pollFd.fd = this->fd;
+    pollFd.events = POLLIN;
+
+    if ((poll(&pollFd, 1, timeoutMs) <= 0) || !(pollFd.revents & POLLIN))
+    {
+        return false;
+    }
+
+    v4l2_buffer buffer = {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+
+    if (!this->device_ioctl(VIDIOC_DQBUF, &buffer) ||
+        (buffer.index >= this->buffers.size()))
+    {
+        return false;
+    }
+
+    frame->data = this->buffers[buffer.index].ptr;
+    frame->numBytes = buffer.bytesused;
+    frame->bufferIndex = buffer.index;
+    frame->timestamp = kv4l_buffer_timestamp(buffer);
+    frame->sequence = buffer.sequence;
+    frame->numFramesSkipped = (this->hasPrevSequence? (buffer.sequence - this->prevSequence - 1) : 0);
+
+    // Guard against drivers that don't increment the sequence number.
+    if (frame->numFramesSkipped > (UINT32_MAX / 2))
+    {
+        frame->numFramesSkipped = 0;
+    }
+
+    this->prevSequence = buffer.sequence;
+    this->hasPrevSequence = true;
+
+    return true;
+}
+
+bool v4l2_stream_c::requeue(const frame_s &frame)
+{
+    v4l2_buffer buffer = {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = frame.bufferIndex;
+
+    return this->device_ioctl(VIDIOC_QBUF, &buffer);
+}
+
+bool v4l2_stream_c::set_control(const uint32_t controlId, const int value)
+{
+    v4l2_control control = {};
+    control.id = controlId;
+    control.value = value;
+
+    return (this->is_open() && this->device_ioctl(VIDIOC_S_CTRL, &control));
+}
+
+bool v4l2_stream_c::set_frame_rate(const unsigned fps)
+{
+    v4l2_streamparm params = {};
+    params.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    params.parm.capture.timeperframe.numerator = 1;
+    params.parm.capture.timeperframe.denominator = fps;
+
+    return (this->is_open() && fps && this->device_ioctl(VIDIOC_S_PARM, &params));
+}
@@ -0,0 +1,117 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ * A minimal Video4Linux2 streaming interface for the generic V4L capture
+ * backend. Opens a /dev/videoX device, negotiates the cheapest pixel format the
+ * device offers from among those VCS can convert natively, and streams frames
+ * via mmap() buffers, handing them to the caller in the device's own memory.
+ *
+ * Uncompressed formats are preferred, unless the device can't deliver them at
+ * the requested frame rate and resolution but can deliver MJPEG.
+ *
+ */
+
+#ifndef VCS_CAPTURE_GENERIC_V4L_V4L2_STREAM_H
+#define VCS_CAPTURE_GENERIC_V4L_V4L2_STREAM_H
+
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include "capture/capture.h"
+
+struct v4l2_format;
+
+class v4l2_stream_c
+{
+public:
+    // Pixel formats the stream can deliver, in order of preference (cheapest to
+    // convert into VCS's BGRA first).
+    enum class pixel_format_e
+    {
+        bgr32,
+        yuyv,
+        nv12,
+        mjpeg,
+    };
+
+    // A frame dequeued from the device. Its data remain valid until the frame is
+    // given back to the device via requeue().
+    struct frame_s
+    {
+        const uint8_t *data = nullptr;
+        unsigned numBytes = 0;
+        unsigned bufferIndex = 0;
+
+        // When the device captured the frame, per the driver's timestamp, or the
+        // time of dequeuing if the driver's timestamps aren't monotonic.
+        std::chrono::steady_clock::time_point timestamp;
+
+        // The driver's sequence number for the frame.
+        uint32_t sequence = 0;
+
+        // The number of frames the device skipped between the previously dequeued
+        // frame and this one, as indicated by a gap in their sequence numbers.
+        unsigned numFramesSkipped = 0;
+    };
+
+    ~v4l2_stream_c();
+
+    // Opens /dev/video<deviceIndex> and starts streaming from it at the given
+    // resolution (or, if the resolution is 0 x 0, the device's current one) and
+    // frame rate. Returns false if the device can't be opened or doesn't offer
+    // any of the supported pixel formats; true otherwise.
+    bool open(const unsigned deviceIndex, const resolution_s &resolution, const unsigned fps, const unsigned numBuffers);
+
+    void close(void);
+
+    bool is_open(void) const;
+
+    // Waits up to the given number of milliseconds for the device to fill a
+    // buffer. Returns true and sets the frame on success; false on timeout or
+    // error.
+    bool dequeue(frame_s *const frame, const unsigned timeoutMs);
+
+    // Gives the given frame's buffer back to the device for refilling.
+    bool requeue(const frame_s &frame);
+
+    // Sets the value of the given V4L2 control (V4L2_CID_xxxx). Returns true on
+    // success; false otherwise.
+    bool set_control(const uint32_t controlId, const int value);
+
+    bool set_frame_rate(const unsigned fps);
+
+    const resolution_s& resolution(void) const { return this->streamResolution; }
+    pixel_format_e pixel_format(void) const { return this->streamPixelFormat; }
+    unsigned bytes_per_line(void) const { return this->streamBytesPerLine; }
+
+private:
+    bool device_ioctl(const unsigned long request, void *data);
+    bool negotiate_format(const resolution_s &resolution, const unsigned fps);
+    bool try_format(const uint32_t v4l2Format, const resolution_s &resolution, v4l2_format *const format);
+    unsigned max_frame_rate(const uint32_t v4l2Format, const resolution_s &resolution);
+    bool allocate_buffers(const unsigned numBuffers);
+    void release_buffers(void);
+
+    int fd = -1;
+    bool isStreaming = false;
+
+    // The sequence number of the most recently dequeued frame, if any has been
+    // dequeued since the stream was started.
+    uint32_t prevSequence = 0;
+    bool hasPrevSequence = false;
+
+    resolution_s streamResolution = {.w = 0, .h = 0};
+    pixel_format_e streamPixelFormat = pixel_format_e::bgr32;
+    unsigned streamBytesPerLine = 0;
+
+    struct mmap_buffer_s
+    {
+        uint8_t *ptr;
+        unsigned length;
+    };
+    std::vector<mmap_buffer_s> buffers;
+};
+
+#endif
@@ -5,14 +5,29 @@
  *
  */
 
+/*
+ * The live preview runs on two threads: a fetch thread requests preview images
+ * from the camera, handing each one's JPEG data off to a decode thread and then
+ * immediately requesting the next, so that the USB transfer of one image
+ * overlaps the decoding of the previous. If the decode thread falls behind, it
+ * skips to the most recent image.
+ *
+ */
+
+#include <condition_variable>
 #include <future>
 #include <chrono>
+#include <mutex>
 #include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #include <gphoto2/gphoto2.h>
 #include "common/timer/timer.h"
+#include "capture/capture_event_flags.h"
 #include "capture/capture.h"
+#include "capture/device_properties.h"
+#include "scaler/scaler.h"
 
-static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
+static device_properties_c DEVICE_PROPERTIES = {
     {"api name", intptr_t("gPhoto2")},
     {"has signal", false},
     {"supports live preview", false},
@@ -28,21 +43,35 @@ static GPContext *GP_CONTEXT;
 
 static unsigned NUM_FRAMES_PER_SECOND = 0;
 static captured_frame_s LOCAL_FRAME_BUFFER = {.pixels = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]()};
-static std::vector<unsigned> CAPTURE_FLAGS(static_cast<unsigned>(capture_event_e::num_enumerators));
+static capture_event_flags_c CAPTURE_EVENTS;
 
 static std::future<void> LIVE_PREVIEW_THREAD;
+static std::future<void> DECODE_THREAD;
 static std::atomic<bool> RUN_LIVE_PREVIEW_LOOP = false;
 
+// The JPEG data of the most recently fetched preview image, waiting to be decoded.
+static std::mutex PENDING_IMAGE_MUTEX;
+static std::condition_variable PENDING_IMAGE_AVAILABLE;
+static std::vector<uint8_t> PENDING_IMAGE;
+static bool IS_PENDING_IMAGE_NEW = false;
+
+// Preview images fetched but replaced by a newer one before they could be decoded.
+static std::atomic<unsigned> NUM_PREVIEW_IMAGES_SKIPPED = 0;
+
+// If the scaler's output resolution is fixed, the resolution below which preview
+// images shouldn't be reduced when decoding; otherwise, 0 x 0, in which case the
+// images are decoded at full size.
+static std::atomic<unsigned> MIN_DECODE_WIDTH = 0;
+static std::atomic<unsigned> MIN_DECODE_HEIGHT = 0;
+
 static void push_event(capture_event_e flag)
 {
-    CAPTURE_FLAGS[int(flag)] = true;
+    CAPTURE_EVENTS.push(flag);
 }
 
 static bool pop_event(const capture_event_e flag)
 {
-    const bool flagValue = CAPTURE_FLAGS[int(flag)];
-    CAPTURE_FLAGS[int(flag)] = false;
-    return flagValue;
+    return CAPTURE_EVENTS.pop(flag);
 }
 
 static std::string get_config_value(const std::string &name)
@@ -129,6 +158,158 @@ static void initialize_camera(void)
     kc_set_device_property("supports taking photo", does_camera_support_feature(GP_OPERATION_CAPTURE_IMAGE));
 }
 
+// Reads the resolution of the given JPEG image from its frame header into the
+// given resolution. Returns false if the image has no valid frame header; true
+// otherwise.
+static bool jpeg_resolution(const std::vector<uint8_t> &jpeg, resolution_s *const dst)
+{
+    if ((jpeg.size() < 4) || (jpeg[0] != 0xff) || (jpeg[1] != 0xd8))
+    {
+        return false;
+    }
+
+    // Walk the segments following the start-of-image marker until the start of
+    // frame (SOF0-SOF15, excluding the DHT, JPG and DAC markers that share the
+    // range), whose payload gives the image's height and width.
+    for (size_t i = 2; (i + 4) <= jpeg.size();)
+    {
+        if (jpeg[i] != 0xff)
+        {
+            return false;
+        }
+
+        const uint8_t marker = jpeg[i + 1];
+
+        // Fill bytes.
+        if (marker == 0xff)
+        {
+            i++;
+            continue;
+        }
+
+        // Markers without a payload.
+        if ((marker == 0x01) || ((marker >= 0xd0) && (marker <= 0xd7)))
+        {
+            i += 2;
+            continue;
+        }
+
+        // Start of scan or end of image without a frame header.
+        if ((marker == 0xda) || (marker == 0xd9))
+        {
+            return false;
+        }
+
+        const unsigned segmentLength = ((jpeg[i + 2] << 8) | jpeg[i + 3]);
+
+        if (
+            (marker >= 0xc0) &&
+            (marker <= 0xcf) &&
+            (marker != 0xc4) &&
+            (marker != 0xc8) &&
+            (marker != 0xcc)
+        ){
+            if ((i + 9) > jpeg.size())
+            {
+                return false;
+            }
+
+            dst->h = ((jpeg[i + 5] << 8) | jpeg[i + 6]);
+            dst->w = ((jpeg[i + 7] << 8) | jpeg[i + 8]);
+
+            return (dst->w && dst->h);
+        }
+
+        i += (2 + segmentLength);
+    }
+
+    return false;
+}
+
+// Returns the IMREAD_xxxx flag for decoding a JPEG image of the given resolution
+// at the smallest scale that's no smaller than the minimum decode resolution.
+static int decode_flag(const resolution_s &jpegResolution)
+{
+    const unsigned minWidth = MIN_DECODE_WIDTH;
+    const unsigned minHeight = MIN_DECODE_HEIGHT;
+
+    if (minWidth && minHeight)
+    {
+        for (const auto &[divisor, flag]: {std::pair{8u, cv::IMREAD_REDUCED_COLOR_8}, {4u, cv::IMREAD_REDUCED_COLOR_4}, {2u, cv::IMREAD_REDUCED_COLOR_2}})
+        {
+            if (((jpegResolution.w / divisor) >= minWidth) && ((jpegResolution.h / divisor) >= minHeight))
+            {
+                return flag;
+            }
+        }
+    }
+
+    return cv::IMREAD_COLOR;
+}
+
+// Runs in its own thread, decoding the preview images fetched by capture_loop().
+static void decode_loop(void)
+{
+    // Scratch buffers reused across images.
+    std::vector<uint8_t> jpeg;
+    cv::Mat bgrImage;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(PENDING_IMAGE_MUTEX);
+            PENDING_IMAGE_AVAILABLE.wait(lock, []{return (IS_PENDING_IMAGE_NEW || !RUN_LIVE_PREVIEW_LOOP);});
+
+            if (!RUN_LIVE_PREVIEW_LOOP)
+            {
+                return;
+            }
+
+            std::swap(jpeg, PENDING_IMAGE);
+            IS_PENDING_IMAGE_NEW = false;
+        }
+
+        // Images whose resolution can't be read from their header are decoded at
+        // full size.
+        resolution_s jpegResolution = {.w = 0, .h = 0};
+        const int flag = (jpeg_resolution(jpeg, &jpegResolution)? decode_flag(jpegResolution) : cv::IMREAD_COLOR);
+        cv::imdecode(cv::Mat(1, jpeg.size(), CV_8UC1, jpeg.data()), flag, &bgrImage);
+
+        if (!bgrImage.data)
+        {
+            LOCK_CAPTURE_MUTEX_IN_SCOPE;
+            kc_set_device_property("has signal", false);
+            continue;
+        }
+
+        if ((unsigned(bgrImage.cols) > MAX_CAPTURE_WIDTH) || (unsigned(bgrImage.rows) > MAX_CAPTURE_HEIGHT))
+        {
+            continue;
+        }
+
+        LOCK_CAPTURE_MUTEX_IN_SCOPE;
+
+        if (
+            (kc_device_property(device_property_e::width) != bgrImage.cols) ||
+            (kc_device_property(device_property_e::height) != bgrImage.rows)
+        ){
+            push_event(capture_event_e::new_video_mode);
+        }
+
+        kc_set_device_property("width", bgrImage.cols);
+        kc_set_device_property("height", bgrImage.rows);
+
+        push_event(capture_event_e::new_frame);
+
+        cv::Mat frameBuffer(bgrImage.rows, bgrImage.cols, CV_8UC4, LOCAL_FRAME_BUFFER.pixels);
+        cv::cvtColor(bgrImage, frameBuffer, cv::COLOR_BGR2BGRA);
+
+        LOCAL_FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
+    }
+}
+
+// Runs in its own thread, fetching preview images from the camera for
+// decode_loop() to decode.
 static void capture_loop(void)
 {
     CameraFile *file = nullptr;
@@ -145,58 +326,43 @@ static void capture_loop(void)
             default: continue;
         }
 
-        LOCK_CAPTURE_MUTEX_IN_SCOPE;
-        kc_set_device_property("has signal", true);
-
         // An error of some kind occurred.
         if (GP_OK > gp_file_get_data_and_size(file, &rawImageData, &rawImageDataLen))
         {
+            LOCK_CAPTURE_MUTEX_IN_SCOPE;
             kc_set_device_property("has signal", false);
             continue;
         }
 
-        const cv::Mat image = cv::imdecode(cv::Mat(1, rawImageDataLen, CV_8UC1, (char*)rawImageData), cv::IMREAD_COLOR);
-
-        if (!image.data)
         {
-            kc_set_device_property("has signal", false);
-            continue;
-        }
-
-        if (
-            (kc_device_property("width") != image.cols) ||
-            (kc_device_property("height") != image.rows)
-        ){
-            push_event(capture_event_e::new_video_mode);
+            LOCK_CAPTURE_MUTEX_IN_SCOPE;
+            kc_set_device_property("has signal", true);
         }
 
-        kc_set_device_property("width", image.cols);
-        kc_set_device_property("height", image.rows);
-
-        push_event(capture_event_e::new_frame);
-
-        for (unsigned y = 0; y < image.rows; y++)
         {
-            for (unsigned x = 0; x < image.cols; x++)
-            {
-                const unsigned srcIdx = (((x % image.cols) + (y % image.rows) * image.cols) * 3);
-                const unsigned dstIdx = ((x + y * image.cols) * 4);
+            std::lock_guard<std::mutex> lock(PENDING_IMAGE_MUTEX);
 
-                for (unsigned c = 0; c < 3; c++)
-                {
-                    LOCAL_FRAME_BUFFER.pixels[dstIdx+c] = image.data[srcIdx+c];
-                }
+            if (IS_PENDING_IMAGE_NEW)
+            {
+                NUM_PREVIEW_IMAGES_SKIPPED++;
             }
+
+            PENDING_IMAGE.assign(rawImageData, (rawImageData + rawImageDataLen));
+            IS_PENDING_IMAGE_NEW = true;
         }
 
-        LOCAL_FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
+        PENDING_IMAGE_AVAILABLE.notify_one();
     }
+
+    gp_file_unref(file);
 }
 
 static void start_live_preview(void)
 {
     RUN_LIVE_PREVIEW_LOOP = true;
+    IS_PENDING_IMAGE_NEW = false;
     LIVE_PREVIEW_THREAD = std::async(std::launch::async, capture_loop);
+    DECODE_THREAD = std::async(std::launch::async, decode_loop);
 }
 
 static void stop_live_preview(void)
@@ -206,13 +372,23 @@ static void stop_live_preview(void)
         return;
     }
 
-    RUN_LIVE_PREVIEW_LOOP = false;
+    {
+        std::lock_guard<std::mutex> lock(PENDING_IMAGE_MUTEX);
+        RUN_LIVE_PREVIEW_LOOP = false;
+    }
+
+    PENDING_IMAGE_AVAILABLE.notify_all();
 
     if (LIVE_PREVIEW_THREAD.valid())
     {
         LIVE_PREVIEW_THREAD.wait();
     }
 
+    if (DECODE_THREAD.valid())
+    {
+        DECODE_THREAD.wait();
+    }
+
     gp_camera_exit(CAMERA, GP_CONTEXT);
 }
 
@@ -311,6 +487,16 @@ void kc_initialize_device(void)
         NUM_FRAMES_PER_SECOND++;
     });
 
+    // Whether the output resolution is fixed can change without the resolution
+    // itself changing (e.g. when a custom output scaler becomes active), so the
+    // minimum decode resolution is updated with each output image.
+    ev_new_output_image.listen([](const image_s &image)
+    {
+        const bool isFixed = ks_is_output_resolution_fixed();
+        MIN_DECODE_WIDTH = (isFixed? image.resolution.w : 0);
+        MIN_DECODE_HEIGHT = (isFixed? image.resolution.h : 0);
+    });
+
     // Create some custom GUI entries in VCS's control panel.
     {
         // Camera.
@@ -464,9 +650,14 @@ void kc_initialize_device(void)
     return;
 }
 
+intptr_t kc_device_property(const device_property_e property)
+{
+    return DEVICE_PROPERTIES.value(property);
+}
+
 intptr_t kc_device_property(const std::string &key)
 {
-    return (DEVICE_PROPERTIES.contains(key)? DEVICE_PROPERTIES.at(key) : 0);
+    return DEVICE_PROPERTIES.value(key);
 }
 
 bool kc_set_device_property(const std::string &key, intptr_t value)
@@ -497,12 +688,12 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
     }
     else if (
         (key == "has signal") &&
-        (DEVICE_PROPERTIES[key] != value)
+        (DEVICE_PROPERTIES.value(key) != value)
     ){
         push_event(value? capture_event_e::signal_gained : capture_event_e::signal_lost);
     }
 
-    DEVICE_PROPERTIES[key] = value;
+    DEVICE_PROPERTIES.set(key, value);
 
     return true;
 }
@@ -556,7 +747,7 @@ const captured_frame_s& kc_frame_buffer(void)
 
 uint kc_dropped_frames_count(void)
 {
-    return 0;
+    return NUM_PREVIEW_IMAGES_SKIPPED;
 }
 
 bool kc_release_device(void)
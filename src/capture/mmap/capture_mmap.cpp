@@ -19,31 +19,128 @@
  *   4:  uint16_t  The maximum width the SCREEN buffer can hold. Set by VCS.
  *   6:  uint16_t  The maximum height the SCREEN buffer can hold. Set by VCS.
  *   8:  uint16_t  Capture flag. Set to 1 by the application when it has made a new frame available via the SCREEN buffer; set to 0 by VCS when it has received the frame. The application shouldn't modify the SCREEN buffer while this has a value of 1.
- *   10: uint16_t  Number of frames the application attempted to share with VCS while the value of the capture flag was 1. This is effectively a count of dropped frames.
+ *   10: uint16_t  Number of frames the application attempted to share with VCS while the value of the capture flag was 1. This is effectively a count of dropped frames. In protocol version 3+, a running count, wrapping around at 65536, of frames the application published over an unreceived frame.
+ *   12: uint16_t  The highest version of this protocol that VCS supports. Set by VCS.
+ *   14: uint16_t  The version of this protocol that the application uses; 0 or 1 for the original protocol. Set by the application.
+ *   16: uint32_t  Doorbell (protocol version 2+). A futex word that the application increments, and then wakes with FUTEX_WAKE, after making a new frame available.
+ *   20: uint32_t  Ready slot (protocol version 3+). Bits 0-1 give the index of the SCREEN slot that's owned by neither party, and bit 31 is set if that slot holds a frame VCS hasn't yet received. Initialized by VCS to 2.
+ *   24: uint16_t  The width and height, as 3 pairs of uint16_t, of the image in each SCREEN slot (protocol version 3+). Set by the application.
+ *   36: uint16_t  The pixel format, as 3 uint16_t, of the image in each SCREEN slot (protocol version 4+): 0 = 32-bit BGRA, 1 = 8-bit palettized, 2 = 16-bit RGB565, 3 = 16-bit RGB555. Set by the application.
+ *   42: uint16_t  The number of dirty rectangles, as 3 uint16_t, of the image in each SCREEN slot (protocol version 4+); 0 if the whole image is new, otherwise at most 16. Set by the application.
+ *   48: uint16_t  Full-frame request (protocol version 4+). Set to 1 by VCS when it needs the application's next frame to be published with no dirty rectangles; set to 0 by the application when it publishes such a frame.
+ *   50: uint16_t  The sequence number, as 3 uint16_t, of the image in each SCREEN slot (protocol version 4+). A running count, wrapping around at 65536, of the images the application has published. Set by the application.
+ *   56: uint16_t  The base sequence number, as 3 uint16_t, of the image in each SCREEN slot (protocol version 4+): the sequence number of the image that the slot's dirty rectangles update. Set by the application.
+ *   64: uint16_t  The dirty rectangles of each SCREEN slot (protocol version 4+), as 3 arrays of 16 rectangles of 4 uint16_t each: x, y, width, and height. Set by the application.
+ *   512: uint32_t The palettes of each SCREEN slot (protocol version 4+), as 3 arrays of 256 BGRA colors. Used for 8-bit palettized images. Set by the application.
+ *
+ * In protocol version 3+, the SCREEN buffer is divided into 3 slots, each the
+ * size of MAX_NUM_BYTES_IN_CAPTURED_FRAME and the first one being at the start
+ * of the buffer, where versions 1 and 2 have their single frame. At any time,
+ * the application owns one of the slots (the back slot, initially slot 1), VCS
+ * another (the front slot, initially slot 0), and the ready slot holds the index
+ * of the third. The application renders into its back slot and then atomically
+ * swaps the back slot with the ready slot; VCS in turn swaps its front slot with
+ * the ready slot when the latter has a new frame, and reads the frame in place.
+ * This way, the application never has to wait for VCS or drop frames because
+ * VCS is busy, and VCS doesn't need to copy the frame out of shared memory.
+ *
+ * Protocol version 4+ additionally lets the application publish images in a
+ * more compact pixel format than BGRA, and only the parts of each image that
+ * have changed since its previous image. The pixels of a slot's image are laid
+ * out row by row with no padding, each row being (width * bytes per pixel)
+ * bytes long; if the slot has dirty rectangles, only the pixels inside them
+ * need to be valid. VCS converts the pixels into BGRA, updating only the dirty
+ * rectangles of a copy of the previous image it received. Images that VCS
+ * can't update this way - e.g. the first image after VCS has started, or one
+ * whose base sequence number isn't that of the image VCS last received - are
+ * dropped, and VCS sets the full-frame request flag.
  *
  * How the application should use the interface (assuming STATUS is accessed as
  * an array of uint16_t):
  *
  *   1. Acquire the two shared buffer files, "vcs_mmap_status" and
- *      "vcs_mmap_screen", using shm_open() and mmap().
+ *      "vcs_mmap_screen", using shm_open() and mmap(). (The files are accessible
+ *      only to the user running VCS.) Then set STATUS[7] to the smaller of
+ *      STATUS[6] and the highest protocol version the application supports.
+ *
+ *   2. (Protocol versions 1 and 2.) On each render loop, check whether STATUS[4]
+ *      is 0. If it isn't, increment a local numFramesDropped variable and move
+ *      on - this represents a dropped frame. Otherwise, copy the frame buffer to
+ *      SCREEN, and set STATUS[5] to numFramesDropped, STATUS[0] and STATUS[1] to
+ *      the width and height of the frame buffer, and STATUS[4] to 1.
+ *
+ *   2. (Protocol version 3+.) On each render loop, copy the frame buffer into the
+ *      back slot, and set the slot's width and height in STATUS[12 + (slot * 2)]
+ *      and STATUS[13 + (slot * 2)]. Then atomically exchange the uint32_t at byte
+ *      20 of STATUS with the value (back slot index | 0x80000000), using release-
+ *      acquire ordering. The lower two bits of the previous value are the new
+ *      back slot; if the previous value had bit 31 set, increment STATUS[5].
  *
- *   2. On each render loop, check whether STATUS[4] is 0. If it isn't, increment
- *      a local numFramesDropped variable and move on - this represents a dropped
- *      frame. Otherwise, copy the frame buffer to SCREEN, and set STATUS[5] to
- *      numFramesDropped, STATUS[0] and STATUS[1] to the width and height of the
- *      frame buffer, and STATUS[4] to 1.
+ *      (Protocol version 4+.) Before the exchange, also set the slot's pixel
+ *      format, palette, and dirty rectangles, and copy only the pixels inside
+ *      the dirty rectangles. Set the slot's sequence number in STATUS[25 + slot]
+ *      to one more than that of the previously published image, and its base
+ *      sequence number in STATUS[28 + slot] to the sequence number of the
+ *      previously published image. If the previous frame was dropped or superseded
+ *      (i.e. its exchange returned a value with bit 31 set), or STATUS[24] is 1,
+ *      publish the whole frame with no dirty rectangles and set STATUS[24] to 0.
+ *
+ *   3. If using protocol version 2+, atomically increment the uint32_t at byte
+ *      16 of STATUS and call futex(FUTEX_WAKE) on it.
+ *
+ * Applications that don't ring the doorbell (protocol version 1) are still
+ * supported, but VCS will then poll the capture flag at intervals of about a
+ * millisecond, rather than sleeping until the application signals a new frame.
  *
  */
 
 #include <atomic>
 #include <future>
+#include <thread>
 #include <chrono>
 #include <cstring>
+#include <algorithm>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include "common/pixel_conversion/pixel_conversion.h"
+#include "common/futex/futex.h"
 #include "common/globals.h"
+#include "capture/capture_event_flags.h"
 #include "capture/capture.h"
+#include "capture/device_properties.h"
+
+// The highest version of the shared memory protocol that VCS supports.
+static const uint16_t PROTOCOL_VERSION = 4;
+
+// How long the capture thread waits on the doorbell before re-checking things.
+// Applications ring the doorbell on each new frame, so this only matters if one
+// has stopped producing frames.
+static const auto DOORBELL_TIMEOUT = std::chrono::milliseconds(250);
+
+// How often the capture thread polls the capture flag for applications that don't
+// use the doorbell.
+static const auto LEGACY_POLL_INTERVAL = std::chrono::milliseconds(1);
+
+// The number of frame slots in the SCREEN buffer in protocol version 3+.
+static const unsigned NUM_SCREEN_SLOTS = 3;
+
+// Flags the ready slot as holding a frame that VCS hasn't yet received.
+static const uint32_t READY_SLOT_IS_NEW = 0x80000000u;
+static const uint32_t READY_SLOT_INDEX_MASK = 0x3u;
+
+// The maximum number of dirty rectangles per slot in protocol version 4+.
+static const unsigned MAX_NUM_DIRTY_RECTS = 16;
+
+// Pixel formats of slot images in protocol version 4+.
+enum class pixel_format_e
+{
+    bgra,
+    pal8,
+    rgb565,
+    rgb555,
+    num_enumerators
+};
 
 namespace status
 {
@@ -55,6 +152,18 @@ namespace status
         max_height,
         new_frame_available,
         dropped_frames_count,
+        vcs_protocol_version,
+        app_protocol_version,
+        doorbell, // uint32_t; occupies two elements.
+        ready_slot = (doorbell + 2), // uint32_t; occupies two elements.
+        slot_resolutions = (ready_slot + 2), // 3 pairs of width and height.
+        slot_pixel_formats = (slot_resolutions + 6),
+        slot_num_dirty_rects = (slot_pixel_formats + 3),
+        full_frame_request = (slot_num_dirty_rects + 3),
+        slot_sequences = (full_frame_request + 1),
+        slot_base_sequences = (slot_sequences + 3),
+        dirty_rects = 32, // 3 arrays of 16 rectangles of x, y, width, and height.
+        palettes = 256, // 3 arrays of 256 uint32_t.
     };
 }
 
@@ -66,12 +175,13 @@ static struct shared_buffer
 
     void acquire(void)
     {
-        const int fd = shm_open(this->filename.c_str(), (O_RDWR | O_CREAT), 0666);
+        const int fd = shm_open(this->filename.c_str(), (O_RDWR | O_CREAT), 0600);
         k_assert((fd >= 0), "Failed to create the shared memory file.");
         const int ftrerr = ftruncate(fd, this->size);
         k_assert((ftrerr == 0), "Failed to initialize the shared memory file.");
-        this->_data = (uint16_t*)mmap(nullptr, this->size, 0666, MAP_SHARED, fd, 0);
-        k_assert(this->_data, "Failed to MMAP into the shared memory file.");
+        void *const memory = mmap(nullptr, this->size, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+        k_assert((memory != MAP_FAILED), "Failed to MMAP into the shared memory file.");
+        this->_data = (uint16_t*)memory;
     }
 
     uint16_t* data(void) const
@@ -89,27 +199,58 @@ static struct shared_buffer
     {
         return this->data()[valueEnum];
     }
+
+    uint32_t* doorbell(void) const
+    {
+        return reinterpret_cast<uint32_t*>(this->data() + status::doorbell);
+    }
+
+    uint32_t* ready_slot(void) const
+    {
+        return reinterpret_cast<uint32_t*>(this->data() + status::ready_slot);
+    }
+
+    const uint32_t* palette(const unsigned slot) const
+    {
+        return (reinterpret_cast<const uint32_t*>(this->data() + status::palettes) + (slot * 256));
+    }
 }
 MMAP_STATUS_BUFFER = {
     .filename = "vcs_mmap_status",
-    .size = 256,
+    .size = 4096,
 },
 MMAP_SCREEN_BUFFER = {
     .filename = "vcs_mmap_screen",
-    .size = MAX_NUM_BYTES_IN_CAPTURED_FRAME,
+    .size = (NUM_SCREEN_SLOTS * MAX_NUM_BYTES_IN_CAPTURED_FRAME),
 };
 
 static std::atomic<bool> RUN_CAPTURE_LOOP = {false};
 static std::future<int> CAPTURE_THREAD;
 static unsigned NUM_DROPPED_FRAMES = 0;
 static bool IS_VALID_SIGNAL = true;
-static bool CAPTURE_EVENT_FLAGS[(int)capture_event_e::num_enumerators];
+static capture_event_flags_c CAPTURE_EVENTS;
+static uint16_t NUM_SLOT_FRAMES_DROPPED = 0;
+static uint32_t FRONT_SLOT = 0;
+
+// Holds the received frame for protocol versions 1 and 2, and for images in
+// protocol version 4+ that have to be converted into BGRA or that have dirty
+// rectangles. Otherwise, the frame buffer points to VCS's front slot in the
+// SCREEN buffer.
+static uint8_t *const LOCAL_PIXELS = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]();
+
+// Whether LOCAL_PIXELS holds the most recent frame received, in which case the
+// next frame's dirty rectangles can be applied on top of it.
+static bool LOCAL_PIXELS_ARE_CURRENT = false;
+
+// The sequence number of the image most recently received into LOCAL_PIXELS.
+static uint16_t LOCAL_PIXELS_SEQUENCE = 0;
+
 static captured_frame_s FRAME_BUFFER = {
     .resolution = {.w = 640, .h = 480},
-    .pixels = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]()
+    .pixels = LOCAL_PIXELS
 };
 
-static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
+static device_properties_c DEVICE_PROPERTIES = {
     {"api name", intptr_t("MMAP")},
     {"width: minimum", MIN_CAPTURE_WIDTH},
     {"height: minimum", MIN_CAPTURE_HEIGHT},
@@ -120,64 +261,267 @@ static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
 
 static void push_capture_event(const capture_event_e event)
 {
-    CAPTURE_EVENT_FLAGS[(int)event] = true;
+    CAPTURE_EVENTS.push(event);
     return;
 }
 
 static bool pop_capture_event(const capture_event_e event)
 {
-    const bool oldFlagValue = CAPTURE_EVENT_FLAGS[(int)event];
-    CAPTURE_EVENT_FLAGS[(int)event] = false;
-    return oldFlagValue;
+    return CAPTURE_EVENTS.pop(event);
+}
+
+// Blocks until the application may have made a new frame available, or until
+// VCS wants the capture thread to notice something (e.g. that it should exit).
+static void wait_for_new_frame(const uint32_t doorbellValue)
+{
+    if (MMAP_STATUS_BUFFER(status::app_protocol_version) >= 2)
+    {
+        kfutex_wait(MMAP_STATUS_BUFFER.doorbell(), doorbellValue, DOORBELL_TIMEOUT);
+    }
+    else
+    {
+        std::this_thread::sleep_for(LEGACY_POLL_INTERVAL);
+    }
+
+    return;
+}
+
+// Rings the doorbell from VCS's side, waking up the capture thread.
+static void ring_doorbell(void)
+{
+    std::atomic_ref<uint32_t>(*MMAP_STATUS_BUFFER.doorbell()).fetch_add(1);
+    kfutex_wake(MMAP_STATUS_BUFFER.doorbell());
+
+    return;
+}
+
+// Updates the frame buffer's resolution for a new frame of the given resolution.
+// Returns false if the resolution is out of bounds; true otherwise. Should be
+// called with the capture mutex locked.
+static bool accept_frame_resolution(const unsigned frameWidth, const unsigned frameHeight)
+{
+    if ((frameWidth > MAX_CAPTURE_WIDTH) ||
+        (frameHeight > MAX_CAPTURE_HEIGHT) ||
+        (frameWidth < MIN_CAPTURE_WIDTH) ||
+        (frameHeight < MIN_CAPTURE_HEIGHT))
+    {
+        IS_VALID_SIGNAL = false;
+        push_capture_event(capture_event_e::invalid_signal);
+        return false;
+    }
+    else
+    {
+        IS_VALID_SIGNAL = true;
+    }
+
+    if ((frameWidth != FRAME_BUFFER.resolution.w) ||
+        (frameHeight != FRAME_BUFFER.resolution.h))
+    {
+        FRAME_BUFFER.resolution.w = frameWidth;
+        FRAME_BUFFER.resolution.h = frameHeight;
+        LOCAL_PIXELS_ARE_CURRENT = false;
+        push_capture_event(capture_event_e::new_video_mode);
+    }
+
+    return true;
+}
+
+static unsigned bytes_per_pixel(const pixel_format_e format)
+{
+    switch (format)
+    {
+        case pixel_format_e::bgra: return 4;
+        case pixel_format_e::pal8: return 1;
+        case pixel_format_e::rgb565: return 2;
+        case pixel_format_e::rgb555: return 2;
+        default: k_assert(0, "Unknown pixel format."); return 0;
+    }
+}
+
+// Converts the given rectangle of the given slot's image into BGRA in LOCAL_PIXELS.
+static void convert_rect_to_local_pixels(
+    const unsigned slot,
+    const pixel_format_e format,
+    const unsigned x,
+    const unsigned y,
+    const unsigned width,
+    const unsigned height
+)
+{
+    const unsigned frameWidth = FRAME_BUFFER.resolution.w;
+    const unsigned bpp = bytes_per_pixel(format);
+    const uint8_t *const srcPixels = ((uint8_t*)MMAP_SCREEN_BUFFER.data() + (slot * MAX_NUM_BYTES_IN_CAPTURED_FRAME));
+
+    for (unsigned row = y; row < (y + height); row++)
+    {
+        const uint8_t *const src = (srcPixels + (((row * frameWidth) + x) * bpp));
+        uint8_t *const dst = (LOCAL_PIXELS + (((row * frameWidth) + x) * 4));
+
+        switch (format)
+        {
+            case pixel_format_e::bgra: memcpy(dst, src, (width * 4)); break;
+            case pixel_format_e::pal8: kpixel_convert_pal8_to_bgra(src, dst, width, MMAP_STATUS_BUFFER.palette(slot)); break;
+            case pixel_format_e::rgb565: kpixel_convert_rgb565_to_bgra((const uint16_t*)src, dst, width); break;
+            case pixel_format_e::rgb555: kpixel_convert_rgb555_to_bgra((const uint16_t*)src, dst, width); break;
+            default: break;
+        }
+    }
+
+    return;
+}
+
+// Points the frame buffer at the pixels of the given slot's image, converting
+// them into BGRA first if needed. Returns false if the image couldn't be
+// received; true otherwise. Should be called with the capture mutex locked.
+static bool receive_slot_pixels(const unsigned slot)
+{
+    const bool hasCompactFormats = (MMAP_STATUS_BUFFER(status::app_protocol_version) >= 4);
+    const auto format = (hasCompactFormats? pixel_format_e(MMAP_STATUS_BUFFER(status::slot_pixel_formats + slot)) : pixel_format_e::bgra);
+    const unsigned numDirtyRects = (hasCompactFormats? MMAP_STATUS_BUFFER(status::slot_num_dirty_rects + slot) : 0);
+
+    if ((format >= pixel_format_e::num_enumerators) || (numDirtyRects > MAX_NUM_DIRTY_RECTS))
+    {
+        NBENE(("The MMAP application provided an invalid pixel format or dirty rectangle count."));
+        return false;
+    }
+
+    // An application using protocol version 3 can't send dirty rectangles, so
+    // its images are read in place. In version 4+, the image is also copied, so
+    // that the application's later dirty rectangles have a previous image to
+    // update.
+    if (!hasCompactFormats)
+    {
+        FRAME_BUFFER.pixels = ((uint8_t*)MMAP_SCREEN_BUFFER.data() + (slot * MAX_NUM_BYTES_IN_CAPTURED_FRAME));
+        LOCAL_PIXELS_ARE_CURRENT = false;
+        return true;
+    }
+
+    if (!numDirtyRects)
+    {
+        convert_rect_to_local_pixels(slot, format, 0, 0, FRAME_BUFFER.resolution.w, FRAME_BUFFER.resolution.h);
+    }
+    // Dirty rectangles update the application's previous frame, which VCS
+    // doesn't have in this case (e.g. because the application superseded it
+    // before VCS received it), so it asks the application for a whole frame
+    // instead.
+    else if (
+        !LOCAL_PIXELS_ARE_CURRENT ||
+        (MMAP_STATUS_BUFFER(status::slot_base_sequences + slot) != LOCAL_PIXELS_SEQUENCE)
+    ){
+        LOCAL_PIXELS_ARE_CURRENT = false;
+        MMAP_STATUS_BUFFER[status::full_frame_request] = 1;
+        NUM_DROPPED_FRAMES++;
+        return false;
+    }
+    else
+    {
+        const uint16_t *const rects = (MMAP_STATUS_BUFFER.data() + status::dirty_rects + (slot * MAX_NUM_DIRTY_RECTS * 4));
+
+        for (unsigned i = 0; i < numDirtyRects; i++)
+        {
+            const uint16_t *const rect = (rects + (i * 4));
+            const unsigned x = std::min<unsigned>(rect[0], FRAME_BUFFER.resolution.w);
+            const unsigned y = std::min<unsigned>(rect[1], FRAME_BUFFER.resolution.h);
+            const unsigned width = std::min<unsigned>(rect[2], (FRAME_BUFFER.resolution.w - x));
+            const unsigned height = std::min<unsigned>(rect[3], (FRAME_BUFFER.resolution.h - y));
+
+            convert_rect_to_local_pixels(slot, format, x, y, width, height);
+        }
+    }
+
+    FRAME_BUFFER.pixels = LOCAL_PIXELS;
+    LOCAL_PIXELS_ARE_CURRENT = true;
+    LOCAL_PIXELS_SEQUENCE = MMAP_STATUS_BUFFER(status::slot_sequences + slot);
+
+    return true;
+}
+
+// Receives a frame via the capture flag (protocol versions 1 and 2), copying it
+// out of the SCREEN buffer.
+static void receive_flagged_frame(void)
+{
+    LOCK_CAPTURE_MUTEX_IN_SCOPE;
+
+    if (accept_frame_resolution(MMAP_STATUS_BUFFER(status::width), MMAP_STATUS_BUFFER(status::height)))
+    {
+        push_capture_event(capture_event_e::new_frame);
+        FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
+        FRAME_BUFFER.pixels = LOCAL_PIXELS;
+        LOCAL_PIXELS_ARE_CURRENT = true;
+        memcpy(
+            FRAME_BUFFER.pixels,
+            (char*)MMAP_SCREEN_BUFFER.data(),
+            (FRAME_BUFFER.resolution.w * FRAME_BUFFER.resolution.h * 4)
+        );
+    }
+
+    NUM_DROPPED_FRAMES += MMAP_STATUS_BUFFER[status::dropped_frames_count];
+    std::atomic_ref<uint16_t>(MMAP_STATUS_BUFFER[status::new_frame_available]).store(false, std::memory_order_release);
+
+    return;
+}
+
+// Receives a frame via the ready slot (protocol version 3+) by making the slot
+// VCS's front slot, from which the frame is then read in place (or, in protocol
+// version 4+, possibly converted into LOCAL_PIXELS).
+static void receive_slotted_frame(void)
+{
+    // The swap is done with the capture mutex locked, since the front slot's
+    // pixels are exposed to the rest of VCS via the frame buffer.
+    LOCK_CAPTURE_MUTEX_IN_SCOPE;
+
+    const uint32_t readySlot = std::atomic_ref<uint32_t>(*MMAP_STATUS_BUFFER.ready_slot()).exchange(FRONT_SLOT, std::memory_order_acq_rel);
+    FRONT_SLOT = (readySlot & READY_SLOT_INDEX_MASK);
+
+    if (FRONT_SLOT >= NUM_SCREEN_SLOTS)
+    {
+        NBENE(("The MMAP application provided an invalid frame slot index (%u).", FRONT_SLOT));
+        FRONT_SLOT = 0;
+        return;
+    }
+
+    const unsigned frameWidth = MMAP_STATUS_BUFFER(status::slot_resolutions + (FRONT_SLOT * 2));
+    const unsigned frameHeight = MMAP_STATUS_BUFFER(status::slot_resolutions + (FRONT_SLOT * 2) + 1);
+
+    if (accept_frame_resolution(frameWidth, frameHeight) && receive_slot_pixels(FRONT_SLOT))
+    {
+        push_capture_event(capture_event_e::new_frame);
+        FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
+    }
+
+    const uint16_t numSlotFramesDropped = MMAP_STATUS_BUFFER(status::dropped_frames_count);
+    NUM_DROPPED_FRAMES += uint16_t(numSlotFramesDropped - NUM_SLOT_FRAMES_DROPPED);
+    NUM_SLOT_FRAMES_DROPPED = numSlotFramesDropped;
+
+    return;
 }
 
-// Runs in its own thread, polling the memory shared with DOSBox for new frames.
+// Runs in its own thread, receiving new frames from the memory shared with DOSBox.
 // Returns 1 on successful exit; 0 otherwise.
 static int capture_loop(void)
 {
     while (RUN_CAPTURE_LOOP)
     {
-        if (MMAP_STATUS_BUFFER(status::new_frame_available))
-        {
-            LOCK_CAPTURE_MUTEX_IN_SCOPE;
-            
-            const unsigned frameWidth = MMAP_STATUS_BUFFER(status::width);
-            const unsigned frameHeight = MMAP_STATUS_BUFFER(status::height);
-
-            if ((frameWidth > MAX_CAPTURE_WIDTH) ||
-                (frameHeight > MAX_CAPTURE_HEIGHT) ||
-                (frameWidth < MIN_CAPTURE_WIDTH) ||
-                (frameHeight < MIN_CAPTURE_HEIGHT))
-            {
-                IS_VALID_SIGNAL = false;
-                push_capture_event(capture_event_e::invalid_signal);
-                goto done;
-            }
-            else
-            {
-                IS_VALID_SIGNAL = true;
-            }
+        // The doorbell's value is read before checking for a new frame, so that a
+        // frame made available after the check will have changed the value, and
+        // the wait won't sleep through the frame.
+        const uint32_t doorbellValue = std::atomic_ref<uint32_t>(*MMAP_STATUS_BUFFER.doorbell()).load(std::memory_order_acquire);
 
-            if ((frameWidth != FRAME_BUFFER.resolution.w) ||
-                (frameHeight != FRAME_BUFFER.resolution.h))
+        if (MMAP_STATUS_BUFFER(status::app_protocol_version) >= 3)
+        {
+            if (std::atomic_ref<uint32_t>(*MMAP_STATUS_BUFFER.ready_slot()).load(std::memory_order_acquire) & READY_SLOT_IS_NEW)
             {
-                FRAME_BUFFER.resolution.w = frameWidth;
-                FRAME_BUFFER.resolution.h = frameHeight;
-                push_capture_event(capture_event_e::new_video_mode);
+                receive_slotted_frame();
+                continue;
             }
-
-            push_capture_event(capture_event_e::new_frame);
-            FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
-            memcpy(
-                FRAME_BUFFER.pixels,
-                (char*)MMAP_SCREEN_BUFFER.data(),
-                (frameWidth * frameHeight * 4)
-            );
-
-            done:
-            NUM_DROPPED_FRAMES += MMAP_STATUS_BUFFER[status::dropped_frames_count];
-            MMAP_STATUS_BUFFER[status::new_frame_available] = false;
         }
+        else if (std::atomic_ref<uint16_t>(MMAP_STATUS_BUFFER[status::new_frame_available]).load(std::memory_order_acquire))
+        {
+            receive_flagged_frame();
+            continue;
+        }
+
+        wait_for_new_frame(doorbellValue);
     }
 
     return 1;
@@ -193,6 +537,10 @@ void kc_initialize_device(void)
 
     MMAP_STATUS_BUFFER[status::max_width] = kc_device_property("width: maximum");
     MMAP_STATUS_BUFFER[status::max_height] = kc_device_property("height: maximum");
+    MMAP_STATUS_BUFFER[status::vcs_protocol_version] = PROTOCOL_VERSION;
+    MMAP_STATUS_BUFFER[status::app_protocol_version] = 0;
+    std::atomic_ref<uint32_t>(*MMAP_STATUS_BUFFER.ready_slot()).store(2);
+    NUM_SLOT_FRAMES_DROPPED = MMAP_STATUS_BUFFER(status::dropped_frames_count);
 
     RUN_CAPTURE_LOOP = true;
     CAPTURE_THREAD = std::async(std::launch::async, capture_loop);
@@ -234,22 +582,29 @@ capture_event_e kc_process_next_capture_event(void)
     return capture_event_e::sleep;
 }
 
+intptr_t kc_device_property(const device_property_e property)
+{
+    return DEVICE_PROPERTIES.value(property);
+}
+
 intptr_t kc_device_property(const std::string &key)
 {
-    return (DEVICE_PROPERTIES.contains(key)? DEVICE_PROPERTIES.at(key) : 0);
+    return DEVICE_PROPERTIES.value(key);
 }
 
 bool kc_set_device_property(const std::string &key, intptr_t value)
 {
-    DEVICE_PROPERTIES[key] = value;
+    DEVICE_PROPERTIES.set(key, value);
     return true;
 }
 
 bool kc_release_device(void)
 {
     RUN_CAPTURE_LOOP = false;
+    ring_doorbell();
     CAPTURE_THREAD.wait();
-    delete [] FRAME_BUFFER.pixels;
+    FRAME_BUFFER.pixels = nullptr;
+    delete [] LOCAL_PIXELS;
     return true;
 }
 
@@ -0,0 +1,548 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * A capture backend that plays back a replay file recorded with the capture
+ * recorder (see replay_recorder.h), for profiling VCS's pipeline offline
+ * against the frames of a real capture device.
+ *
+ * The file is memory-mapped, and the frame buffer points directly into the
+ * mapping, so playback doesn't copy pixel data. The mapping is private, so any
+ * writes into the frame buffer don't reach the file.
+ *
+ * Frames can be played back either at the timing at which they were recorded
+ * or as fast as VCS consumes them. At the end of the file, playback restarts
+ * from the beginning.
+ *
+ */
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common/globals.h"
+#include "common/vcs_event/vcs_event.h"
+#include "display/qt/persistent_settings.h"
+#include "common/abstract_gui.h"
+#include "common/timer/timer.h"
+#include "common/latency_stamp/latency_stamp.h"
+#include "capture/replay/replay_file.h"
+#include "capture/video_presets.h"
+#include "capture/capture_event_flags.h"
+#include "capture/capture.h"
+#include "capture/device_properties.h"
+
+enum class playback_timing_e : int
+{
+    // Frames are emitted at the intervals at which they were recorded.
+    original = 0,
+
+    // Frames are emitted as fast as VCS asks for them.
+    unthrottled = 1,
+} PLAYBACK_TIMING = playback_timing_e::original;
+
+// A record in the replay file, located when the file was opened.
+struct replay_record_s
+{
+    replay_record_type_e type;
+    int64_t timestampNs;
+
+    // Points into the file's memory mapping, just past the record's header.
+    uint8_t *payload;
+    uint64_t payloadSize;
+};
+
+static capture_event_flags_c CAPTURE_EVENTS;
+
+static captured_frame_s FRAME_BUFFER;
+
+// The memory mapping of the replay file being played back.
+static uint8_t *FILE_DATA = nullptr;
+static std::size_t FILE_SIZE = 0;
+
+static std::vector<replay_record_s> RECORDS;
+static unsigned NUM_FRAME_RECORDS = 0;
+
+// The index in RECORDS of the next record to be played back.
+static unsigned NEXT_RECORD_IDX = 0;
+
+// The time at which playback (re)started from the first record.
+static std::chrono::steady_clock::time_point PLAYBACK_START_TIME;
+
+static unsigned NUM_FRAMES_DROPPED = 0;
+
+static struct {
+    abstract_gui_s replay;
+} GUI;
+
+static std::vector<const char*> SUPPORTED_VIDEO_PROPERTIES = {};
+
+static device_properties_c DEVICE_PROPERTIES = {
+    {"api name", intptr_t("Replay")},
+
+    {"width: minimum", MIN_CAPTURE_WIDTH},
+    {"width: maximum", MAX_CAPTURE_WIDTH},
+    {"height: minimum", MIN_CAPTURE_HEIGHT},
+    {"height: maximum", MAX_CAPTURE_HEIGHT},
+
+    {"has signal", false},
+
+    {"supported video preset properties", intptr_t(&SUPPORTED_VIDEO_PROPERTIES)},
+    {"supports video presets", false},
+    {"supports channel switching", false},
+    {"supports resolution switching", false},
+};
+
+static void push_capture_event(const capture_event_e event)
+{
+    // A signal change supersedes an opposite one that's still pending, e.g. when
+    // a replay file is swapped for another, so that the main loop doesn't see
+    // the two in the wrong order and end up out of sync with "has signal".
+    if (event == capture_event_e::signal_gained)
+    {
+        CAPTURE_EVENTS.pop(capture_event_e::signal_lost);
+    }
+    else if (event == capture_event_e::signal_lost)
+    {
+        CAPTURE_EVENTS.pop(capture_event_e::signal_gained);
+    }
+
+    CAPTURE_EVENTS.push(event);
+
+    return;
+}
+
+static bool pop_capture_event(const capture_event_e event)
+{
+    return CAPTURE_EVENTS.pop(event);
+}
+
+static void close_replay_file(void)
+{
+    if (FILE_DATA)
+    {
+        munmap(FILE_DATA, FILE_SIZE);
+    }
+
+    FILE_DATA = nullptr;
+    FILE_SIZE = 0;
+    FRAME_BUFFER.pixels = nullptr;
+    RECORDS.clear();
+    NUM_FRAME_RECORDS = 0;
+    NEXT_RECORD_IDX = 0;
+
+    kc_set_device_property("has signal", false);
+
+    return;
+}
+
+// Builds the index of records in the mapped file. Returns false if the file is
+// malformed.
+static bool index_records(void)
+{
+    const auto *const fileHeader = reinterpret_cast<const replay_file_header_s*>(FILE_DATA);
+
+    if (
+        (FILE_SIZE < sizeof(replay_file_header_s)) ||
+        std::memcmp(fileHeader->magic, REPLAY_FILE_MAGIC, sizeof(REPLAY_FILE_MAGIC)) ||
+        (fileHeader->version != REPLAY_FILE_VERSION) ||
+        (fileHeader->headerSize != replay_padded_size(fileHeader->headerSize)) ||
+        (fileHeader->headerSize > FILE_SIZE)
+    ){
+        return false;
+    }
+
+    RECORDS.clear();
+    NUM_FRAME_RECORDS = 0;
+
+    // A recording that was cut short (e.g. by a crash) may end in a partial
+    // record, which we ignore.
+    for (
+        std::size_t offset = fileHeader->headerSize;
+        (offset + sizeof(replay_record_header_s)) <= FILE_SIZE;
+    ){
+        const auto *const header = reinterpret_cast<const replay_record_header_s*>(FILE_DATA + offset);
+        offset += sizeof(replay_record_header_s);
+
+        if (header->payloadSize > (FILE_SIZE - offset))
+        {
+            break;
+        }
+
+        const replay_record_s record = {
+            .type = header->type,
+            .timestampNs = header->timestampNs,
+            .payload = (FILE_DATA + offset),
+            .payloadSize = header->payloadSize,
+        };
+
+        offset += replay_padded_size(header->payloadSize);
+
+        switch (record.type)
+        {
+            case replay_record_type_e::video_mode:
+            {
+                if (record.payloadSize < sizeof(replay_video_mode_s))
+                {
+                    return false;
+                }
+
+                break;
+            }
+            case replay_record_type_e::frame:
+            {
+                const auto *const frame = reinterpret_cast<const replay_frame_s*>(record.payload);
+
+                if (
+                    (record.payloadSize < sizeof(replay_frame_s)) ||
+                    (frame->width < MIN_CAPTURE_WIDTH) ||
+                    (frame->width > MAX_CAPTURE_WIDTH) ||
+                    (frame->height < MIN_CAPTURE_HEIGHT) ||
+                    (frame->height > MAX_CAPTURE_HEIGHT) ||
+                    ((record.payloadSize - sizeof(replay_frame_s)) < (uint64_t(frame->width) * frame->height * 4))
+                ){
+                    return false;
+                }
+
+                NUM_FRAME_RECORDS++;
+                break;
+            }
+            // Skip unknown record types, for forward compatibility.
+            default: continue;
+        }
+
+        RECORDS.push_back(record);
+    }
+
+    return (NUM_FRAME_RECORDS > 0);
+}
+
+static bool open_replay_file(const std::string &filename)
+{
+    close_replay_file();
+
+    const int fd = open(filename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        NBENE(("Failed to open the replay file \"%s\".", filename.c_str()));
+        return false;
+    }
+
+    struct stat fileStat;
+
+    if (
+        (fstat(fd, &fileStat) < 0) ||
+        (fileStat.st_size <= 0)
+    ){
+        NBENE(("Failed to query the size of the replay file \"%s\".", filename.c_str()));
+        close(fd);
+        return false;
+    }
+
+    FILE_SIZE = std::size_t(fileStat.st_size);
+
+    // Mapped privately and writably, so that the frame buffer can be handed to
+    // code that expects a mutable buffer without the file being modified.
+    void *const data = mmap(nullptr, FILE_SIZE, (PROT_READ | PROT_WRITE), MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        NBENE(("Failed to memory-map the replay file \"%s\".", filename.c_str()));
+        FILE_SIZE = 0;
+        return false;
+    }
+
+    FILE_DATA = static_cast<uint8_t*>(data);
+    madvise(FILE_DATA, FILE_SIZE, MADV_SEQUENTIAL);
+
+    if (!index_records())
+    {
+        NBENE(("The replay file \"%s\" is malformed or contains no frames.", filename.c_str()));
+        close_replay_file();
+        return false;
+    }
+
+    INFO(("Replaying %u frames from \"%s\".", NUM_FRAME_RECORDS, filename.c_str()));
+
+    NEXT_RECORD_IDX = 0;
+    PLAYBACK_START_TIME = std::chrono::steady_clock::now();
+    kc_set_device_property("has signal", true);
+
+    return true;
+}
+
+// Returns true if the given record is due to be played back.
+static bool is_record_due(const replay_record_s &record, const std::chrono::steady_clock::time_point &timeNow)
+{
+    return (
+        (PLAYBACK_TIMING == playback_timing_e::unthrottled) ||
+        ((PLAYBACK_START_TIME + std::chrono::nanoseconds(record.timestampNs - RECORDS.front().timestampNs)) <= timeNow)
+    );
+}
+
+// Plays back the next record in the file, if it's due. Returns the capture
+// event that the record corresponds to.
+static capture_event_e play_next_record(void)
+{
+    const auto timeNow = std::chrono::steady_clock::now();
+
+    if (NEXT_RECORD_IDX >= RECORDS.size())
+    {
+        NEXT_RECORD_IDX = 0;
+        PLAYBACK_START_TIME = timeNow;
+    }
+
+    if (!is_record_due(RECORDS[NEXT_RECORD_IDX], timeNow))
+    {
+        return capture_event_e::none;
+    }
+
+    // If we've fallen behind the original timing, skip to the most recent due
+    // frame, as a capture device would.
+    while (
+        (RECORDS[NEXT_RECORD_IDX].type == replay_record_type_e::frame) &&
+        ((NEXT_RECORD_IDX + 1) < RECORDS.size()) &&
+        (RECORDS[NEXT_RECORD_IDX + 1].type == replay_record_type_e::frame) &&
+        is_record_due(RECORDS[NEXT_RECORD_IDX + 1], timeNow) &&
+        (PLAYBACK_TIMING == playback_timing_e::original)
+    ){
+        NEXT_RECORD_IDX++;
+        NUM_FRAMES_DROPPED++;
+    }
+
+    const replay_record_s &record = RECORDS[NEXT_RECORD_IDX++];
+
+    switch (record.type)
+    {
+        case replay_record_type_e::video_mode:
+        {
+            const auto *const mode = reinterpret_cast<const replay_video_mode_s*>(record.payload);
+
+            FRAME_BUFFER.resolution = {.w = mode->width, .h = mode->height};
+            DEVICE_PROPERTIES.set(device_property_e::width, mode->width);
+            DEVICE_PROPERTIES.set(device_property_e::height, mode->height);
+            refresh_rate_s::to_capture_device_properties(refresh_rate_s::from_fixedpoint(mode->refreshRate));
+
+            return capture_event_e::new_video_mode;
+        }
+        case replay_record_type_e::frame:
+        {
+            const auto *const frame = reinterpret_cast<const replay_frame_s*>(record.payload);
+
+            // Frames whose resolution doesn't match the current video mode (which
+            // a well-formed file doesn't contain) would be misinterpreted by
+            // the rest of VCS.
+            if (
+                (frame->width != FRAME_BUFFER.resolution.w) ||
+                (frame->height != FRAME_BUFFER.resolution.h)
+            ){
+                NUM_FRAMES_DROPPED++;
+                return capture_event_e::none;
+            }
+
+            FRAME_BUFFER.pixels = (record.payload + sizeof(replay_frame_s));
+            FRAME_BUFFER.timestamp = timeNow;
+
+            // The file's mapping is private, so this doesn't modify the file.
+            kstamp_stamp_frame(&FRAME_BUFFER);
+
+            // Ask the kernel to start reading in the next frame while this one
+            // is being processed.
+            if (NEXT_RECORD_IDX < RECORDS.size())
+            {
+                const replay_record_s &nextRecord = RECORDS[NEXT_RECORD_IDX];
+                const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+                const uintptr_t start = (uintptr_t(nextRecord.payload) & ~(pageSize - 1));
+                madvise(reinterpret_cast<void*>(start), (uintptr_t(nextRecord.payload + nextRecord.payloadSize) - start), MADV_WILLNEED);
+            }
+
+            return capture_event_e::new_frame;
+        }
+        default: return capture_event_e::none;
+    }
+}
+
+void kc_initialize_device(void)
+{
+    DEBUG(("Initializing the replay capture device."));
+
+    FRAME_BUFFER.resolution = {.w = 640, .h = 480};
+    FRAME_BUFFER.pixels = nullptr;
+
+    PLAYBACK_TIMING = playback_timing_e(kpers_value_of(INI_GROUP_CAPTURE, "ReplayTiming", 0).toInt());
+
+    const std::string filename = kpers_value_of(INI_GROUP_CAPTURE, "ReplayFile", "").toString().toStdString();
+    if (!filename.empty())
+    {
+        open_replay_file(filename);
+    }
+
+    // Create custom GUI entries.
+    {
+        auto *const fileInfo = new abstract_gui_widget::label;
+        fileInfo->text = (FILE_DATA? (std::to_string(NUM_FRAME_RECORDS) + " frames") : "No file loaded");
+
+        auto *const selectFile = new abstract_gui_widget::button_get_open_filename;
+        selectFile->label = "Select file...";
+        selectFile->filenameFilter = "Replay files (*.vcsreplay);;All files(*.*)";
+        selectFile->on_success = [fileInfo](const std::string &filename)
+        {
+            if (open_replay_file(filename))
+            {
+                kpers_set_value(INI_GROUP_CAPTURE, "ReplayFile", QString::fromStdString(filename));
+                fileInfo->set_text(std::to_string(NUM_FRAME_RECORDS) + " frames");
+            }
+            else
+            {
+                fileInfo->set_text("No file loaded");
+                kd_show_headless_error_message(
+                    "Replay file error",
+                    "The selected file couldn't be opened as a replay file. More "
+                    "information will have been printed into the console."
+                );
+            }
+        };
+
+        auto *const timing = new abstract_gui_widget::combo_box;
+        timing->items = {"Original timing", "As fast as possible"};
+        timing->index = unsigned(PLAYBACK_TIMING);
+        timing->on_change = [](const int itemsIdx)
+        {
+            PLAYBACK_TIMING = playback_timing_e(itemsIdx);
+            kpers_set_value(INI_GROUP_CAPTURE, "ReplayTiming", itemsIdx);
+
+            // Restart the timing from the current frame.
+            if (!RECORDS.empty())
+            {
+                const unsigned currentIdx = std::min<unsigned>(NEXT_RECORD_IDX, (RECORDS.size() - 1));
+                PLAYBACK_START_TIME = (
+                    std::chrono::steady_clock::now() -
+                    std::chrono::nanoseconds(RECORDS[currentIdx].timestampNs - RECORDS.front().timestampNs)
+                );
+            }
+        };
+
+        GUI.replay.layout = abstract_gui_s::layout_e::vertical_box;
+        GUI.replay.fields.push_back({"", {selectFile}});
+        GUI.replay.fields.push_back({"", {fileInfo}});
+        GUI.replay.fields.push_back({"", {timing}});
+
+        kd_add_control_panel_widget("Capture", "Replay", &GUI.replay);
+    }
+
+    return;
+}
+
+intptr_t kc_device_property(const device_property_e property)
+{
+    return DEVICE_PROPERTIES.value(property);
+}
+
+intptr_t kc_device_property(const std::string &key)
+{
+    return DEVICE_PROPERTIES.value(key);
+}
+
+bool kc_set_device_property(const std::string &key, intptr_t value)
+{
+    if (
+        (key == "has signal") &&
+        (DEVICE_PROPERTIES.value(key) != value)
+    ){
+        push_capture_event(value? capture_event_e::signal_gained : capture_event_e::signal_lost);
+    }
+    // The resolution is dictated by the replay file.
+    else if (
+        (key == "width") ||
+        (key == "height")
+    ){
+        return false;
+    }
+    // Not persisted, so that e.g. a benchmark run doesn't change the user's setting.
+    else if (key == "unthrottled")
+    {
+        PLAYBACK_TIMING = (
+            value
+                ? playback_timing_e::unthrottled
+                : playback_timing_e(kpers_value_of(INI_GROUP_CAPTURE, "ReplayTiming", 0).toInt())
+        );
+    }
+    // The value is expected to point to a null-terminated file name.
+    else if (key == "replay file")
+    {
+        return (value && open_replay_file((const char*)value));
+    }
+
+    DEVICE_PROPERTIES.set(key, value);
+
+    return true;
+}
+
+capture_event_e kc_process_next_capture_event(void)
+{
+    if (pop_capture_event(capture_event_e::signal_gained))
+    {
+        ev_capture_signal_gained.fire();
+        return capture_event_e::signal_gained;
+    }
+
+    if (pop_capture_event(capture_event_e::signal_lost))
+    {
+        ev_capture_signal_lost.fire();
+        return capture_event_e::signal_lost;
+    }
+
+    if (!FILE_DATA)
+    {
+        return capture_event_e::sleep;
+    }
+
+    const capture_event_e event = play_next_record();
+
+    switch (event)
+    {
+        case capture_event_e::new_video_mode:
+        {
+            ev_new_proposed_video_mode.fire(video_mode_s{
+                .resolution = resolution_s::from_capture_device_properties(),
+                .refreshRate = refresh_rate_s::from_capture_device_properties()
+            });
+            break;
+        }
+        case capture_event_e::new_frame:
+        {
+            ev_new_captured_frame.fire(FRAME_BUFFER);
+            break;
+        }
+        default: break;
+    }
+
+    return event;
+}
+
+bool kc_release_device(void)
+{
+    close_replay_file();
+
+    return true;
+}
+
+const captured_frame_s& kc_frame_buffer(void)
+{
+    return FRAME_BUFFER;
+}
+
+uint kc_dropped_frames_count(void)
+{
+    return NUM_FRAMES_DROPPED;
+}
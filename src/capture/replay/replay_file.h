@@ -0,0 +1,99 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The layout of a capture replay file.
+ *
+ * A replay file holds a sequence of captured frames as they were received from
+ * the capture device, along with the video mode changes that occurred between
+ * them. Replay files are written by the capture recorder (see replay_recorder.h)
+ * and played back by the replay capture backend (capture_replay.cpp), which
+ * memory-maps the file and hands out pointers into it as frame buffers.
+ *
+ * The file begins with a replay_file_header_s, followed back-to-back by records.
+ * Each record begins with a replay_record_header_s, followed by the record's
+ * payload, which is padded to a multiple of REPLAY_FILE_ALIGNMENT bytes. All
+ * values are in the host's byte order.
+ *
+ * Record payloads:
+ *
+ *   video_mode: a replay_video_mode_s. Precedes the first frame of the recording
+ *               and any frame whose resolution or refresh rate differs from that
+ *               of the previous frame.
+ *
+ *   frame: a replay_frame_s, followed by the frame's BGRA pixels (width * height
+ *          * 4 bytes).
+ *
+ */
+
+#ifndef VCS_CAPTURE_REPLAY_REPLAY_FILE_H
+#define VCS_CAPTURE_REPLAY_REPLAY_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+
+// The magic value is "VCSRPLAY".
+static const char REPLAY_FILE_MAGIC[8] = {'V', 'C', 'S', 'R', 'P', 'L', 'A', 'Y'};
+static const uint32_t REPLAY_FILE_VERSION = 1;
+
+// Records, and so also frames' pixel data, begin at multiples of this many bytes
+// from the start of the file.
+static const std::size_t REPLAY_FILE_ALIGNMENT = 8;
+
+enum class replay_record_type_e : uint32_t
+{
+    video_mode = 1,
+    frame = 2,
+};
+
+struct replay_file_header_s
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+};
+
+struct replay_record_header_s
+{
+    replay_record_type_e type;
+    uint32_t reserved;
+
+    // The size of the payload that follows this header, excluding padding.
+    uint64_t payloadSize;
+
+    // Nanoseconds since the start of the recording.
+    int64_t timestampNs;
+};
+
+struct replay_video_mode_s
+{
+    uint32_t width;
+    uint32_t height;
+
+    // The refresh rate in refresh_rate_s's fixed-point representation.
+    int32_t refreshRate;
+
+    uint32_t reserved;
+};
+
+struct replay_frame_s
+{
+    uint32_t width;
+    uint32_t height;
+};
+
+static_assert((sizeof(replay_file_header_s) % REPLAY_FILE_ALIGNMENT) == 0);
+static_assert((sizeof(replay_record_header_s) % REPLAY_FILE_ALIGNMENT) == 0);
+static_assert((sizeof(replay_frame_s) % REPLAY_FILE_ALIGNMENT) == 0);
+
+// Returns the given payload size rounded up to the file's alignment.
+static inline uint64_t replay_padded_size(const uint64_t size)
+{
+    return ((size + (REPLAY_FILE_ALIGNMENT - 1)) & ~uint64_t(REPLAY_FILE_ALIGNMENT - 1));
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <cstring>
+#include <cstdio>
+#include "common/frame_queue/frame_writer.h"
+#include "common/vcs_event/vcs_event.h"
+#include "common/timer/timer.h"
+#include "common/refresh_rate.h"
+#include "common/globals.h"
+#include "capture/replay/replay_recorder.h"
+#include "capture/replay/replay_file.h"
+#include "capture/capture.h"
+#include "display/display.h"
+
+static frame_writer_c *WRITER = nullptr;
+
+// Accessed only by the writer thread while it's running.
+static FILE *FILE_HANDLE = nullptr;
+
+static bool IS_RECORDING = false;
+static std::string FILENAME;
+static std::chrono::steady_clock::time_point START_TIMESTAMP;
+
+static bool write_record(const replay_record_type_e type,
+                         const int64_t timestampNs,
+                         const void *const payload,
+                         const uint64_t payloadSize,
+                         const void *const extraPayload = nullptr,
+                         const uint64_t extraPayloadSize = 0)
+{
+    static const uint8_t padding[REPLAY_FILE_ALIGNMENT] = {0};
+
+    const uint64_t totalPayloadSize = (payloadSize + extraPayloadSize);
+    const uint64_t paddingSize = (replay_padded_size(totalPayloadSize) - totalPayloadSize);
+
+    const replay_record_header_s header = {
+        .type = type,
+        .reserved = 0,
+        .payloadSize = totalPayloadSize,
+        .timestampNs = timestampNs,
+    };
+
+    return (
+        (std::fwrite(&header, sizeof(header), 1, FILE_HANDLE) == 1) &&
+        (std::fwrite(payload, 1, payloadSize, FILE_HANDLE) == payloadSize) &&
+        (std::fwrite(extraPayload, 1, extraPayloadSize, FILE_HANDLE) == extraPayloadSize) &&
+        (std::fwrite(padding, 1, paddingSize, FILE_HANDLE) == paddingSize)
+    );
+}
+
+// Returns a function for the writer thread that writes each given frame into
+// the file, preceded by a video mode record whenever the video mode changes.
+static frame_writer_c::write_fn_t make_frame_writer(void)
+{
+    // The video mode of the most recently written frame. Frames are tagged with
+    // the refresh rate that was in effect when they were captured.
+    return [prevResolution = resolution_s{0, 0}, prevRefreshRate = int32_t(0)](const queued_frame_s &frame) mutable -> bool
+    {
+        const int64_t timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(frame.timestamp - START_TIMESTAMP).count();
+        const int32_t refreshRate = int32_t(frame.tag);
+
+        if (
+            (frame.resolution != prevResolution) ||
+            (refreshRate != prevRefreshRate)
+        ){
+            const replay_video_mode_s videoMode = {
+                .width = frame.resolution.w,
+                .height = frame.resolution.h,
+                .refreshRate = refreshRate,
+                .reserved = 0,
+            };
+
+            if (!write_record(replay_record_type_e::video_mode, timestampNs, &videoMode, sizeof(videoMode)))
+            {
+                return false;
+            }
+
+            prevResolution = frame.resolution;
+            prevRefreshRate = refreshRate;
+        }
+
+        const replay_frame_s frameInfo = {
+            .width = frame.resolution.w,
+            .height = frame.resolution.h,
+        };
+
+        return write_record(replay_record_type_e::frame, timestampNs, &frameInfo, sizeof(frameInfo), frame.pixels.data(), frame.pixels.size());
+    };
+}
+
+// Called by the writer thread once it has written the recording's frames.
+static bool close_file(void)
+{
+    const bool isClosed = (std::fclose(FILE_HANDLE) == 0);
+
+    FILE_HANDLE = nullptr;
+
+    return isClosed;
+}
+
+// Joins the writer thread of the most recent recording if it has finished
+// writing the recording's frames, or - if so requested - once it has.
+static void reap_finished_writer(const bool isBlocking = false)
+{
+    if (
+        !IS_RECORDING &&
+        WRITER &&
+        (isBlocking || WRITER->is_finished()) &&
+        WRITER->join()
+    ){
+        if (WRITER->has_write_error())
+        {
+            NBENE(("Capture recording into \"%s\" ended in a write error.", FILENAME.c_str()));
+        }
+        else
+        {
+            INFO((
+                "Finished recording %u captured frames into \"%s\" (%u frames dropped).",
+                WRITER->num_frames_written(),
+                FILENAME.c_str(),
+                WRITER->num_frames_dropped()
+            ));
+        }
+    }
+
+    return;
+}
+
+subsystem_releaser_t kreplay_initialize_recorder(void)
+{
+    DEBUG(("Initializing the capture recorder."));
+
+    ev_new_captured_frame.listen([](const captured_frame_s &frame)
+    {
+        if (!IS_RECORDING)
+        {
+            return;
+        }
+
+        const int32_t refreshRate = refresh_rate_s::from_capture_device_properties().fixedpoint;
+
+        WRITER->push(image_s(frame.pixels, frame.resolution), "", uint64_t(uint32_t(refreshRate)), frame.timestamp);
+    }, "Replay recorder");
+
+    kt_timer(250, [](const unsigned)
+    {
+        if (IS_RECORDING && WRITER->has_write_error())
+        {
+            kreplay_stop_recording();
+
+            k_defer_until_capture_mutex_unlocked([]
+            {
+                kd_show_headless_error_message(
+                    "Capture recording stopped",
+                    "The recording was stopped because its frames couldn't be written to disk."
+                );
+            });
+        }
+
+        reap_finished_writer();
+    });
+
+    return []
+    {
+        DEBUG(("Releasing the capture recorder."));
+
+        kreplay_stop_recording();
+        reap_finished_writer(true);
+
+        delete WRITER;
+        WRITER = nullptr;
+    };
+}
+
+bool kreplay_start_recording(const std::string &filename)
+{
+    reap_finished_writer();
+
+    if (IS_RECORDING || (WRITER && !WRITER->is_finished()))
+    {
+        NBENE(("Can't start a new capture recording while the previous one is still being written."));
+        return false;
+    }
+
+    if (!(FILE_HANDLE = std::fopen(filename.c_str(), "wb")))
+    {
+        NBENE(("Failed to open \"%s\" for capture recording.", filename.c_str()));
+        return false;
+    }
+
+    replay_file_header_s header = {};
+    std::memcpy(header.magic, REPLAY_FILE_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_FILE_VERSION;
+    header.headerSize = sizeof(header);
+
+    if (std::fwrite(&header, sizeof(header), 1, FILE_HANDLE) != 1)
+    {
+        NBENE(("Failed to write into \"%s\".", filename.c_str()));
+        std::fclose(FILE_HANDLE);
+        FILE_HANDLE = nullptr;
+        return false;
+    }
+
+    FILENAME = filename;
+    START_TIMESTAMP = std::chrono::steady_clock::now();
+    IS_RECORDING = true;
+
+    // The writer's backlog is sized for frames of the current capture resolution.
+    const resolution_s resolution = resolution_s::from_capture_device_properties();
+
+    delete WRITER;
+    WRITER = new frame_writer_c((sizeof(replay_record_header_s) + (resolution.w * resolution.h * 4)), make_frame_writer(), close_file);
+
+    INFO(("Recording captured frames into \"%s\".", FILENAME.c_str()));
+
+    return true;
+}
+
+void kreplay_stop_recording(void)
+{
+    if (IS_RECORDING)
+    {
+        IS_RECORDING = false;
+        WRITER->close();
+    }
+
+    return;
+}
+
+bool kreplay_is_recording(void)
+{
+    return IS_RECORDING;
+}
+
+unsigned kreplay_num_frames_recorded(void)
+{
+    return (WRITER? WRITER->num_frames_written() : 0);
+}
+
+unsigned kreplay_num_frames_dropped(void)
+{
+    return (WRITER? WRITER->num_frames_dropped() : 0);
+}
@@ -0,0 +1,67 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The capture recorder interface.
+ *
+ * The capture recorder records captured frames -- as received from the capture
+ * device, prior to any filtering or scaling -- along with their timestamps and
+ * video mode changes into a replay file (see replay_file.h). The replay capture
+ * backend can then feed the recorded frames through VCS's pipeline, so that
+ * e.g. filter graphs can be profiled offline against real-world input.
+ *
+ * As with the recording subsystem (see record.h), frames are handed to a frame
+ * writer (see frame_writer.h), which copies them into a pooled ring of buffers
+ * from which its thread writes them to disk; frames arriving while the ring is
+ * full are dropped.
+ *
+ * ## Usage
+ *
+ *   1. Call kreplay_initialize_recorder() to initialize the recorder. Note that
+ *      this function should be called only once per program execution.
+ *
+ *   2. Start recording:
+ *      @code
+ *      kreplay_start_recording("capture.vcsreplay");
+ *      @endcode
+ *
+ *   3. Stop recording. Frames still in the writer's backlog will be written in
+ *      the background:
+ *      @code
+ *      kreplay_stop_recording();
+ *      @endcode
+ *
+ *   4. VCS will automatically release the recorder on program exit, which also
+ *      stops any active recording.
+ *
+ */
+
+#ifndef VCS_CAPTURE_REPLAY_REPLAY_RECORDER_H
+#define VCS_CAPTURE_REPLAY_REPLAY_RECORDER_H
+
+#include <string>
+#include "main.h"
+
+subsystem_releaser_t kreplay_initialize_recorder(void);
+
+// Starts recording captured frames into the given file. Returns false if the
+// recording couldn't be started, e.g. because the file couldn't be opened.
+bool kreplay_start_recording(const std::string &filename);
+
+// Stops the active recording, if any.
+void kreplay_stop_recording(void);
+
+bool kreplay_is_recording(void);
+
+// Returns the number of frames written into the active (or most recent) recording.
+unsigned kreplay_num_frames_recorded(void);
+
+// Returns the number of captured frames that the active (or most recent) recording
+// skipped because the writer's backlog was full.
+unsigned kreplay_num_frames_dropped(void);
+
+#endif
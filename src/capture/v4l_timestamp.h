@@ -0,0 +1,38 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * Capture timestamps of Video4Linux2 buffers, shared by the capture backends
+ * that use Video4Linux2.
+ *
+ */
+
+#ifndef VCS_CAPTURE_V4L_TIMESTAMP_H
+#define VCS_CAPTURE_V4L_TIMESTAMP_H
+
+#include <chrono>
+#include <linux/videodev2.h>
+
+// Returns the capture time of the given dequeued buffer in steady_clock's time
+// base, which on Linux is CLOCK_MONOTONIC. If the driver doesn't timestamp its
+// buffers with the monotonic clock, returns the current time instead.
+inline std::chrono::steady_clock::time_point kv4l_buffer_timestamp(const v4l2_buffer &buffer)
+{
+    if (
+        ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) ||
+        (!buffer.timestamp.tv_sec && !buffer.timestamp.tv_usec)
+    ){
+        return std::chrono::steady_clock::now();
+    }
+
+    return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::seconds(buffer.timestamp.tv_sec) +
+        std::chrono::microseconds(buffer.timestamp.tv_usec)
+    ));
+}
+
+#endif
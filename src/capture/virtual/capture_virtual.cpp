@@ -6,6 +6,7 @@
  */
 
 #include <unordered_map>
+#include <algorithm>
 #include <chrono>
 #include <opencv2/imgcodecs/imgcodecs.hpp>
 #include "common/globals.h"
@@ -13,19 +14,32 @@
 #include "display/qt/persistent_settings.h"
 #include "common/abstract_gui.h"
 #include "common/timer/timer.h"
+#include "common/latency_stamp/latency_stamp.h"
 #include "capture/video_presets.h"
+#include "capture/capture_event_flags.h"
 #include "capture/capture.h"
+#include "capture/device_properties.h"
 
-// We'll try to redraw the on-screen test pattern this often.
-static const double TARGET_REFRESH_RATE = 60;
+// The rate at which new frames are generated, in Hz. A value of 0 means frames
+// are generated as fast as VCS consumes them, which makes the virtual device
+// usable as a load generator for measuring the throughput of the rest of the
+// pipeline.
+static unsigned TARGET_REFRESH_RATE = 60;
+
+// When the next frame is due, if the refresh rate is throttled.
+static std::chrono::steady_clock::time_point NEXT_FRAME_DEADLINE;
 
 // Keep track of the actual achieved refresh rate.
 static unsigned NUM_FRAMES_PER_SECOND = 0;
 
-static bool CAPTURE_EVENT_FLAGS[(int)capture_event_e::num_enumerators];
+static capture_event_flags_c CAPTURE_EVENTS;
 
 static captured_frame_s FRAME_BUFFER;
 
+// The buffer into which the test pattern is drawn. FRAME_BUFFER.pixels points
+// either to this or, for the noise pattern, into NOISE_FRAMES.
+static uint8_t *LOCAL_PIXELS = nullptr;
+
 static cv::Mat BG_IMAGE;
 
 enum class output_pattern_type : int
@@ -33,8 +47,29 @@ enum class output_pattern_type : int
     animated = 0,
     non_animated = 1,
     image = 2,
+    noise = 3,
 } PATTERN_TYPE = output_pattern_type::animated;
 
+// The noise pattern cycles through this many pre-generated frames, so that the
+// cost of generating it isn't paid per frame. Each frame is generated at the
+// current capture resolution, which bounds the memory cost.
+static const unsigned NUM_NOISE_FRAMES = 4;
+static std::vector<uint8_t> NOISE_FRAMES;
+
+// The maximum deviation of a noise pixel's color channels from the still pattern.
+static unsigned NOISE_AMPLITUDE = 64;
+
+// Set when something affecting the cached pattern data (resolution, brightness,
+// pattern type, etc.) changes, so that the data get regenerated for the next frame.
+static bool IS_PATTERN_DIRTY = true;
+
+// Maps a channel value to its brightness-adjusted equivalent.
+static uint8_t BRIGHTNESS_LUT[256];
+
+// The red and blue channels of the animated pattern's rows, which differ only
+// in their green channel.
+static std::vector<uint32_t> ANIMATED_ROW_TEMPLATE;
+
 static struct {
     abstract_gui_s patternGeneration;
 } GUI;
@@ -48,7 +83,7 @@ static std::vector<const char*> SUPPORTED_VIDEO_PROPERTIES = {
     "Brightness",
 };
 
-static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
+static device_properties_c DEVICE_PROPERTIES = {
     {"api name", intptr_t("Virtual")},
 
     {"width: minimum", MIN_CAPTURE_WIDTH},
@@ -64,61 +99,224 @@ static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
     {"supports resolution switching", true},
 };
 
-static void refresh_test_pattern(void)
+static void update_brightness_lut(void)
 {
-    static unsigned numTicks = 0;
-
-    if (PATTERN_TYPE == output_pattern_type::animated)
+    for (unsigned i = 0; i < 256; i++)
     {
-        numTicks++;
+        BRIGHTNESS_LUT[i] = uint8_t(i * VIDEO_PARAMS.brightness);
     }
 
-    FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
+    IS_PATTERN_DIRTY = true;
+
+    return;
+}
+
+// Draws the color-gradient test pattern, offset by the given number of ticks,
+// into the given BGRA buffer. Each row differs from the others only in its
+// green channel, so the rows are composited from a precomputed red/blue row and
+// a per-row green value, which the compiler can vectorize.
+static void draw_gradient_pattern(uint8_t *const dst, const unsigned numTicks)
+{
+    const unsigned width = FRAME_BUFFER.resolution.w;
+    const unsigned height = FRAME_BUFFER.resolution.h;
 
-    if (
-        (PATTERN_TYPE == output_pattern_type::image) &&
-        (BG_IMAGE.data != nullptr)
-    ){
-        k_assert_optional(
-            (BG_IMAGE.elemSize() == 3),
-            "Expected the image to have 3 color channels."
+    ANIMATED_ROW_TEMPLATE.resize(width);
+    for (unsigned x = 0; x < width; x++)
+    {
+        ANIMATED_ROW_TEMPLATE[x] = (
+            uint32_t(BRIGHTNESS_LUT[150]) |
+            (uint32_t(BRIGHTNESS_LUT[(numTicks + x) % 256]) << 16) |
+            0xff000000u
         );
+    }
+
+    const uint32_t *const rowTemplate = ANIMATED_ROW_TEMPLATE.data();
+
+    for (unsigned y = 0; y < height; y++)
+    {
+        uint32_t *const dstRow = (reinterpret_cast<uint32_t*>(dst) + (y * width));
+        const uint32_t green = (uint32_t(BRIGHTNESS_LUT[(numTicks + y) % 256]) << 8);
+
+        for (unsigned x = 0; x < width; x++)
+        {
+            dstRow[x] = (rowTemplate[x] | green);
+        }
+    }
+
+    return;
+}
+
+static void draw_image_pattern(uint8_t *const dst)
+{
+    k_assert_optional(
+        (BG_IMAGE.elemSize() == 3),
+        "Expected the image to have 3 color channels."
+    );
+
+    for (unsigned y = 0; y < FRAME_BUFFER.resolution.h; y++)
+    {
+        const uint8_t *const srcRow = BG_IMAGE.ptr<uint8_t>(y % BG_IMAGE.rows);
+        uint32_t *const dstRow = (reinterpret_cast<uint32_t*>(dst) + (y * FRAME_BUFFER.resolution.w));
+
+        for (unsigned x = 0; x < FRAME_BUFFER.resolution.w; x++)
+        {
+            const uint8_t *const srcPixel = (srcRow + ((x % BG_IMAGE.cols) * 3));
+
+            dstRow[x] = (
+                uint32_t(BRIGHTNESS_LUT[srcPixel[0]]) |
+                (uint32_t(BRIGHTNESS_LUT[srcPixel[1]]) << 8) |
+                (uint32_t(BRIGHTNESS_LUT[srcPixel[2]]) << 16) |
+                0xff000000u
+            );
+        }
+    }
+
+    return;
+}
+
+// Fills NOISE_FRAMES with frames of the gradient test pattern perturbed by random
+// noise of up to +/- NOISE_AMPLITUDE per channel.
+static void generate_noise_frames(void)
+{
+    const std::size_t numPixels = (FRAME_BUFFER.resolution.w * FRAME_BUFFER.resolution.h);
+    NOISE_FRAMES.resize(numPixels * 4 * NUM_NOISE_FRAMES);
+
+    uint32_t rngState = 0x9e3779b9u;
+    const auto next_random = [&rngState]
+    {
+        // Xorshift32.
+        rngState ^= (rngState << 13);
+        rngState ^= (rngState >> 17);
+        rngState ^= (rngState << 5);
+        return rngState;
+    };
+
+    const int amplitude = int(NOISE_AMPLITUDE);
+
+    for (unsigned i = 0; i < NUM_NOISE_FRAMES; i++)
+    {
+        uint8_t *const frame = (NOISE_FRAMES.data() + (i * numPixels * 4));
+        draw_gradient_pattern(frame, 0);
 
-        for (unsigned y = 0; y < FRAME_BUFFER.resolution.h; y++)
+        for (std::size_t p = 0; p < numPixels; p++)
         {
-            for (unsigned x = 0; x < FRAME_BUFFER.resolution.w; x++)
+            const uint32_t random = next_random();
+
+            for (unsigned c = 0; c < 3; c++)
             {
-                const unsigned srcIdx = (((x % BG_IMAGE.cols) + (y % BG_IMAGE.rows) * BG_IMAGE.cols) * 3);
-                const unsigned dstIdx = ((x + y * FRAME_BUFFER.resolution.w) * 4);
+                const int offset = (int((random >> (c * 8)) & 0xff) - 128);
+                const int value = (frame[(p * 4) + c] + ((offset * amplitude) / 128));
+                frame[(p * 4) + c] = uint8_t(std::clamp(value, 0, 255));
+            }
+        }
+    }
 
-                for (unsigned c = 0; c < 3; c++)
+    return;
+}
+
+static void refresh_test_pattern(void)
+{
+    static unsigned numTicks = 0;
+    static unsigned noiseFrameIdx = 0;
+
+    FRAME_BUFFER.timestamp = std::chrono::steady_clock::now();
+
+    switch (PATTERN_TYPE)
+    {
+        case output_pattern_type::animated:
+        {
+            FRAME_BUFFER.pixels = LOCAL_PIXELS;
+            draw_gradient_pattern(LOCAL_PIXELS, ++numTicks);
+            break;
+        }
+        case output_pattern_type::non_animated:
+        {
+            FRAME_BUFFER.pixels = LOCAL_PIXELS;
+            if (IS_PATTERN_DIRTY)
+            {
+                draw_gradient_pattern(LOCAL_PIXELS, numTicks);
+            }
+            break;
+        }
+        case output_pattern_type::image:
+        {
+            FRAME_BUFFER.pixels = LOCAL_PIXELS;
+            if (IS_PATTERN_DIRTY)
+            {
+                if (BG_IMAGE.data)
+                {
+                    draw_image_pattern(LOCAL_PIXELS);
+                }
+                else
                 {
-                    FRAME_BUFFER.pixels[dstIdx+c] = (BG_IMAGE.data[srcIdx+c] * VIDEO_PARAMS.brightness);
+                    draw_gradient_pattern(LOCAL_PIXELS, numTicks);
                 }
             }
+            break;
         }
-    }
-    else
-    {
-        for (unsigned y = 0; y < FRAME_BUFFER.resolution.h; y++)
+        case output_pattern_type::noise:
         {
-            for (unsigned x = 0; x < FRAME_BUFFER.resolution.w; x++)
+            if (IS_PATTERN_DIRTY)
             {
-                const unsigned idx = ((x + y * FRAME_BUFFER.resolution.w) * 4);
-                FRAME_BUFFER.pixels[idx + 0] = (150 * VIDEO_PARAMS.brightness);
-                FRAME_BUFFER.pixels[idx + 1] = (((numTicks + y) % 256) * VIDEO_PARAMS.brightness);
-                FRAME_BUFFER.pixels[idx + 2] = (((numTicks + x) % 256) * VIDEO_PARAMS.brightness);
-                FRAME_BUFFER.pixels[idx + 3] = 255;
+                generate_noise_frames();
             }
+
+            noiseFrameIdx = ((noiseFrameIdx + 1) % NUM_NOISE_FRAMES);
+            const std::size_t frameSize = (FRAME_BUFFER.resolution.w * FRAME_BUFFER.resolution.h * 4);
+            FRAME_BUFFER.pixels = (NOISE_FRAMES.data() + (noiseFrameIdx * frameSize));
+            break;
         }
     }
 
+    IS_PATTERN_DIRTY = false;
+
+    kstamp_stamp_frame(&FRAME_BUFFER);
+
     return;
 }
 
 static void push_capture_event(const capture_event_e event)
 {
-    CAPTURE_EVENT_FLAGS[(int)event] = true;
+    CAPTURE_EVENTS.push(event);
+
+    return;
+}
+
+// Simulates the capturing of a new frame, if one is due.
+static void generate_frame_if_due(void)
+{
+    const auto timeNow = std::chrono::steady_clock::now();
+
+    if (TARGET_REFRESH_RATE)
+    {
+        if (timeNow < NEXT_FRAME_DEADLINE)
+        {
+            return;
+        }
+
+        const auto framePeriod = std::chrono::nanoseconds(1000000000 / TARGET_REFRESH_RATE);
+        NEXT_FRAME_DEADLINE += framePeriod;
+
+        // If we've fallen more than a frame behind (e.g. because the refresh rate
+        // was just changed), resynchronize rather than generate a burst of frames.
+        if (NEXT_FRAME_DEADLINE < timeNow)
+        {
+            NEXT_FRAME_DEADLINE = (timeNow + framePeriod);
+        }
+    }
+
+    const auto inres = resolution_s::from_capture_device_properties();
+
+    if ((inres.w > MAX_CAPTURE_WIDTH) || (inres.h > MAX_CAPTURE_HEIGHT))
+    {
+        push_capture_event(capture_event_e::invalid_signal);
+    }
+    else
+    {
+        push_capture_event(capture_event_e::new_frame);
+        NUM_FRAMES_PER_SECOND++;
+        refresh_test_pattern();
+    }
 
     return;
 }
@@ -127,32 +325,20 @@ void kc_initialize_device(void)
 {
     DEBUG(("Initializing the virtual capture device."));
 
-    k_assert(!FRAME_BUFFER.pixels, "Attempting to doubly initialize the capture device.");
+    k_assert(!LOCAL_PIXELS, "Attempting to doubly initialize the capture device.");
     FRAME_BUFFER.resolution = {.w = 640, .h = 480};
-    FRAME_BUFFER.pixels = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]();
+    LOCAL_PIXELS = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]();
+    FRAME_BUFFER.pixels = LOCAL_PIXELS;
+    update_brightness_lut();
 
     kc_set_device_property("channel", INPUT_CHANNEL_IDX);
     kc_set_device_property("width", FRAME_BUFFER.resolution.w);
     kc_set_device_property("height", FRAME_BUFFER.resolution.h);
 
     PATTERN_TYPE = output_pattern_type(kpers_value_of(INI_GROUP_CAPTURE, "VirtualPattern", 0).toInt());
-
-    // Simulate the capturing of a new frame.
-    kt_timer(std::round(1000 / TARGET_REFRESH_RATE), [](const unsigned)
-    {
-        const auto inres = resolution_s::from_capture_device_properties();
-
-        if ((inres.w > MAX_CAPTURE_WIDTH) || (inres.h > MAX_CAPTURE_HEIGHT))
-        {
-            push_capture_event(capture_event_e::invalid_signal);
-        }
-        else
-        {
-            push_capture_event(capture_event_e::new_frame);
-            NUM_FRAMES_PER_SECOND++;
-            refresh_test_pattern();
-        }
-    });
+    TARGET_REFRESH_RATE = kpers_value_of(INI_GROUP_CAPTURE, "VirtualRefreshRate", 60).toUInt();
+    NOISE_AMPLITUDE = kpers_value_of(INI_GROUP_CAPTURE, "VirtualNoiseAmplitude", 64).toUInt();
+    NEXT_FRAME_DEADLINE = std::chrono::steady_clock::now();
 
     kt_timer(1000, [](const unsigned elapsedMs)
     {
@@ -217,6 +403,8 @@ void kc_initialize_device(void)
                         .h = unsigned(BG_IMAGE.rows)
                     };
 
+                    IS_PATTERN_DIRTY = true;
+
                     kc_set_device_property("width", FRAME_BUFFER.resolution.w);
                     kc_set_device_property("height", FRAME_BUFFER.resolution.h);
                 }
@@ -229,21 +417,65 @@ void kc_initialize_device(void)
                 }
             };
 
+            auto *const noiseAmplitude = new abstract_gui_widget::spinner;
+            noiseAmplitude->prefix = "Noise amplitude: ";
+            noiseAmplitude->minValue = 0;
+            noiseAmplitude->maxValue = 255;
+            noiseAmplitude->value = int(NOISE_AMPLITUDE);
+            noiseAmplitude->isEnabled = (PATTERN_TYPE == output_pattern_type::noise);
+            noiseAmplitude->isVisible = (PATTERN_TYPE == output_pattern_type::noise);
+            noiseAmplitude->on_change = [](const int value)
+            {
+                NOISE_AMPLITUDE = unsigned(value);
+                IS_PATTERN_DIRTY = true;
+                kpers_set_value(INI_GROUP_CAPTURE, "VirtualNoiseAmplitude", value);
+            };
+
             auto *const patternType = new abstract_gui_widget::combo_box;
-            patternType->items = {"Animated", "Still", "Image from file"};
+            patternType->items = {"Animated", "Still", "Image from file", "Noise"};
             patternType->index = unsigned(PATTERN_TYPE);
-            patternType->on_change = [patternType, selectImage](const int itemsIdx)
+            patternType->on_change = [selectImage, noiseAmplitude](const int itemsIdx)
             {
                 PATTERN_TYPE = output_pattern_type(itemsIdx);
+                IS_PATTERN_DIRTY = true;
                 kpers_set_value(INI_GROUP_CAPTURE, "VirtualPattern", itemsIdx);
 
                 selectImage->set_enabled(PATTERN_TYPE == output_pattern_type::image);
                 selectImage->set_visible(PATTERN_TYPE == output_pattern_type::image);
+                noiseAmplitude->set_enabled(PATTERN_TYPE == output_pattern_type::noise);
+                noiseAmplitude->set_visible(PATTERN_TYPE == output_pattern_type::noise);
+            };
+
+            auto *const refreshRate = new abstract_gui_widget::spinner;
+            refreshRate->suffix = " Hz";
+            refreshRate->minValue = 1;
+            refreshRate->maxValue = 1000;
+            refreshRate->value = int(TARGET_REFRESH_RATE? TARGET_REFRESH_RATE : 60);
+            refreshRate->isEnabled = bool(TARGET_REFRESH_RATE);
+            refreshRate->on_change = [](const int value)
+            {
+                TARGET_REFRESH_RATE = unsigned(value);
+                NEXT_FRAME_DEADLINE = std::chrono::steady_clock::now();
+                kpers_set_value(INI_GROUP_CAPTURE, "VirtualRefreshRate", value);
+            };
+
+            auto *const unthrottled = new abstract_gui_widget::checkbox;
+            unthrottled->label = "Unthrottled";
+            unthrottled->state = !TARGET_REFRESH_RATE;
+            unthrottled->on_change = [refreshRate](const bool isChecked)
+            {
+                TARGET_REFRESH_RATE = (isChecked? 0 : unsigned(refreshRate->value));
+                NEXT_FRAME_DEADLINE = std::chrono::steady_clock::now();
+                kpers_set_value(INI_GROUP_CAPTURE, "VirtualRefreshRate", TARGET_REFRESH_RATE);
+
+                refreshRate->set_enabled(!isChecked);
             };
 
             GUI.patternGeneration.layout = abstract_gui_s::layout_e::vertical_box;
             GUI.patternGeneration.fields.push_back({"", {patternType}});
             GUI.patternGeneration.fields.push_back({"", {selectImage}});
+            GUI.patternGeneration.fields.push_back({"", {noiseAmplitude}});
+            GUI.patternGeneration.fields.push_back({"", {refreshRate, unthrottled}});
 
             kd_add_control_panel_widget("Capture", "Pattern generator", &GUI.patternGeneration);
         }
@@ -252,9 +484,14 @@ void kc_initialize_device(void)
     return;
 }
 
+intptr_t kc_device_property(const device_property_e property)
+{
+    return DEVICE_PROPERTIES.value(property);
+}
+
 intptr_t kc_device_property(const std::string &key)
 {
-    return (DEVICE_PROPERTIES.contains(key)? DEVICE_PROPERTIES.at(key) : 0);
+    return DEVICE_PROPERTIES.value(key);
 }
 
 bool kc_set_device_property(const std::string &key, intptr_t value)
@@ -269,6 +506,7 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
         }
 
         FRAME_BUFFER.resolution.w = value;
+        IS_PATTERN_DIRTY = true;
         push_capture_event(capture_event_e::new_video_mode);
     }
     else if (key == "height")
@@ -281,6 +519,7 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
         }
 
         FRAME_BUFFER.resolution.h = value;
+        IS_PATTERN_DIRTY = true;
         push_capture_event(capture_event_e::new_video_mode);
     }
     else if (key == "channel")
@@ -290,9 +529,15 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
     else if (key == "Brightness")
     {
         VIDEO_PARAMS.brightness = (value / double(kc_device_property("Brightness: maximum")));
+        update_brightness_lut();
+    }
+    // Not persisted, so that e.g. a benchmark run doesn't change the user's setting.
+    else if (key == "unthrottled")
+    {
+        TARGET_REFRESH_RATE = (value? 0 : kpers_value_of(INI_GROUP_CAPTURE, "VirtualRefreshRate", 60).toUInt());
     }
 
-    DEVICE_PROPERTIES[key] = value;
+    DEVICE_PROPERTIES.set(key, value);
 
     return true;
 }
@@ -301,11 +546,11 @@ capture_event_e kc_process_next_capture_event(void)
 {
     static const auto pop_capture_event = [](const capture_event_e event)
     {
-        const bool oldFlagValue = CAPTURE_EVENT_FLAGS[(int)event];
-        CAPTURE_EVENT_FLAGS[(int)event] = false;
-        return oldFlagValue;
+        return CAPTURE_EVENTS.pop(event);
     };
 
+    generate_frame_if_due();
+
     if (pop_capture_event(capture_event_e::invalid_signal))
     {
         ev_invalid_capture_signal.fire();
@@ -332,7 +577,11 @@ capture_event_e kc_process_next_capture_event(void)
 
 bool kc_release_device(void)
 {
-    delete [] FRAME_BUFFER.pixels;
+    FRAME_BUFFER.pixels = nullptr;
+    delete [] LOCAL_PIXELS;
+    LOCAL_PIXELS = nullptr;
+    NOISE_FRAMES.clear();
+    NOISE_FRAMES.shrink_to_fit();
 
     return true;
 }
@@ -24,6 +24,7 @@
 #include "capture/vision_v4l/input_channel_v4l.h"
 #include "capture/video_presets.h"
 #include "capture/capture.h"
+#include "capture/device_properties.h"
 #include "capture/vision_v4l/ic_v4l_video_parameters.h"
 #include "common/vcs_event/vcs_event.h"
 #include "display/qt/persistent_settings.h"
@@ -100,7 +101,7 @@ static const  std::vector<const char*> SUPPORTED_VIDEO_PROPERTIES_DIGITAL = {
     "Contrast",
 };
 
-static std::unordered_map<std::string, intptr_t> DEVICE_PROPERTIES = {
+static device_properties_c DEVICE_PROPERTIES = {
     {"api name", intptr_t("Datapath Vision")},
 
     {"width: minimum", MIN_CAPTURE_WIDTH},
@@ -254,9 +255,14 @@ static void set_input_channel(const unsigned channelIdx)
     return;
 }
 
+intptr_t kc_device_property(const device_property_e property)
+{
+    return DEVICE_PROPERTIES.value(property);
+}
+
 intptr_t kc_device_property(const std::string &key)
 {
-    return (DEVICE_PROPERTIES.contains(key)? DEVICE_PROPERTIES.at(key) : 0);
+    return DEVICE_PROPERTIES.value(key);
 }
 
 bool kc_set_device_property(const std::string &key, intptr_t value)
@@ -304,7 +310,8 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
     else if (key == "capture rate")
     {
         refresh_rate_s rateOnDevice = send_capture_rate_to_device(refresh_rate_s::from_fixedpoint(value));
-        value = DEVICE_PROPERTIES[key] = rateOnDevice.fixedpoint;
+        value = rateOnDevice.fixedpoint;
+        DEVICE_PROPERTIES.set(key, value);
         ev_new_capture_rate.fire(rateOnDevice);
     }
     else if (key == "channel")
@@ -364,7 +371,7 @@ bool kc_set_device_property(const std::string &key, intptr_t value)
         }
     }
 
-    DEVICE_PROPERTIES[key] = value;
+    DEVICE_PROPERTIES.set(key, value);
 
     return true;
 }
@@ -428,6 +435,7 @@ capture_event_e kc_process_next_capture_event(void)
     }
     else if (INPUT_CHANNEL->pop_capture_event(capture_event_e::new_frame))
     {
+        INPUT_CHANNEL->receive_new_frame();
         ev_new_captured_frame.fire(FRAME_BUFFER);
         return capture_event_e::new_frame;
     }
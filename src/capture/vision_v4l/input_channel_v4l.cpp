@@ -12,9 +12,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <cstring>
+#include <utility>
 #include <linux/videodev2.h>
 #include "capture/vision_v4l/input_channel_v4l.h"
 #include "capture/vision_v4l/ic_v4l_video_parameters.h"
+#include "capture/v4l_timestamp.h"
 
 #define INCLUDE_VISION
 #include <rgb133control.h>
@@ -40,6 +42,9 @@ input_channel_v4l_c::input_channel_v4l_c(
     this->captureStatus.refreshRate = LATEST_REFRESH_RATE;
     this->captureStatus.resolution = LATEST_RESOLUTION;
 
+    this->backFrameBuffer.pixels = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]();
+    this->numDeviceDroppedFrames = this->dstFrameBuffer->numDeviceDroppedFrames;
+
     this->start_capturing();
 
     return;
@@ -54,28 +59,28 @@ input_channel_v4l_c::~input_channel_v4l_c()
     /// TODO: Do something with retVal if need be, e.g. report errors.
     (void)retVal;
 
+    delete [] this->backFrameBuffer.pixels;
+
     return;
 }
 
-void input_channel_v4l_c::push_capture_event(capture_event_e flag)
+void input_channel_v4l_c::receive_new_frame(void)
 {
-    const unsigned flagIdx = static_cast<unsigned>(flag);
+    std::swap(*this->dstFrameBuffer, this->backFrameBuffer);
 
-    k_assert((flagIdx < this->captureEventFlags.size()), "Overflowing the capture event flag buffer.");
+    return;
+}
 
-    this->captureEventFlags[flagIdx] = 1;
+void input_channel_v4l_c::push_capture_event(capture_event_e flag)
+{
+    this->captureEvents.push(flag);
 
     return;
 }
 
 bool input_channel_v4l_c::pop_capture_event(const capture_event_e flag)
 {
-    const unsigned flagIdx = static_cast<unsigned>(flag);
-
-    k_assert((flagIdx < this->captureEventFlags.size()), "Overflowing the capture event flag buffer.");
-
-    const bool value = this->captureEventFlags[flagIdx];
-    this->captureEventFlags[flagIdx] = 0;
+    const bool value = this->captureEvents.pop(flag);
 
     if ((flag == capture_event_e::sleep) &&
         !this->run)
@@ -135,7 +140,6 @@ bool input_channel_v4l_c::capture_thread__has_signal(void)
 
         if (hasStatusChanged)
         {
-            LOCK_CAPTURE_MUTEX_IN_SCOPE;
             this->push_capture_event(hasNoSignal? capture_event_e::signal_lost : capture_event_e::signal_gained);
         }
     }
@@ -152,8 +156,6 @@ bool input_channel_v4l_c::capture_thread__has_source_mode_changed(void)
     {
         if (!input_channel_v4l_c::is_format_of_valid_signal(&format))
         {
-            LOCK_CAPTURE_MUTEX_IN_SCOPE;
-
             this->captureStatus.invalidSignal = true;
             this->push_capture_event(capture_event_e::invalid_signal);
 
@@ -181,8 +183,6 @@ bool input_channel_v4l_c::capture_thread__has_source_mode_changed(void)
     // Failed to query the video format.
     else
     {
-        LOCK_CAPTURE_MUTEX_IN_SCOPE;
-
         this->captureStatus.invalidSignal = true;
         this->push_capture_event(capture_event_e::invalid_signal);
         this->push_capture_event(capture_event_e::unrecoverable_error);
@@ -227,8 +227,6 @@ bool input_channel_v4l_c::capture_thread__get_next_frame(void)
                 }
                 default:
                 {
-                    LOCK_CAPTURE_MUTEX_IN_SCOPE;
-
                     this->push_capture_event(capture_event_e::unrecoverable_error);
 
                     return false;
@@ -236,6 +234,20 @@ bool input_channel_v4l_c::capture_thread__get_next_frame(void)
             }
         }
 
+        // Frames the device skipped show up as gaps in its sequence numbering.
+        {
+            const uint32_t numSkipped = (this->hasPrevFrameSequence? (buf.sequence - this->prevFrameSequence - 1) : 0);
+
+            // Guard against drivers that don't increment the sequence number.
+            if (numSkipped < (UINT32_MAX / 2))
+            {
+                this->numDeviceDroppedFrames += numSkipped;
+            }
+
+            this->prevFrameSequence = buf.sequence;
+            this->hasPrevFrameSequence = true;
+        }
+
         // If the hardware is sending us a new frame while we're still unfinished
         // processing the previous frame, we'll skip this new frame.
         if (this->captureStatus.numFramesCaptured != this->captureStatus.numFramesProcessed)
@@ -244,13 +256,13 @@ bool input_channel_v4l_c::capture_thread__get_next_frame(void)
         }
         else
         {
-            LOCK_CAPTURE_MUTEX_IN_SCOPE;
-
             const input_channel_v4l_c::mmap_metadata &srcBuffer = this->mmapBackBuffers.at(buf.index);
 
-            this->dstFrameBuffer->timestamp = std::chrono::steady_clock::now();
-            this->dstFrameBuffer->resolution = LATEST_RESOLUTION;
-            memcpy(this->dstFrameBuffer->pixels, srcBuffer.ptr, srcBuffer.length);
+            this->backFrameBuffer.timestamp = kv4l_buffer_timestamp(buf);
+            this->backFrameBuffer.sequence = buf.sequence;
+            this->backFrameBuffer.numDeviceDroppedFrames = this->numDeviceDroppedFrames;
+            this->backFrameBuffer.resolution = LATEST_RESOLUTION;
+            memcpy(this->backFrameBuffer.pixels, srcBuffer.ptr, srcBuffer.length);
 
             this->captureStatus.numFramesCaptured++;
             this->push_capture_event(capture_event_e::new_frame);
@@ -259,8 +271,6 @@ bool input_channel_v4l_c::capture_thread__get_next_frame(void)
         // Tell the capture device that we've finished accessing the buffer.
         if (!this->device_ioctl(VIDIOC_QBUF, &buf))
         {
-            LOCK_CAPTURE_MUTEX_IN_SCOPE;
-
             this->push_capture_event(capture_event_e::unrecoverable_error);
 
             return false;
@@ -269,10 +279,8 @@ bool input_channel_v4l_c::capture_thread__get_next_frame(void)
     // A capture error.
     else
     {
-        LOCK_CAPTURE_MUTEX_IN_SCOPE;
-
         this->push_capture_event(capture_event_e::unrecoverable_error);
-        
+
         return false;
     }
 
@@ -354,8 +362,6 @@ int input_channel_v4l_c::capture_thread(void)
             }
             else
             {
-                LOCK_CAPTURE_MUTEX_IN_SCOPE;
-
                 this->push_capture_event(capture_event_e::new_video_mode);
 
                 // The parent is expected to re-spawn this input channel, so we can exit the
@@ -621,10 +627,7 @@ bool input_channel_v4l_c::start_capturing()
 
 void input_channel_v4l_c::reset_capture_event_flags(void)
 {
-    for (auto &flag: this->captureEventFlags)
-    {
-        flag = 0;
-    }
+    this->captureEvents.clear();
 
     return;
 }
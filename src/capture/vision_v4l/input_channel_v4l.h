@@ -18,6 +18,7 @@
 #include "common/globals.h"
 #include "common/refresh_rate.h"
 #include "capture/capture.h"
+#include "capture/capture_event_flags.h"
 #include "capture/vision_v4l/ic_v4l_video_parameters.h"
 
 struct v4l2_format;
@@ -39,6 +40,10 @@ public:
     // the flag.
     bool pop_capture_event(const capture_event_e flag);
 
+    // Swaps the most recently captured frame into the frame buffer given to the
+    // constructor. To be called by VCS's main thread on a new frame event.
+    void receive_new_frame(void);
+
     // Execute an ioctl() on this input channel's underlying /dev/videoX device.
     // Returns true on success; false otherwise (see errno for ioctl() errors).
     bool device_ioctl(const unsigned long request, void *data);
@@ -55,7 +60,7 @@ public:
 
         // True if the signal we're currently receiving is invalid in some way
         // (e.g. out of range).
-        bool invalidSignal = false;
+        std::atomic<bool> invalidSignal = false;
 
         // Set to true if we were unable to start capturing on the given capture
         // device.
@@ -86,7 +91,7 @@ private:
 
     // Poll the capture devicve for a new frame. Sets capture events flags
     // accordingly. On success, returns true and either copies the new frame's
-    // data to dstFrameBuffer or does nothing if no new frame was available. On
+    // data to backFrameBuffer or does nothing if no new frame was available. On
     // error, returns false.
     bool capture_thread__get_next_frame(void);
 
@@ -135,6 +140,16 @@ private:
     };
     std::vector<mmap_metadata> mmapBackBuffers;
 
+    // The driver's sequence number of the most recently dequeued frame, for
+    // detecting frames the device skipped. Accessed only by the capture thread.
+    uint32_t prevFrameSequence = 0;
+    bool hasPrevFrameSequence = false;
+
+    // A running count of frames the device has skipped, continuing the frame
+    // buffer's count from before this channel was opened. Accessed only by the
+    // capture thread once it's running.
+    unsigned numDeviceDroppedFrames = 0;
+
     // Returns the maximum supported capture resolution for this input channel.
     resolution_s maximum_resolution(void) const;
 
@@ -143,7 +158,7 @@ private:
 
     // Flags that the capture channel will set to convey to the VCS thread the
     // various capture events it detects during capture.
-    std::vector<unsigned> captureEventFlags = std::vector<unsigned>(static_cast<unsigned>(capture_event_e::num_enumerators));
+    capture_event_flags_c captureEvents;
 
     std::string v4lDeviceFileName = "";
 
@@ -154,6 +169,13 @@ private:
     // by the parent capture API
     captured_frame_s *const dstFrameBuffer;
 
+    // The capture thread copies each new frame into this buffer, without locking
+    // the capture mutex, and receive_new_frame() then swaps it with
+    // dstFrameBuffer. A new frame is copied only once VCS has finished processing
+    // the previous one (see captureStatus), so the capture thread never writes
+    // into the frame buffer that VCS is using.
+    captured_frame_s backFrameBuffer;
+
     // The number of back buffers our parent capture API asked us to use. Note that
     // the capture device may not be able to supply this many.
     const unsigned requestedNumBackBuffers;
@@ -5,6 +5,7 @@
  */
 
 #include <unistd.h>
+#include <getopt.h>
 #include "common/globals.h"
 #include "display/display.h"
 
@@ -27,6 +28,18 @@ static std::string VIDEO_PRESETS_FILE_NAME = "";
 // Name of (and path to) the filter set file on disk.
 static std::string FILTER_GRAPH_FILE_NAME = "";
 
+// The address ("[IPv4 address:]port") on which to serve metrics; or an empty
+// string if metrics aren't to be served.
+static std::string METRICS_ADDRESS = "";
+
+// The options of the headless benchmark (see kbench_parse_options()); or an empty
+// string if the benchmark isn't to be run.
+static std::string BENCHMARK_SPEC = "";
+
+// The options of the end-to-end latency test (see latency_stamp.h); or an empty
+// string if the test isn't to be run.
+static std::string LATENCY_TEST_SPEC = "";
+
 bool kcom_parse_command_line(const int argc, char *const argv[])
 {
     const char parseFailMsg[] = "VCS has to exit because it found unexpected values "
@@ -35,8 +48,14 @@ bool kcom_parse_command_line(const int argc, char *const argv[])
                                 "console window was not already open, run VCS "
                                 "again from the command line.";
 
+    const option longOptions[] = {
+        {"benchmark", required_argument, nullptr, 'b'},
+        {"latency-test", required_argument, nullptr, 'l'},
+        {nullptr, 0, nullptr, 0}
+    };
+
     int c = 0;
-    while ((c = getopt(argc, argv, "i:v:f:s")) != -1)
+    while ((c = getopt_long(argc, argv, "i:v:f:m:s", longOptions, nullptr)) != -1)
     {
         switch (c)
         {
@@ -75,6 +94,21 @@ bool kcom_parse_command_line(const int argc, char *const argv[])
                 FILTER_GRAPH_FILE_NAME = optarg;
                 break;
             }
+            case 'm':
+            {
+                METRICS_ADDRESS = optarg;
+                break;
+            }
+            case 'b':
+            {
+                BENCHMARK_SPEC = optarg;
+                break;
+            }
+            case 'l':
+            {
+                LATENCY_TEST_SPEC = optarg;
+                break;
+            }
         }
     }
 
@@ -104,3 +138,18 @@ const std::string& kcom_video_presets_file_name(void)
 {
     return VIDEO_PRESETS_FILE_NAME;
 }
+
+const std::string& kcom_metrics_address(void)
+{
+    return METRICS_ADDRESS;
+}
+
+const std::string& kcom_benchmark_spec(void)
+{
+    return BENCHMARK_SPEC;
+}
+
+const std::string& kcom_latency_test_spec(void)
+{
+    return LATENCY_TEST_SPEC;
+}
@@ -14,6 +14,9 @@ bool kcom_parse_command_line(const int argc, char *const argv[]);
 const std::string& kcom_aliases_file_name(void);
 const std::string& kcom_filter_graph_file_name(void);
 const std::string& kcom_video_presets_file_name(void);
+const std::string& kcom_metrics_address(void);
+const std::string& kcom_benchmark_spec(void);
+const std::string& kcom_latency_test_spec(void);
 
 void kcom_override_filter_graph_file_name(const std::string newFilename);
 void kcom_override_video_presets_file_name(const std::string newFilename);
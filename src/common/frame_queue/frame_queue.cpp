@@ -0,0 +1,114 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <cstring>
+#include "common/frame_queue/frame_queue.h"
+#include "common/assert.h"
+
+frame_queue_c::frame_queue_c(const unsigned capacity) :
+    capacity(capacity)
+{
+    k_assert((capacity > 0), "A frame queue's capacity must be greater than zero.");
+
+    this->bufferPool.reserve(capacity);
+
+    return;
+}
+
+bool frame_queue_c::push(const image_s &image,
+                         const std::string &label,
+                         const uint64_t tag,
+                         const std::chrono::steady_clock::time_point timestamp)
+{
+    k_assert(image.is_valid(), "Attempting to push an invalid image into a frame queue.");
+
+    queued_frame_s frame;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+
+        if (
+            this->isClosed ||
+            (this->numFramesOutstanding >= this->capacity)
+        ){
+            return false;
+        }
+
+        if (!this->bufferPool.empty())
+        {
+            frame.pixels = std::move(this->bufferPool.back());
+            this->bufferPool.pop_back();
+        }
+
+        this->numFramesOutstanding++;
+    }
+
+    // Copy the pixels outside of the lock, so consumers aren't held up by it.
+    frame.pixels.resize(image.byte_size());
+    std::memcpy(frame.pixels.data(), image.pixels, image.byte_size());
+    frame.resolution = image.resolution;
+    frame.timestamp = timestamp;
+    frame.label = label;
+    frame.tag = tag;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->frames.push_back(std::move(frame));
+    }
+
+    this->frameAvailable.notify_one();
+
+    return true;
+}
+
+bool frame_queue_c::pop(queued_frame_s *const frame)
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    this->frameAvailable.wait(lock, [this]{return (this->isClosed || !this->frames.empty());});
+
+    if (this->frames.empty())
+    {
+        return false;
+    }
+
+    *frame = std::move(this->frames.front());
+    this->frames.pop_front();
+
+    return true;
+}
+
+void frame_queue_c::recycle(queued_frame_s &frame)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    k_assert((this->numFramesOutstanding > 0), "Recycling more frames than were pushed into the frame queue.");
+
+    this->bufferPool.push_back(std::move(frame.pixels));
+    this->numFramesOutstanding--;
+
+    return;
+}
+
+void frame_queue_c::close(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->isClosed = true;
+    }
+
+    this->frameAvailable.notify_all();
+
+    return;
+}
+
+unsigned frame_queue_c::backlog(void)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    return this->frames.size();
+}
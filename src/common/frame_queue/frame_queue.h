@@ -0,0 +1,108 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#ifndef VCS_COMMON_FRAME_QUEUE_FRAME_QUEUE_H
+#define VCS_COMMON_FRAME_QUEUE_FRAME_QUEUE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <deque>
+#include <mutex>
+#include "display/display.h"
+
+// A frame's pixel data copied into a frame queue (see frame_queue_c).
+struct queued_frame_s
+{
+    std::vector<uint8_t> pixels;
+    resolution_s resolution = {0, 0};
+    std::chrono::steady_clock::time_point timestamp;
+
+    // Caller-defined information associated with the frame, e.g. a file name
+    // and a format identifier.
+    std::string label;
+    uint64_t tag = 0;
+};
+
+// A bounded, thread-safe FIFO queue for handing copies of frames from VCS's main
+// thread to one or more worker threads.
+//
+// The queue's frame buffers are pooled: once a consumer is done with a frame, it
+// returns the frame's buffer to the queue via recycle(), and the buffer is then
+// reused for subsequently pushed frames. Once the pool has warmed up, pushing a
+// frame thus costs a memcpy of its pixels but no allocations.
+//
+// Usage:
+//
+//   1. Producer (typically VCS's main thread):
+//
+//      if (!queue.push(image))
+//      {
+//          // The queue was full, so the frame was dropped.
+//      }
+//
+//   2. Consumer (a worker thread):
+//
+//      queued_frame_s frame;
+//      while (queue.pop(&frame))
+//      {
+//          // Process the frame...
+//          queue.recycle(frame);
+//      }
+//
+//   3. To shut down the consumers, call queue.close(). Consumers will finish
+//      processing the frames remaining in the queue, after which pop() will
+//      return false.
+//
+class frame_queue_c
+{
+public:
+    // The capacity is the maximum number of frames that can be in the queue or
+    // held by consumers at any one time.
+    frame_queue_c(const unsigned capacity);
+
+    // Copies the given image into a pooled buffer and appends it to the queue.
+    // Returns false, dropping the frame, if the queue is at capacity or closed.
+    bool push(const image_s &image,
+              const std::string &label = "",
+              const uint64_t tag = 0,
+              const std::chrono::steady_clock::time_point timestamp = std::chrono::steady_clock::now());
+
+    // Waits until the queue has a frame or is closed. Returns false if the queue
+    // has been closed and has no more frames; otherwise, moves the oldest frame
+    // in the queue into the given frame and returns true.
+    //
+    // The frame's buffer should be given back via recycle() once it's no longer
+    // needed.
+    bool pop(queued_frame_s *const frame);
+
+    // Returns the given popped frame's buffer to the queue's pool.
+    void recycle(queued_frame_s &frame);
+
+    // Wakes up any waiting consumers and makes the queue refuse further pushes.
+    void close(void);
+
+    // Returns the number of frames waiting in the queue to be popped.
+    unsigned backlog(void);
+
+    const unsigned capacity;
+
+private:
+    std::mutex mutex;
+    std::condition_variable frameAvailable;
+    std::deque<queued_frame_s> frames;
+    std::vector<std::vector<uint8_t>> bufferPool;
+
+    // The number of frames currently in the queue or held by consumers.
+    unsigned numFramesOutstanding = 0;
+
+    bool isClosed = false;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <algorithm>
+#include "common/frame_queue/frame_writer.h"
+#include "common/assert.h"
+
+// The approximate maximum amount of memory, in bytes, to be used for frames
+// waiting to be written. Limits the length of the writer's backlog.
+static const std::size_t MAX_BACKLOG_BYTE_SIZE = (512 * 1024 * 1024);
+
+frame_writer_c::frame_writer_c(const std::size_t frameByteSize, write_fn_t write, close_fn_t close) :
+    write(write),
+    closeFn(close)
+{
+    k_assert((frameByteSize > 0), "A frame writer's frames must have a non-zero size.");
+
+    this->queue = std::make_unique<frame_queue_c>(std::clamp<std::size_t>((MAX_BACKLOG_BYTE_SIZE / frameByteSize), 4, 120));
+    this->thread = std::thread(&frame_writer_c::writer_thread, this);
+
+    return;
+}
+
+frame_writer_c::~frame_writer_c()
+{
+    this->close();
+    this->join();
+
+    return;
+}
+
+void frame_writer_c::writer_thread(void)
+{
+    queued_frame_s frame;
+
+    while (this->queue->pop(&frame))
+    {
+        if (!this->hasWriteError)
+        {
+            if (this->write(frame))
+            {
+                this->numFramesWritten++;
+            }
+            else
+            {
+                this->hasWriteError = true;
+            }
+        }
+
+        this->queue->recycle(frame);
+    }
+
+    if (!this->closeFn())
+    {
+        this->hasWriteError = true;
+    }
+
+    this->isFinished = true;
+
+    return;
+}
+
+bool frame_writer_c::push(const image_s &image,
+                          const std::string &label,
+                          const uint64_t tag,
+                          const std::chrono::steady_clock::time_point timestamp)
+{
+    if (!this->queue || !this->queue->push(image, label, tag, timestamp))
+    {
+        this->numFramesDropped++;
+        return false;
+    }
+
+    return true;
+}
+
+void frame_writer_c::close(void)
+{
+    if (this->queue)
+    {
+        this->queue->close();
+    }
+
+    return;
+}
+
+bool frame_writer_c::is_finished(void) const
+{
+    return this->isFinished;
+}
+
+bool frame_writer_c::join(void)
+{
+    if (!this->thread.joinable())
+    {
+        return false;
+    }
+
+    this->thread.join();
+    this->queue.reset();
+
+    return true;
+}
+
+bool frame_writer_c::has_write_error(void) const
+{
+    return this->hasWriteError;
+}
+
+unsigned frame_writer_c::num_frames_written(void) const
+{
+    return this->numFramesWritten;
+}
+
+unsigned frame_writer_c::num_frames_dropped(void) const
+{
+    return this->numFramesDropped;
+}
+
+unsigned frame_writer_c::backlog(void) const
+{
+    return (this->queue? this->queue->backlog() : 0);
+}
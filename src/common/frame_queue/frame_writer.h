@@ -0,0 +1,106 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#ifndef VCS_COMMON_FRAME_QUEUE_FRAME_WRITER_H
+#define VCS_COMMON_FRAME_QUEUE_FRAME_WRITER_H
+
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <chrono>
+#include "common/frame_queue/frame_queue.h"
+
+// Writes copies of frames, e.g. into a file, on a worker thread of its own, so
+// that VCS's main thread only has to copy each frame into a bounded frame queue
+// (see frame_queue_c). Frames pushed while the queue is full are dropped.
+//
+// The user supplies the functions that write each frame and that finish the
+// writing (e.g. close the file); both are called on the writer thread.
+//
+// Usage:
+//
+//   1. Open the destination, then create the writer, which starts the writer
+//      thread:
+//
+//      frame_writer_c *writer = new frame_writer_c(frameByteSize, write_frame, close_file);
+//
+//   2. From VCS's main thread, push frames to be written:
+//
+//      writer->push(image);
+//
+//   3. Call writer->close() to have the writer finish writing the frames in its
+//      backlog and then call the close function. Once is_finished() returns
+//      true, join() the writer thread.
+//
+class frame_writer_c
+{
+public:
+    // Writes the given frame. Returns false if the frame couldn't be written, in
+    // which case the writer gives up on the remaining frames.
+    typedef std::function<bool(const queued_frame_s &frame)> write_fn_t;
+
+    // Called once all frames have been written (or given up on). Returns false
+    // if the writing couldn't be finished, e.g. because the file couldn't be
+    // closed; true otherwise.
+    typedef std::function<bool(void)> close_fn_t;
+
+    // The writer's backlog holds as many frames of the given byte size as fit
+    // in a fixed memory budget, within reasonable limits.
+    frame_writer_c(const std::size_t frameByteSize, write_fn_t write, close_fn_t close);
+    ~frame_writer_c();
+
+    // Queues a copy of the given image to be written. Returns false if the frame
+    // was dropped because the backlog was full or the writer has been closed;
+    // true otherwise. To be called from VCS's main thread.
+    bool push(const image_s &image,
+              const std::string &label = "",
+              const uint64_t tag = 0,
+              const std::chrono::steady_clock::time_point timestamp = std::chrono::steady_clock::now());
+
+    // Stops accepting frames. The frames already in the backlog will be written
+    // in the background.
+    void close(void);
+
+    // Returns true once the writer thread has finished writing and called the
+    // close function.
+    bool is_finished(void) const;
+
+    // Waits for the writer thread to finish (the writer should have been closed),
+    // then joins it and frees the backlog's buffers. Returns true if this call
+    // joined the thread; false if it had already been joined.
+    bool join(void);
+
+    // Returns true if a frame couldn't be written or the close function failed.
+    bool has_write_error(void) const;
+
+    unsigned num_frames_written(void) const;
+
+    // Returns the number of frames that were dropped because the backlog was full.
+    unsigned num_frames_dropped(void) const;
+
+    // Returns the number of frames waiting to be written.
+    unsigned backlog(void) const;
+
+private:
+    void writer_thread(void);
+
+    const write_fn_t write;
+    const close_fn_t closeFn;
+
+    std::unique_ptr<frame_queue_c> queue;
+    std::thread thread;
+
+    std::atomic<bool> isFinished = false;
+    std::atomic<bool> hasWriteError = false;
+    std::atomic<unsigned> numFramesWritten = 0;
+    unsigned numFramesDropped = 0;
+};
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#include <ctime>
+#include "common/futex/futex.h"
+
+// Note: We use the non-private futex operations, since the futex word may be in
+// memory shared with another process.
+
+bool kfutex_wait(uint32_t *const word, const uint32_t expectedValue, const std::chrono::nanoseconds timeout)
+{
+    const struct timespec timeoutSpec = {
+        .tv_sec = time_t(timeout.count() / 1000000000),
+        .tv_nsec = long(timeout.count() % 1000000000),
+    };
+
+    const long result = syscall(SYS_futex, word, FUTEX_WAIT, expectedValue, &timeoutSpec, nullptr, 0);
+
+    return !((result == -1) && (errno == ETIMEDOUT));
+}
+
+void kfutex_wake(uint32_t *const word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+
+    return;
+}
@@ -0,0 +1,44 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * Thin wrappers around Linux futexes, for sleeping until a 32-bit word of
+ * memory -- possibly one shared with another process -- changes value.
+ *
+ * Usage:
+ *
+ *   Waiter:
+ *
+ *      const uint32_t seen = std::atomic_ref<uint32_t>(*word).load();
+ *      // ...check whether there's work to do; if not:
+ *      kfutex_wait(word, seen, std::chrono::milliseconds(100));
+ *
+ *   Waker:
+ *
+ *      std::atomic_ref<uint32_t>(*word).fetch_add(1);
+ *      kfutex_wake(word);
+ *
+ */
+
+#ifndef VCS_COMMON_FUTEX_FUTEX_H
+#define VCS_COMMON_FUTEX_FUTEX_H
+
+#include <cstdint>
+#include <chrono>
+
+// Sleeps until another thread or process wakes up waiters on the given word via
+// kfutex_wake(), or the timeout expires. Returns immediately if the word's value
+// isn't the expected value. Spurious wakeups are possible, so the caller should
+// re-check its wait condition on return.
+//
+// Returns false if the wait timed out; true otherwise.
+bool kfutex_wait(uint32_t *const word, const uint32_t expectedValue, const std::chrono::nanoseconds timeout);
+
+// Wakes up all threads and processes waiting on the given word.
+void kfutex_wake(uint32_t *const word);
+
+#endif
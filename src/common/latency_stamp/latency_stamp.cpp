@@ -0,0 +1,328 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <sstream>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <array>
+#include "common/latency_stamp/latency_stamp.h"
+#include "common/command_line/command_line.h"
+#include "common/trace/trace.h"
+#include "capture/capture.h"
+#include "common/globals.h"
+#include "common/assert.h"
+
+// The stamp consists of a row of blocks, one per bit of the frame counter, with
+// the bit's value in the block's top half and its complement in the bottom half.
+// A bit whose halves don't disagree tells us that there's no valid stamp.
+static const unsigned NUM_STAMP_BITS = 32;
+static const unsigned STAMP_BLOCK_SIZE = 8;
+static const unsigned STAMP_WIDTH = (NUM_STAMP_BITS * STAMP_BLOCK_SIZE);
+static const unsigned STAMP_HEIGHT = (STAMP_BLOCK_SIZE * 2);
+
+static bool IS_ENABLED = false;
+
+// How many presented frames to measure before asking VCS to exit; and where to
+// write the results (stdout if empty).
+static unsigned NUM_FRAMES_TO_MEASURE = 0;
+static std::string RESULTS_FILENAME = "";
+
+static uint32_t NEXT_FRAME_COUNTER = 1;
+
+// The resolution of the most recently stamped frame, by which we locate the
+// stamp in a presented image.
+static resolution_s STAMP_RESOLUTION = {0, 0};
+
+// The capture times of the most recently stamped frames, indexed by their frame
+// counter modulo the array's size.
+struct stamped_frame_s
+{
+    uint32_t counter = 0;
+    std::chrono::steady_clock::time_point timestamp;
+};
+
+static std::array<stamped_frame_s, 1024> STAMPED_FRAMES;
+
+// The counter of the frame read by kstamp_read_presented_frame(), if any; and of
+// the most recent frame whose latency was recorded.
+static uint32_t PENDING_COUNTER = 0;
+static uint32_t LATEST_RECORDED_COUNTER = 0;
+
+static latency_histogram_c LATENCIES;
+static unsigned NUM_FRAMES_MEASURED = 0;
+static uint32_t FIRST_RECORDED_COUNTER = 0;
+static bool ARE_RESULTS_WRITTEN = false;
+
+static bool parse_spec(const std::string &spec)
+{
+    std::stringstream specStream(spec);
+    std::string option;
+
+    while (std::getline(specStream, option, ','))
+    {
+        const std::size_t separatorPos = option.find('=');
+        const std::string key = option.substr(0, separatorPos);
+        const std::string value = ((separatorPos == std::string::npos)? "" : option.substr(separatorPos + 1));
+
+        if (key == "frames")
+        {
+            NUM_FRAMES_TO_MEASURE = unsigned(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (key == "json")
+        {
+            RESULTS_FILENAME = value;
+        }
+        else
+        {
+            NBENE(("Unknown latency test option \"%s\".", option.c_str()));
+            return false;
+        }
+    }
+
+    if (!NUM_FRAMES_TO_MEASURE)
+    {
+        NBENE(("The latency test needs a positive frame count, e.g. \"frames=600\"."));
+        return false;
+    }
+
+    return true;
+}
+
+static void write_results(void)
+{
+    ARE_RESULTS_WRITTEN = true;
+
+    const latency_percentiles_s stats = LATENCIES.percentiles();
+
+    // Stamped frames between the first and most recent measured one that never
+    // made it onto the screen.
+    const uint64_t numFramesNotPresented = (
+        stats.count
+            ? ((uint64_t(LATEST_RECORDED_COUNTER - FIRST_RECORDED_COUNTER) + 1) - stats.count)
+            : 0
+    );
+
+    char json[512];
+    std::snprintf(
+        json,
+        sizeof(json),
+        "{\n"
+        "  \"frames\": %llu,\n"
+        "  \"frames_not_presented\": %llu,\n"
+        "  \"capture_to_present\": {\"p50_us\": %u, \"p95_us\": %u, \"p99_us\": %u, \"max_us\": %u}\n"
+        "}\n",
+        (unsigned long long)stats.count,
+        (unsigned long long)numFramesNotPresented,
+        stats.p50,
+        stats.p95,
+        stats.p99,
+        stats.max
+    );
+
+    if (RESULTS_FILENAME.empty())
+    {
+        std::fputs(json, stdout);
+        return;
+    }
+
+    FILE *const file = std::fopen(RESULTS_FILENAME.c_str(), "w");
+    const bool isWritten = (file && (std::fputs(json, file) >= 0));
+
+    if (
+        !file ||
+        (std::fclose(file) != 0) ||
+        !isWritten
+    ){
+        NBENE(("Failed to write the latency test results into \"%s\".", RESULTS_FILENAME.c_str()));
+        return;
+    }
+
+    INFO(("Saved the latency test results into \"%s\".", RESULTS_FILENAME.c_str()));
+
+    return;
+}
+
+subsystem_releaser_t kstamp_initialize(void)
+{
+    DEBUG(("Initializing the latency stamping subsystem."));
+
+    if (!kcom_latency_test_spec().empty())
+    {
+        if (parse_spec(kcom_latency_test_spec()))
+        {
+            IS_ENABLED = true;
+            INFO(("Measuring capture-to-present latency over %u frames.", NUM_FRAMES_TO_MEASURE));
+        }
+        else
+        {
+            NBENE(("Malformed latency test options. The latency test is disabled."));
+        }
+    }
+
+    return []
+    {
+        DEBUG(("Releasing the latency stamping subsystem."));
+
+        // If VCS is exiting before the requested number of frames were measured,
+        // we report what we've got.
+        if (IS_ENABLED && !ARE_RESULTS_WRITTEN)
+        {
+            write_results();
+        }
+    };
+}
+
+bool kstamp_is_enabled(void)
+{
+    return IS_ENABLED;
+}
+
+void kstamp_stamp_frame(captured_frame_s *const frame)
+{
+    if (!IS_ENABLED)
+    {
+        return;
+    }
+
+    if (
+        !frame->pixels ||
+        (frame->resolution.w < STAMP_WIDTH) ||
+        (frame->resolution.h < STAMP_HEIGHT)
+    ){
+        static bool isWarned = false;
+
+        if (!isWarned)
+        {
+            NBENE(("Frames are too small for latency stamping; need at least %u x %u.", STAMP_WIDTH, STAMP_HEIGHT));
+            isWarned = true;
+        }
+
+        return;
+    }
+
+    const uint32_t counter = NEXT_FRAME_COUNTER++;
+
+    // Zero denotes no frame.
+    if (!NEXT_FRAME_COUNTER)
+    {
+        NEXT_FRAME_COUNTER = 1;
+    }
+
+    for (unsigned bit = 0; bit < NUM_STAMP_BITS; bit++)
+    {
+        const bool isSet = ((counter >> bit) & 1);
+
+        for (unsigned y = 0; y < STAMP_HEIGHT; y++)
+        {
+            const bool isTopHalf = (y < STAMP_BLOCK_SIZE);
+            const uint8_t value = ((isSet == isTopHalf)? 255 : 0);
+            uint8_t *const row = (frame->pixels + (((y * frame->resolution.w) + (bit * STAMP_BLOCK_SIZE)) * 4));
+
+            for (unsigned x = 0; x < STAMP_BLOCK_SIZE; x++)
+            {
+                row[(x * 4) + 0] = value;
+                row[(x * 4) + 1] = value;
+                row[(x * 4) + 2] = value;
+            }
+        }
+    }
+
+    STAMPED_FRAMES[counter % STAMPED_FRAMES.size()] = {counter, frame->timestamp};
+    STAMP_RESOLUTION = frame->resolution;
+
+    return;
+}
+
+void kstamp_read_presented_frame(const std::function<uint8_t(const double x, const double y)> &sample_green)
+{
+    PENDING_COUNTER = 0;
+
+    if (
+        !IS_ENABLED ||
+        !STAMP_RESOLUTION.w ||
+        !STAMP_RESOLUTION.h
+    ){
+        return;
+    }
+
+    uint32_t counter = 0;
+
+    for (unsigned bit = 0; bit < NUM_STAMP_BITS; bit++)
+    {
+        // Sample the centers of the bit's top and bottom halves.
+        const double x = (((bit * STAMP_BLOCK_SIZE) + (STAMP_BLOCK_SIZE / 2.0)) / STAMP_RESOLUTION.w);
+        const bool top = (sample_green(x, ((STAMP_BLOCK_SIZE * 0.5) / STAMP_RESOLUTION.h)) > 127);
+        const bool bottom = (sample_green(x, ((STAMP_BLOCK_SIZE * 1.5) / STAMP_RESOLUTION.h)) > 127);
+
+        if (top == bottom)
+        {
+            return;
+        }
+
+        counter |= (uint32_t(top) << bit);
+    }
+
+    PENDING_COUNTER = counter;
+
+    return;
+}
+
+void kstamp_stamp_extent(double *const width, double *const height)
+{
+    if (
+        !IS_ENABLED ||
+        !STAMP_RESOLUTION.w ||
+        !STAMP_RESOLUTION.h
+    ){
+        *width = *height = 0;
+        return;
+    }
+
+    *width = (double(STAMP_WIDTH) / STAMP_RESOLUTION.w);
+    *height = (double(STAMP_HEIGHT) / STAMP_RESOLUTION.h);
+
+    return;
+}
+
+void kstamp_mark_presented(void)
+{
+    if (
+        !IS_ENABLED ||
+        ARE_RESULTS_WRITTEN ||
+        !PENDING_COUNTER ||
+        (PENDING_COUNTER == LATEST_RECORDED_COUNTER)
+    ){
+        return;
+    }
+
+    const stamped_frame_s &stampedFrame = STAMPED_FRAMES[PENDING_COUNTER % STAMPED_FRAMES.size()];
+
+    // The frame is too old to still be in our records, or the stamp was misread.
+    if (stampedFrame.counter != PENDING_COUNTER)
+    {
+        return;
+    }
+
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stampedFrame.timestamp).count();
+    LATENCIES.add(unsigned(std::max<decltype(microseconds)>(0, microseconds)));
+
+    if (!FIRST_RECORDED_COUNTER)
+    {
+        FIRST_RECORDED_COUNTER = PENDING_COUNTER;
+    }
+
+    LATEST_RECORDED_COUNTER = PENDING_COUNTER;
+
+    if (++NUM_FRAMES_MEASURED >= NUM_FRAMES_TO_MEASURE)
+    {
+        write_results();
+        PROGRAM_EXIT_REQUESTED = true;
+    }
+
+    return;
+}
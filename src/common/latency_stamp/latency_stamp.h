@@ -0,0 +1,94 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The end-to-end latency measurement interface.
+ *
+ * Measures the time from a frame's capture to its presentation on screen, as
+ * opposed to the latency tracing subsystem (see trace.h), which can only see as
+ * far as VCS's own calls into the display. The capture backend stamps a frame
+ * counter into the pixels of each frame it produces, as a row of black and white
+ * blocks in the frame's top left corner; the display subsystem reads the stamp
+ * back from the pixels it's about to present (e.g. with glReadPixels() from the
+ * OpenGL surface); and the time from the stamped frame's capture to the present
+ * is added to a latency histogram. Since the stamp is read from the output
+ * surface, a frame that's dropped or presented twice is accounted for correctly.
+ *
+ * The measurement is requested via the command line, e.g.
+ *
+ *   vcs --latency-test frames=600,json=latency.json
+ *
+ * where "frames" is the number of presented frames to measure before VCS exits
+ * and "json" optionally names a file for the results, which otherwise are printed
+ * to stdout. The virtual and replay capture backends support stamping. For the
+ * stamp to survive, the frames should be at least 256 x 16 pixels, with no
+ * filters distorting the image's top left corner or overlay covering it.
+ *
+ * The functions of this interface are to be called from VCS's main thread.
+ *
+ * ## Usage
+ *
+ *   1. Call kstamp_initialize() to initialize the subsystem. Note that this
+ *      function should be called only once per program execution.
+ *
+ *   2. In a capture backend, stamp each new frame:
+ *      @code
+ *      kstamp_stamp_frame(&FRAME_BUFFER);
+ *      @endcode
+ *
+ *   3. In the display, read the stamp from the image to be presented, giving a
+ *      function that returns the green channel's value at a relative XY
+ *      coordinate of the image, and mark the image as presented once it has
+ *      been. If reading the image's pixels is costly (e.g. from an OpenGL
+ *      surface), the stamp's region can first be fetched in one go, its extent
+ *      given by kstamp_stamp_extent():
+ *      @code
+ *      kstamp_read_presented_frame([&image](const double x, const double y)
+ *      {
+ *          return image.pixels[...];
+ *      });
+ *
+ *      kstamp_mark_presented();
+ *      @endcode
+ *
+ */
+
+#ifndef VCS_COMMON_LATENCY_STAMP_LATENCY_STAMP_H
+#define VCS_COMMON_LATENCY_STAMP_LATENCY_STAMP_H
+
+#include <functional>
+#include <cstdint>
+#include "main.h"
+
+struct captured_frame_s;
+
+subsystem_releaser_t kstamp_initialize(void);
+
+// Returns true if end-to-end latency is being measured; false otherwise.
+bool kstamp_is_enabled(void);
+
+// Stamps the next frame counter into the given frame's pixels and remembers the
+// frame's capture time by it. Has no effect if latency isn't being measured.
+void kstamp_stamp_frame(captured_frame_s *const frame);
+
+// Decodes the frame counter stamped into the image that's about to be presented.
+// The given function is to return the value of the image's green channel at the
+// given XY coordinate, relative to the image's size (0-1). Has no effect if
+// latency isn't being measured.
+void kstamp_read_presented_frame(const std::function<uint8_t(const double x, const double y)> &sample_green);
+
+// Returns in the given variables the width and height of the stamp's region,
+// which starts at the image's top left corner, relative to the image's size
+// (0-1); or 0 if there's no stamp to be read.
+void kstamp_stamp_extent(double *const width, double *const height);
+
+// Records the latency of the frame most recently read by kstamp_read_presented_frame(),
+// as having been presented now. Has no effect if latency isn't being measured,
+// if no stamp was found, or if the frame's latency has already been recorded.
+void kstamp_mark_presented(void);
+
+#endif
@@ -0,0 +1,393 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <cmath>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "common/command_line/command_line.h"
+#include "common/metrics/metrics.h"
+#include "common/globals.h"
+#include "common/assert.h"
+
+// How long the server thread waits for a connection before checking whether it
+// should exit.
+static const int SERVER_POLL_TIMEOUT_MS = 250;
+
+// Guards the list of metrics, which the server thread iterates while the other
+// subsystems may be registering new metrics. Updating a metric's value doesn't
+// need the lock.
+static std::mutex REGISTRY_MUTEX;
+static std::vector<std::unique_ptr<abstract_metric_c>> REGISTRY;
+
+static std::thread SERVER_THREAD;
+static std::atomic<bool> RUN_SERVER = false;
+static int SERVER_SOCKET = -1;
+
+// Formats the given value as Prometheus expects, e.g. "+Inf" for infinity.
+static std::string format_value(const double value)
+{
+    if (std::isinf(value))
+    {
+        return ((value > 0)? "+Inf" : "-Inf");
+    }
+    else if (std::isnan(value))
+    {
+        return "NaN";
+    }
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+
+    return buffer;
+}
+
+static void write_exposition_header(std::string *const dst, const abstract_metric_c &metric, const char *const type)
+{
+    *dst += ("# HELP " + metric.name + " " + metric.help + "\n");
+    *dst += ("# TYPE " + metric.name + " " + type + "\n");
+
+    return;
+}
+
+void metric_counter_c::add(const uint64_t amount)
+{
+    this->count.fetch_add(amount, std::memory_order_relaxed);
+
+    return;
+}
+
+void metric_counter_c::set(const uint64_t value)
+{
+    this->count.store(value, std::memory_order_relaxed);
+
+    return;
+}
+
+uint64_t metric_counter_c::value(void) const
+{
+    return this->count.load(std::memory_order_relaxed);
+}
+
+void metric_counter_c::write_exposition(std::string *const dst) const
+{
+    write_exposition_header(dst, *this, "counter");
+    *dst += (this->name + " " + std::to_string(this->value()) + "\n");
+
+    return;
+}
+
+void metric_gauge_c::set(const double value)
+{
+    this->currentValue.store(value, std::memory_order_relaxed);
+
+    return;
+}
+
+double metric_gauge_c::value(void) const
+{
+    return this->currentValue.load(std::memory_order_relaxed);
+}
+
+void metric_gauge_c::write_exposition(std::string *const dst) const
+{
+    write_exposition_header(dst, *this, "gauge");
+    *dst += (this->name + " " + format_value(this->value()) + "\n");
+
+    return;
+}
+
+metric_histogram_c::metric_histogram_c(
+    const std::string &name,
+    const std::string &help,
+    const std::vector<double> &bucketUpperBounds
+) :
+    abstract_metric_c(name, help),
+    upperBounds(bucketUpperBounds),
+    bucketCounts(new std::atomic<uint64_t>[bucketUpperBounds.size() + 1]())
+{
+    k_assert(
+        std::is_sorted(this->upperBounds.begin(), this->upperBounds.end()),
+        "A histogram metric's bucket bounds must be in ascending order."
+    );
+
+    return;
+}
+
+void metric_histogram_c::observe(const double value)
+{
+    const unsigned bucketIdx = (std::lower_bound(this->upperBounds.begin(), this->upperBounds.end(), value) - this->upperBounds.begin());
+    this->bucketCounts[bucketIdx].fetch_add(1, std::memory_order_relaxed);
+
+    double expected = this->sum.load(std::memory_order_relaxed);
+    while (!this->sum.compare_exchange_weak(expected, (expected + value), std::memory_order_relaxed));
+
+    return;
+}
+
+void metric_histogram_c::write_exposition(std::string *const dst) const
+{
+    write_exposition_header(dst, *this, "histogram");
+
+    // Prometheus expects the bucket counts to be cumulative.
+    uint64_t cumulativeCount = 0;
+
+    for (unsigned i = 0; i <= this->upperBounds.size(); i++)
+    {
+        const double upperBound = ((i < this->upperBounds.size())? this->upperBounds[i] : INFINITY);
+
+        cumulativeCount += this->bucketCounts[i].load(std::memory_order_relaxed);
+        *dst += (this->name + "_bucket{le=\"" + format_value(upperBound) + "\"} " + std::to_string(cumulativeCount) + "\n");
+    }
+
+    *dst += (this->name + "_sum " + format_value(this->sum.load(std::memory_order_relaxed)) + "\n");
+    *dst += (this->name + "_count " + std::to_string(cumulativeCount) + "\n");
+
+    return;
+}
+
+template <typename T, typename ...Args>
+static T* register_metric(const std::string &name, Args&&... args)
+{
+    std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+
+    k_assert(
+        std::none_of(REGISTRY.begin(), REGISTRY.end(), [&name](const auto &metric){return (metric->name == name);}),
+        "Duplicate metric name."
+    );
+
+    T *const metric = new T(name, std::forward<Args>(args)...);
+    REGISTRY.emplace_back(metric);
+
+    return metric;
+}
+
+metric_counter_c* kmetrics_counter(const std::string &name, const std::string &help)
+{
+    return register_metric<metric_counter_c>(name, help);
+}
+
+metric_gauge_c* kmetrics_gauge(const std::string &name, const std::string &help)
+{
+    return register_metric<metric_gauge_c>(name, help);
+}
+
+metric_histogram_c* kmetrics_histogram(const std::string &name, const std::string &help, const std::vector<double> &bucketUpperBounds)
+{
+    return register_metric<metric_histogram_c>(name, help, bucketUpperBounds);
+}
+
+std::string kmetrics_exposition(void)
+{
+    std::lock_guard<std::mutex> lock(REGISTRY_MUTEX);
+
+    std::string exposition;
+
+    for (const auto &metric: REGISTRY)
+    {
+        metric->write_exposition(&exposition);
+    }
+
+    return exposition;
+}
+
+bool kmetrics_is_serving(void)
+{
+    return RUN_SERVER;
+}
+
+static bool send_all(const int socket, const std::string &data)
+{
+    std::size_t numBytesSent = 0;
+
+    while (numBytesSent < data.size())
+    {
+        const ssize_t n = send(socket, (data.data() + numBytesSent), (data.size() - numBytesSent), MSG_NOSIGNAL);
+
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        numBytesSent += n;
+    }
+
+    return true;
+}
+
+// Reads an HTTP request from the given client and responds to it.
+static void serve_client(const int client)
+{
+    // Don't let a stalled client block the server indefinitely.
+    const timeval timeout = {.tv_sec = 2, .tv_usec = 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // We only need the request line, e.g. "GET /metrics HTTP/1.1".
+    std::string request;
+    {
+        char buffer[1024];
+
+        while (request.find("\r\n") == std::string::npos)
+        {
+            const ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+
+            if ((n <= 0) || ((request.size() + n) > 8192))
+            {
+                return;
+            }
+
+            request.append(buffer, n);
+        }
+    }
+
+    const std::string requestLine = request.substr(0, request.find("\r\n"));
+    std::string status = "200 OK";
+    std::string body;
+
+    if (requestLine.rfind("GET ", 0) != 0)
+    {
+        status = "405 Method Not Allowed";
+    }
+    else if (
+        (requestLine.rfind("GET /metrics ", 0) != 0) &&
+        (requestLine.rfind("GET / ", 0) != 0)
+    ){
+        status = "404 Not Found";
+    }
+    else
+    {
+        body = kmetrics_exposition();
+    }
+
+    send_all(client, (
+        "HTTP/1.1 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n"
+        "\r\n" +
+        body
+    ));
+
+    return;
+}
+
+static void server_loop(void)
+{
+    pollfd serverPoll = {.fd = SERVER_SOCKET, .events = POLLIN, .revents = 0};
+
+    while (RUN_SERVER)
+    {
+        if (poll(&serverPoll, 1, SERVER_POLL_TIMEOUT_MS) <= 0)
+        {
+            continue;
+        }
+
+        const int client = accept(SERVER_SOCKET, nullptr, nullptr);
+
+        if (client >= 0)
+        {
+            serve_client(client);
+            close(client);
+        }
+    }
+
+    return;
+}
+
+// Parses an address of the form "[ipv4 address:]port" into the given struct.
+// If no IP address is given, the loopback address is used.
+static bool parse_address(const std::string &address, sockaddr_in *const dst)
+{
+    const std::size_t separatorPos = address.rfind(':');
+    const std::string host = ((separatorPos == std::string::npos)? "127.0.0.1" : address.substr(0, separatorPos));
+    const std::string port = ((separatorPos == std::string::npos)? address : address.substr(separatorPos + 1));
+
+    char *portEnd = nullptr;
+    const long portNumber = std::strtol(port.c_str(), &portEnd, 10);
+
+    if (port.empty() || *portEnd || (portNumber < 1) || (portNumber > 65535))
+    {
+        return false;
+    }
+
+    std::memset(dst, 0, sizeof(*dst));
+    dst->sin_family = AF_INET;
+    dst->sin_port = htons(uint16_t(portNumber));
+
+    return (inet_pton(AF_INET, host.c_str(), &dst->sin_addr) == 1);
+}
+
+static bool start_server(const std::string &address)
+{
+    sockaddr_in socketAddress;
+
+    if (!parse_address(address, &socketAddress))
+    {
+        NBENE(("Invalid metrics server address \"%s\". Expected \"[IPv4 address:]port\".", address.c_str()));
+        return false;
+    }
+
+    if ((SERVER_SOCKET = socket(AF_INET, (SOCK_STREAM | SOCK_CLOEXEC), 0)) < 0)
+    {
+        NBENE(("Failed to create a socket for the metrics server."));
+        return false;
+    }
+
+    const int reuseAddress = 1;
+    setsockopt(SERVER_SOCKET, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+    if (
+        (bind(SERVER_SOCKET, (sockaddr*)&socketAddress, sizeof(socketAddress)) != 0) ||
+        (listen(SERVER_SOCKET, 8) != 0)
+    ){
+        NBENE(("Failed to listen on \"%s\" for the metrics server: %s.", address.c_str(), std::strerror(errno)));
+        close(SERVER_SOCKET);
+        SERVER_SOCKET = -1;
+        return false;
+    }
+
+    RUN_SERVER = true;
+    SERVER_THREAD = std::thread(server_loop);
+
+    char host[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &socketAddress.sin_addr, host, sizeof(host));
+
+    INFO(("Serving metrics at http://%s:%u/metrics.", host, unsigned(ntohs(socketAddress.sin_port))));
+
+    return true;
+}
+
+subsystem_releaser_t kmetrics_initialize(void)
+{
+    DEBUG(("Initializing the metrics subsystem."));
+
+    if (!kcom_metrics_address().empty())
+    {
+        start_server(kcom_metrics_address());
+    }
+
+    return []
+    {
+        DEBUG(("Releasing the metrics subsystem."));
+
+        if (RUN_SERVER)
+        {
+            RUN_SERVER = false;
+            SERVER_THREAD.join();
+
+            close(SERVER_SOCKET);
+            SERVER_SOCKET = -1;
+        }
+    };
+}
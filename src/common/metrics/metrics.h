@@ -0,0 +1,155 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The metrics subsystem interface.
+ *
+ * Lets VCS's subsystems register counters, gauges and histograms describing
+ * their operation (frames captured, frames dropped, processing latency, etc.),
+ * and serves the metrics over HTTP in the Prometheus text exposition format, so
+ * that they can be scraped by monitoring tools.
+ *
+ * Updating a metric is lock-free -- a relaxed atomic operation or a few -- so
+ * metrics can be updated from VCS's main loop and capture threads without
+ * affecting their timing. The metrics server runs in its own thread, reading the
+ * metrics' current values when a scrape request comes in.
+ *
+ * The server is started only if the user asked for it via the command line (see
+ * kcom_metrics_address()), and listens on the loopback interface by default.
+ *
+ * ## Usage
+ *
+ *   1. Call kmetrics_initialize() to initialize the subsystem. This should be
+ *      done before the other subsystems are initialized, so that they can
+ *      register their metrics. Note that this function should be called only
+ *      once per program execution.
+ *
+ *   2. Register a metric, typically in a subsystem's initializer, and keep the
+ *      returned pointer:
+ *      @code
+ *      static metric_counter_c *FRAMES_CAPTURED = nullptr;
+ *
+ *      FRAMES_CAPTURED = kmetrics_counter(
+ *          "vcs_capture_frames_total",
+ *          "Frames received from the capture device."
+ *      );
+ *      @endcode
+ *
+ *   3. Update the metric:
+ *      @code
+ *      FRAMES_CAPTURED->add();
+ *      @endcode
+ *
+ *   4. VCS will automatically release the subsystem on program exit. Metric
+ *      pointers remain valid until then.
+ *
+ */
+
+#ifndef VCS_COMMON_METRICS_METRICS_H
+#define VCS_COMMON_METRICS_METRICS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "main.h"
+
+class abstract_metric_c
+{
+public:
+    abstract_metric_c(const std::string &name, const std::string &help) :
+        name(name),
+        help(help)
+    {
+    }
+
+    virtual ~abstract_metric_c(void) {}
+
+    // Appends the metric's current value(s) into the given string in the
+    // Prometheus text exposition format.
+    virtual void write_exposition(std::string *const dst) const = 0;
+
+    const std::string name;
+    const std::string help;
+};
+
+// A monotonically increasing count of something, e.g. frames captured.
+class metric_counter_c : public abstract_metric_c
+{
+public:
+    using abstract_metric_c::abstract_metric_c;
+
+    void add(const uint64_t amount = 1);
+
+    // For mirroring a cumulative count that's maintained elsewhere, e.g. a
+    // capture backend's count of dropped frames.
+    void set(const uint64_t value);
+
+    uint64_t value(void) const;
+
+    void write_exposition(std::string *const dst) const override;
+
+private:
+    std::atomic<uint64_t> count = 0;
+};
+
+// A value that can go up and down, e.g. the current refresh rate.
+class metric_gauge_c : public abstract_metric_c
+{
+public:
+    using abstract_metric_c::abstract_metric_c;
+
+    void set(const double value);
+
+    double value(void) const;
+
+    void write_exposition(std::string *const dst) const override;
+
+private:
+    std::atomic<double> currentValue = 0;
+};
+
+// A distribution of observed values, e.g. latencies, counted into buckets with
+// fixed upper bounds.
+class metric_histogram_c : public abstract_metric_c
+{
+public:
+    // The bucket bounds must be in ascending order. A bucket for values larger
+    // than the largest bound is added automatically.
+    metric_histogram_c(const std::string &name, const std::string &help, const std::vector<double> &bucketUpperBounds);
+
+    void observe(const double value);
+
+    void write_exposition(std::string *const dst) const override;
+
+private:
+    const std::vector<double> upperBounds;
+
+    // Non-cumulative counts; one more than there are upper bounds.
+    const std::unique_ptr<std::atomic<uint64_t>[]> bucketCounts;
+
+    std::atomic<double> sum = 0;
+};
+
+subsystem_releaser_t kmetrics_initialize(void);
+
+// Registers a new metric by the given name, which must be unique and a valid
+// Prometheus metric name. Returns a pointer to the metric, valid for the rest
+// of the program's execution.
+metric_counter_c* kmetrics_counter(const std::string &name, const std::string &help);
+metric_gauge_c* kmetrics_gauge(const std::string &name, const std::string &help);
+metric_histogram_c* kmetrics_histogram(const std::string &name, const std::string &help, const std::vector<double> &bucketUpperBounds);
+
+// Returns the current values of all registered metrics in the Prometheus text
+// exposition format.
+std::string kmetrics_exposition(void);
+
+// Returns true if the metrics server is running, i.e. if metrics can be scraped.
+bool kmetrics_is_serving(void);
+
+#endif
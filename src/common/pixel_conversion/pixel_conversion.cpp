@@ -0,0 +1,265 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "common/pixel_conversion/pixel_conversion.h"
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+// Expands an n-bit channel value into 8 bits by replicating its top bits into the
+// vacated low bits, so that the channel's maximum maps to 255.
+static inline uint8_t expand_5_bits(const unsigned value)
+{
+    return ((value << 3) | (value >> 2));
+}
+
+static inline uint8_t expand_6_bits(const unsigned value)
+{
+    return ((value << 2) | (value >> 4));
+}
+
+// Converts one BT.601 limited-range YUV sample into BGRA. The coefficients are
+// those of the standard 8-bit fixed-point approximation, with each product
+// rounded down individually so that the result matches the SSE2 code exactly.
+static inline void yuv_to_bgra(const int y, const int u, const int v, uint8_t *const dst)
+{
+    const int c = (((y - 16) * 298) >> 8);
+    const int d = (u - 128);
+    const int e = (v - 128);
+
+    dst[0] = std::clamp((c + ((d * 516) >> 8)), 0, 255);
+    dst[1] = std::clamp((c - ((d * 100) >> 8) - ((e * 208) >> 8)), 0, 255);
+    dst[2] = std::clamp((c + ((e * 409) >> 8)), 0, 255);
+    dst[3] = 255;
+
+    return;
+}
+
+#ifdef __SSE2__
+// Interleaves the 8-bit channel values held in the 16-bit lanes of the given
+// vectors into 8 BGRA pixels, and stores them into the destination.
+static inline void store_bgra_x8(const __m128i b, const __m128i g, const __m128i r, uint8_t *const dst)
+{
+    const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    const __m128i ra = _mm_or_si128(r, _mm_set1_epi16(int16_t(0xff00)));
+
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(bg, ra));
+
+    return;
+}
+
+static inline __m128i expand_5_bits_x8(const __m128i value)
+{
+    return _mm_or_si128(_mm_slli_epi16(value, 3), _mm_srli_epi16(value, 2));
+}
+
+// Returns floor((value * coefficient) / 256) for each 16-bit lane of the given
+// value, where -256 <= value < 256 (so that value * 128 fits in 16 bits) and
+// 0 <= coefficient < 16384. The callers' values are within -128 to 239: luma
+// minus 16, and chroma minus 128.
+static inline __m128i mul_div_256_x8(const __m128i value, const int16_t coefficient)
+{
+    return _mm_mulhi_epi16(_mm_slli_epi16(value, 7), _mm_set1_epi16(coefficient * 2));
+}
+
+// Converts 8 pixels of YUV into BGRA, given their luma samples and the 4 pairs of
+// chroma samples (U V) that they share, in 16-bit lanes.
+static inline void yuv_to_bgra_x8(const __m128i y, const __m128i uv, uint8_t *const dst)
+{
+    const __m128i maskLow16 = _mm_set1_epi32(0xffff);
+    const __m128i u = _mm_and_si128(uv, maskLow16);
+    const __m128i v = _mm_srli_epi32(uv, 16);
+
+    // Duplicate each pair's chroma for both of its pixels.
+    const __m128i d = _mm_sub_epi16(_mm_or_si128(u, _mm_slli_epi32(u, 16)), _mm_set1_epi16(128));
+    const __m128i e = _mm_sub_epi16(_mm_or_si128(v, _mm_slli_epi32(v, 16)), _mm_set1_epi16(128));
+    const __m128i c = mul_div_256_x8(_mm_sub_epi16(y, _mm_set1_epi16(16)), 298);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    const auto clamp = [zero, max](const __m128i x){return _mm_min_epi16(_mm_max_epi16(x, zero), max);};
+
+    store_bgra_x8(
+        clamp(_mm_add_epi16(c, mul_div_256_x8(d, 516))),
+        clamp(_mm_sub_epi16(_mm_sub_epi16(c, mul_div_256_x8(d, 100)), mul_div_256_x8(e, 208))),
+        clamp(_mm_add_epi16(c, mul_div_256_x8(e, 409))),
+        dst
+    );
+
+    return;
+}
+#endif
+
+void kpixel_convert_pal8_to_bgra(const uint8_t *src, uint8_t *dst, const unsigned numPixels, const uint32_t *const palette)
+{
+    // A palette lookup is a gather, which SSE2 has no instruction for, so this
+    // is scalar; storing whole 32-bit palette entries keeps it to one load and
+    // one store per pixel.
+    for (unsigned i = 0; i < numPixels; i++)
+    {
+        const uint32_t pixel = (palette[src[i]] | 0xff000000u);
+        std::memcpy((dst + (i * 4)), &pixel, 4);
+    }
+
+    return;
+}
+
+void kpixel_convert_rgb565_to_bgra(const uint16_t *src, uint8_t *dst, const unsigned numPixels)
+{
+    unsigned i = 0;
+
+    #ifdef __SSE2__
+        const __m128i mask5 = _mm_set1_epi16(0x1f);
+        const __m128i mask6 = _mm_set1_epi16(0x3f);
+
+        for (; (i + 8) <= numPixels; i += 8)
+        {
+            const __m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+            const __m128i r = _mm_srli_epi16(pixels, 11);
+            const __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 5), mask6);
+            const __m128i b = _mm_and_si128(pixels, mask5);
+
+            store_bgra_x8(
+                expand_5_bits_x8(b),
+                _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4)),
+                expand_5_bits_x8(r),
+                (dst + (i * 4))
+            );
+        }
+    #endif
+
+    kpixel_convert_rgb565_to_bgra_reference((src + i), (dst + (i * 4)), (numPixels - i));
+
+    return;
+}
+
+void kpixel_convert_rgb565_to_bgra_reference(const uint16_t *src, uint8_t *dst, const unsigned numPixels)
+{
+    for (unsigned i = 0; i < numPixels; i++)
+    {
+        const unsigned pixel = src[i];
+        uint8_t *const px = (dst + (i * 4));
+
+        px[0] = expand_5_bits(pixel & 0x1f);
+        px[1] = expand_6_bits((pixel >> 5) & 0x3f);
+        px[2] = expand_5_bits(pixel >> 11);
+        px[3] = 255;
+    }
+
+    return;
+}
+
+void kpixel_convert_rgb555_to_bgra(const uint16_t *src, uint8_t *dst, const unsigned numPixels)
+{
+    unsigned i = 0;
+
+    #ifdef __SSE2__
+        const __m128i mask5 = _mm_set1_epi16(0x1f);
+
+        for (; (i + 8) <= numPixels; i += 8)
+        {
+            const __m128i pixels = _mm_loadu_si128((const __m128i*)(src + i));
+            const __m128i r = _mm_and_si128(_mm_srli_epi16(pixels, 10), mask5);
+            const __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 5), mask5);
+            const __m128i b = _mm_and_si128(pixels, mask5);
+
+            store_bgra_x8(
+                expand_5_bits_x8(b),
+                expand_5_bits_x8(g),
+                expand_5_bits_x8(r),
+                (dst + (i * 4))
+            );
+        }
+    #endif
+
+    kpixel_convert_rgb555_to_bgra_reference((src + i), (dst + (i * 4)), (numPixels - i));
+
+    return;
+}
+
+void kpixel_convert_rgb555_to_bgra_reference(const uint16_t *src, uint8_t *dst, const unsigned numPixels)
+{
+    for (unsigned i = 0; i < numPixels; i++)
+    {
+        const unsigned pixel = src[i];
+        uint8_t *const px = (dst + (i * 4));
+
+        px[0] = expand_5_bits(pixel & 0x1f);
+        px[1] = expand_5_bits((pixel >> 5) & 0x1f);
+        px[2] = expand_5_bits((pixel >> 10) & 0x1f);
+        px[3] = 255;
+    }
+
+    return;
+}
+
+void kpixel_convert_yuyv_to_bgra(const uint8_t *src, uint8_t *dst, const unsigned numPixels)
+{
+    unsigned i = 0;
+
+    #ifdef __SSE2__
+        const __m128i maskLow8 = _mm_set1_epi16(0xff);
+
+        for (; (i + 8) <= numPixels; i += 8)
+        {
+            const __m128i yuyv = _mm_loadu_si128((const __m128i*)(src + (i * 2)));
+            yuv_to_bgra_x8(_mm_and_si128(yuyv, maskLow8), _mm_srli_epi16(yuyv, 8), (dst + (i * 4)));
+        }
+    #endif
+
+    kpixel_convert_yuyv_to_bgra_reference((src + (i * 2)), (dst + (i * 4)), (numPixels - i));
+
+    return;
+}
+
+void kpixel_convert_yuyv_to_bgra_reference(const uint8_t *src, uint8_t *dst, const unsigned numPixels)
+{
+    for (unsigned i = 0; (i + 2) <= numPixels; i += 2)
+    {
+        const uint8_t *const yuyv = (src + (i * 2));
+
+        yuv_to_bgra(yuyv[0], yuyv[1], yuyv[3], (dst + (i * 4)));
+        yuv_to_bgra(yuyv[2], yuyv[1], yuyv[3], (dst + ((i + 1) * 4)));
+    }
+
+    return;
+}
+
+void kpixel_convert_nv12_row_to_bgra(const uint8_t *srcY, const uint8_t *srcUV, uint8_t *dst, const unsigned numPixels)
+{
+    unsigned i = 0;
+
+    #ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; (i + 8) <= numPixels; i += 8)
+        {
+            const __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(srcY + i)), zero);
+            const __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(srcUV + i)), zero);
+            yuv_to_bgra_x8(y, uv, (dst + (i * 4)));
+        }
+    #endif
+
+    kpixel_convert_nv12_row_to_bgra_reference((srcY + i), (srcUV + i), (dst + (i * 4)), (numPixels - i));
+
+    return;
+}
+
+void kpixel_convert_nv12_row_to_bgra_reference(const uint8_t *srcY, const uint8_t *srcUV, uint8_t *dst, const unsigned numPixels)
+{
+    for (unsigned i = 0; (i + 2) <= numPixels; i += 2)
+    {
+        yuv_to_bgra(srcY[i], srcUV[i], srcUV[i + 1], (dst + (i * 4)));
+        yuv_to_bgra(srcY[i + 1], srcUV[i], srcUV[i + 1], (dst + ((i + 1) * 4)));
+    }
+
+    return;
+}
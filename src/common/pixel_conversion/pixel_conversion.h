@@ -0,0 +1,53 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * Conversion of runs of pixels from various compact pixel formats into the
+ * 32-bit BGRA format of VCS's frame buffers.
+ *
+ * The conversions are vectorized with SSE2 where available, with scalar code
+ * handling the remaining pixels and non-SSE2 builds. Each function converts
+ * one contiguous run of pixels, e.g. a row or part of a row of an image; the
+ * destination's alpha channel is set to 255.
+ *
+ * The vectorized functions also have a *_reference() version, which is the
+ * plain scalar code, and which the vectorized code uses for the pixels left
+ * over from its blocks. The reference versions produce exactly the same output
+ * and are mainly for verifying the vectorized code (see equivalence.h).
+ *
+ */
+
+#ifndef VCS_COMMON_PIXEL_CONVERSION_PIXEL_CONVERSION_H
+#define VCS_COMMON_PIXEL_CONVERSION_PIXEL_CONVERSION_H
+
+#include <cstdint>
+
+// Converts 8-bit palette indices into BGRA using the given 256-entry palette,
+// whose entries are BGRA pixels as 32-bit little-endian words.
+void kpixel_convert_pal8_to_bgra(const uint8_t *src, uint8_t *dst, const unsigned numPixels, const uint32_t *const palette);
+
+// Converts 16-bit RGB565 pixels (red in the high bits) into BGRA.
+void kpixel_convert_rgb565_to_bgra(const uint16_t *src, uint8_t *dst, const unsigned numPixels);
+void kpixel_convert_rgb565_to_bgra_reference(const uint16_t *src, uint8_t *dst, const unsigned numPixels);
+
+// Converts 16-bit RGB555 pixels (red in the high bits; the top bit is ignored)
+// into BGRA.
+void kpixel_convert_rgb555_to_bgra(const uint16_t *src, uint8_t *dst, const unsigned numPixels);
+void kpixel_convert_rgb555_to_bgra_reference(const uint16_t *src, uint8_t *dst, const unsigned numPixels);
+
+// Converts packed 4:2:2 YUYV pixels (byte order Y0 U Y1 V) with BT.601 limited-
+// range values into BGRA. The number of pixels should be even.
+void kpixel_convert_yuyv_to_bgra(const uint8_t *src, uint8_t *dst, const unsigned numPixels);
+void kpixel_convert_yuyv_to_bgra_reference(const uint8_t *src, uint8_t *dst, const unsigned numPixels);
+
+// Converts one row of a 4:2:0 NV12 image with BT.601 limited-range values into
+// BGRA, given the row's luma samples and the interleaved chroma samples (byte
+// order U V) of the chroma row covering it. The number of pixels should be even.
+void kpixel_convert_nv12_row_to_bgra(const uint8_t *srcY, const uint8_t *srcUV, uint8_t *dst, const unsigned numPixels);
+void kpixel_convert_nv12_row_to_bgra_reference(const uint8_t *srcY, const uint8_t *srcUV, uint8_t *dst, const unsigned numPixels);
+
+#endif
@@ -17,12 +17,12 @@ refresh_rate_s refresh_rate_s::from_fixedpoint(const fixedpoint_hz_t fixedpoint)
 
 refresh_rate_s refresh_rate_s::from_capture_device_properties()
 {
-    return refresh_rate_s::from_fixedpoint(kc_device_property("refresh rate"));
+    return refresh_rate_s::from_fixedpoint(kc_device_property(device_property_e::refresh_rate));
 }
 
 void refresh_rate_s::to_capture_device_properties(const refresh_rate_s &rate)
 {
-    kc_set_device_property("refresh rate", rate.fixedpoint);
+    kc_set_device_property(device_property_e::refresh_rate, rate.fixedpoint);
 }
 
 void refresh_rate_s::operator=(const unsigned hz)
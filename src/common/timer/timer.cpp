@@ -13,28 +13,153 @@
  *   2. Call kt_timer() to add a new timer. The function takes in an interval and
  *      a function; the function will be executed at about the given intervals.
  *
- *   3. To stop and release all timers, call kt_release_timers(). Individual
- *      timers cannot currently be stopped.
+ *   3. Call kt_update_timers() periodically (e.g. once per iteration of VCS's
+ *      main loop) to run the functions of the timers that are due. To know how
+ *      long you can wait before the next call, use kt_next_timer_deadline().
+ *
+ *   4. To stop a timer, call kt_stop_timer() with the ID returned by kt_timer().
+ *      To stop and release all timers, call kt_release_timers().
+ *
+ * The timers' deadlines are kept in a min-heap, so that finding out whether any
+ * timer is due takes one clock read and one comparison, regardless of how many
+ * timers there are. The timers run on std::chrono::steady_clock, so changes to
+ * the system's wall clock don't affect them.
+ *
+ * The timer functions are to be called from VCS's main thread.
  *
  */
 
+#include <unordered_map>
+#include <algorithm>
 #include <vector>
 #include "common/timer/timer.h"
 
-static std::vector<timer_c> ACTIVE_TIMERS;
+struct timer_s
+{
+    unsigned intervalMs;
+    std::chrono::steady_clock::time_point timeOfLastTimeout;
+    std::function<void(const unsigned elapsedMs)> timeoutFunction;
+};
+
+struct timer_deadline_s
+{
+    std::chrono::steady_clock::time_point deadline;
+    timer_id_t timerId;
+
+    // For ordering a std::*_heap() as a min-heap.
+    bool operator<(const timer_deadline_s &other) const
+    {
+        return (this->deadline > other.deadline);
+    }
+};
+
+// The running timers, by ID.
+static std::unordered_map<timer_id_t, timer_s> ACTIVE_TIMERS;
+
+// A min-heap of the running timers' next deadlines. A stopped timer's deadline
+// is left in the heap and discarded when it reaches the top.
+static std::vector<timer_deadline_s> DEADLINES;
+
+// IDs aren't reused, so a stale deadline can't be mistaken for a new timer's.
+static timer_id_t NEXT_TIMER_ID = 1;
+
+static void push_deadline(const std::chrono::steady_clock::time_point deadline, const timer_id_t timerId)
+{
+    DEADLINES.push_back({deadline, timerId});
+    std::push_heap(DEADLINES.begin(), DEADLINES.end());
+
+    return;
+}
+
+static void pop_deadline(void)
+{
+    std::pop_heap(DEADLINES.begin(), DEADLINES.end());
+    DEADLINES.pop_back();
+
+    return;
+}
+
+void kt_initialize_timers(void)
+{
+    kt_release_timers();
+
+    return;
+}
 
-void kt_timer(const unsigned intervalMs, std::function<void(const unsigned elapsedMs)> functionToRun)
+void kt_release_timers(void)
 {
-    ACTIVE_TIMERS.push_back(timer_c(intervalMs, functionToRun));
+    ACTIVE_TIMERS.clear();
+    DEADLINES.clear();
 
     return;
 }
 
+timer_id_t kt_timer(const unsigned intervalMs, std::function<void(const unsigned elapsedMs)> functionToRun)
+{
+    const auto timeNow = std::chrono::steady_clock::now();
+    const timer_id_t timerId = NEXT_TIMER_ID++;
+
+    ACTIVE_TIMERS[timerId] = {
+        .intervalMs = intervalMs,
+        .timeOfLastTimeout = timeNow,
+        .timeoutFunction = functionToRun,
+    };
+
+    push_deadline((timeNow + std::chrono::milliseconds(intervalMs)), timerId);
+
+    return timerId;
+}
+
+void kt_stop_timer(const timer_id_t timerId)
+{
+    ACTIVE_TIMERS.erase(timerId);
+
+    return;
+}
+
+std::chrono::steady_clock::time_point kt_next_timer_deadline(void)
+{
+    while (!DEADLINES.empty() && !ACTIVE_TIMERS.contains(DEADLINES.front().timerId))
+    {
+        pop_deadline();
+    }
+
+    return (DEADLINES.empty()? std::chrono::steady_clock::time_point::max() : DEADLINES.front().deadline);
+}
+
 void kt_update_timers(void)
 {
-    for (timer_c &timer: ACTIVE_TIMERS)
+    const auto timeNow = std::chrono::steady_clock::now();
+
+    // Timers that ran in this call, to be rescheduled once all due timers have
+    // run; so that a timer with a zero interval runs at most once per call.
+    std::vector<timer_deadline_s> rescheduled;
+
+    while (kt_next_timer_deadline() <= timeNow)
+    {
+        const timer_id_t timerId = DEADLINES.front().timerId;
+        pop_deadline();
+
+        timer_s &timer = ACTIVE_TIMERS.at(timerId);
+        const unsigned msSinceLastTimeout = std::chrono::duration_cast<std::chrono::milliseconds>(timeNow - timer.timeOfLastTimeout).count();
+        timer.timeOfLastTimeout = timeNow;
+
+        // The function may create or stop timers, which can invalidate references
+        // into ACTIVE_TIMERS, so we don't hold on to the timer while it runs.
+        const auto timeoutFunction = timer.timeoutFunction;
+        const auto nextDeadline = (timeNow + std::chrono::milliseconds(timer.intervalMs));
+
+        timeoutFunction(msSinceLastTimeout);
+
+        rescheduled.push_back({nextDeadline, timerId});
+    }
+
+    for (const timer_deadline_s &timerDeadline: rescheduled)
     {
-        timer.update();
+        if (ACTIVE_TIMERS.contains(timerDeadline.timerId))
+        {
+            push_deadline(timerDeadline.deadline, timerDeadline.timerId);
+        }
     }
 
     return;
@@ -1,6 +1,6 @@
 /*
  * 2020 Tarpeeksi Hyvae Soft
- * 
+ *
  * Software: VCS
  *
  */
@@ -9,67 +9,32 @@
 #define VCS_COMMON_TIMER_TIMER_H
 
 #include <chrono>
-#include <atomic>
 #include <functional>
 
-// An in-thread timer object, to be used by VCS's timer subsystem (kt_xxxx).
-//
-// Usage:
-//
-//   1. Create a timer object:
-//
-//      timer_c timer(...);
-//
-//   2. Periodically update the timer to keep it running (this will also fire
-//      the timer's timeout function when appropriate):
-//
-//      timer.update();
-//
-//   3. When you want the timer to stop, just stop calling the .update()
-//      method.
-//
-class timer_c
-{
-public:
-    timer_c(const unsigned intervalMs, std::function<void(const unsigned elapsedMs)> func) :
-        intervalMs(intervalMs),
-        timeoutFunction(func)
-    {
-        this->timeOfLastTimeout = std::chrono::system_clock::now();
-
-        return;
-    }
-
-    void update(void)
-    {
-        const auto timeNow = std::chrono::system_clock::now();
-        const unsigned msSinceLastTimeout = std::chrono::duration_cast<std::chrono::milliseconds>(timeNow - this->timeOfLastTimeout).count();
-
-        if (unsigned(msSinceLastTimeout) >= this->intervalMs)
-        {
-            this->timeoutFunction(msSinceLastTimeout);
-            this->timeOfLastTimeout = timeNow;
-        }
+// Identifies a timer created with kt_timer(), e.g. for stopping it.
+typedef unsigned timer_id_t;
 
-        return;
-    }
-
-    const unsigned intervalMs;
-
-    const std::function<void(const unsigned elapsedMs)> timeoutFunction;
+// Runs the given function at the given interval (+ the function's time of
+// execution), from kt_update_timers(). The function receives the number of
+// milliseconds since it was last run (or since the timer was created). Returns
+// an ID by which the timer can be stopped.
+timer_id_t kt_timer(const unsigned intervalMs, std::function<void(const unsigned elapsedMs)> func);
 
-private:
-    std::chrono::system_clock::time_point timeOfLastTimeout = {};
-};
+// Stops the given timer, so that its function won't be run again. Can be called
+// from within the timer's own function. Has no effect if the timer has already
+// been stopped.
+void kt_stop_timer(const timer_id_t timerId);
 
-// Runs the given function at the given interval (+ the function's time of
-// execution). The timer can't be stopped.
-void kt_timer(const unsigned intervalMs, std::function<void(const unsigned elapsedMs)> func);
+// Returns the time at which the next timer is due, or time_point::max() if no
+// timers are running. Lets e.g. VCS's main loop sleep until then without delaying
+// the timers.
+std::chrono::steady_clock::time_point kt_next_timer_deadline(void);
 
 void kt_initialize_timers(void);
 
 void kt_release_timers(void);
 
+// Runs the functions of the timers that are due.
 void kt_update_timers(void);
 
 #endif
@@ -0,0 +1,316 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include "common/trace/trace.h"
+#include "common/globals.h"
+#include "capture/capture.h"
+#include "filter/abstract_filter.h"
+
+using trace_clock_t = std::chrono::steady_clock;
+
+// The trace of the frame currently passing through the pipeline.
+struct frame_trace_s
+{
+    bool isOpen = false;
+    std::array<trace_clock_t::time_point, int(trace_point_e::num_enumerators)> timestamps;
+    std::array<bool, int(trace_point_e::num_enumerators)> isMarked;
+};
+
+static frame_trace_s CURRENT_TRACE;
+
+static std::array<latency_histogram_c, int(trace_stage_e::num_enumerators)> STAGE_HISTOGRAMS;
+
+// Histograms of the time taken by individual filters to process a frame.
+struct filter_stage_s
+{
+    std::string name;
+    latency_histogram_c histogram;
+};
+
+static std::unordered_map<const abstract_filter_c*, filter_stage_s> FILTER_STAGES;
+
+unsigned latency_histogram_c::bucket_idx(const unsigned microseconds)
+{
+    const unsigned value = std::min(microseconds, ((NUM_SUB_BUCKETS << NUM_OCTAVES) - 1));
+
+    if (value < NUM_SUB_BUCKETS)
+    {
+        return value;
+    }
+
+    // The number of bits by which the value must be shifted right to fit into
+    // the sub-bucket range [NUM_SUB_BUCKETS, NUM_SUB_BUCKETS * 2).
+    const unsigned octave = (unsigned(std::log2(value)) - unsigned(std::log2(NUM_SUB_BUCKETS)));
+
+    return (NUM_SUB_BUCKETS + (octave * NUM_SUB_BUCKETS) + ((value >> octave) - NUM_SUB_BUCKETS));
+}
+
+unsigned latency_histogram_c::bucket_max_value(const unsigned bucketIdx)
+{
+    if (bucketIdx < NUM_SUB_BUCKETS)
+    {
+        return bucketIdx;
+    }
+
+    const unsigned octave = ((bucketIdx - NUM_SUB_BUCKETS) / NUM_SUB_BUCKETS);
+    const unsigned subBucket = (NUM_SUB_BUCKETS + ((bucketIdx - NUM_SUB_BUCKETS) % NUM_SUB_BUCKETS));
+
+    return (((subBucket + 1) << octave) - 1);
+}
+
+void latency_histogram_c::add(const unsigned microseconds)
+{
+    this->buckets[bucket_idx(microseconds)]++;
+    this->count++;
+    this->max = std::max(this->max, microseconds);
+
+    return;
+}
+
+void latency_histogram_c::clear(void)
+{
+    this->buckets.fill(0);
+    this->count = 0;
+    this->max = 0;
+
+    return;
+}
+
+latency_percentiles_s latency_histogram_c::percentiles(void) const
+{
+    latency_percentiles_s result;
+    result.count = this->count;
+    result.max = this->max;
+
+    if (!this->count)
+    {
+        return result;
+    }
+
+    const auto percentile = [this](const double fraction)->unsigned
+    {
+        const uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(fraction * this->count)));
+        uint64_t cumulativeCount = 0;
+
+        for (unsigned i = 0; i < this->buckets.size(); i++)
+        {
+            cumulativeCount += this->buckets[i];
+
+            if (cumulativeCount >= rank)
+            {
+                return std::min(bucket_max_value(i), this->max);
+            }
+        }
+
+        return this->max;
+    };
+
+    result.p50 = percentile(0.50);
+    result.p95 = percentile(0.95);
+    result.p99 = percentile(0.99);
+
+    return result;
+}
+
+// Adds the durations between the current trace's trace points into the stage
+// histograms, and closes the trace.
+static void finish_current_trace(void)
+{
+    if (!CURRENT_TRACE.isOpen)
+    {
+        return;
+    }
+
+    const auto add_stage = [](const trace_stage_e stage, const trace_point_e from, const trace_point_e to)
+    {
+        if (CURRENT_TRACE.isMarked[int(from)] && CURRENT_TRACE.isMarked[int(to)])
+        {
+            const auto duration = (CURRENT_TRACE.timestamps[int(to)] - CURRENT_TRACE.timestamps[int(from)]);
+            const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+            STAGE_HISTOGRAMS[int(stage)].add(unsigned(std::max<decltype(microseconds)>(0, microseconds)));
+        }
+    };
+
+    const trace_point_e scaleStart = (
+        CURRENT_TRACE.isMarked[int(trace_point_e::filter_chain_end)]
+            ? trace_point_e::filter_chain_end
+            : trace_point_e::dequeue
+    );
+
+    add_stage(trace_stage_e::queue,        trace_point_e::capture,            trace_point_e::dequeue);
+    add_stage(trace_stage_e::filter_chain, trace_point_e::filter_chain_start, trace_point_e::filter_chain_end);
+    add_stage(trace_stage_e::scale,        scaleStart,                        trace_point_e::scale);
+    add_stage(trace_stage_e::paint_wait,   trace_point_e::scale,              trace_point_e::paint_start);
+    add_stage(trace_stage_e::overlay,      trace_point_e::overlay_start,      trace_point_e::overlay_end);
+    add_stage(trace_stage_e::paint,        trace_point_e::paint_start,        trace_point_e::paint_submit);
+    add_stage(trace_stage_e::present,      trace_point_e::paint_submit,       trace_point_e::present);
+    add_stage(trace_stage_e::total,        trace_point_e::capture,            trace_point_e::present);
+
+    CURRENT_TRACE.isOpen = false;
+
+    return;
+}
+
+subsystem_releaser_t ktrace_initialize(void)
+{
+    DEBUG(("Initializing the latency tracing subsystem."));
+
+    ktrace_reset();
+
+    return []{};
+}
+
+void ktrace_begin_frame(const captured_frame_s &frame)
+{
+    finish_current_trace();
+
+    CURRENT_TRACE.isOpen = true;
+    CURRENT_TRACE.isMarked.fill(false);
+
+    // Every capture backend timestamps its frames, with the device's capture
+    // time if it reports one and otherwise the time of receipt.
+    CURRENT_TRACE.timestamps[int(trace_point_e::capture)] = frame.timestamp;
+    CURRENT_TRACE.isMarked[int(trace_point_e::capture)] = true;
+
+    ktrace_mark(trace_point_e::dequeue);
+
+    return;
+}
+
+void ktrace_mark(const trace_point_e point)
+{
+    if (!CURRENT_TRACE.isOpen || CURRENT_TRACE.isMarked[int(point)])
+    {
+        return;
+    }
+
+    CURRENT_TRACE.timestamps[int(point)] = trace_clock_t::now();
+    CURRENT_TRACE.isMarked[int(point)] = true;
+
+    if (point == trace_point_e::present)
+    {
+        finish_current_trace();
+    }
+
+    return;
+}
+
+void ktrace_mark_filter(const abstract_filter_c *const filter, const std::chrono::steady_clock::time_point &startTime)
+{
+    if (!CURRENT_TRACE.isOpen)
+    {
+        return;
+    }
+
+    filter_stage_s &stage = FILTER_STAGES[filter];
+
+    if (stage.name.empty())
+    {
+        stage.name = filter->name();
+    }
+
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(trace_clock_t::now() - startTime).count();
+    stage.histogram.add(unsigned(std::max<decltype(microseconds)>(0, microseconds)));
+
+    return;
+}
+
+latency_percentiles_s ktrace_stage_percentiles(const trace_stage_e stage)
+{
+    k_assert((stage < trace_stage_e::num_enumerators), "Unknown pipeline stage.");
+
+    return STAGE_HISTOGRAMS[int(stage)].percentiles();
+}
+
+const char* ktrace_stage_name(const trace_stage_e stage)
+{
+    switch (stage)
+    {
+        case trace_stage_e::queue: return "Queue";
+        case trace_stage_e::filter_chain: return "Filter chain";
+        case trace_stage_e::scale: return "Scale";
+        case trace_stage_e::paint_wait: return "Paint wait";
+        case trace_stage_e::overlay: return "Overlay";
+        case trace_stage_e::paint: return "Paint";
+        case trace_stage_e::present: return "Present";
+        case trace_stage_e::total: return "Total";
+        default: k_assert(0, "Unknown pipeline stage."); return "";
+    }
+}
+
+void ktrace_reset(void)
+{
+    for (auto &histogram: STAGE_HISTOGRAMS)
+    {
+        histogram.clear();
+    }
+
+    for (auto &[filter, stage]: FILTER_STAGES)
+    {
+        stage.histogram.clear();
+    }
+
+    return;
+}
+
+void ktrace_forget_filter(const abstract_filter_c *const filter)
+{
+    FILTER_STAGES.erase(filter);
+
+    return;
+}
+
+bool ktrace_dump(const std::string &filename)
+{
+    FILE *const file = std::fopen(filename.c_str(), "w");
+
+    if (!file)
+    {
+        NBENE(("Failed to open \"%s\" for writing the latency trace.", filename.c_str()));
+        return false;
+    }
+
+    const auto write_row = [file](const std::string &name, const latency_percentiles_s &stats)
+    {
+        std::fprintf(
+            file,
+            "\"%s\",%llu,%u,%u,%u,%u\n",
+            name.c_str(),
+            (unsigned long long)stats.count,
+            stats.p50,
+            stats.p95,
+            stats.p99,
+            stats.max
+        );
+    };
+
+    std::fprintf(file, "stage,count,p50_us,p95_us,p99_us,max_us\n");
+
+    for (int i = 0; i < int(trace_stage_e::num_enumerators); i++)
+    {
+        write_row(ktrace_stage_name(trace_stage_e(i)), ktrace_stage_percentiles(trace_stage_e(i)));
+    }
+
+    for (const auto &[filter, stage]: FILTER_STAGES)
+    {
+        write_row(("Filter: " + stage.name), stage.histogram.percentiles());
+    }
+
+    if (std::fclose(file) != 0)
+    {
+        NBENE(("Failed to write the latency trace into \"%s\".", filename.c_str()));
+        return false;
+    }
+
+    INFO(("Saved the latency trace into \"%s\".", filename.c_str()));
+
+    return true;
+}
@@ -0,0 +1,172 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The latency tracing interface.
+ *
+ * Each captured frame carries a trace of timestamps taken as it passes through
+ * VCS's frame pipeline: when it was captured, when VCS's main loop took it for
+ * processing, when the filter chain started and finished with it (and each
+ * filter in between), when it had been scaled, and when it had been painted,
+ * overlaid and presented in the output window. Once the frame has been presented
+ * (or replaced by a newer frame before it could be), the durations between its
+ * timestamps are added to per-stage latency histograms, from which percentiles
+ * can be queried or dumped to a file.
+ *
+ * The frame pipeline runs on VCS's main thread, and so must the functions of
+ * this interface be called.
+ *
+ * ## Usage
+ *
+ *   1. Call ktrace_initialize() to initialize the tracing subsystem. Note that
+ *      this function should be called only once per program execution.
+ *
+ *   2. When the main loop takes a captured frame for processing, begin its trace:
+ *      @code
+ *      ktrace_begin_frame(frame);
+ *      @endcode
+ *
+ *   3. As the frame passes through the pipeline, mark the trace points:
+ *      @code
+ *      ktrace_mark(trace_point_e::scale);
+ *
+ *      ktrace_mark_filter(filter, startTime);
+ *      @endcode
+ *
+ *   4. Query the latency statistics of a stage:
+ *      @code
+ *      const latency_percentiles_s stats = ktrace_stage_percentiles(trace_stage_e::scale);
+ *      @endcode
+ *
+ *   5. VCS will automatically release the subsystem on program exit.
+ *
+ */
+
+#ifndef VCS_COMMON_TRACE_TRACE_H
+#define VCS_COMMON_TRACE_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include <array>
+#include "main.h"
+
+struct captured_frame_s;
+class abstract_filter_c;
+
+// The points in the frame pipeline at which a frame's trace is timestamped.
+enum class trace_point_e
+{
+    capture,            // The capture device captured the frame.
+    dequeue,            // VCS's main loop took the frame for processing.
+    filter_chain_start, // The frame entered the filter chain.
+    filter_chain_end,   // The frame left the filter chain.
+    scale,              // The frame had been scaled to the output resolution.
+    paint_start,        // The output window began painting the frame.
+    overlay_start,      // The output window began drawing the overlay.
+    overlay_end,        // The output window finished drawing the overlay.
+    paint_submit,       // The output window finished painting the frame.
+    present,            // The painted frame was presented on screen.
+
+    num_enumerators
+};
+
+// The stages of the frame pipeline, as durations between trace points.
+enum class trace_stage_e
+{
+    queue,        // capture -> dequeue
+    filter_chain, // filter_chain_start -> filter_chain_end
+    scale,        // filter_chain_end (or dequeue if no filter chain) -> scale
+    paint_wait,   // scale -> paint_start
+    overlay,      // overlay_start -> overlay_end
+    paint,        // paint_start -> paint_submit
+    present,      // paint_submit -> present
+    total,        // capture -> present
+
+    num_enumerators
+};
+
+struct latency_percentiles_s
+{
+    uint64_t count = 0;
+
+    // In microseconds.
+    unsigned p50 = 0;
+    unsigned p95 = 0;
+    unsigned p99 = 0;
+    unsigned max = 0;
+};
+
+// A histogram of latencies at microsecond resolution. The buckets are spaced
+// log-linearly, so that percentiles are accurate to within about 3% of their
+// value across the histogram's range, from 0 to about 67 seconds.
+class latency_histogram_c
+{
+public:
+    void add(const unsigned microseconds);
+
+    void clear(void);
+
+    latency_percentiles_s percentiles(void) const;
+
+private:
+    // Values below this are given a bucket of their own; above it, each power
+    // of two is divided into this many buckets.
+    static constexpr unsigned NUM_SUB_BUCKETS = 32;
+    static constexpr unsigned NUM_OCTAVES = 21;
+
+    static unsigned bucket_idx(const unsigned microseconds);
+
+    // Returns the largest value that would fall into the given bucket.
+    static unsigned bucket_max_value(const unsigned bucketIdx);
+
+    std::array<uint32_t, (NUM_SUB_BUCKETS * (NUM_OCTAVES + 1))> buckets = {};
+    uint64_t count = 0;
+    unsigned max = 0;
+};
+
+subsystem_releaser_t ktrace_initialize(void);
+
+// Begins the trace of the given frame, timestamping its capture (by the frame's
+// timestamp) and dequeue (by the current time). If the trace of the previous
+// frame hasn't yet been finished, it's finished with whatever trace points it
+// got.
+void ktrace_begin_frame(const captured_frame_s &frame);
+
+// Timestamps the given trace point in the current frame's trace with the current
+// time. Has no effect if there's no frame being traced or if the point has
+// already been timestamped for the frame, so e.g. a repaint of the same frame
+// doesn't affect its trace.
+//
+// Marking trace_point_e::present finishes the frame's trace.
+void ktrace_mark(const trace_point_e point);
+
+// Records into the current frame's trace that the given filter was applied,
+// having started at the given time and finishing now.
+void ktrace_mark_filter(const abstract_filter_c *const filter, const std::chrono::steady_clock::time_point &startTime);
+
+// Returns the latency statistics of the given pipeline stage across the frames
+// traced since the subsystem was initialized or last reset.
+latency_percentiles_s ktrace_stage_percentiles(const trace_stage_e stage);
+
+// Returns a human-readable name of the given pipeline stage, e.g. "Filter chain".
+const char* ktrace_stage_name(const trace_stage_e stage);
+
+// Clears the latency statistics of all stages.
+void ktrace_reset(void);
+
+// Discards the latency statistics of the given filter. To be called when the
+// filter is deleted, so that its statistics don't get attributed to a new filter
+// allocated at the same address.
+void ktrace_forget_filter(const abstract_filter_c *const filter);
+
+// Writes the latency statistics of all stages, including those of individual
+// filters, into the given file as comma-separated values. Returns true on
+// success; false otherwise.
+bool ktrace_dump(const std::string &filename);
+
+#endif
@@ -6,28 +6,94 @@
  */
 
 #include "common/vcs_event/vcs_event.h"
+#include "capture/video_presets.h"
+#include "common/refresh_rate.h"
+#include "display/display.h"
+#include "capture/capture.h"
+#include "main.h"
 
-vcs_event_c<const captured_frame_s&> ev_new_captured_frame;
-vcs_event_c<const video_mode_s&> ev_new_proposed_video_mode;
-vcs_event_c<const video_mode_s&> ev_new_video_mode;
-vcs_event_c<unsigned> ev_new_input_channel;
-vcs_event_c<void> ev_invalid_capture_device;
-vcs_event_c<void> ev_capture_signal_lost;
-vcs_event_c<void> ev_capture_signal_gained;
-vcs_event_c<void> ev_invalid_capture_signal;
-vcs_event_c<void> ev_dirty_output_window;
-vcs_event_c<const resolution_s&> ev_new_output_resolution;
-vcs_event_c<const image_s&> ev_new_output_image;
-vcs_event_c<const refresh_rate_s&> ev_frames_per_second;
-vcs_event_c<void> ev_custom_output_scaler_enabled;
-vcs_event_c<void> ev_custom_output_scaler_disabled;
-vcs_event_c<void> ev_eco_mode_enabled;
-vcs_event_c<void> ev_eco_mode_disabled;
-vcs_event_c<const captured_frame_s&> ev_frame_processing_finished;
-vcs_event_c<const video_preset_s*> ev_video_preset_activated;
-vcs_event_c<const video_preset_s*> ev_video_preset_name_changed;
-vcs_event_c<unsigned> ev_missed_frames_count;
-vcs_event_c<unsigned> ev_capture_processing_latency;
-vcs_event_c<const refresh_rate_s&> ev_new_capture_rate;
-vcs_event_c<std::vector<const char*>> ev_list_of_supported_video_preset_properties_changed;
-vcs_event_c<const video_preset_s*> kc_ev_video_preset_params_changed;
+// All events, for kevent_listener_stats(). A function-local static, so that it's
+// initialized before the events that register themselves into it.
+static std::vector<abstract_vcs_event_c*>& all_events(void)
+{
+    static std::vector<abstract_vcs_event_c*> events;
+    return events;
+}
+
+abstract_vcs_event_c::abstract_vcs_event_c(const char *const name) :
+    name(name)
+{
+    all_events().push_back(this);
+
+    return;
+}
+
+abstract_vcs_event_c::~abstract_vcs_event_c(void)
+{
+    std::erase(all_events(), this);
+
+    return;
+}
+
+vcs_event_listener_id_t abstract_vcs_event_c::new_listener_id(void)
+{
+    static vcs_event_listener_id_t nextListenerId = 1;
+
+    return nextListenerId++;
+}
+
+void abstract_vcs_event_c::defer(std::function<void(void)> callback)
+{
+    k_defer_until_capture_mutex_unlocked(callback);
+
+    return;
+}
+
+std::vector<vcs_event_listener_stats_s> kevent_listener_stats(void)
+{
+    std::vector<vcs_event_listener_stats_s> stats;
+
+    for (const abstract_vcs_event_c *const event: all_events())
+    {
+        event->append_listener_stats(&stats);
+    }
+
+    return stats;
+}
+
+void kevent_reset_listener_stats(void)
+{
+    for (abstract_vcs_event_c *const event: all_events())
+    {
+        event->reset_listener_stats();
+    }
+
+    return;
+}
+
+vcs_event_c<const captured_frame_s&> ev_new_captured_frame("ev_new_captured_frame");
+vcs_event_c<const video_mode_s&> ev_new_proposed_video_mode("ev_new_proposed_video_mode");
+vcs_event_c<const video_mode_s&> ev_new_video_mode("ev_new_video_mode");
+vcs_event_c<unsigned> ev_new_input_channel("ev_new_input_channel");
+vcs_event_c<void> ev_invalid_capture_device("ev_invalid_capture_device");
+vcs_event_c<void> ev_capture_signal_lost("ev_capture_signal_lost");
+vcs_event_c<void> ev_capture_signal_gained("ev_capture_signal_gained");
+vcs_event_c<void> ev_invalid_capture_signal("ev_invalid_capture_signal");
+vcs_event_c<void> ev_dirty_output_window("ev_dirty_output_window");
+vcs_event_c<const resolution_s&> ev_new_output_resolution("ev_new_output_resolution");
+vcs_event_c<const image_s&> ev_new_output_image("ev_new_output_image");
+vcs_event_c<const refresh_rate_s&> ev_frames_per_second("ev_frames_per_second");
+vcs_event_c<void> ev_custom_output_scaler_enabled("ev_custom_output_scaler_enabled");
+vcs_event_c<void> ev_custom_output_scaler_disabled("ev_custom_output_scaler_disabled");
+vcs_event_c<void> ev_eco_mode_enabled("ev_eco_mode_enabled");
+vcs_event_c<void> ev_eco_mode_disabled("ev_eco_mode_disabled");
+vcs_event_c<void> ev_recording_started("ev_recording_started");
+vcs_event_c<void> ev_recording_stopped("ev_recording_stopped");
+vcs_event_c<const captured_frame_s&> ev_frame_processing_finished("ev_frame_processing_finished");
+vcs_event_c<const video_preset_s*> ev_video_preset_activated("ev_video_preset_activated");
+vcs_event_c<const video_preset_s*> ev_video_preset_name_changed("ev_video_preset_name_changed");
+vcs_event_c<unsigned> ev_missed_frames_count("ev_missed_frames_count");
+vcs_event_c<unsigned> ev_capture_processing_latency("ev_capture_processing_latency");
+vcs_event_c<const refresh_rate_s&> ev_new_capture_rate("ev_new_capture_rate");
+vcs_event_c<std::vector<const char*>> ev_list_of_supported_video_preset_properties_changed("ev_list_of_supported_video_preset_properties_changed");
+vcs_event_c<const video_preset_s*> kc_ev_video_preset_params_changed("kc_ev_video_preset_params_changed");
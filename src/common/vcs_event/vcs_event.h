@@ -26,14 +26,44 @@
  * If there are multiple listeners to an event, they'll be called synchronously in the
  * order they were subscribed.
  *
- * Note: Listener functions can't be unsubscribed.
+ * listen() returns an ID by which the listener can be unsubscribed:
+ *
+ *     const vcs_event_listener_id_t listenerId = ev_new_output_image.listen(...);
+ *     ev_new_output_image.unlisten(listenerId);
+ *
+ * A listener that doesn't need to run for every firing of a frequent event (e.g. a
+ * GUI widget displaying the current output resolution, which needn't update for
+ * every output frame) can ask for deferred delivery, i.e. to be called only once VCS's
+ * main loop has released the capture mutex (see k_defer_until_capture_mutex_unlocked()).
+ * Firings of the event before then are coalesced, so the listener receives only the
+ * most recent one. The listener receives a copy of the event's argument, so any data
+ * the argument points to may have changed by then.
+ *
+ *     ev_new_output_image.listen([](const image_s &image)
+ *     {
+ *         ...
+ *     }, "Status panel", vcs_event_delivery_e::deferred);
+ *
+ * The time each listener spends processing events is measured; kevent_listener_stats()
+ * returns the measurements, to find listeners that are too slow for their event.
+ * The name given to listen() identifies the listener in the measurements.
+ *
+ * The event system isn't thread-safe; events are to be listened to and fired from
+ * VCS's main thread.
  */
 
 #ifndef VCS_COMMON_VCS_EVENT_VCS_EVENT_H
 #define VCS_COMMON_VCS_EVENT_VCS_EVENT_H
 
+#include <type_traits>
 #include <functional>
-#include <list>
+#include <algorithm>
+#include <optional>
+#include <memory>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <tuple>
 
 struct captured_frame_s;
 struct refresh_rate_s;
@@ -42,70 +72,321 @@ struct video_mode_s;
 struct resolution_s;
 struct image_s;
 
-// An event that passes an argument to its event handlers.
-template <typename T>
-class vcs_event_c
+// Identifies a listener subscribed to an event, e.g. for unsubscribing it. IDs
+// are unique across all events.
+typedef unsigned vcs_event_listener_id_t;
+
+enum class vcs_event_delivery_e
+{
+    // The listener is called from fire().
+    immediate,
+
+    // The listener is called after VCS's main loop has released the capture
+    // mutex, with the most recent of the firings since it was last called.
+    deferred,
+};
+
+// The time a listener has spent processing events.
+struct vcs_event_listener_profile_s
+{
+    uint64_t numCalls = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+};
+
+struct vcs_event_listener_stats_s
+{
+    const char *eventName;
+    const char *listenerName;
+    vcs_event_delivery_e delivery;
+    vcs_event_listener_profile_s profile;
+};
+
+// Returns the time spent by each of the listeners subscribed to any event.
+std::vector<vcs_event_listener_stats_s> kevent_listener_stats(void);
+
+// Clears the time measurements of all listeners.
+void kevent_reset_listener_stats(void);
+
+// The non-template part of an event, by which the event system keeps track of all
+// events, e.g. for kevent_listener_stats().
+class abstract_vcs_event_c
 {
 public:
-    void listen(std::function<void(T)> handlerFn)
+    abstract_vcs_event_c(const char *const name);
+    virtual ~abstract_vcs_event_c(void);
+
+    virtual void append_listener_stats(std::vector<vcs_event_listener_stats_s> *const dst) const = 0;
+    virtual void reset_listener_stats(void) = 0;
+
+    const char *const name;
+
+protected:
+    static vcs_event_listener_id_t new_listener_id(void);
+
+    // Calls the given function once VCS's main loop has released the capture mutex.
+    static void defer(std::function<void(void)> callback);
+};
+
+// The listeners of an event whose listener functions take the given arguments.
+template <typename ...Args>
+class vcs_event_listeners_c : public abstract_vcs_event_c
+{
+public:
+    using abstract_vcs_event_c::abstract_vcs_event_c;
+
+    void unlisten(const vcs_event_listener_id_t listenerId)
     {
-        this->subscribedHandlers.push_back(handlerFn);
+        for (auto *const listeners: {&this->listeners, &this->listenersAddedWhileFiring})
+        {
+            for (listener_s &listener: *listeners)
+            {
+                if (listener.id == listenerId)
+                {
+                    // The listener may currently be running, so we can't destroy
+                    // its function yet. Removed listeners are cleaned up once the
+                    // event is no longer firing.
+                    listener.id = 0;
+                }
+            }
+        }
+
+        this->remove_unsubscribed_listeners();
 
         return;
     }
 
-    // For event handlers that want to ignore the callback argument.
-    void listen(std::function<void(void)> handlerFn)
+    void append_listener_stats(std::vector<vcs_event_listener_stats_s> *const dst) const override
     {
-        this->subscribedHandlersNoArgs.push_back(handlerFn);
+        for (const listener_s &listener: this->listeners)
+        {
+            if (listener.id)
+            {
+                dst->push_back({this->name, listener.name, listener.delivery, listener.profile});
+            }
+        }
 
         return;
     }
 
-    void fire(T value) const
+    void reset_listener_stats(void) override
     {
-        for (const auto &handlerFn: this->subscribedHandlers)
+        for (listener_s &listener: this->listeners)
         {
-            handlerFn(value);
+            listener.profile = {};
         }
 
-        for (const auto &handlerFn: this->subscribedHandlersNoArgs)
+        return;
+    }
+
+protected:
+    vcs_event_listener_id_t add_listener(std::function<void(Args...)> handlerFn, const char *const name, const vcs_event_delivery_e delivery)
+    {
+        const vcs_event_listener_id_t listenerId = new_listener_id();
+
+        // Adding to the listeners while they're being iterated over could move
+        // a running listener function in memory.
+        (this->firingDepth? this->listenersAddedWhileFiring : this->listeners).push_back({
+            .id = listenerId,
+            .handlerFn = handlerFn,
+            .name = name,
+            .delivery = delivery,
+        });
+
+        return listenerId;
+    }
+
+    void fire_listeners(Args... args)
+    {
+        this->firingDepth++;
+
+        for (listener_s &listener: this->listeners)
         {
-            handlerFn();
+            if (!listener.id)
+            {
+                continue;
+            }
+
+            if (listener.delivery == vcs_event_delivery_e::immediate)
+            {
+                this->call(listener, args...);
+            }
+            else
+            {
+                if (!listener.pendingArgs)
+                {
+                    listener.pendingArgs = std::make_shared<pending_args_t>();
+                }
+
+                pending_args_t &pendingArgs = *static_cast<pending_args_t*>(listener.pendingArgs.get());
+                const bool isDeliveryPending = pendingArgs.has_value();
+
+                pendingArgs.emplace(args...);
+
+                if (!isDeliveryPending)
+                {
+                    defer([this, listenerId = listener.id]{this->deliver_deferred(listenerId);});
+                }
+            }
         }
 
+        this->firingDepth--;
+        this->remove_unsubscribed_listeners();
+
         return;
     }
 
 private:
-    std::list<std::function<void(T)>> subscribedHandlers;
-    std::list<std::function<void(void)>> subscribedHandlersNoArgs;
-};
+    // For deferred delivery, the arguments of the most recent firing that hasn't
+    // yet been delivered.
+    using pending_args_t = std::optional<std::tuple<std::decay_t<Args>...>>;
 
-// An event that passes no arguments to its event handlers.
-template <>
-class vcs_event_c<void>
-{
-public:
-    void listen(std::function<void(void)> handlerFn)
+    struct listener_s
+    {
+        // 0 if the listener has been unsubscribed.
+        vcs_event_listener_id_t id;
+
+        std::function<void(Args...)> handlerFn;
+        const char *name;
+        vcs_event_delivery_e delivery;
+        vcs_event_listener_profile_s profile = {};
+
+        // A pending_args_t, allocated on the first deferred delivery. Type-erased,
+        // so that listening to an event doesn't require its argument type to be
+        // complete.
+        std::shared_ptr<void> pendingArgs = nullptr;
+    };
+
+    template <typename ...CallArgs>
+    static void call(listener_s &listener, CallArgs&&... args)
+    {
+        const auto startTime = std::chrono::steady_clock::now();
+
+        listener.handlerFn(std::forward<CallArgs>(args)...);
+
+        const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+        listener.profile.numCalls++;
+        listener.profile.totalNs += ns;
+        listener.profile.maxNs = std::max(listener.profile.maxNs, ns);
+
+        return;
+    }
+
+    void deliver_deferred(const vcs_event_listener_id_t listenerId)
     {
-        this->subscribedHandlers.push_back(handlerFn);
+        this->firingDepth++;
+
+        for (listener_s &listener: this->listeners)
+        {
+            if ((listener.id == listenerId) && listener.pendingArgs)
+            {
+                pending_args_t &pendingArgs = *static_cast<pending_args_t*>(listener.pendingArgs.get());
+
+                if (!pendingArgs.has_value())
+                {
+                    break;
+                }
+
+                const auto args = std::move(*pendingArgs);
+                pendingArgs.reset();
+
+                std::apply([&listener](const auto&... args){call(listener, args...);}, args);
+                break;
+            }
+        }
+
+        this->firingDepth--;
+        this->remove_unsubscribed_listeners();
 
         return;
     }
 
-    void fire(void) const
+    void remove_unsubscribed_listeners(void)
     {
-        for (const auto &handlerFn: this->subscribedHandlers)
+        if (this->firingDepth)
         {
-            handlerFn();
+            return;
         }
 
+        std::erase_if(this->listeners, [](const listener_s &listener){return !listener.id;});
+
+        for (listener_s &listener: this->listenersAddedWhileFiring)
+        {
+            if (listener.id)
+            {
+                this->listeners.push_back(std::move(listener));
+            }
+        }
+
+        this->listenersAddedWhileFiring.clear();
+
         return;
     }
 
-private:
-    std::list<std::function<void(void)>> subscribedHandlers;
+    std::vector<listener_s> listeners;
+    std::vector<listener_s> listenersAddedWhileFiring;
+
+    // How many calls to fire_listeners() or deliver_deferred() are in progress;
+    // more than one if a listener fires its own event.
+    unsigned firingDepth = 0;
+};
+
+// An event that passes an argument to its event handlers.
+template <typename T>
+class vcs_event_c : public vcs_event_listeners_c<T>
+{
+public:
+    using vcs_event_listeners_c<T>::vcs_event_listeners_c;
+
+    vcs_event_listener_id_t listen(
+        std::function<void(T)> handlerFn,
+        const char *const name = "",
+        const vcs_event_delivery_e delivery = vcs_event_delivery_e::immediate
+    )
+    {
+        return this->add_listener(handlerFn, name, delivery);
+    }
+
+    // For event handlers that want to ignore the callback argument.
+    vcs_event_listener_id_t listen(
+        std::function<void(void)> handlerFn,
+        const char *const name = "",
+        const vcs_event_delivery_e delivery = vcs_event_delivery_e::immediate
+    )
+    {
+        return this->add_listener([handlerFn](T){handlerFn();}, name, delivery);
+    }
+
+    void fire(T value)
+    {
+        this->fire_listeners(value);
+
+        return;
+    }
+};
+
+// An event that passes no arguments to its event handlers.
+template <>
+class vcs_event_c<void> : public vcs_event_listeners_c<>
+{
+public:
+    using vcs_event_listeners_c<>::vcs_event_listeners_c;
+
+    vcs_event_listener_id_t listen(
+        std::function<void(void)> handlerFn,
+        const char *const name = "",
+        const vcs_event_delivery_e delivery = vcs_event_delivery_e::immediate
+    )
+    {
+        return this->add_listener(handlerFn, name, delivery);
+    }
+
+    void fire(void)
+    {
+        this->fire_listeners();
+
+        return;
+    }
 };
 
 // Fired when the capture subsystem makes a new captured frame available. A
@@ -176,6 +457,14 @@ extern vcs_event_c<void> ev_custom_output_scaler_disabled;
 // kvideopreset_apply_current_active_preset() instead.
 extern vcs_event_c<const video_preset_s*> kc_ev_video_preset_params_changed;
 
+// Fired when the recording subsystem starts recording output frames into a file.
+extern vcs_event_c<void> ev_recording_started;
+
+// Fired when the recording subsystem stops recording, whether by request or e.g.
+// due to a change in output resolution. Frames in the writer's backlog may still
+// be in the process of being written.
+extern vcs_event_c<void> ev_recording_stopped;
+
 extern vcs_event_c<void> ev_eco_mode_enabled;
 extern vcs_event_c<void> ev_eco_mode_disabled;
 extern vcs_event_c<const captured_frame_s&> ev_frame_processing_finished;
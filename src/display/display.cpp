@@ -8,6 +8,14 @@
 #include "display/display.h"
 #include "capture/capture.h"
 
+resolution_s resolution_s::from_capture_device_properties(void)
+{
+    return resolution_s{
+        .w = unsigned(kc_device_property(device_property_e::width)),
+        .h = unsigned(kc_device_property(device_property_e::height))
+    };
+}
+
 resolution_s resolution_s::from_capture_device_properties(const std::string &nameSpace)
 {
     return resolution_s{
@@ -18,8 +26,8 @@ resolution_s resolution_s::from_capture_device_properties(const std::string &nam
 
 void resolution_s::to_capture_device_properties(const resolution_s &resolution)
 {
-    kc_set_device_property("width", resolution.w);
-    kc_set_device_property("height", resolution.h);
+    kc_set_device_property(device_property_e::width, resolution.w);
+    kc_set_device_property(device_property_e::height, resolution.h);
 }
 
 bool resolution_s::operator==(const resolution_s &other) const
@@ -38,7 +38,11 @@ struct resolution_s
     unsigned w;
     unsigned h;
 
-    static resolution_s from_capture_device_properties(const std::string &nameSpace = "");
+    static resolution_s from_capture_device_properties(void);
+
+    // Returns the resolution given by the "width" and "height" capture device
+    // properties suffixed with the given namespace; e.g. ": maximum".
+    static resolution_s from_capture_device_properties(const std::string &nameSpace);
 
     static void to_capture_device_properties(const resolution_s &resolution);
 
@@ -19,6 +19,7 @@
 #include "common/globals.h"
 #include "filter/filter.h"
 #include "common/log/log.h"
+#include "common/metrics/metrics.h"
 
 // We'll want to avoid accessing the GUI via non-GUI threads, so let's assume
 // the thread that creates this unit is the GUI thread. We'll later compare
@@ -62,6 +63,21 @@ subsystem_releaser_t kd_acquire_output_window(void)
 
     WINDOW = new OutputWindow;
 
+    // The processing latency covers everything from the frame's capture to its
+    // display, but it's measured once the frame has been displayed.
+    {
+        metric_histogram_c *const latencyMetric = kmetrics_histogram(
+            "vcs_display_processing_latency_seconds",
+            "Time from a frame's capture to the end of its processing and display.",
+            {0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.05, 0.066, 0.1, 0.25}
+        );
+
+        ev_capture_processing_latency.listen([latencyMetric](const unsigned latencyUs)
+        {
+            latencyMetric->observe(latencyUs / 1000000.0);
+        }, "Display latency metric");
+    }
+
     for (const auto t: CUSTOM_WIDGET_QUEUE)
     {
         WINDOW->add_control_panel_widget(t.tabName, t.widgetTitle, *t.widget);
@@ -8,8 +8,10 @@
 #include <cmath>
 #include <QPixmap>
 #include <QPainter>
+#include <QThreadPool>
 #include <QtConcurrent/QtConcurrent>
 #include "display/qt/widgets/ColorHistogram.h"
+#include "scaler/scaler.h"
 #include "common/globals.h"
 #include "common/assert.h"
 
@@ -18,6 +20,11 @@ ColorHistogram::ColorHistogram(QWidget *parent) : QWidget(parent)
     this->update_pixmap_size();
     this->clear();
 
+    connect(&this->binningThread, &QFutureWatcher<void>::finished, this, [this]
+    {
+        this->graph_bins();
+    });
+
     connect(&this->graphingThread, &QFutureWatcher<void>::finished, this, [this]
     {
         this->update();
@@ -28,44 +35,150 @@ ColorHistogram::ColorHistogram(QWidget *parent) : QWidget(parent)
 
 ColorHistogram::~ColorHistogram()
 {
+    this->wait_for_worker_threads();
+
+    return;
+}
+
+// Waits until any binning and graphing in progress has finished. The results of
+// binning that hasn't yet been graphed are discarded.
+void ColorHistogram::wait_for_worker_threads(void)
+{
+    this->binningThread.waitForFinished();
+    this->isBinningPending = false;
     this->graphingThread.waitForFinished();
 
     return;
 }
 
-void ColorHistogram::refresh(const image_s &image)
+void ColorHistogram::set_scope(const scope_e scope)
+{
+    this->wait_for_worker_threads();
+
+    this->scope = scope;
+    this->waveform.assign(((scope == scope_e::rgb_parade? (numParadeColumns * 3) : numWaveformColumns) * numBins), 0);
+    this->waveformColumnOfX.clear();
+    this->clear();
+
+    return;
+}
+
+void ColorHistogram::set_sampling_stride(const unsigned stride)
+{
+    k_assert((stride > 0), "The sampling stride must be greater than zero.");
+
+    this->wait_for_worker_threads();
+    this->samplingStride = stride;
+
+    return;
+}
+
+void ColorHistogram::refresh(void)
 {
-    static uint8_t *const scratchBuffer = new uint8_t[MAX_NUM_BYTES_IN_CAPTURED_FRAME]();
+    const image_s image = ks_scaler_frame_buffer();
 
     k_assert_optional((image.bytes_per_pixel() == 4), "Unsupported color depth.");
 
-    if (!this->graphingThread.isFinished())
+    if (
+        this->isBinningPending ||
+        !this->graphingThread.isFinished() ||
+        !image.pixels ||
+        !image.resolution.w ||
+        !image.resolution.h
+    ){
+        return;
+    }
+
+    // The frame buffer is only written on the main thread, which is also the
+    // thread that graphs the binned data, so a change in its generation by then
+    // means the image was overwritten while being binned.
+    this->image = image;
+    this->imageGeneration = ks_scaler_frame_buffer_generation();
+
+    this->bands.resize(std::max(1, QThreadPool::globalInstance()->maxThreadCount()));
+    const unsigned numBands = this->bands.size();
+
+    if (this->scope == scope_e::histogram)
+    {
+        const unsigned numSampledRows = ((image.resolution.h + this->samplingStride - 1) / this->samplingStride);
+
+        for (unsigned i = 0; i < numBands; i++)
+        {
+            this->bands[i].start = ((numSampledRows * i) / numBands);
+            this->bands[i].end = ((numSampledRows * (i + 1)) / numBands);
+        }
+
+        this->isBinningPending = true;
+        this->binningThread.setFuture(QtConcurrent::map(this->bands, [this](band_s &band)
+        {
+            this->bin_histogram(band);
+        }));
+    }
+    else
+    {
+        const unsigned numColumns = ((this->scope == scope_e::rgb_parade)? numParadeColumns : numWaveformColumns);
+
+        if (this->waveformColumnOfX.size() != image.resolution.w)
+        {
+            this->waveformColumnOfX.resize(image.resolution.w);
+
+            for (unsigned x = 0; x < image.resolution.w; x++)
+            {
+                this->waveformColumnOfX[x] = ((x * numColumns) / image.resolution.w);
+            }
+        }
+
+        for (unsigned i = 0; i < numBands; i++)
+        {
+            this->bands[i].start = ((numColumns * i) / numBands);
+            this->bands[i].end = ((numColumns * (i + 1)) / numBands);
+        }
+
+        this->isBinningPending = true;
+        this->binningThread.setFuture(QtConcurrent::map(this->bands, [this](band_s &band)
+        {
+            this->bin_waveform(band);
+        }));
+    }
+
+    return;
+}
+
+// Called once the bands of the current image have been binned. Merges the bands'
+// histogram bins, if any, and starts graphing the binned data.
+void ColorHistogram::graph_bins(void)
+{
+    if (!this->isBinningPending)
     {
         return;
     }
 
-    std::memcpy(scratchBuffer, image.pixels, image.byte_size());
-    const unsigned imageDataLen = image.byte_size();
-    const unsigned imageBytesPerPixel = image.bytes_per_pixel();
+    this->isBinningPending = false;
+
+    if (ks_scaler_frame_buffer_generation() != this->imageGeneration)
+    {
+        this->refresh();
+        return;
+    }
 
-    graphingThread.setFuture(QtConcurrent::run([this, imageDataLen, imageBytesPerPixel]{
+    if (this->scope == scope_e::histogram)
+    {
         this->redBins.fill(0);
         this->greenBins.fill(0);
         this->blueBins.fill(0);
 
-        for (unsigned i = 0; i < imageDataLen; i += imageBytesPerPixel)
+        for (const band_s &band: this->bands)
         {
-            this->blueBins[scratchBuffer[i+0]]++;
-            this->greenBins[scratchBuffer[i+1]]++;
-            this->redBins[scratchBuffer[i+2]]++;
+            for (unsigned i = 0; i < numBins; i++)
+            {
+                this->redBins[i] += band.redBins[i];
+                this->greenBins[i] += band.greenBins[i];
+                this->blueBins[i] += band.blueBins[i];
+            }
         }
+    }
 
-        this->maxBinHeight = std::max({
-            *std::max_element(this->redBins.begin(), this->redBins.end()),
-            *std::max_element(this->greenBins.begin(), this->greenBins.end()),
-            *std::max_element(this->blueBins.begin(), this->blueBins.end()),
-        });
-
+    graphingThread.setFuture(QtConcurrent::run([this]{
         this->isEmpty = false;
         this->redraw_graph();
     }));
@@ -73,6 +186,122 @@ void ColorHistogram::refresh(const image_s &image)
     return;
 }
 
+// Bins into the given band's histogram bins every sampled pixel on the band's
+// sampled rows of the image.
+void ColorHistogram::bin_histogram(band_s &band) const
+{
+    // Consecutive samples alternate between two sets of bins, so that runs of
+    // similar pixels don't serialize on incrementing the same bin.
+    unsigned bins[2][3][numBins] = {};
+
+    const unsigned stride = this->samplingStride;
+    const unsigned width = this->image.resolution.w;
+
+    for (unsigned i = band.start; i < band.end; i++)
+    {
+        const uint8_t *const row = (this->image.pixels + (i * stride * width * 4));
+        unsigned x = 0;
+
+        for (; (x + stride) < width; x += (stride * 2))
+        {
+            const uint8_t *const px1 = (row + (x * 4));
+            const uint8_t *const px2 = (row + ((x + stride) * 4));
+
+            bins[0][0][px1[0]]++;
+            bins[0][1][px1[1]]++;
+            bins[0][2][px1[2]]++;
+            bins[1][0][px2[0]]++;
+            bins[1][1][px2[1]]++;
+            bins[1][2][px2[2]]++;
+        }
+
+        for (; x < width; x += stride)
+        {
+            const uint8_t *const px = (row + (x * 4));
+
+            bins[0][0][px[0]]++;
+            bins[0][1][px[1]]++;
+            bins[0][2][px[2]]++;
+        }
+    }
+
+    for (unsigned i = 0; i < numBins; i++)
+    {
+        band.blueBins[i] = (bins[0][0][i] + bins[1][0][i]);
+        band.greenBins[i] = (bins[0][1][i] + bins[1][1][i]);
+        band.redBins[i] = (bins[0][2][i] + bins[1][2][i]);
+    }
+
+    return;
+}
+
+// Bins into the waveform columns owned by the given band every sampled pixel of
+// the image that maps to those columns.
+void ColorHistogram::bin_waveform(band_s &band)
+{
+    const unsigned stride = this->samplingStride;
+    const unsigned width = this->image.resolution.w;
+    const unsigned height = this->image.resolution.h;
+    const unsigned numColumns = ((this->scope == scope_e::rgb_parade)? numParadeColumns : numWaveformColumns);
+
+    // The range of pixel columns (aligned to the sampling stride) that map to this
+    // band's waveform columns.
+    const unsigned xStart = (((((band.start * width) + numColumns - 1) / numColumns) + stride - 1) / stride * stride);
+    const unsigned xEnd = std::min(width, (((band.end * width) + numColumns - 1) / numColumns));
+
+    if (this->scope == scope_e::rgb_parade)
+    {
+        unsigned *const red = this->waveform.data();
+        unsigned *const green = (red + (numParadeColumns * numBins));
+        unsigned *const blue = (green + (numParadeColumns * numBins));
+
+        for (unsigned c = band.start; c < band.end; c++)
+        {
+            std::fill_n((red + (c * numBins)), numBins, 0);
+            std::fill_n((green + (c * numBins)), numBins, 0);
+            std::fill_n((blue + (c * numBins)), numBins, 0);
+        }
+
+        for (unsigned y = 0; y < height; y += stride)
+        {
+            const uint8_t *const row = (this->image.pixels + (y * width * 4));
+
+            for (unsigned x = xStart; x < xEnd; x += stride)
+            {
+                const uint8_t *const px = (row + (x * 4));
+                const unsigned columnOffset = (this->waveformColumnOfX[x] * numBins);
+
+                blue[columnOffset + px[0]]++;
+                green[columnOffset + px[1]]++;
+                red[columnOffset + px[2]]++;
+            }
+        }
+    }
+    else
+    {
+        unsigned *const luma = this->waveform.data();
+
+        std::fill((luma + (band.start * numBins)), (luma + (band.end * numBins)), 0);
+
+        for (unsigned y = 0; y < height; y += stride)
+        {
+            const uint8_t *const row = (this->image.pixels + (y * width * 4));
+
+            for (unsigned x = xStart; x < xEnd; x += stride)
+            {
+                const uint8_t *const px = (row + (x * 4));
+
+                // Rec. 709 luma in 8-bit fixed point; the weights sum to 256.
+                const unsigned y709 = (((19 * px[0]) + (183 * px[1]) + (54 * px[2])) >> 8);
+
+                luma[(this->waveformColumnOfX[x] * numBins) + y709]++;
+            }
+        }
+    }
+
+    return;
+}
+
 void ColorHistogram::redraw_graph(void)
 {
     QPixmap &histogram = *this->backBuffer;
@@ -86,8 +315,31 @@ void ColorHistogram::redraw_graph(void)
 
     QPainter painter(&histogram);
 
+    if (this->scope == scope_e::histogram)
+    {
+        this->draw_histogram(painter);
+    }
+    else
+    {
+        this->draw_waveform(painter);
+    }
+
+    std::swap(this->frontBuffer, this->backBuffer);
+
+    return;
+}
+
+void ColorHistogram::draw_histogram(QPainter &painter)
+{
+    const QPixmap &histogram = *this->backBuffer;
     const double binWidth = (histogram.width() / double(numBins));
 
+    this->maxBinHeight = std::max({
+        *std::max_element(this->redBins.begin(), this->redBins.end()),
+        *std::max_element(this->greenBins.begin(), this->greenBins.end()),
+        *std::max_element(this->blueBins.begin(), this->blueBins.end()),
+    });
+
     const auto draw_bins = [&painter, binWidth, &histogram, this](const std::array<unsigned, numBins> &bins, const QColor color)->void
     {
         const int maxHeight = (histogram.height() - 1);
@@ -118,19 +370,66 @@ void ColorHistogram::redraw_graph(void)
     draw_bins(this->greenBins, "#53d76a");
     draw_bins(this->redBins, "#fa3244");
 
-    std::swap(this->frontBuffer, this->backBuffer);
+    return;
+}
+
+// Draws the waveform data as an image whose horizontal axis is the waveform column
+// and vertical axis the signal level, with a pixel's opacity given by the
+// (logarithmically scaled) number of samples in that column at that level.
+void ColorHistogram::draw_waveform(QPainter &painter)
+{
+    const bool isParade = (this->scope == scope_e::rgb_parade);
+    const unsigned numColumns = (isParade? (numParadeColumns * 3) : numWaveformColumns);
+
+    if (
+        (this->waveformImage.width() != int(numColumns)) ||
+        (this->waveformImage.height() != int(numBins))
+    ){
+        this->waveformImage = QImage(numColumns, numBins, QImage::Format_ARGB32);
+    }
+
+    const unsigned maxCount = *std::max_element(this->waveform.begin(), this->waveform.end());
+
+    if (!maxCount)
+    {
+        return;
+    }
+
+    const double logMaxCount = std::log1p(maxCount);
+
+    for (unsigned c = 0; c < numColumns; c++)
+    {
+        const QRgb color = ([c, isParade]()->QRgb
+        {
+            if (!isParade) return qRgb(0xdd, 0xdd, 0xdd);
+            if (c < numParadeColumns) return qRgb(0xfa, 0x32, 0x44);
+            if (c < (numParadeColumns * 2)) return qRgb(0x53, 0xd7, 0x6a);
+            return qRgb(0x15, 0x7e, 0xfd);
+        }());
+
+        const unsigned *const levels = (this->waveform.data() + (c * numBins));
+
+        for (unsigned level = 0; level < numBins; level++)
+        {
+            const unsigned alpha = (levels[level]? unsigned(64 + ((191 * std::log1p(levels[level])) / logMaxCount)) : 0);
+            this->waveformImage.setPixel(c, (numBins - 1 - level), ((alpha << 24) | (color & 0x00ffffff)));
+        }
+    }
+
+    painter.drawImage(this->backBuffer->rect(), this->waveformImage);
 
     return;
 }
 
 void ColorHistogram::clear(void)
 {
-    graphingThread.waitForFinished();
+    this->wait_for_worker_threads();
 
     this->isEmpty = true;
     this->redBins.fill(0);
     this->greenBins.fill(0);
     this->blueBins.fill(0);
+    std::fill(this->waveform.begin(), this->waveform.end(), 0);
     frontBuffer->fill(Qt::transparent);
 
     this->update();
@@ -151,7 +450,7 @@ void ColorHistogram::paintEvent(QPaintEvent *)
 
 void ColorHistogram::update_pixmap_size(void)
 {
-    graphingThread.waitForFinished();
+    this->wait_for_worker_threads();
 
     *frontBuffer = QPixmap(
         std::max(1, this->width()),
@@ -1,6 +1,6 @@
 /*
  * 2021 Tarpeeksi Hyvae Soft
- * 
+ *
  * Software: VCS
  *
  */
@@ -8,28 +8,69 @@
 #ifndef VCS_DISPLAY_QT_WIDGETS_COLORHISTOGRAM_H
 #define VCS_DISPLAY_QT_WIDGETS_COLORHISTOGRAM_H
 
+#include <array>
+#include <vector>
 #include <QWidget>
+#include <QImage>
 #include <QFuture>
 #include <QFutureWatcher>
 #include "display/display.h"
 
+// Displays a scope (RGB histogram, luma waveform, or RGB parade) of the image in
+// the scaler's frame buffer, as of the latest call to refresh().
+//
+// Every Nth pixel on every Nth row of the image, where N is the sampling stride
+// (see set_sampling_stride()), is binned in parallel on Qt's global thread pool,
+// straight from the frame buffer; the binned data is then graphed. Both steps run
+// asynchronously, so refresh() doesn't wait for them, and is ignored while the
+// previous image is still being processed. If the scaler overwrites the image
+// while it's being binned, the results are discarded and the new image binned
+// instead.
 class ColorHistogram : public QWidget
 {
     Q_OBJECT
 
 public:
+    enum class scope_e
+    {
+        histogram,
+        luma_waveform,
+        rgb_parade,
+    };
+
     explicit ColorHistogram(QWidget *parent = 0);
     ~ColorHistogram();
 
-    void refresh(const image_s &image);
+    void refresh(void);
     void clear(void);
+    void set_scope(const scope_e scope);
+    void set_sampling_stride(const unsigned stride);
 
 private:
+    // A portion of the image to be binned by one worker thread. For the histogram,
+    // bands are horizontal strips of the image, each with its own bins that get
+    // merged once all bands are done; for the waveforms, bands are vertical strips
+    // whose samples go into mutually exclusive columns of the shared waveform data.
+    struct band_s
+    {
+        unsigned start;
+        unsigned end;
+        std::array<unsigned, 256> redBins;
+        std::array<unsigned, 256> greenBins;
+        std::array<unsigned, 256> blueBins;
+    };
+
     void paintEvent(QPaintEvent *);
     void resizeEvent(QResizeEvent *);
 
     void update_pixmap_size(void);
     void redraw_graph(void);
+    void draw_histogram(QPainter &painter);
+    void draw_waveform(QPainter &painter);
+    void bin_histogram(band_s &band) const;
+    void bin_waveform(band_s &band);
+    void graph_bins(void);
+    void wait_for_worker_threads(void);
 
     QVector<QPixmap> histogram{2};
     QPixmap *frontBuffer = &histogram[0];
@@ -37,12 +78,43 @@ private:
 
     bool isEmpty = true;
 
+    scope_e scope = scope_e::histogram;
+
+    unsigned samplingStride = 1;
+
     unsigned maxBinHeight = 1;
     static const unsigned numBins = 256;
     std::array<unsigned, numBins> redBins;
     std::array<unsigned, numBins> greenBins;
     std::array<unsigned, numBins> blueBins;
 
+    // The number of horizontal positions into which the luma waveform and each
+    // channel of the RGB parade are divided.
+    static const unsigned numWaveformColumns = 256;
+    static const unsigned numParadeColumns = 128;
+
+    // Sample counts for the waveform scopes, laid out as rows of 256 signal levels,
+    // one row per waveform column.
+    std::vector<unsigned> waveform;
+
+    // For each horizontal pixel position in the image being binned, the waveform
+    // column that it maps to. Cached across frames of the same width.
+    std::vector<unsigned> waveformColumnOfX;
+
+    QImage waveformImage;
+
+    std::vector<band_s> bands;
+
+    // The image being binned, and the scaler's frame buffer generation at the
+    // time binning started.
+    image_s image = {nullptr, {0, 0}};
+    unsigned imageGeneration = 0;
+
+    // Set when binning starts, and cleared when its results are graphed or
+    // discarded.
+    bool isBinningPending = false;
+
+    QFutureWatcher<void> binningThread;
     QFutureWatcher<void> graphingThread;
 };
 
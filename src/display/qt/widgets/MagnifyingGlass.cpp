@@ -5,12 +5,29 @@
  *
  */
 
-#include <QImage>
+#include <cstring>
+#include <QApplication>
+#include <QPixmap>
+#include <QCursor>
 #include <QPoint>
 #include "display/qt/widgets/MagnifyingGlass.h"
+#include "capture/capture.h"
+#include "scaler/scaler.h"
+
+/// TODO: Let the parent define these.
+static const unsigned MAGNIFICATION = 8;
+static const QSize REGION_SIZE = QSize(40, 30);
+static const QSize GLASS_SIZE = QSize(
+    (REGION_SIZE.width() * MAGNIFICATION),
+    (REGION_SIZE.height() * MAGNIFICATION)
+);
+
+// How often (in milliseconds) the glass updates while it's being shown.
+static const unsigned UPDATE_INTERVAL = 16;
 
 MagnifyingGlass::MagnifyingGlass(QWidget *parent) :
-    QLabel(parent)
+    QLabel(parent),
+    glassImage(GLASS_SIZE, QImage::Format_RGB32)
 {
     this->setStyleSheet(
         "background-color: rgba(0, 0, 0, 255);"
@@ -20,52 +37,107 @@ MagnifyingGlass::MagnifyingGlass(QWidget *parent) :
         "border-radius: 3px;"
     );
 
+    // Cache the nearest-neighbor scaling kernel.
+    this->srcColumnOfX.resize(GLASS_SIZE.width());
+    for (int x = 0; x < GLASS_SIZE.width(); x++)
+    {
+        this->srcColumnOfX[x] = ((x * REGION_SIZE.width()) / GLASS_SIZE.width());
+    }
+
+    this->updateTimer.setInterval(UPDATE_INTERVAL);
+    connect(&this->updateTimer, &QTimer::timeout, this, [this]{this->update_glass();});
+
+    this->resize(GLASS_SIZE);
     this->hide();
-                                
+
     return;
 }
 
-void MagnifyingGlass::magnify(const QImage &fromImage, const QPoint &fromPosition)
+void MagnifyingGlass::start(void)
 {
-    /// TODO: Let the parent define these.
-    static const unsigned magnification = 8;
-    static const QSize regionSize = QSize(40, 30);
-    static const QSize glassSize = QSize(
-        (regionSize.width() * magnification),
-        (regionSize.height() * magnification)
-    );
-    
+    if (!this->updateTimer.isActive())
+    {
+        this->updateTimer.start();
+        this->update_glass();
+    }
+
+    return;
+}
+
+void MagnifyingGlass::update_glass(void)
+{
+    QWidget *const parent = this->parentWidget();
+    const QPoint cursorPos = parent->mapFromGlobal(QCursor::pos());
+
+    if (!(qApp->mouseButtons() & Qt::MiddleButton))
+    {
+        this->updateTimer.stop();
+        this->hide();
+    }
+    else if (
+        kc_has_signal() &&
+        parent->isActiveWindow() &&
+        parent->rect().contains(cursorPos)
+    ){
+        this->magnify(cursorPos);
+    }
+    else
+    {
+        this->hide();
+    }
+
+    return;
+}
+
+void MagnifyingGlass::magnify(const QPoint &fromPosition)
+{
+    const image_s image = ks_scaler_frame_buffer();
+
+    if (
+        !image.pixels ||
+        (image.resolution.w < unsigned(REGION_SIZE.width())) ||
+        (image.resolution.h < unsigned(REGION_SIZE.height()))
+    ){
+        this->hide();
+        return;
+    }
+
     QPoint regionTopLeft = QPoint(
-        (fromPosition.x() - (regionSize.width() / 2)),
-        (fromPosition.y() - (regionSize.height() / 2))
+        (fromPosition.x() - (REGION_SIZE.width() / 2)),
+        (fromPosition.y() - (REGION_SIZE.height() / 2))
     );
 
     // Don't let the magnification overflow the source image.
-    regionTopLeft.setX(std::max(0, std::min(regionTopLeft.x(), (fromImage.width() - regionSize.width()))));
-    regionTopLeft.setY(std::max(0, std::min(regionTopLeft.y(), (fromImage.height() - regionSize.height()))));
-
-    // Grab the magnified region's pixel data.
-    const unsigned startIdx = (regionTopLeft.x() + regionTopLeft.y() * fromImage.width()) * (fromImage.depth() / 8);
-    const QImage magnified(
-        (fromImage.bits() + startIdx),
-        regionSize.width(),
-        regionSize.height(),
-        fromImage.bytesPerLine(),
-        fromImage.format()
-    );
+    regionTopLeft.setX(std::max(0, std::min(regionTopLeft.x(), int(image.resolution.w - REGION_SIZE.width()))));
+    regionTopLeft.setY(std::max(0, std::min(regionTopLeft.y(), int(image.resolution.h - REGION_SIZE.height()))));
 
-    this->setPixmap(QPixmap::fromImage(
-        magnified.scaled(glassSize.width(), glassSize.height(), Qt::IgnoreAspectRatio, Qt::FastTransformation))
-    );
+    // Scale the region into the glass image. Each source row is magnified once and
+    // then duplicated for the rest of its magnified rows.
+    for (int y = 0; y < REGION_SIZE.height(); y++)
+    {
+        const uint32_t *const srcRow = (reinterpret_cast<const uint32_t*>(image.pixels) + regionTopLeft.x() + ((regionTopLeft.y() + y) * image.resolution.w));
+        uint32_t *const dstRow = reinterpret_cast<uint32_t*>(this->glassImage.scanLine(y * MAGNIFICATION));
+
+        for (int x = 0; x < GLASS_SIZE.width(); x++)
+        {
+            dstRow[x] = srcRow[this->srcColumnOfX[x]];
+        }
+
+        for (unsigned i = 1; i < MAGNIFICATION; i++)
+        {
+            std::memcpy(this->glassImage.scanLine((y * MAGNIFICATION) + i), dstRow, this->glassImage.bytesPerLine());
+        }
+    }
 
-    this->resize(glassSize);
+    this->setPixmap(QPixmap::fromImage(this->glassImage));
 
     // Center over the magnified region.
     this->move(
-        std::min((this->parentWidget()->width() - glassSize.width() + 3), std::max(0, fromPosition.x() - (glassSize.width() / 2))),
-        std::max(-3, std::min((this->parentWidget()->height() - glassSize.height()), fromPosition.y() - (glassSize.height() / 2)))
+        std::min((this->parentWidget()->width() - GLASS_SIZE.width() + 3), std::max(0, fromPosition.x() - (GLASS_SIZE.width() / 2))),
+        std::max(-3, std::min((this->parentWidget()->height() - GLASS_SIZE.height()), fromPosition.y() - (GLASS_SIZE.height() / 2)))
     );
 
+    this->raise();
     this->show();
 
     return;
@@ -8,18 +8,40 @@
 #ifndef VCS_DISPLAY_QT_SUBCLASSES_QLABEL_MAGNIFYING_GLASS_H
 #define VCS_DISPLAY_QT_SUBCLASSES_QLABEL_MAGNIFYING_GLASS_H
 
+#include <vector>
 #include <QLabel>
+#include <QImage>
+#include <QTimer>
 
-class QImage;
 class QPoint;
 
+// Displays over its parent widget a magnified view of the scaler's output around
+// the cursor for as long as the middle mouse button is held down.
+//
+// The glass updates itself on its own timer once start() has been called, reading
+// only the magnified region from the scaler's output buffer.
 class MagnifyingGlass : public QLabel
 {
     Q_OBJECT
 
 public:
     explicit MagnifyingGlass(QWidget *parent = 0);
-    void magnify(const QImage &fromImage, const QPoint &fromPosition);
+
+    // Starts updating the glass, until the middle mouse button is released.
+    void start(void);
+
+private:
+    void update_glass(void);
+    void magnify(const QPoint &fromPosition);
+
+    QTimer updateTimer;
+
+    // The magnified image, reused across updates.
+    QImage glassImage;
+
+    // For each horizontal pixel in the glass, the horizontal offset of the source
+    // pixel (relative to the magnified region's left edge) that it samples.
+    std::vector<unsigned> srcColumnOfX;
 };
 
 #endif
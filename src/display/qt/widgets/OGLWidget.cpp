@@ -7,6 +7,9 @@
  *
  */
 
+#include <algorithm>
+#include <vector>
+#include <cmath>
 #include <QCoreApplication>
 #include <QOpenGLWidget>
 #include <QMatrix4x4>
@@ -15,6 +18,8 @@
 #include "display/display.h"
 #include "common/globals.h"
 #include "scaler/scaler.h"
+#include "common/trace/trace.h"
+#include "common/latency_stamp/latency_stamp.h"
 
 // The texture into which we'll stream the captured frames.
 GLuint FRAMEBUFFER_TEXTURE;
@@ -25,6 +30,9 @@ GLuint OVERLAY_TEXTURE;
 // A function that returns the current overlay as a QImage.
 std::function<QImage()> OVERLAY_AS_QIMAGE_F;
 
+// The latency stamp's region of the surface, as read back for the latency test.
+static std::vector<uint8_t> STAMP_REGION_PIXELS;
+
 OGLWidget::OGLWidget(std::function<QImage()> overlay_as_qimage, QWidget *parent) : QOpenGLWidget(parent)
 {
     OVERLAY_AS_QIMAGE_F = overlay_as_qimage;
@@ -77,6 +85,8 @@ void OGLWidget::resizeGL(int w, int h)
 
 void OGLWidget::paintGL()
 {
+    ktrace_mark(trace_point_e::paint_start);
+
     // Draw the output frame.
     {
         const image_s frame = ks_scaler_frame_buffer();
@@ -112,6 +122,7 @@ void OGLWidget::paintGL()
     }
 
     // Draw the overlay, if any.
+    ktrace_mark(trace_point_e::overlay_start);
     const QImage overlay = OVERLAY_AS_QIMAGE_F();
     if (!overlay.isNull())
     {
@@ -139,8 +150,48 @@ void OGLWidget::paintGL()
             glTexCoord2i(0, 0); glVertex2i(0,             0);
         glEnd();
     }
+    ktrace_mark(trace_point_e::overlay_end);
 
     this->glFlush();
+    ktrace_mark(trace_point_e::paint_submit);
+
+    // Read back from the surface the frame we're about to present, for measuring
+    // its end-to-end latency. The widget's framebuffer is in device pixels, with
+    // its origin at the bottom left. The stamp's region is read in one go, as
+    // each read stalls until rendering has finished.
+    if (kstamp_is_enabled())
+    {
+        const double fbWidth = (this->width() * this->devicePixelRatioF());
+        const double fbHeight = (this->height() * this->devicePixelRatioF());
+
+        double stampWidth = 0;
+        double stampHeight = 0;
+        kstamp_stamp_extent(&stampWidth, &stampHeight);
+
+        const GLint regionWidth = std::min(GLint(fbWidth), (GLint(std::ceil(stampWidth * fbWidth)) + 1));
+        const GLint regionHeight = std::min(GLint(fbHeight), (GLint(std::ceil(stampHeight * fbHeight)) + 1));
+        const GLint regionY = (GLint(fbHeight) - regionHeight);
+
+        STAMP_REGION_PIXELS.resize(regionWidth * regionHeight * 4);
+
+        if (!STAMP_REGION_PIXELS.empty())
+        {
+            this->glReadPixels(0, regionY, regionWidth, regionHeight, GL_RGBA, GL_UNSIGNED_BYTE, STAMP_REGION_PIXELS.data());
+        }
+
+        kstamp_read_presented_frame([fbWidth, fbHeight, regionWidth, regionHeight, regionY](const double x, const double y)->uint8_t
+        {
+            const GLint px = GLint(x * fbWidth);
+            const GLint py = (GLint(fbHeight - 1 - (y * fbHeight)) - regionY);
+
+            if ((px < 0) || (px >= regionWidth) || (py < 0) || (py >= regionHeight))
+            {
+                return 0;
+            }
+
+            return STAMP_REGION_PIXELS[(((py * regionWidth) + px) * 4) + 1];
+        });
+    }
 
     return;
 }
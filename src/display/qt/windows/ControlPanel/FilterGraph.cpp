@@ -280,6 +280,22 @@ control_panel::FilterGraph::FilterGraph(QWidget *parent) :
             emit this->data_changed();
         });
 
+        // Periodically repaint the nodes, to keep their display of the filters'
+        // processing times up to date.
+        {
+            auto *const processingTimeRefreshTimer = new QTimer(this);
+
+            connect(processingTimeRefreshTimer, &QTimer::timeout, this, [this]
+            {
+                if (this->isVisible() && this->is_enabled())
+                {
+                    this->graphicsScene->update();
+                }
+            });
+
+            processingTimeRefreshTimer->start(500);
+        }
+
         connect(this->graphicsScene, &InteractibleNodeGraph::nodeRemoved, this, [this](InteractibleNodeGraphNode *const node)
         {
             BaseFilterGraphNode *const filterNode = dynamic_cast<BaseFilterGraphNode*>(node);
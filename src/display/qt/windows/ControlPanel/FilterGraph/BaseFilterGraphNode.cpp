@@ -11,8 +11,10 @@
 #include <QStyle>
 #include "filter/filter.h"
 #include "filter/abstract_filter.h"
+#include "common/refresh_rate.h"
 #include "common/globals.h"
 #include "common/assert.h"
+#include "capture/capture.h"
 #include "display/qt/windows/ControlPanel/FilterGraph/BaseFilterGraphNode.h"
 #include "display/qt/widgets/InteractibleNodeGraph.h"
 
@@ -38,6 +40,9 @@ BaseFilterGraphNode::~BaseFilterGraphNode()
     return;
 }
 
+// The height of the processing time caption drawn below the node.
+static const unsigned PROCESSING_TIME_CAPTION_HEIGHT = 20;
+
 QRectF BaseFilterGraphNode::boundingRect(void) const
 {
     const int margin = 7;
@@ -46,7 +51,7 @@ QRectF BaseFilterGraphNode::boundingRect(void) const
         -margin,
         -margin,
         (this->width + (margin * 2)),
-        (this->height + (margin * 2))
+        (this->height + PROCESSING_TIME_CAPTION_HEIGHT + (margin * 2))
     );
 }
 
@@ -101,6 +106,56 @@ void BaseFilterGraphNode::paint(QPainter *painter, const QStyleOptionGraphicsIte
         painter->drawText(titleBarTextRect, (Qt::AlignLeft | Qt::AlignVCenter), elidedTitle);
     }
 
+    // Draw the time the node's filter (or, for the end of a filter chain, the
+    // whole chain) takes to process a frame, relative to the interval between
+    // captured frames.
+    {
+        const bool isChainEnd = (
+            (this->filterType == filter_node_type_e::scaler) ||
+            (this->associatedFilter->category() == filter_category_e::output_condition)
+        );
+
+        const filter_processing_time_s time = (
+            isChainEnd
+                ? kf_filter_chain_processing_time(this->associatedFilter)
+                : (this->filterType == filter_node_type_e::filter)
+                    ? this->associatedFilter->processing_time()
+                    : filter_processing_time_s{}
+        );
+
+        if (time.numSamples && this->is_enabled())
+        {
+            const double frameIntervalMs = (kc_has_signal()? (1000.0 / refresh_rate_s::from_capture_device_properties().value<double>()) : 0);
+            const double budgetUsed = (frameIntervalMs > 0)? (time.average / frameIntervalMs) : 0;
+
+            QString caption = QString("%1%2 ms (peak %3 ms)")
+                .arg(isChainEnd? "Chain: " : "")
+                .arg(QString::number(time.average, 'f', 2))
+                .arg(QString::number(time.peak, 'f', 2));
+
+            if (frameIntervalMs > 0)
+            {
+                caption += QString(", %1% of frame").arg(QString::number((budgetUsed * 100), 'f', 0));
+            }
+
+            const QColor color = (
+                (budgetUsed >= 0.75)
+                    ? "#ff6060"
+                    : (budgetUsed >= 0.25)
+                        ? "#ffdc00"
+                        : "#80d080"
+            );
+            const QRect captionRect = QRect(4, (this->height + 2), (this->width - 8), (PROCESSING_TIME_CAPTION_HEIGHT - 2));
+
+            painter->setPen(color);
+            painter->drawText(
+                captionRect,
+                (Qt::AlignLeft | Qt::AlignVCenter),
+                QFontMetrics(painter->font()).elidedText(caption, Qt::ElideRight, captionRect.width())
+            );
+        }
+    }
+
     return;
 }
 
@@ -36,7 +36,7 @@ control_panel::output::Histogram::Histogram(QWidget *parent) :
             }
             else
             {
-                this->ui->histogram->refresh(ks_scaler_frame_buffer());
+                this->ui->histogram->refresh();
             }
         });
 
@@ -44,19 +44,41 @@ control_panel::output::Histogram::Histogram(QWidget *parent) :
         {
             this->set_enabled(isChecked);
         });
+
+        connect(this->ui->comboBox_scope, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](const int index)
+        {
+            kpers_set_value(INI_GROUP_OUTPUT, "HistogramScope", index);
+
+            this->ui->histogram->set_scope(
+                (index == 1)? ColorHistogram::scope_e::luma_waveform
+                : (index == 2)? ColorHistogram::scope_e::rgb_parade
+                : ColorHistogram::scope_e::histogram
+            );
+
+            if (this->ui->groupBox->isChecked())
+            {
+                this->ui->histogram->refresh();
+            }
+        });
+
+        connect(this->ui->comboBox_samplingStride, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](const int index)
+        {
+            kpers_set_value(INI_GROUP_OUTPUT, "HistogramSamplingStride", index);
+            this->ui->histogram->set_sampling_stride(1 << std::max(0, index));
+        });
     }
 
     // Listen for app events.
     {
-        ev_new_output_image.listen([this](const image_s &image)
+        ev_new_output_image.listen([this]
         {
             if (
                 this->isVisible() &&
                 this->ui->groupBox->isChecked()
             ){
-                this->ui->histogram->refresh(image);
+                this->ui->histogram->refresh();
             }
-        });
+        }, "Histogram", vcs_event_delivery_e::deferred);
 
         ev_capture_signal_gained.listen([this]
         {
@@ -78,6 +100,8 @@ control_panel::output::Histogram::Histogram(QWidget *parent) :
 
     // Restore persistent settings.
     {
+        this->ui->comboBox_samplingStride->setCurrentIndex(kpers_value_of(INI_GROUP_OUTPUT, "HistogramSamplingStride", 1).toInt());
+        this->ui->comboBox_scope->setCurrentIndex(kpers_value_of(INI_GROUP_OUTPUT, "HistogramScope", 0).toInt());
         this->ui->groupBox->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "HistogramEnabled", true).toBool());
     }
 
@@ -85,7 +109,7 @@ control_panel::output::Histogram::Histogram(QWidget *parent) :
     {
         if (this->ui->groupBox->isChecked())
         {
-            this->ui->histogram->refresh(ks_scaler_frame_buffer());
+            this->ui->histogram->refresh();
         }
         else
         {
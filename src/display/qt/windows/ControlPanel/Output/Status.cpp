@@ -20,6 +20,8 @@
 #include "display/display.h"
 #include "capture/capture.h"
 #include "common/disk/disk.h"
+#include "common/trace/trace.h"
+#include "record/record.h"
 #include "Status.h"
 #include "ui_Status.h"
 
@@ -29,6 +31,11 @@ static QTimer INFO_UPDATE_TIMER;
 static unsigned LATENCY_HISTORY_HEAD = 0;
 static std::array<unsigned, 140> LATENCY_HISTORY;
 
+static QString stage_latency_property_name(const trace_stage_e stage)
+{
+    return QString("Latency: %1").arg(ktrace_stage_name(stage));
+}
+
 control_panel::output::Status::Status(QWidget *parent) :
     DialogFragment(parent),
     ui(new Ui::Status)
@@ -47,12 +54,93 @@ control_panel::output::Status::Status(QWidget *parent) :
             "Processing latency",
             "Time spent by VCS to process and display a captured frame"
         );
-        ui->tableWidget_propertyTable->add_property("Frames dropped");
+        ui->tableWidget_propertyTable->add_property(
+            "Frames dropped",
+            "Frames VCS was too busy to process, and frames the capture device reported having failed to deliver"
+        );
+        ui->tableWidget_propertyTable->add_property(
+            "Recording",
+            "Frames written to disk, frames dropped by the recorder, and frames waiting to be written"
+        );
+
+        for (int i = 0; i < int(trace_stage_e::num_enumerators); i++)
+        {
+            ui->tableWidget_propertyTable->add_property(
+                stage_latency_property_name(trace_stage_e(i)),
+                "Median, 95th and 99th percentile, and peak latency of this stage of processing a captured frame"
+            );
+        }
 
         INFO_UPDATE_TIMER.start(1000);
         connect(&INFO_UPDATE_TIMER, &QTimer::timeout, [this]
         {
-            ui->tableWidget_propertyTable->modify_property("Frames dropped", QString::number(kc_dropped_frames_count()));
+            ui->tableWidget_propertyTable->modify_property(
+                "Frames dropped",
+                QString("%1 by VCS, %2 by device")
+                    .arg(kc_dropped_frames_count())
+                    .arg(kc_device_dropped_frames_count())
+            );
+
+            if (krecord_is_recording() || krecord_backlog())
+            {
+                ui->tableWidget_propertyTable->modify_property(
+                    "Recording",
+                    QString("%1 written, %2 dropped, %3 in backlog")
+                        .arg(krecord_num_frames_recorded())
+                        .arg(krecord_num_frames_dropped())
+                        .arg(krecord_backlog())
+                );
+            }
+            else
+            {
+                ui->tableWidget_propertyTable->modify_property("Recording", "Off");
+            }
+
+            for (int i = 0; i < int(trace_stage_e::num_enumerators); i++)
+            {
+                const latency_percentiles_s stats = ktrace_stage_percentiles(trace_stage_e(i));
+
+                if (!stats.count)
+                {
+                    ui->tableWidget_propertyTable->modify_property(stage_latency_property_name(trace_stage_e(i)), "-");
+                    continue;
+                }
+
+                ui->tableWidget_propertyTable->modify_property(
+                    stage_latency_property_name(trace_stage_e(i)),
+                    QString("%1 / %2 / %3 / %4 ms")
+                        .arg(QString::number((stats.p50 / 1000.0), 'f', 1))
+                        .arg(QString::number((stats.p95 / 1000.0), 'f', 1))
+                        .arg(QString::number((stats.p99 / 1000.0), 'f', 1))
+                        .arg(QString::number((stats.max / 1000.0), 'f', 1))
+                );
+            }
+        });
+    }
+
+    // Connect the GUI controls to consequences for changing their values.
+    {
+        connect(ui->pushButton_resetLatencyTrace, &QPushButton::clicked, this, []
+        {
+            ktrace_reset();
+        });
+
+        connect(ui->pushButton_saveLatencyTrace, &QPushButton::clicked, this, [this]
+        {
+            const QString filename = QFileDialog::getSaveFileName(
+                this,
+                "Save latency statistics",
+                "vcs-latency.csv",
+                "CSV files (*.csv);;All files (*.*)"
+            );
+
+            if (!filename.isEmpty() && !ktrace_dump(filename.toStdString()))
+            {
+                kd_show_headless_error_message(
+                    "Failed to save latency statistics",
+                    "The latency statistics couldn't be written into the file."
+                );
+            }
         });
     }
 
@@ -64,7 +152,7 @@ control_panel::output::Status::Status(QWidget *parent) :
             const double avg = ((std::accumulate(LATENCY_HISTORY.begin(), LATENCY_HISTORY.end(), 0) / LATENCY_HISTORY.size()) / 1000.0);
             const double peak = (*std::max_element(LATENCY_HISTORY.begin(), LATENCY_HISTORY.end()) / 1000.0);
             ui->tableWidget_propertyTable->modify_property("Processing latency", (QString::number(avg, 'f', 1) + " ms, " + QString::number(peak, 'f', 1) + " ms peak"));
-        });
+        }, "Status panel latency");
 
         ev_new_output_image.listen([this](const image_s &image)
         {
@@ -74,7 +162,7 @@ control_panel::output::Status::Status(QWidget *parent) :
                     .arg(image.resolution.w)
                     .arg(image.resolution.h)
             );
-        });
+        }, "Status panel resolution", vcs_event_delivery_e::deferred);
 
         ev_frames_per_second.listen([this](const refresh_rate_s &fps)
         {
@@ -2,6 +2,7 @@
 #include "display/display.h"
 #include "display/qt/windows/OutputWindow.h"
 #include "display/qt/persistent_settings.h"
+#include "screenshot/screenshot.h"
 #include "Window.h"
 #include "ui_Window.h"
 
@@ -23,8 +24,34 @@ control_panel::output::Window::Window(QWidget *parent) :
         OutputWindow::current_instance()->override_window_title(title);
     });
 
+    connect(ui->comboBox_screenshotFormat, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](const int index)
+    {
+        kpers_set_value(INI_GROUP_OUTPUT_WINDOW, "ScreenshotFormat", ui->comboBox_screenshotFormat->itemText(index));
+        kscreenshot_set_format(
+            (index == 1)? screenshot_format_e::qoi
+            : (index == 2)? screenshot_format_e::bgra
+            : screenshot_format_e::png
+        );
+        ui->spinBox_pngCompression->setEnabled(index == 0);
+    });
+
+    connect(ui->spinBox_pngCompression, QOverload<int>::of(&QSpinBox::valueChanged), this, [](const int level)
+    {
+        kpers_set_value(INI_GROUP_OUTPUT_WINDOW, "PngCompression", level);
+        kscreenshot_set_png_compression_level(level);
+    });
+
+    connect(ui->comboBox_recordingCodec, &QComboBox::currentTextChanged, this, [](const QString &codecName)
+    {
+        kpers_set_value(INI_GROUP_OUTPUT_WINDOW, "RecordingCodec", codecName);
+    });
+
     ui->comboBox_renderer->setCurrentText(kpers_value_of(INI_GROUP_OUTPUT_WINDOW, "Renderer", ui->comboBox_renderer->itemText(0)).toString());
     ui->lineEdit_title->setText(kpers_value_of(INI_GROUP_OUTPUT_WINDOW, "Title", ui->lineEdit_title->text()).toString());
+    ui->comboBox_screenshotFormat->setCurrentText(kpers_value_of(INI_GROUP_OUTPUT_WINDOW, "ScreenshotFormat", ui->comboBox_screenshotFormat->itemText(0)).toString());
+    ui->spinBox_pngCompression->setValue(kpers_value_of(INI_GROUP_OUTPUT_WINDOW, "PngCompression", ui->spinBox_pngCompression->value()).toInt());
+    kscreenshot_set_png_compression_level(ui->spinBox_pngCompression->value());
+    ui->comboBox_recordingCodec->setCurrentText(kpers_value_of(INI_GROUP_OUTPUT_WINDOW, "RecordingCodec", ui->comboBox_recordingCodec->itemText(0)).toString());
 }
 
 control_panel::output::Window::~Window()
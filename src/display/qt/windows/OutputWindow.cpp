@@ -19,14 +19,13 @@
 #include <QMessageBox>
 #include <QMouseEvent>
 #include <QGroupBox>
-#include <QDateTime>
 #include <QShortcut>
 #include <QPainter>
-#include <QRegularExpression>
 #include <QScreen>
 #include <QImage>
 #include <QLabel>
 #include <QMenu>
+#include <QDateTime>
 #include <QDir>
 #include <cmath>
 #include "display/qt/widgets/MagnifyingGlass.h"
@@ -48,6 +47,12 @@
 #include "capture/capture.h"
 #include "common/globals.h"
 #include "scaler/scaler.h"
+#include "screenshot/screenshot.h"
+#include "record/record.h"
+#include "capture/replay/replay_recorder.h"
+#include "output_sink/output_sink.h"
+#include "common/trace/trace.h"
+#include "common/latency_stamp/latency_stamp.h"
 #include "main.h"
 #include "ui_OutputWindow.h"
 
@@ -183,7 +188,113 @@ OutputWindow::OutputWindow(QWidget *parent) :
             });
         }
 
+        QAction *saveFrames = new QAction("Save next frames...", this);
+        {
+            connect(saveFrames, &QAction::triggered, this, [this]
+            {
+                bool ok = false;
+                const int numFrames = QInputDialog::getInt(
+                    this,
+                    "Save next frames",
+                    "Number of upcoming output frames to save:",
+                    60, 1, 100000, 1, &ok
+                );
+
+                if (ok)
+                {
+                    kscreenshot_save_next_output_frames(numFrames);
+                }
+            });
+        }
+
+        QAction *record = new QAction("Record", this);
+        {
+            record->setCheckable(true);
+            record->setChecked(krecord_is_recording());
+
+            ev_recording_started.listen([record]
+            {
+                record->setChecked(true);
+            });
+
+            ev_recording_stopped.listen([record]
+            {
+                record->setChecked(false);
+            });
+
+            connect(record, &QAction::triggered, this, [record](const bool checked)
+            {
+                if (!checked)
+                {
+                    krecord_stop();
+                    return;
+                }
+
+                const QString baseFilename = QString("%1/vcs %2")
+                    .arg(QDir::currentPath())
+                    .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd 'at' hh.mm.ss"));
+
+                const bool isRaw = kpers_value_of(INI_GROUP_OUTPUT_WINDOW, "RecordingCodec", "").toString().startsWith("Raw");
+
+                if (!krecord_start(baseFilename.toStdString(), (isRaw? record_codec_e::raw_bgra : record_codec_e::ffv1)))
+                {
+                    record->setChecked(false);
+                }
+            });
+        }
+
+        QAction *recordCapture = new QAction("Record captured frames", this);
+        {
+            recordCapture->setCheckable(true);
+
+            // The recorder may stop by itself, e.g. on a write error.
+            connect(this->contextMenu, &QMenu::aboutToShow, this, [recordCapture]
+            {
+                recordCapture->setChecked(kreplay_is_recording());
+            });
+
+            connect(recordCapture, &QAction::triggered, this, [recordCapture](const bool checked)
+            {
+                if (!checked)
+                {
+                    kreplay_stop_recording();
+                    return;
+                }
+
+                const QString filename = QString("%1/vcs %2.vcsreplay")
+                    .arg(QDir::currentPath())
+                    .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd 'at' hh.mm.ss"));
+
+                if (!kreplay_start_recording(filename.toStdString()))
+                {
+                    recordCapture->setChecked(false);
+                }
+            });
+        }
+
+        QAction *sharedMemoryOutput = new QAction("Shared-memory output", this);
+        {
+            sharedMemoryOutput->setCheckable(true);
+
+            connect(sharedMemoryOutput, &QAction::toggled, this, [sharedMemoryOutput](const bool checked)
+            {
+                if (!ksink_set_enabled(checked))
+                {
+                    sharedMemoryOutput->setChecked(false);
+                    return;
+                }
+
+                kpers_set_value(INI_GROUP_OUTPUT, "SharedMemoryOutput", checked);
+            });
+
+            sharedMemoryOutput->setChecked(kpers_value_of(INI_GROUP_OUTPUT, "SharedMemoryOutput", false).toBool());
+        }
+
         this->contextMenu->addAction(screenshot);
+        this->contextMenu->addAction(saveFrames);
+        this->contextMenu->addAction(record);
+        this->contextMenu->addAction(recordCapture);
+        this->contextMenu->addAction(sharedMemoryOutput);
         this->contextMenu->addSeparator();
         this->contextMenu->addAction(controlPanel);
         this->contextMenu->addSeparator();
@@ -281,7 +392,7 @@ OutputWindow::OutputWindow(QWidget *parent) :
         ev_new_output_image.listen([this]
         {
             this->redraw();
-        });
+        }, "Output window");
 
         ev_eco_mode_enabled.listen([this]
         {
@@ -451,6 +562,11 @@ void OutputWindow::set_opengl_enabled(const bool enabled)
         k_assert((OGL_SURFACE == nullptr), "Can't doubly enable OpenGL.");
 
         OGL_SURFACE = new OGLWidget(std::bind(&OutputWindow::overlay_image, this), this);
+        connect(OGL_SURFACE, &QOpenGLWidget::frameSwapped, []
+        {
+            ktrace_mark(trace_point_e::present);
+            kstamp_mark_presented();
+        });
         OGL_SURFACE->show();
         OGL_SURFACE->raise();
 
@@ -577,6 +693,10 @@ void OutputWindow::mousePressEvent(QMouseEvent *event)
         LEFT_MOUSE_BUTTON_DOWN = true;
         PREV_MOUSE_POS = event->globalPos();
     }
+    else if (event->button() == Qt::MiddleButton)
+    {
+        this->magnifyingGlass->start();
+    }
 
     return;
 }
@@ -638,31 +758,41 @@ void OutputWindow::paintEvent(QPaintEvent *)
         }
     }
 
+    ktrace_mark(trace_point_e::paint_start);
+
     QPainter painter(this);
 
     if (!frameImage.isNull())
     {
         painter.drawImage(0, 0, frameImage);
+
+        // Qt doesn't give us access to the window's backing store, so for
+        // measuring end-to-end latency we read back the image we painted.
+        if (kstamp_is_enabled())
+        {
+            kstamp_read_presented_frame([&frameImage](const double x, const double y)->uint8_t
+            {
+                return uint8_t(qGreen(frameImage.pixel(int(x * frameImage.width()), int(y * frameImage.height()))));
+            });
+        }
     }
 
+    ktrace_mark(trace_point_e::overlay_start);
     const QImage overlayImg = overlay_image();
     if (!overlayImg.isNull())
     {
         painter.drawImage(0, 0, overlayImg);
     }
+    ktrace_mark(trace_point_e::overlay_end);
 
-    if (
-        kc_has_signal() &&
-        this->isActiveWindow() &&
-        this->rect().contains(this->mapFromGlobal(QCursor::pos())) &&
-        (qApp->mouseButtons() & Qt::MiddleButton)
-    ){
-        this->magnifyingGlass->magnify(frameImage, this->mapFromGlobal(QCursor::pos()));
-    }
-    else
-    {
-        this->magnifyingGlass->hide();
-    }
+    painter.end();
+    ktrace_mark(trace_point_e::paint_submit);
+
+    // Qt flushes the painted window to screen once we return, without telling
+    // us when it's done, so in non-OpenGL mode this is as close to presentation
+    // as we can trace.
+    ktrace_mark(trace_point_e::present);
+    kstamp_mark_presented();
 
     return;
 }
@@ -800,54 +930,7 @@ void OutputWindow::toggle_window_border(void)
 
 void OutputWindow::save_screenshot(void)
 {
-    const QString datestampedFilename = (
-        QDir::currentPath() +
-        "/" +
-        ([]()->QString
-        {
-            QString filename = QString("vcs %1.png").arg(QDateTime::currentDateTime().toString("yyyy-MM-dd 'at' hh.mm.ss"));
-
-            if (QFile::exists(filename))
-            {
-                // Append the current time's milliseconds, for some protection against filename collisions.
-                filename.replace(QRegularExpression(".png$"), QString(".%1.png").arg(QTime::currentTime().toString("z")));
-            }
-
-            return filename;
-        })()
-    );
-
-    const QImage frameImage = ([]()->QImage
-    {
-        const image_s curOutputImage = ks_scaler_frame_buffer();
-
-        if (!curOutputImage.pixels)
-        {
-            DEBUG(("Requested the scaler output as a QImage while the scaler's output buffer was uninitialized."));
-            return QImage();
-        }
-        else
-        {
-            return QImage(curOutputImage.pixels, curOutputImage.resolution.w, curOutputImage.resolution.h, QImage::Format_RGB32);
-        }
-    })();
-
-    if (frameImage.save(datestampedFilename))
-    {
-        INFO(("Output saved to \"%s\".", QDir::toNativeSeparators(datestampedFilename).toStdString().c_str()));
-    }
-    else
-    {
-        NBENE(("Failed to save the output image to \"%s\".", QDir::toNativeSeparators(datestampedFilename).toStdString().c_str()));
-
-        QMessageBox::critical(
-            this,
-            "Error saving image",
-            QString(
-                "The following location could not be written to:<br><br><b>%1</b>"
-            ).arg(QDir::toNativeSeparators(QFileInfo(datestampedFilename).absolutePath()))
-        );
-    }
+    kscreenshot_save_current_output();
 
     return;
 }
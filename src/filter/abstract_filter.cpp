@@ -7,7 +7,11 @@
  *
  */
 
+#include <algorithm>
+#include <numeric>
+#include <chrono>
 #include "filter/abstract_filter.h"
+#include "common/trace/trace.h"
 #include "common/globals.h"
 
 abstract_filter_c::abstract_filter_c(
@@ -36,6 +40,38 @@ abstract_filter_c::~abstract_filter_c(void)
     return;
 }
 
+void abstract_filter_c::apply_timed(image_s *const image)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    this->apply(image);
+
+    const auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+    this->processingTimeHistory[this->numProcessingTimeSamples++ % this->processingTimeHistory.size()] = unsigned(microseconds);
+
+    ktrace_mark_filter(this, startTime);
+
+    return;
+}
+
+filter_processing_time_s abstract_filter_c::processing_time(void) const
+{
+    const unsigned numSamples = std::min<unsigned>(this->numProcessingTimeSamples, this->processingTimeHistory.size());
+
+    if (!numSamples)
+    {
+        return {};
+    }
+
+    const auto samples = this->processingTimeHistory.begin();
+
+    return {
+        .numSamples = numSamples,
+        .average = ((std::accumulate(samples, (samples + numSamples), 0.0) / numSamples) / 1000.0),
+        .peak = (*std::max_element(samples, (samples + numSamples)) / 1000.0),
+    };
+}
+
 unsigned abstract_filter_c::num_parameters(void) const
 {
     return this->parameterValues.size();
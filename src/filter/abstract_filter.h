@@ -10,6 +10,7 @@
 
 #include <vector>
 #include <string>
+#include <array>
 #include "common/abstract_gui.h"
 #include "common/assert.h"
 #include "display/display.h"
@@ -58,6 +59,17 @@ enum class filter_category_e
     internal,
 };
 
+// How long a filter has taken to process an image, over its most recent
+// applications.
+struct filter_processing_time_s
+{
+    unsigned numSamples = 0;
+
+    // In milliseconds.
+    double average = 0;
+    double peak = 0;
+};
+
 // An image filter. Applies a pre-set effect (e.g blurring, sharpening, or the like)
 // onto the pixels of a given image.
 class abstract_filter_c
@@ -97,12 +109,33 @@ public:
     // Applies the filter's effect on the input image.
     virtual void apply(image_s *const image) = 0;
 
+    // A plain implementation of the filter's effect, against which an optimized
+    // (e.g. vectorized or multithreaded) apply() can be verified. A filter that
+    // optimizes apply() should keep its earlier implementation here; otherwise,
+    // apply() is its own reference.
+    virtual void apply_reference(image_s *const image) { this->apply(image); }
+
+    // The largest difference, per color channel, that apply()'s output may have
+    // from apply_reference()'s. Zero if they must be bit-exact.
+    virtual unsigned reference_tolerance(void) const { return 0; }
+
+    // Calls apply(), recording how long it takes. The filter subsystem applies
+    // filters via this function, so their cost can be shown to the user.
+    void apply_timed(image_s *const image);
+
+    filter_processing_time_s processing_time(void) const;
+
     // The filter's GUI widget, which appears in VCS's filter graph and provides
     // the user with controls for adjusting the filter's parameters.
     abstract_gui_s *gui = nullptr;
 
 private:
     std::vector<double> parameterValues;
+
+    // The durations, in microseconds, of the most recent calls to apply_timed(),
+    // as a ring buffer.
+    std::array<unsigned, 60> processingTimeHistory = {};
+    unsigned numProcessingTimeSamples = 0;
 };
 
 // Shorthands for creating and initializing widgets for filter GUIs.
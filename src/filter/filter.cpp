@@ -18,6 +18,8 @@
 #include "filter/filter.h"
 #include "filter/abstract_filter.h"
 #include "filter/filters/filters.h"
+#include "common/trace/trace.h"
+#include "common/metrics/metrics.h"
 
 filter_unknown_c *KF_PLACEHOLDER_FILTER = new filter_unknown_c();
 
@@ -40,11 +42,19 @@ static std::vector<std::vector<abstract_filter_c*>> FILTER_CHAINS;
 // resolution.
 static int MOST_RECENT_FILTER_CHAIN_IDX = -1;
 
+static metric_histogram_c *CHAIN_DURATION_METRIC = nullptr;
+
 subsystem_releaser_t kf_initialize_filters(void)
 {
     DEBUG(("Initializing the filter subsystem."));
     k_assert(!KNOWN_FILTER_TYPES.size(), "Attempting to doubly initialize the filter subsystem.");
 
+    CHAIN_DURATION_METRIC = kmetrics_histogram(
+        "vcs_filter_chain_duration_seconds",
+        "Time taken to apply a filter chain to a captured frame.",
+        {0.0001, 0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066}
+    );
+
     KNOWN_FILTER_TYPES = {
         new filter_blur_c(),
         new filter_frame_rate_c(),
@@ -101,11 +111,17 @@ abstract_filter_c* kf_apply_matching_filter_chain(image_s *const dstImage)
     {
         // The gate filters are expected to be #first and #last, while the actual
         // applicable filters are the ones in-between.
+        ktrace_mark(trace_point_e::filter_chain_start);
+        const auto startTime = std::chrono::steady_clock::now();
+
         for (unsigned c = 1; c < (chain.size() - 1); c++)
         {
-            chain[c]->apply(dstImage);
+            chain[c]->apply_timed(dstImage);
         }
 
+        CHAIN_DURATION_METRIC->observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+        ktrace_mark(trace_point_e::filter_chain_end);
+
         MOST_RECENT_FILTER_CHAIN_IDX = idx;
 
         return (
@@ -214,6 +230,47 @@ const std::vector<const abstract_filter_c*>& kf_available_filter_types(void)
     return KNOWN_FILTER_TYPES;
 }
 
+filter_processing_time_s kf_filter_chain_processing_time(const abstract_filter_c *const chainEnd)
+{
+    const std::vector<abstract_filter_c*> *chain = nullptr;
+
+    if (
+        (MOST_RECENT_FILTER_CHAIN_IDX >= 0) &&
+        (unsigned(MOST_RECENT_FILTER_CHAIN_IDX) < FILTER_CHAINS.size()) &&
+        (FILTER_CHAINS[MOST_RECENT_FILTER_CHAIN_IDX].back() == chainEnd)
+    ){
+        chain = &FILTER_CHAINS[MOST_RECENT_FILTER_CHAIN_IDX];
+    }
+    else
+    {
+        const auto match = std::find_if(FILTER_CHAINS.begin(), FILTER_CHAINS.end(), [chainEnd](const std::vector<abstract_filter_c*> &c)
+        {
+            return (c.back() == chainEnd);
+        });
+
+        if (match == FILTER_CHAINS.end())
+        {
+            return {};
+        }
+
+        chain = &(*match);
+    }
+
+    filter_processing_time_s total;
+
+    // The input gate doesn't process images, but an output scaler does.
+    for (unsigned i = 1; i < chain->size(); i++)
+    {
+        const filter_processing_time_s time = chain->at(i)->processing_time();
+
+        total.numSamples = std::max(total.numSamples, time.numSamples);
+        total.average += time.average;
+        total.peak += time.peak;
+    }
+
+    return total;
+}
+
 void kf_register_filter_chain(std::vector<abstract_filter_c*> newChain)
 {
     k_assert((newChain.size() >= 2) &&
@@ -241,6 +298,7 @@ void kf_delete_filter_instance(const abstract_filter_c *const filter)
 
     if (entry != FILTER_POOL.end())
     {
+        ktrace_forget_filter(*entry);
         delete (*entry);
         FILTER_POOL.erase(entry);
     }
@@ -166,6 +166,12 @@ abstract_filter_c* kf_apply_matching_filter_chain(image_s *const dstImage);
 
 const std::vector<const abstract_filter_c*>& kf_available_filter_types(void);
 
+// Returns the combined processing time of the filters in the registered filter
+// chain that ends in the given output gate or output scaler. If several chains
+// end in it, the one most recently applied is preferred. If no chain ends in
+// it, returns a processing time of no samples.
+filter_processing_time_s kf_filter_chain_processing_time(const abstract_filter_c *const chainEnd);
+
 // Creates a new instance of a filter, whose type is identified with a UUID and
 // whose initial parameters values are given.
 //
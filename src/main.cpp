@@ -9,7 +9,8 @@
     !defined(CAPTURE_BACKEND_GPHOTO2) &&\
     !defined(CAPTURE_BACKEND_VISION_V4L) &&\
     !defined(CAPTURE_BACKEND_GENERIC_V4L) &&\
-    !defined(CAPTURE_BACKEND_MMAP)
+    !defined(CAPTURE_BACKEND_MMAP) &&\
+    !defined(CAPTURE_BACKEND_REPLAY)
     #error "Unrecognized value for the capture backend toggle"
 #endif
 
@@ -28,6 +29,14 @@
 #include "capture/alias.h"
 #include "common/disk/disk.h"
 #include "common/timer/timer.h"
+#include "screenshot/screenshot.h"
+#include "record/record.h"
+#include "output_sink/output_sink.h"
+#include "capture/replay/replay_recorder.h"
+#include "common/trace/trace.h"
+#include "common/latency_stamp/latency_stamp.h"
+#include "common/metrics/metrics.h"
+#include "benchmark/benchmark.h"
 #include "main.h"
 
 #ifdef __SANITIZE_ADDRESS__
@@ -60,7 +69,7 @@ static std::deque<subsystem_releaser_t> SUBSYSTEM_RELEASERS;
 bool PROGRAM_EXIT_REQUESTED = false;
 
 static bool IS_ECO_MODE_ENABLED = false;
-static auto ECO_REFERENCE_TIME = std::chrono::system_clock::now();
+static auto ECO_REFERENCE_TIME = std::chrono::steady_clock::now();
 
 static void prepare_for_exit(void)
 {
@@ -84,57 +93,68 @@ static void prepare_for_exit(void)
     return;
 }
 
-static bool initialize_all(void)
+static void listen_for_app_events(void)
 {
-    // Listen for app events.
+    ev_eco_mode_enabled.listen([]
     {
-        ev_eco_mode_enabled.listen([]
-        {
-            ECO_REFERENCE_TIME = std::chrono::system_clock::now();
-        });
+        ECO_REFERENCE_TIME = std::chrono::steady_clock::now();
+    });
 
-        ev_new_video_mode.listen([](const video_mode_s &videoMode)
+    ev_new_video_mode.listen([](const video_mode_s &videoMode)
+    {
+        INFO((
+            "Video mode: %u x %u at %.3f Hz.",
+            videoMode.resolution.w,
+            videoMode.resolution.h,
+            videoMode.refreshRate.value<double>()
+        ));
+    });
+
+    // The capture device has received a new video mode. We'll inspect the
+    // mode to see if we think it's acceptable, then allow news of it to
+    // propagate to the rest of VCS.
+    ev_new_proposed_video_mode.listen([](const video_mode_s &videoMode)
+    {
+        if (ka_has_alias(videoMode.resolution))
         {
-            INFO((
-                "Video mode: %u x %u at %.3f Hz.",
-                videoMode.resolution.w,
-                videoMode.resolution.h,
-                videoMode.refreshRate.value<double>()
+            const resolution_s aliasedResolution = ka_aliased(videoMode.resolution);
+
+            DEBUG((
+                "Aliasing %u x %u to %u x %u",
+                 videoMode.resolution.w,
+                 videoMode.resolution.h,
+                 aliasedResolution.w,
+                 aliasedResolution.h
             ));
-        });
 
-        // The capture device has received a new video mode. We'll inspect the
-        // mode to see if we think it's acceptable, then allow news of it to
-        // propagate to the rest of VCS.
-        ev_new_proposed_video_mode.listen([](const video_mode_s &videoMode)
+            resolution_s::to_capture_device_properties(aliasedResolution);
+        }
+        else
         {
-            if (ka_has_alias(videoMode.resolution))
-            {
-                const resolution_s aliasedResolution = ka_aliased(videoMode.resolution);
+            ev_new_video_mode.fire(videoMode);
+        }
+    });
 
-                DEBUG((
-                    "Aliasing %u x %u to %u x %u",
-                     videoMode.resolution.w,
-                     videoMode.resolution.h,
-                     aliasedResolution.w,
-                     aliasedResolution.h
-                ));
+    return;
+}
 
-                resolution_s::to_capture_device_properties(aliasedResolution);
-            }
-            else
-            {
-                ev_new_video_mode.fire(videoMode);
-            }
-        });
-    }
+static bool initialize_all(void)
+{
+    listen_for_app_events();
 
     // Initialize subsystems.
     {
         SUBSYSTEM_RELEASERS.push_back(kvideopreset_initialize());
+        SUBSYSTEM_RELEASERS.push_back(kmetrics_initialize());
+        SUBSYSTEM_RELEASERS.push_back(ktrace_initialize());
+        SUBSYSTEM_RELEASERS.push_back(kstamp_initialize());
         SUBSYSTEM_RELEASERS.push_back(ks_initialize_scaler());
         SUBSYSTEM_RELEASERS.push_back(kc_initialize_capture());
         SUBSYSTEM_RELEASERS.push_back(kf_initialize_filters());
+        SUBSYSTEM_RELEASERS.push_back(kscreenshot_initialize());
+        SUBSYSTEM_RELEASERS.push_back(krecord_initialize());
+        SUBSYSTEM_RELEASERS.push_back(ksink_initialize());
+        SUBSYSTEM_RELEASERS.push_back(kreplay_initialize_recorder());
 
         // The display subsystem should be initialized last.
         SUBSYSTEM_RELEASERS.push_back(kd_acquire_output_window());
@@ -143,6 +163,47 @@ static bool initialize_all(void)
     return !PROGRAM_EXIT_REQUESTED;
 }
 
+// Runs the headless benchmark requested via the command line (--benchmark).
+// Only the subsystems of the frame pipeline are initialized; there's no output
+// window, and nothing gets recorded or saved.
+static int run_benchmark(void)
+{
+    benchmark_options_s options;
+
+    if (!kbench_parse_options(kcom_benchmark_spec(), &options))
+    {
+        NBENE(("Malformed benchmark options. Exiting."));
+        return EXIT_FAILURE;
+    }
+
+    int exitCode = EXIT_FAILURE;
+
+    try
+    {
+        listen_for_app_events();
+
+        SUBSYSTEM_RELEASERS.push_back(kvideopreset_initialize());
+        SUBSYSTEM_RELEASERS.push_back(kmetrics_initialize());
+        SUBSYSTEM_RELEASERS.push_back(ktrace_initialize());
+        SUBSYSTEM_RELEASERS.push_back(ks_initialize_scaler());
+        SUBSYSTEM_RELEASERS.push_back(kc_initialize_capture());
+        SUBSYSTEM_RELEASERS.push_back(kf_initialize_filters());
+
+        exitCode = kbench_run(options);
+    }
+    // Generally assumed to be from k_assert(), which will already have displayed
+    // a more detailed error report to the user.
+    catch (...)
+    {
+        NBENE(("VCS has encountered an error while benchmarking and will attempt to exit normally."));
+        exitCode = EXIT_FAILURE;
+    }
+
+    prepare_for_exit();
+
+    return exitCode;
+}
+
 static capture_event_e handle_next_capture_event(void)
 {
     const capture_event_e e = kc_process_next_capture_event();
@@ -196,6 +257,17 @@ void k_defer_until_capture_mutex_unlocked(std::function<void(void)> callback)
     return;
 }
 
+void k_run_deferred_callbacks(void)
+{
+    while (!POST_MUTEX_CALLBACKS.empty())
+    {
+        POST_MUTEX_CALLBACKS.front()();
+        POST_MUTEX_CALLBACKS.pop();
+    }
+
+    return;
+}
+
 void k_set_eco_mode_enabled(const bool isEnabled)
 {
     if (isEnabled == IS_ECO_MODE_ENABLED)
@@ -237,16 +309,25 @@ static void eco_sleep(const capture_event_e event)
 
     const double maxTimeToSleepMs = 20;
 
+    // Don't sleep past the next timer's deadline, so the timers run on time.
+    const auto sleep_for = [](const unsigned ms)
+    {
+        std::this_thread::sleep_until(std::min(
+            (std::chrono::steady_clock::now() + std::chrono::milliseconds(ms)),
+            kt_next_timer_deadline()
+        ));
+    };
+
     if (!kc_has_signal())
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(unsigned(maxTimeToSleepMs)));
+        sleep_for(unsigned(maxTimeToSleepMs));
         return;
     }
     else
     {
         static double timeToSleepMs = 0;
         static unsigned numDroppedFrames = kc_dropped_frames_count();
-        const double msSinceLastEvent = (0.85 * std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - ECO_REFERENCE_TIME).count());
+        const double msSinceLastEvent = (0.85 * std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - ECO_REFERENCE_TIME).count());
 
         const unsigned numNewDroppedFrames = (kc_dropped_frames_count() - numDroppedFrames);
         numDroppedFrames += numNewDroppedFrames;
@@ -259,13 +340,13 @@ static void eco_sleep(const capture_event_e event)
         // We have time to sleep only if we're not dropping frames.
         if (!numNewDroppedFrames)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(unsigned(timeToSleepMs)));
+            sleep_for(unsigned(timeToSleepMs));
         }
     }
 
     if (event != capture_event_e::sleep)
     {
-        ECO_REFERENCE_TIME = std::chrono::system_clock::now();
+        ECO_REFERENCE_TIME = std::chrono::steady_clock::now();
     }
 
     return;
@@ -288,6 +369,11 @@ int main(int argc, char *argv[])
             goto fail;
         }
 
+        if (!kcom_benchmark_spec().empty())
+        {
+            return run_benchmark();
+        }
+
         if (!initialize_all())
         {
             kd_show_headless_error_message(
@@ -332,11 +418,7 @@ int main(int argc, char *argv[])
                 kd_spin_event_loop();
             }
 
-            while (!POST_MUTEX_CALLBACKS.empty())
-            {
-                POST_MUTEX_CALLBACKS.front()();
-                POST_MUTEX_CALLBACKS.pop();
-            }
+            k_run_deferred_callbacks();
 
             if (e == capture_event_e::new_frame)
             {
@@ -28,4 +28,10 @@ bool k_is_eco_mode_enabled(void);
 // callbacks are registered, they're executed in the order of registration.
 void k_defer_until_capture_mutex_unlocked(std::function<void(void)> callback);
 
+// Executes, in the order of registration, the callbacks registered with
+// k_defer_until_capture_mutex_unlocked(). Should be called with the capture
+// mutex unlocked. Loops that process capture events outside of the main loop
+// (e.g. the benchmark's) should call this after each event, like the main loop.
+void k_run_deferred_callbacks(void);
+
 #endif
@@ -0,0 +1,254 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ *
+ * Implements an output sink that publishes VCS's output frames into shared
+ * memory for other processes to read. It's the output-side counterpart of the
+ * MMAP capture backend (capture/mmap/capture_mmap.cpp).
+ *
+ * The shared memory file, "vcs_mmap_output" (to be opened with shm_open() and
+ * mmap()), is accessible only to the user running VCS, and consists of a header
+ * followed by a ring of frame slots. The header's
+ * byte-level layout, in native byte order:
+ *
+ *   0:  uint32_t  Magic number, 0x4f534356 ("VCSO").
+ *   4:  uint32_t  Protocol version, currently 1.
+ *   8:  uint32_t  Number of frame slots (N).
+ *   12: uint32_t  Size in bytes of each frame slot.
+ *   16: uint32_t  Offset in bytes from the start of the file to the first frame slot.
+ *   20: uint32_t  Doorbell. A futex word incremented by VCS each time it publishes a frame.
+ *   24: uint32_t  Number of consumers waiting on the doorbell. Consumers should increment this before waiting on the doorbell and decrement it after; VCS skips waking the doorbell's waiters while this is 0.
+ *   28: uint32_t  1 while VCS is publishing frames; 0 otherwise.
+ *   32: uint64_t  Sequence number of the most recently published frame, starting from 1; 0 if none.
+ *   64: N slot descriptors of 32 bytes each:
+ *       0:  uint64_t  Sequence number of the frame in the slot; 0 while VCS is writing into the slot.
+ *       8:  uint32_t  Width of the frame.
+ *       12: uint32_t  Height of the frame.
+ *       16: uint32_t  Number of bytes per row of pixels.
+ *       20: uint32_t  Pixel format; 0 = 32-bit BGRA (the alpha channel is undefined).
+ *       24: int64_t   The time, in nanoseconds of CLOCK_MONOTONIC, when the frame was captured.
+ *
+ * Frame number S is published into slot (S % N), whose pixels begin at byte
+ * (first slot offset + ((S % N) * slot size)). Since VCS writes into the slot
+ * again only when publishing frame (S + N), consumers can read the frame in
+ * place, without copying, for as long as they keep up within N - 1 frames.
+ *
+ * How a consumer should read frames:
+ *
+ *   1. Open and mmap() the file, and verify the magic number and version.
+ *
+ *   2. Read the doorbell's value, then the latest sequence number S. If S is no
+ *      newer than the previous frame you read, increment the waiter count, wait
+ *      on the doorbell with FUTEX_WAIT (expecting the value you read), decrement
+ *      the waiter count, and start over.
+ *
+ *   3. Read slot (S % N)'s sequence number (with acquire semantics). If it isn't
+ *      S, start over. Otherwise, read the slot's metadata and pixels, then issue
+ *      an acquire fence and read the slot's sequence number again. If it's still
+ *      S, the data you read were valid; otherwise, VCS overwrote the slot while
+ *      you were reading it, and you should discard the data.
+ *
+ */
+
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common/vcs_event/vcs_event.h"
+#include "common/futex/futex.h"
+#include "common/globals.h"
+#include "output_sink/output_sink.h"
+#include "capture/capture.h"
+#include "display/display.h"
+
+static const char SHARED_FILENAME[] = "vcs_mmap_output";
+static const uint32_t PROTOCOL_MAGIC = 0x4f534356;
+static const uint32_t PROTOCOL_VERSION = 1;
+static const unsigned NUM_SLOTS = 3;
+static const std::size_t FIRST_SLOT_OFFSET = 4096;
+static const std::size_t SLOT_SIZE = MAX_NUM_BYTES_IN_OUTPUT_FRAME;
+static const std::size_t SHARED_FILE_SIZE = (FIRST_SLOT_OFFSET + (NUM_SLOTS * SLOT_SIZE));
+
+struct slot_descriptor_s
+{
+    uint64_t sequence;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerLine;
+    uint32_t pixelFormat;
+    int64_t timestampNs;
+};
+
+struct shared_header_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t slotSize;
+    uint32_t firstSlotOffset;
+    uint32_t doorbell;
+    uint32_t numWaiters;
+    uint32_t isActive;
+    uint64_t latestSequence;
+    uint64_t reserved[3];
+    slot_descriptor_s slots[NUM_SLOTS];
+};
+
+static_assert(offsetof(shared_header_s, latestSequence) == 32);
+static_assert(offsetof(shared_header_s, slots) == 64);
+static_assert(sizeof(slot_descriptor_s) == 32);
+static_assert(sizeof(shared_header_s) <= FIRST_SLOT_OFFSET);
+
+static uint8_t *SHARED_MEMORY = nullptr;
+static bool IS_ENABLED = false;
+static uint64_t NUM_FRAMES_PUBLISHED = 0;
+
+static shared_header_s& header(void)
+{
+    return *reinterpret_cast<shared_header_s*>(SHARED_MEMORY);
+}
+
+static bool acquire_shared_memory(void)
+{
+    if (SHARED_MEMORY)
+    {
+        return true;
+    }
+
+    const int fd = shm_open(SHARED_FILENAME, (O_RDWR | O_CREAT), 0600);
+
+    if (fd < 0)
+    {
+        NBENE(("Failed to create the shared memory file for the output sink."));
+        return false;
+    }
+
+    if (ftruncate(fd, SHARED_FILE_SIZE) != 0)
+    {
+        NBENE(("Failed to size the shared memory file for the output sink."));
+        close(fd);
+        return false;
+    }
+
+    void *const memory = mmap(nullptr, SHARED_FILE_SIZE, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (memory == MAP_FAILED)
+    {
+        NBENE(("Failed to MMAP into the shared memory file for the output sink."));
+        return false;
+    }
+
+    SHARED_MEMORY = static_cast<uint8_t*>(memory);
+
+    // Initialize the header. Note that consumers may already have the file mapped.
+    {
+        std::atomic_ref<uint64_t>(header().latestSequence).store(0);
+
+        for (slot_descriptor_s &slot: header().slots)
+        {
+            std::atomic_ref<uint64_t>(slot.sequence).store(0);
+        }
+
+        header().numSlots = NUM_SLOTS;
+        header().slotSize = SLOT_SIZE;
+        header().firstSlotOffset = FIRST_SLOT_OFFSET;
+        header().version = PROTOCOL_VERSION;
+        std::atomic_ref<uint32_t>(header().magic).store(PROTOCOL_MAGIC, std::memory_order_release);
+    }
+
+    return true;
+}
+
+static void publish_frame(const image_s &image)
+{
+    const uint64_t sequence = ++NUM_FRAMES_PUBLISHED;
+    slot_descriptor_s &slot = header().slots[sequence % NUM_SLOTS];
+    uint8_t *const slotPixels = (SHARED_MEMORY + FIRST_SLOT_OFFSET + ((sequence % NUM_SLOTS) * SLOT_SIZE));
+
+    // Mark the slot as being written into, so consumers reading it can tell its
+    // data are no longer valid.
+    std::atomic_ref<uint64_t>(slot.sequence).store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(slotPixels, image.pixels, image.byte_size());
+    slot.width = image.resolution.w;
+    slot.height = image.resolution.h;
+    slot.bytesPerLine = (image.resolution.w * image.bytes_per_pixel());
+    slot.pixelFormat = 0;
+    slot.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(kc_frame_buffer().timestamp.time_since_epoch()).count();
+
+    std::atomic_ref<uint64_t>(slot.sequence).store(sequence, std::memory_order_release);
+    std::atomic_ref<uint64_t>(header().latestSequence).store(sequence, std::memory_order_release);
+    std::atomic_ref<uint32_t>(header().doorbell).fetch_add(1, std::memory_order_release);
+
+    if (std::atomic_ref<uint32_t>(header().numWaiters).load())
+    {
+        kfutex_wake(&header().doorbell);
+    }
+
+    return;
+}
+
+subsystem_releaser_t ksink_initialize(void)
+{
+    DEBUG(("Initializing the output sink subsystem."));
+
+    ev_new_output_image.listen([](const image_s &image)
+    {
+        if (IS_ENABLED && image.is_valid())
+        {
+            publish_frame(image);
+        }
+    }, "Output sink");
+
+    return []
+    {
+        DEBUG(("Releasing the output sink subsystem."));
+
+        ksink_set_enabled(false);
+
+        if (SHARED_MEMORY)
+        {
+            munmap(SHARED_MEMORY, SHARED_FILE_SIZE);
+            SHARED_MEMORY = nullptr;
+        }
+    };
+}
+
+bool ksink_set_enabled(const bool isEnabled)
+{
+    if (isEnabled == IS_ENABLED)
+    {
+        return true;
+    }
+
+    if (isEnabled && !acquire_shared_memory())
+    {
+        return false;
+    }
+
+    IS_ENABLED = isEnabled;
+
+    if (SHARED_MEMORY)
+    {
+        std::atomic_ref<uint32_t>(header().isActive).store(isEnabled);
+
+        // Wake up any waiting consumers so they notice the change.
+        std::atomic_ref<uint32_t>(header().doorbell).fetch_add(1);
+        kfutex_wake(&header().doorbell);
+    }
+
+    INFO(("Output sink %s.", (isEnabled? "enabled" : "disabled")));
+
+    return true;
+}
+
+bool ksink_is_enabled(void)
+{
+    return IS_ENABLED;
+}
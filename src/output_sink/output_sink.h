@@ -0,0 +1,42 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The output sink subsystem interface.
+ *
+ * The output sink publishes VCS's output frames -- i.e. captured frames after
+ * filtering and scaling -- into shared memory, from which other local processes
+ * (encoders, streamers, analysis tools, etc.) can read them without having to
+ * screen-grab VCS's output window. See output_sink.cpp for a description of the
+ * shared memory protocol.
+ *
+ * ## Usage
+ *
+ *   1. Call ksink_initialize() to initialize the subsystem. Note that this
+ *      function should be called only once per program execution.
+ *
+ *   2. Call ksink_set_enabled(true) to begin publishing output frames, and
+ *      ksink_set_enabled(false) to stop.
+ *
+ *   3. VCS will automatically release the subsystem on program exit.
+ *
+ */
+
+#ifndef VCS_OUTPUT_SINK_OUTPUT_SINK_H
+#define VCS_OUTPUT_SINK_OUTPUT_SINK_H
+
+#include "main.h"
+
+subsystem_releaser_t ksink_initialize(void);
+
+// Returns false if the sink couldn't be enabled (e.g. because the shared memory
+// couldn't be set up); true otherwise.
+bool ksink_set_enabled(const bool isEnabled);
+
+bool ksink_is_enabled(void);
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/videoio/videoio.hpp>
+#include <cstdio>
+#include "common/frame_queue/frame_writer.h"
+#include "common/vcs_event/vcs_event.h"
+#include "common/timer/timer.h"
+#include "common/refresh_rate.h"
+#include "common/globals.h"
+#include "capture/capture.h"
+#include "display/display.h"
+#include "scaler/scaler.h"
+#include "record/record.h"
+
+static frame_writer_c *WRITER = nullptr;
+
+// Destinations for the recorded frames, depending on the codec. Accessed only
+// by the writer thread while it's running.
+static cv::VideoWriter VIDEO_WRITER;
+static FILE *RAW_FILE = nullptr;
+
+static bool IS_RECORDING = false;
+static record_codec_e CODEC = record_codec_e::ffv1;
+static resolution_s RESOLUTION = {0, 0};
+static std::string FILENAME;
+
+// Called by the writer thread.
+static bool write_frame(const queued_frame_s &frame)
+{
+    // Scratch buffer reused across frames.
+    static cv::Mat bgrFrame;
+
+    switch (CODEC)
+    {
+        case record_codec_e::ffv1:
+        {
+            cv::cvtColor(cv::Mat(frame.resolution.h, frame.resolution.w, CV_8UC4, (void*)frame.pixels.data()), bgrFrame, cv::COLOR_BGRA2BGR);
+            VIDEO_WRITER.write(bgrFrame);
+            return true;
+        }
+        case record_codec_e::raw_bgra:
+        {
+            return (std::fwrite(frame.pixels.data(), 1, frame.pixels.size(), RAW_FILE) == frame.pixels.size());
+        }
+    }
+
+    return false;
+}
+
+// Called by the writer thread once it has written the recording's frames.
+static bool close_recording(void)
+{
+    const bool isClosed = (!RAW_FILE || (std::fclose(RAW_FILE) == 0));
+
+    RAW_FILE = nullptr;
+    VIDEO_WRITER.release();
+
+    return isClosed;
+}
+
+// Joins the writer thread of the most recent recording if it has finished
+// writing the recording's frames, or - if so requested - once it has.
+static void reap_finished_writer(const bool isBlocking = false)
+{
+    if (
+        !IS_RECORDING &&
+        WRITER &&
+        (isBlocking || WRITER->is_finished()) &&
+        WRITER->join()
+    ){
+        if (WRITER->has_write_error())
+        {
+            NBENE(("Recording into \"%s\" ended in a write error.", FILENAME.c_str()));
+        }
+        else
+        {
+            INFO((
+                "Finished recording %u frames into \"%s\" (%u frames dropped).",
+                WRITER->num_frames_written(),
+                FILENAME.c_str(),
+                WRITER->num_frames_dropped()
+            ));
+        }
+    }
+
+    return;
+}
+
+subsystem_releaser_t krecord_initialize(void)
+{
+    DEBUG(("Initializing the recording subsystem."));
+
+    ev_new_output_image.listen([](const image_s &image)
+    {
+        if (!IS_RECORDING)
+        {
+            return;
+        }
+
+        if (image.resolution != RESOLUTION)
+        {
+            INFO(("The output resolution changed. Stopping the recording."));
+            krecord_stop();
+            return;
+        }
+
+        WRITER->push(image);
+    }, "Recorder");
+
+    kt_timer(250, [](const unsigned)
+    {
+        if (IS_RECORDING && WRITER->has_write_error())
+        {
+            krecord_stop();
+
+            k_defer_until_capture_mutex_unlocked([]
+            {
+                kd_show_headless_error_message(
+                    "Recording stopped",
+                    "The recording was stopped because its frames couldn't be written to disk."
+                );
+            });
+        }
+
+        reap_finished_writer();
+    });
+
+    return []
+    {
+        DEBUG(("Releasing the recording subsystem."));
+
+        krecord_stop();
+        reap_finished_writer(true);
+
+        delete WRITER;
+        WRITER = nullptr;
+    };
+}
+
+bool krecord_start(const std::string &baseFilename, const record_codec_e codec)
+{
+    reap_finished_writer();
+
+    if (IS_RECORDING || (WRITER && !WRITER->is_finished()))
+    {
+        NBENE(("Can't start a new recording while the previous one is still being written."));
+        return false;
+    }
+
+    if (!kc_has_signal())
+    {
+        NBENE(("Can't start recording without a capture signal."));
+        return false;
+    }
+
+    const resolution_s resolution = ks_output_resolution();
+    const double frameRate = ([]()->double
+    {
+        const double hz = refresh_rate_s::from_capture_device_properties().value<double>();
+        return ((hz > 0)? hz : 60);
+    })();
+
+    switch (codec)
+    {
+        case record_codec_e::ffv1:
+        {
+            FILENAME = (baseFilename + ".mkv");
+
+            if (!VIDEO_WRITER.open(FILENAME, cv::CAP_FFMPEG, cv::VideoWriter::fourcc('F', 'F', 'V', '1'), frameRate, {int(resolution.w), int(resolution.h)}, true))
+            {
+                NBENE(("Failed to open \"%s\" for recording.", FILENAME.c_str()));
+                return false;
+            }
+
+            break;
+        }
+        case record_codec_e::raw_bgra:
+        {
+            char suffix[64];
+            std::snprintf(suffix, sizeof(suffix), ".%ux%u@%.3f.bgra", resolution.w, resolution.h, frameRate);
+            FILENAME = (baseFilename + suffix);
+
+            if (!(RAW_FILE = std::fopen(FILENAME.c_str(), "wb")))
+            {
+                NBENE(("Failed to open \"%s\" for recording.", FILENAME.c_str()));
+                return false;
+            }
+
+            break;
+        }
+    }
+
+    CODEC = codec;
+    RESOLUTION = resolution;
+    IS_RECORDING = true;
+
+    delete WRITER;
+    WRITER = new frame_writer_c((resolution.w * resolution.h * 4), write_frame, close_recording);
+    ev_recording_started.fire();
+
+    INFO((
+        "Recording %u x %u at %.3f Hz into \"%s\".",
+        resolution.w,
+        resolution.h,
+        frameRate,
+        FILENAME.c_str()
+    ));
+
+    return true;
+}
+
+void krecord_stop(void)
+{
+    if (IS_RECORDING)
+    {
+        IS_RECORDING = false;
+        WRITER->close();
+        ev_recording_stopped.fire();
+    }
+
+    return;
+}
+
+bool krecord_is_recording(void)
+{
+    return IS_RECORDING;
+}
+
+std::string krecord_filename(void)
+{
+    return FILENAME;
+}
+
+unsigned krecord_num_frames_recorded(void)
+{
+    return (WRITER? WRITER->num_frames_written() : 0);
+}
+
+unsigned krecord_num_frames_dropped(void)
+{
+    return (WRITER? WRITER->num_frames_dropped() : 0);
+}
+
+unsigned krecord_backlog(void)
+{
+    return (WRITER? WRITER->backlog() : 0);
+}
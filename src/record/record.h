@@ -0,0 +1,99 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The recording subsystem interface.
+ *
+ * The recording subsystem records VCS's output frames -- i.e. captured frames
+ * after filtering and scaling -- into a video file.
+ *
+ * While a recording is active, each new output image is copied into a pooled
+ * ring of frame buffers, from which a writer thread encodes and writes it to
+ * disk. The main loop never waits on the writer: if the ring is full when a
+ * new frame arrives, the frame is dropped and counted as dropped by the
+ * recorder (separately from frames dropped by the capture subsystem).
+ *
+ * ## Usage
+ *
+ *   1. Call krecord_initialize() to initialize the subsystem. Note that this
+ *      function should be called only once per program execution.
+ *
+ *   2. Start a recording:
+ *      @code
+ *      krecord_start("recording.mkv", record_codec_e::ffv1);
+ *      @endcode
+ *
+ *   3. Monitor the recording's progress:
+ *      @code
+ *      printf("%u frames recorded, %u dropped, %u waiting to be written.\n",
+ *             krecord_num_frames_recorded(),
+ *             krecord_num_frames_dropped(),
+ *             krecord_backlog());
+ *      @endcode
+ *
+ *   4. Stop the recording. Frames still in the writer's backlog will be written
+ *      in the background:
+ *      @code
+ *      krecord_stop();
+ *      @endcode
+ *
+ *   5. VCS will automatically release the subsystem on program exit, which also
+ *      stops any active recording.
+ *
+ */
+
+#ifndef VCS_RECORD_RECORD_H
+#define VCS_RECORD_RECORD_H
+
+#include <string>
+#include "main.h"
+
+enum class record_codec_e
+{
+    // Lossless FFV1 video via OpenCV's FFmpeg backend; normally in a Matroska
+    // (.mkv) container.
+    ffv1,
+
+    // Uncompressed 32-bit BGRA frames written back-to-back with no header. Can
+    // be read e.g. with FFmpeg's rawvideo demuxer, given the resolution and frame
+    // rate (which are included in the file name).
+    raw_bgra,
+};
+
+subsystem_releaser_t krecord_initialize(void);
+
+// Starts recording output frames into a file. The file name is given without an
+// extension, which will be appended based on the codec. Returns false if the
+// recording couldn't be started, e.g. because there's no signal or the file
+// couldn't be opened.
+//
+// The recording uses the current output resolution and capture refresh rate;
+// if the output resolution changes, the recording is stopped.
+bool krecord_start(const std::string &baseFilename, const record_codec_e codec);
+
+// Stops the active recording, if any. Frames remaining in the writer's backlog
+// will still be written, in the background.
+void krecord_stop(void);
+
+bool krecord_is_recording(void);
+
+// Returns the name of the file being written to by the active recording, or the
+// most recent one if no recording is active.
+std::string krecord_filename(void);
+
+// Returns the number of frames that have been written to disk in the active
+// (or most recent) recording.
+unsigned krecord_num_frames_recorded(void);
+
+// Returns the number of output frames that the active (or most recent) recording
+// skipped because the writer's backlog was full.
+unsigned krecord_num_frames_dropped(void);
+
+// Returns the number of frames waiting to be written to disk.
+unsigned krecord_backlog(void);
+
+#endif
@@ -21,10 +21,21 @@
 #include "filter/filters/render_text/font_10x6_sans_serif.h"
 #include "scaler/scaler.h"
 #include "common/timer/timer.h"
+#include "common/trace/trace.h"
+#include "common/metrics/metrics.h"
 
 // For keeping track of the number of frames scaled per second.
 static unsigned NUM_FRAMES_SCALED_PER_SECOND = 0;
 
+static struct
+{
+    metric_counter_c *framesScaled;
+    metric_gauge_c *framesPerSecond;
+    metric_gauge_c *outputWidth;
+    metric_gauge_c *outputHeight;
+    metric_histogram_c *scaleDuration;
+} METRICS;
+
 static std::string STATUS_MESSAGE = "";
 
 // The image scalers available to VCS.
@@ -42,6 +53,9 @@ static const image_scaler_s *DEFAULT_SCALER = nullptr;
 static uint8_t *FRAME_BUFFER_PIXELS = nullptr;
 static resolution_s FRAME_BUFFER_RESOLUTION = {0};
 
+// Incremented each time an image is written into the frame buffer.
+static unsigned FRAME_BUFFER_GENERATION = 0;
+
 // Whether the current output scaling is done via an output scaling filter that
 // the user has specified in a filter chain.
 static bool IS_CUSTOM_SCALER_ACTIVE = false;
@@ -57,6 +71,11 @@ static bool IS_RESOLUTION_OVERRIDE_ENABLED = false;
 static double SCALING_MULTIPLIER = 1;
 static bool IS_SCALING_MULTIPLIER_ENABLED = false;
 
+bool ks_is_output_resolution_fixed(void)
+{
+    return (IS_CUSTOM_SCALER_ACTIVE || IS_RESOLUTION_OVERRIDE_ENABLED);
+}
+
 resolution_s ks_base_resolution(void)
 {
     return RESOLUTION_OVERRIDE;
@@ -146,6 +165,16 @@ subsystem_releaser_t ks_initialize_scaler(void)
 
     ks_set_default_scaler(KNOWN_SCALERS.at(0).name);
 
+    METRICS.framesScaled = kmetrics_counter("vcs_scaler_frames_total", "Frames scaled to the output resolution.");
+    METRICS.framesPerSecond = kmetrics_gauge("vcs_scaler_frames_per_second", "Frames scaled during the most recent second.");
+    METRICS.outputWidth = kmetrics_gauge("vcs_scaler_output_width_pixels", "Width of the output resolution.");
+    METRICS.outputHeight = kmetrics_gauge("vcs_scaler_output_height_pixels", "Height of the output resolution.");
+    METRICS.scaleDuration = kmetrics_histogram(
+        "vcs_scaler_duration_seconds",
+        "Time taken to filter and scale a captured frame.",
+        {0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.1}
+    );
+
     ev_new_captured_frame.listen([](const captured_frame_s &frame)
     {
         if (kc_has_signal())
@@ -157,7 +186,7 @@ subsystem_releaser_t ks_initialize_scaler(void)
             DEBUG(("Was asked to scale a frame while there was no signal. Ignoring this."));
             return;
         }
-    });
+    }, "Scaler");
 
     ev_invalid_capture_signal.listen([]
     {
@@ -165,8 +194,11 @@ subsystem_releaser_t ks_initialize_scaler(void)
         ev_dirty_output_window.fire();
     });
 
-    ev_new_output_resolution.listen([]
+    ev_new_output_resolution.listen([](const resolution_s &resolution)
     {
+        METRICS.outputWidth->set(resolution.w);
+        METRICS.outputHeight->set(resolution.h);
+
         if (!kc_has_signal())
         {
             ks_indicate_status(STATUS_MESSAGE);
@@ -183,11 +215,14 @@ subsystem_releaser_t ks_initialize_scaler(void)
     ev_new_output_image.listen([]
     {
         NUM_FRAMES_SCALED_PER_SECOND++;
-    });
+        METRICS.framesScaled->add();
+    }, "Scaler FPS counter");
 
     kt_timer(1000, [](const unsigned timeElapsedMs)
     {
-        ev_frames_per_second.fire(NUM_FRAMES_SCALED_PER_SECOND * (1000.0 / timeElapsedMs));
+        const double fps = (NUM_FRAMES_SCALED_PER_SECOND * (1000.0 / timeElapsedMs));
+        ev_frames_per_second.fire(fps);
+        METRICS.framesPerSecond->set(fps);
         NUM_FRAMES_SCALED_PER_SECOND = 0;
     });
 
@@ -199,12 +234,21 @@ subsystem_releaser_t ks_initialize_scaler(void)
 //
 void ks_scale_frame(const captured_frame_s &frame)
 {
+    ktrace_begin_frame(frame);
+
+    const auto startTime = std::chrono::steady_clock::now();
     resolution_s outputRes = ks_output_resolution();
 
     // Verify that we have a workable frame.
     {
-        const auto minres = resolution_s::from_capture_device_properties(": minimum");
-        const auto maxres = resolution_s::from_capture_device_properties(": maximum");
+        const resolution_s minres = {
+            .w = unsigned(kc_device_property(device_property_e::width_minimum)),
+            .h = unsigned(kc_device_property(device_property_e::height_minimum))
+        };
+        const resolution_s maxres = {
+            .w = unsigned(kc_device_property(device_property_e::width_maximum)),
+            .h = unsigned(kc_device_property(device_property_e::height_maximum))
+        };
 
         if (outputRes.w > MAX_OUTPUT_WIDTH ||
             outputRes.h > MAX_OUTPUT_HEIGHT)
@@ -257,7 +301,7 @@ void ks_scale_frame(const captured_frame_s &frame)
             IS_CUSTOM_SCALER_ACTIVE = true;
         }
 
-        customScaler->apply(&imageToBeScaled);
+        customScaler->apply_timed(&imageToBeScaled);
         outputRes = CUSTOM_SCALER_FILTER_RESOLUTION = dynamic_cast<filter_output_scaler_c*>(customScaler)->output_resolution();
     }
     else
@@ -281,12 +325,17 @@ void ks_scale_frame(const captured_frame_s &frame)
         }
     }
 
+    FRAME_BUFFER_GENERATION++;
+
     if (FRAME_BUFFER_RESOLUTION != outputRes)
     {
         ev_new_output_resolution.fire(outputRes);
         FRAME_BUFFER_RESOLUTION = outputRes;
     }
 
+    ktrace_mark(trace_point_e::scale);
+    METRICS.scaleDuration->observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+
     ev_new_output_image.fire(ks_scaler_frame_buffer());
 
     return;
@@ -360,6 +409,8 @@ void ks_indicate_status(const std::string &message)
         filter_render_text_c::ALIGN_CENTER
     );
 
+    FRAME_BUFFER_GENERATION++;
+
     return;
 }
 
@@ -371,6 +422,11 @@ image_s ks_scaler_frame_buffer(void)
     };
 }
 
+unsigned ks_scaler_frame_buffer_generation(void)
+{
+    return FRAME_BUFFER_GENERATION;
+}
+
 // Returns a list of GUI-displayable names of the scalers that're available.
 //
 std::vector<std::string> ks_scaler_names(void)
@@ -385,6 +441,11 @@ std::vector<std::string> ks_scaler_names(void)
     return names;
 }
 
+const std::vector<image_scaler_s>& ks_known_scalers(void)
+{
+    return KNOWN_SCALERS;
+}
+
 static const image_scaler_s* scaler_for_name_string(const std::string &name)
 {
     const image_scaler_s *f = nullptr;
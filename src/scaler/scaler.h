@@ -92,6 +92,11 @@ resolution_s ks_output_resolution(void);
 
 bool ks_is_custom_scaler_active(void);
 
+// Returns true if the scaler's output resolution is independent of the input
+// frames' resolution (e.g. because the base resolution has been overridden);
+// false otherwise.
+bool ks_is_output_resolution_fixed(void);
+
 subsystem_releaser_t ks_initialize_scaler(void);
 
 // Applies scaling to the given frame's pixels and stores the result in the scaler
@@ -127,10 +132,18 @@ void ks_indicate_status(const std::string &message);
 // of image (e.g. one produced by ks_indicate_no_signal()).
 image_s ks_scaler_frame_buffer(void);
 
+// Returns a count of the images written into the scaler subsystem's frame buffer,
+// wrapping around on overflow. Lets code that reads the frame buffer outside the
+// main thread tell whether its image was overwritten in the meantime.
+unsigned ks_scaler_frame_buffer_generation(void);
+
 // Returns a list of the names of the image scalers available in this build of
 // VCS.
 std::vector<std::string> ks_scaler_names(void);
 
+// Returns the image scalers available in this build of VCS.
+const std::vector<image_scaler_s>& ks_known_scalers(void);
+
 // Sets the multiplier by which input frames are scaled. The multiplier applies
 // to both the width and height of the frame.
 void ks_set_scaling_multiplier(const double s);
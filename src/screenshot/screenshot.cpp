@@ -0,0 +1,407 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <filesystem>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <ctime>
+#include "common/frame_queue/frame_queue.h"
+#include "common/vcs_event/vcs_event.h"
+#include "common/timer/timer.h"
+#include "common/globals.h"
+#include "screenshot/screenshot.h"
+#include "display/display.h"
+#include "scaler/scaler.h"
+
+// The maximum number of frames waiting to be (or being) written at any one time.
+static const unsigned WRITER_QUEUE_CAPACITY = 8;
+
+// The outcome of saving a frame, as reported by a writer thread.
+struct write_result_s
+{
+    std::string filename;
+    bool succeeded;
+};
+
+static frame_queue_c *WRITER_QUEUE = nullptr;
+static std::vector<std::thread> WRITER_THREADS;
+
+static std::mutex WRITE_RESULTS_MUTEX;
+static std::vector<write_result_s> WRITE_RESULTS;
+
+static std::atomic<unsigned> PNG_COMPRESSION_LEVEL = 3;
+static screenshot_format_e FORMAT = screenshot_format_e::png;
+
+// State of the ongoing request to save a number of upcoming output frames.
+static unsigned NUM_FRAMES_LEFT_TO_DUMP = 0;
+static unsigned NUM_FRAMES_DUMPED = 0;
+static unsigned NUM_DUMPED_FRAMES_DROPPED = 0;
+static std::string DUMP_BASE_FILENAME;
+
+// Returns e.g. "vcs 2023-03-22 at 18.02.40" for the current date and time. For
+// some protection against filename collisions, names requested within the same
+// second as the previous one get a running suffix; e.g. "vcs 2023-03-22 at
+// 18.02.40.1". The names are reserved here, rather than by checking for existing
+// files, since the files of queued images may not yet have been written.
+static std::string datestamped_base_filename(void)
+{
+    static std::string prevDatestamp;
+    static unsigned numNamesInSameSecond = 0;
+
+    const std::time_t timeNow = std::time(nullptr);
+    char datestamp[64];
+    std::strftime(datestamp, sizeof(datestamp), "%Y-%m-%d at %H.%M.%S", std::localtime(&timeNow));
+
+    std::string baseFilename = ("vcs " + std::string(datestamp));
+
+    if (prevDatestamp == datestamp)
+    {
+        baseFilename += ("." + std::to_string(++numNamesInSameSecond));
+    }
+    else
+    {
+        prevDatestamp = datestamp;
+        numNamesInSameSecond = 0;
+    }
+
+    return (std::filesystem::current_path() / baseFilename).string();
+}
+
+static std::string file_extension(const screenshot_format_e format, const resolution_s &resolution)
+{
+    switch (format)
+    {
+        case screenshot_format_e::png: return ".png";
+        case screenshot_format_e::qoi: return ".qoi";
+        case screenshot_format_e::bgra: return ("." + std::to_string(resolution.w) + "x" + std::to_string(resolution.h) + ".bgra");
+        default: k_assert(0, "Unknown screenshot format."); return "";
+    }
+}
+
+// Encodes the given BGRA pixels into the QOI format (https://qoiformat.org/qoi-specification.pdf)
+// as an RGB image.
+static void encode_qoi(const uint8_t *const bgra, const resolution_s &resolution, std::vector<uint8_t> &dst)
+{
+    const auto write_u32_be = [&dst](const uint32_t value)
+    {
+        dst.push_back(value >> 24);
+        dst.push_back(value >> 16);
+        dst.push_back(value >> 8);
+        dst.push_back(value);
+    };
+
+    dst.clear();
+    dst.insert(dst.end(), {'q', 'o', 'i', 'f'});
+    write_u32_be(resolution.w);
+    write_u32_be(resolution.h);
+    dst.push_back(3); // Channels (RGB).
+    dst.push_back(0); // Color space (sRGB with linear alpha).
+
+    // The index's alpha values are needed only to tell apart its zero-initialized
+    // slots, which hold {0, 0, 0, 0}, from pixels, which are all opaque.
+    struct {uint8_t r, g, b, a;} index[64] = {}, prev = {0, 0, 0, 255};
+    unsigned runLength = 0;
+    const unsigned numPixels = (resolution.w * resolution.h);
+
+    for (unsigned i = 0; i < numPixels; i++)
+    {
+        const uint8_t *const px = (bgra + (i * 4));
+        const uint8_t r = px[2], g = px[1], b = px[0];
+
+        if ((r == prev.r) && (g == prev.g) && (b == prev.b))
+        {
+            runLength++;
+
+            if ((runLength == 62) || (i == (numPixels - 1)))
+            {
+                dst.push_back(0xc0 | (runLength - 1)); // QOI_OP_RUN
+                runLength = 0;
+            }
+
+            continue;
+        }
+
+        if (runLength)
+        {
+            dst.push_back(0xc0 | (runLength - 1)); // QOI_OP_RUN
+            runLength = 0;
+        }
+
+        // The alpha channel is always 255, whose contribution to the hash is 255 * 11.
+        const unsigned indexPos = (((r * 3) + (g * 5) + (b * 7) + (255 * 11)) % 64);
+
+        if ((index[indexPos].r == r) && (index[indexPos].g == g) && (index[indexPos].b == b) && (index[indexPos].a == 255))
+        {
+            dst.push_back(indexPos); // QOI_OP_INDEX
+        }
+        else
+        {
+            index[indexPos] = {r, g, b, 255};
+
+            const int8_t dr = int8_t(r - prev.r);
+            const int8_t dg = int8_t(g - prev.g);
+            const int8_t db = int8_t(b - prev.b);
+            const int8_t drdg = int8_t(dr - dg);
+            const int8_t dbdg = int8_t(db - dg);
+
+            if (
+                (dr >= -2) && (dr <= 1) &&
+                (dg >= -2) && (dg <= 1) &&
+                (db >= -2) && (db <= 1)
+            ){
+                dst.push_back(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)); // QOI_OP_DIFF
+            }
+            else if (
+                (dg >= -32) && (dg <= 31) &&
+                (drdg >= -8) && (drdg <= 7) &&
+                (dbdg >= -8) && (dbdg <= 7)
+            ){
+                dst.push_back(0x80 | (dg + 32)); // QOI_OP_LUMA
+                dst.push_back(((drdg + 8) << 4) | (dbdg + 8));
+            }
+            else
+            {
+                dst.insert(dst.end(), {0xfe, r, g, b}); // QOI_OP_RGB
+            }
+        }
+
+        prev = {r, g, b, 255};
+    }
+
+    dst.insert(dst.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+
+    return;
+}
+
+static bool write_file(const std::string &filename, const uint8_t *const data, const std::size_t numBytes)
+{
+    FILE *const file = std::fopen(filename.c_str(), "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    const bool wasWritten = (std::fwrite(data, 1, numBytes, file) == numBytes);
+
+    return ((std::fclose(file) == 0) && wasWritten);
+}
+
+// Encodes and writes to disk frames from the writer queue until the queue is closed.
+static void writer_thread(void)
+{
+    // Scratch buffers reused across frames.
+    cv::Mat bgrImage;
+    std::vector<uint8_t> encodedImage;
+
+    queued_frame_s frame;
+
+    while (WRITER_QUEUE->pop(&frame))
+    {
+        bool succeeded = false;
+
+        switch (screenshot_format_e(frame.tag))
+        {
+            case screenshot_format_e::png:
+            {
+                try
+                {
+                    cv::cvtColor(cv::Mat(frame.resolution.h, frame.resolution.w, CV_8UC4, frame.pixels.data()), bgrImage, cv::COLOR_BGRA2BGR);
+                    succeeded = cv::imwrite(frame.label, bgrImage, {cv::IMWRITE_PNG_COMPRESSION, int(PNG_COMPRESSION_LEVEL)});
+                }
+                catch (const cv::Exception&)
+                {
+                    succeeded = false;
+                }
+
+                break;
+            }
+            case screenshot_format_e::qoi:
+            {
+                encode_qoi(frame.pixels.data(), frame.resolution, encodedImage);
+                succeeded = write_file(frame.label, encodedImage.data(), encodedImage.size());
+                break;
+            }
+            case screenshot_format_e::bgra:
+            {
+                succeeded = write_file(frame.label, frame.pixels.data(), frame.pixels.size());
+                break;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(WRITE_RESULTS_MUTEX);
+            WRITE_RESULTS.push_back({frame.label, succeeded});
+        }
+
+        WRITER_QUEUE->recycle(frame);
+    }
+
+    return;
+}
+
+// Logs the results of writes completed since the last call, and informs the user
+// if any of them failed. Should be called from VCS's main thread.
+static void report_write_results(void)
+{
+    std::vector<write_result_s> results;
+
+    {
+        std::lock_guard<std::mutex> lock(WRITE_RESULTS_MUTEX);
+        std::swap(results, WRITE_RESULTS);
+    }
+
+    std::string failedFilename;
+
+    for (const auto &result: results)
+    {
+        if (result.succeeded)
+        {
+            INFO(("Output saved to \"%s\".", result.filename.c_str()));
+        }
+        else
+        {
+            NBENE(("Failed to save the output image to \"%s\".", result.filename.c_str()));
+            failedFilename = result.filename;
+        }
+    }
+
+    if (!failedFilename.empty())
+    {
+        k_defer_until_capture_mutex_unlocked([failedFilename]
+        {
+            const std::string message = (
+                "The following location could not be written to:\n\n" +
+                std::filesystem::path(failedFilename).parent_path().string()
+            );
+
+            kd_show_headless_error_message("Error saving image", message.c_str());
+        });
+    }
+
+    return;
+}
+
+static bool queue_image(const image_s &image, const std::string &baseFilename)
+{
+    return WRITER_QUEUE->push(image, (baseFilename + file_extension(FORMAT, image.resolution)), uint64_t(FORMAT));
+}
+
+subsystem_releaser_t kscreenshot_initialize(void)
+{
+    DEBUG(("Initializing the screenshot subsystem."));
+    k_assert(!WRITER_QUEUE, "Attempting to doubly initialize the screenshot subsystem.");
+
+    WRITER_QUEUE = new frame_queue_c(WRITER_QUEUE_CAPACITY);
+
+    const unsigned numWriterThreads = std::clamp((std::thread::hardware_concurrency() / 2), 1u, 4u);
+    for (unsigned i = 0; i < numWriterThreads; i++)
+    {
+        WRITER_THREADS.emplace_back(writer_thread);
+    }
+
+    ev_new_output_image.listen([](const image_s &image)
+    {
+        if (!NUM_FRAMES_LEFT_TO_DUMP)
+        {
+            return;
+        }
+
+        char frameNumber[16];
+        std::snprintf(frameNumber, sizeof(frameNumber), " #%04u", ++NUM_FRAMES_DUMPED);
+
+        if (!queue_image(image, (DUMP_BASE_FILENAME + frameNumber)))
+        {
+            NUM_DUMPED_FRAMES_DROPPED++;
+        }
+
+        if (!--NUM_FRAMES_LEFT_TO_DUMP && NUM_DUMPED_FRAMES_DROPPED)
+        {
+            NBENE((
+                "%u of %u frames were not saved because the writer couldn't keep up.",
+                NUM_DUMPED_FRAMES_DROPPED,
+                NUM_FRAMES_DUMPED
+            ));
+        }
+    }, "Frame dumper");
+
+    kt_timer(250, [](const unsigned)
+    {
+        report_write_results();
+    });
+
+    return []
+    {
+        DEBUG(("Releasing the screenshot subsystem."));
+
+        WRITER_QUEUE->close();
+
+        for (std::thread &thread: WRITER_THREADS)
+        {
+            thread.join();
+        }
+
+        report_write_results();
+
+        delete WRITER_QUEUE;
+        WRITER_QUEUE = nullptr;
+    };
+}
+
+bool kscreenshot_save_current_output(void)
+{
+    const image_s image = ks_scaler_frame_buffer();
+
+    if (!image.is_valid())
+    {
+        DEBUG(("Requested to save the scaler's output while the scaler's output buffer was uninitialized."));
+        return false;
+    }
+
+    if (!queue_image(image, datestamped_base_filename()))
+    {
+        NBENE(("Couldn't save the output image: the writer queue is full."));
+        return false;
+    }
+
+    return true;
+}
+
+void kscreenshot_save_next_output_frames(const unsigned numFrames)
+{
+    NUM_FRAMES_LEFT_TO_DUMP = numFrames;
+    NUM_FRAMES_DUMPED = 0;
+    NUM_DUMPED_FRAMES_DROPPED = 0;
+    DUMP_BASE_FILENAME = datestamped_base_filename();
+
+    INFO(("Saving the next %u output frames.", numFrames));
+
+    return;
+}
+
+void kscreenshot_set_format(const screenshot_format_e format)
+{
+    FORMAT = format;
+
+    return;
+}
+
+screenshot_format_e kscreenshot_format(void)
+{
+    return FORMAT;
+}
+
+void kscreenshot_set_png_compression_level(const unsigned level)
+{
+    PNG_COMPRESSION_LEVEL = std::min(9u, level);
+
+    return;
+}
@@ -0,0 +1,83 @@
+/*
+ * 2023 Tarpeeksi Hyvae Soft
+ *
+ * Software: VCS
+ *
+ */
+
+/*
+ * The screenshot subsystem interface.
+ *
+ * The screenshot subsystem saves VCS's output frames into image files on disk.
+ *
+ * Saving a frame only makes a copy of its pixels on the calling thread; the
+ * encoding and writing to disk happen on the subsystem's background writer
+ * threads, which are fed through a bounded queue. If the queue is full when a
+ * frame is to be saved, the frame is dropped rather than the caller made to
+ * wait.
+ *
+ * The result of each save is reported (logged, and in case of error displayed
+ * to the user) on VCS's main thread shortly after the file has been written.
+ *
+ * ## Usage
+ *
+ *   1. Call kscreenshot_initialize() to initialize the subsystem. Note that this
+ *      function should be called only once per program execution.
+ *
+ *   2. Optionally, customize the format of saved images:
+ *      @code
+ *      kscreenshot_set_format(screenshot_format_e::png);
+ *      kscreenshot_set_png_compression_level(3);
+ *      @endcode
+ *
+ *   3. Save the current output frame, or a number of upcoming output frames:
+ *      @code
+ *      kscreenshot_save_current_output();
+ *      kscreenshot_save_next_output_frames(60);
+ *      @endcode
+ *
+ *   4. VCS will automatically release the subsystem on program exit. Frames
+ *      still waiting in the writer queue will be written before then.
+ *
+ */
+
+#ifndef VCS_SCREENSHOT_SCREENSHOT_H
+#define VCS_SCREENSHOT_SCREENSHOT_H
+
+#include "main.h"
+
+enum class screenshot_format_e
+{
+    // Lossless PNG, with a configurable compression level.
+    png,
+
+    // The Quite OK Image format (https://qoiformat.org), lossless; typically
+    // encodes many times faster than PNG at a somewhat larger file size.
+    qoi,
+
+    // The frame's raw 32-bit BGRA pixel data, with no header. The frame's
+    // resolution is given in the file name.
+    bgra,
+};
+
+subsystem_releaser_t kscreenshot_initialize(void);
+
+// Queues the scaler's current output image to be saved into a date-stamped file
+// in the current working directory. Returns false if the image couldn't be
+// queued (e.g. because the writer queue is full).
+bool kscreenshot_save_current_output(void);
+
+// Queues the given number of upcoming output images to be saved into sequentially-
+// numbered, date-stamped files in the current working directory. If a previous
+// such request is still ongoing, it'll be replaced by this one.
+void kscreenshot_save_next_output_frames(const unsigned numFrames);
+
+void kscreenshot_set_format(const screenshot_format_e format);
+
+screenshot_format_e kscreenshot_format(void);
+
+// Sets the zlib compression level (0-9) of saved PNG images. Higher levels produce
+// smaller files but take longer to encode.
+void kscreenshot_set_png_compression_level(const unsigned level);
+
+#endif
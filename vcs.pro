@@ -37,6 +37,13 @@ DEFINES += \
     #CAPTURE_BACKEND_GPHOTO2
     #CAPTURE_BACKEND_MMAP
     #CAPTURE_BACKEND_GENERIC_V4L
+    #CAPTURE_BACKEND_REPLAY
+
+# Whether the headless benchmark (--benchmark) counts the memory allocations made
+# by the frame pipeline. This replaces the global operator new and delete, so it
+# should be defined only in builds intended for benchmarking.
+DEFINES += \
+    #VCS_BENCHMARK_COUNTS_ALLOCATIONS
 
 # Whether this build of VCS uses the OpenCV library. For now, non-OpenCV builds
 # are not supported, so this should always be defined.
@@ -142,6 +149,8 @@ SOURCES += \
     src/filter/filter.cpp \
     src/common/command_line/command_line.cpp \
     src/capture/capture.cpp \
+    src/capture/capture_event_flags.cpp \
+    src/capture/device_properties.cpp \
     src/display/qt/persistent_settings.cpp \
     src/common/disk/disk.cpp \
     src/common/disk/file_writers/file_writer_filter_graph_version_b.cpp \
@@ -151,7 +160,19 @@ SOURCES += \
     src/common/disk/file_writer.cpp \
     src/capture/video_presets.cpp \
     src/common/disk/file_readers/file_reader_video_presets_version_a.cpp \
-    src/common/timer/timer.cpp
+    src/common/timer/timer.cpp \
+    src/common/frame_queue/frame_queue.cpp \
+    src/common/frame_queue/frame_writer.cpp \
+    src/common/trace/trace.cpp \
+    src/common/latency_stamp/latency_stamp.cpp \
+    src/common/metrics/metrics.cpp \
+    src/benchmark/benchmark.cpp \
+    src/screenshot/screenshot.cpp \
+    src/record/record.cpp \
+    src/common/futex/futex.cpp \
+    src/common/pixel_conversion/pixel_conversion.cpp \
+    src/output_sink/output_sink.cpp \
+    src/capture/replay/replay_recorder.cpp
 
 HEADERS += \
     src/capture/alias.h \
@@ -241,6 +262,9 @@ HEADERS += \
     src/main.h \
     src/scaler/scaler.h \
     src/capture/capture.h \
+    src/capture/capture_event_flags.h \
+    src/capture/device_properties.h \
+    src/capture/v4l_timestamp.h \
     src/display/display.h \
     src/common/log/log.h \
     src/common/abstract_gui.h \
@@ -260,7 +284,20 @@ HEADERS += \
     src/common/disk/file_writers/file_writer_video_presets.h \
     src/common/disk/file_readers/file_reader_video_presets.h \
     src/common/vcs_event/vcs_event.h \
-    src/common/timer/timer.h
+    src/common/timer/timer.h \
+    src/common/frame_queue/frame_queue.h \
+    src/common/frame_queue/frame_writer.h \
+    src/common/trace/trace.h \
+    src/common/latency_stamp/latency_stamp.h \
+    src/common/metrics/metrics.h \
+    src/benchmark/benchmark.h \
+    src/screenshot/screenshot.h \
+    src/record/record.h \
+    src/common/futex/futex.h \
+    src/common/pixel_conversion/pixel_conversion.h \
+    src/output_sink/output_sink.h \
+    src/capture/replay/replay_recorder.h \
+    src/capture/replay/replay_file.h
 
 FORMS += \
     src/display/qt/widgets/ResolutionQuery.ui \
@@ -314,25 +351,25 @@ contains(DEFINES, VCS_USES_OPENCV) {
 
     LIBS += \
         -lopencv_imgproc \
+        -lopencv_imgcodecs \
+        -lopencv_videoio \
         -lopencv_highgui \
         -lopencv_core \
         -lopencv_photo \
-
-    contains(DEFINES, CAPTURE_BACKEND_GPHOTO2) {
-        LIBS += -lopencv_imgcodecs
-    }
-
-    contains(DEFINES, CAPTURE_BACKEND_VIRTUAL) {
-        LIBS += -lopencv_imgcodecs
-    }
-
-    contains(DEFINES, CAPTURE_BACKEND_GENERIC_V4L) {
-        LIBS += -lopencv_videoio
-    }
 }
 
+# For shm_open(), used by the output sink (and the MMAP capture backend).
+LIBS += -lrt
+
 contains(DEFINES, CAPTURE_BACKEND_GENERIC_V4L) {
-    SOURCES += src/capture/generic_v4l/capture_generic_v4l.cpp
+    SOURCES += \
+        src/capture/generic_v4l/capture_generic_v4l.cpp \
+        src/capture/generic_v4l/v4l2_stream.cpp \
+        src/capture/generic_v4l/mjpeg_decoder.cpp
+
+    HEADERS += \
+        src/capture/generic_v4l/v4l2_stream.h \
+        src/capture/generic_v4l/mjpeg_decoder.h
 }
 
 contains(DEFINES, CAPTURE_BACKEND_GPHOTO2) {
@@ -346,7 +383,10 @@ contains(DEFINES, CAPTURE_BACKEND_VIRTUAL) {
 
 contains(DEFINES, CAPTURE_BACKEND_MMAP) {
     SOURCES += src/capture/mmap/capture_mmap.cpp
-    LIBS += -lrt
+}
+
+contains(DEFINES, CAPTURE_BACKEND_REPLAY) {
+    SOURCES += src/capture/replay/capture_replay.cpp
 }
 
 contains(DEFINES, CAPTURE_BACKEND_VISION_V4L) {